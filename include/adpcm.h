@@ -0,0 +1,78 @@
+/**
+ * @file adpcm.h
+ * @brief Streaming IMA-ADPCM decoder for voice clips in flash
+ *
+ * Clips are 4-bit IMA-ADPCM in the same block layout as a WAV file
+ * (format 0x11): each block starts with a 4-byte header holding the
+ * first sample and the step index, followed by two samples per byte,
+ * low nibble first. Headers let a block be decoded without the ones
+ * before it, and stop any rounding drift from carrying across blocks.
+ *
+ * AdpcmDecoder keeps its place between calls, so it can fill a
+ * GeekWatchAudio buffer of any size straight from flash: it decodes
+ * into the DMA buffer in the I2S interrupt, a block at a time, and
+ * needs no PCM copy of the clip. Decoding is a table lookup and a
+ * handful of adds per sample.
+ *
+ * Clip tables are generated from WAV files by wav2adpcm.py.
+ */
+
+#ifndef ADPCM_H
+#define ADPCM_H
+
+#include <Arduino.h>
+
+#define ADPCM_HEADER_BYTES  4
+
+/**
+ * @brief A clip compiled into flash
+ */
+struct AdpcmClip {
+    const uint8_t *data;        // Blocks, back to back
+    uint32_t numSamples;        // Total, the last block may be short
+    uint16_t blockBytes;        // Including the header
+};
+
+/**
+ * @brief Samples in one full block
+ */
+inline uint16_t adpcmBlockSamples(uint16_t blockBytes) {
+    return (blockBytes - ADPCM_HEADER_BYTES) * 2 + 1;
+}
+
+class AdpcmDecoder {
+public:
+    AdpcmDecoder();
+
+    /**
+     * @brief Rewind to the start of a clip
+     */
+    void begin(const AdpcmClip *clip);
+
+    /**
+     * @brief Decode the next samples
+     * @param out Destination
+     * @param maxSamples Space in out
+     * @return Samples written, 0 once the clip has ended
+     */
+    size_t read(int16_t *out, size_t maxSamples);
+
+    bool done() const { return _left == 0; }
+
+    /**
+     * @brief AudioProducer that reads from the AdpcmDecoder in context
+     */
+    static size_t producer(int16_t *buffer, size_t numSamples, void *context);
+
+private:
+    const AdpcmClip *_clip;
+    const uint8_t *_next;       // Header of the next block
+    const uint8_t *_nibbles;    // Position in the current block
+    uint32_t _left;             // Samples left in the clip
+    uint16_t _blockLeft;        // Samples left in the current block
+    bool _highNibble;
+    int16_t _predictor;
+    uint8_t _stepIndex;
+};
+
+#endif // ADPCM_H
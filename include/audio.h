@@ -4,6 +4,27 @@
  * 
  * The MAX98357A is a simple I2S DAC/amplifier that doesn't require I2C configuration.
  * Just provide I2S data stream (BCLK, LRCLK, DIN) and it outputs amplified audio.
+ *
+ * Samples are streamed by the nRF52 I2S peripheral with EasyDMA from two
+ * ping-pong buffers. The TXPTRUPD event means the peripheral has latched
+ * the pointer it was given and is playing that buffer; the interrupt
+ * then refills the other buffer through a producer callback and hands it
+ * over as the next TXD.PTR. The CPU wakes once per buffer (32ms at
+ * 16kHz) and play() returns immediately unless asked to block.
+ *
+ * Clips, tones and streams go through the mixer (mixer.h) so they can
+ * overlap: starting one adds a voice and starts the stream if it was
+ * idle. A voice added while the stream winds down is picked up by the
+ * interrupt, so starting one never blocks. play() and start() still
+ * take the stream over exclusively.
+ *
+ * The amp (SD pin), the HFXO and the I2S clocks are only up around
+ * playback. A cold start requests the HFXO, raises SD and clocks out
+ * AUDIO_PREROLL_MS of silence while the amp settles; every stream ends
+ * with AUDIO_POSTROLL_MS of silence before I2S stops. The amp and HFXO
+ * then stay up for AUDIO_HOLDOFF_MS, so sounds close together start
+ * warm without another power cycle (and pop). The delay from a play
+ * call to its first real sample is measured on every start.
  */
 
 #ifndef AUDIO_H
@@ -11,11 +32,29 @@
 
 #include <Arduino.h>
 #include "config.h"
+#include "mixer.h"
 
 // Audio buffer configuration
 #define AUDIO_BUFFER_SIZE   512   // Samples per buffer
 #define NUM_AUDIO_BUFFERS   2     // Double buffering
 
+/**
+ * @brief Fills the next buffer, called from the I2S interrupt
+ * @param buffer Mono 16-bit samples to write
+ * @param numSamples Space in buffer
+ * @param context Pointer given to start()
+ * @return Samples written; the rest of the buffer is padded with silence.
+ *         0 ends the stream once what was already queued has played.
+ */
+typedef size_t (*AudioProducer)(int16_t *buffer, size_t numSamples, void *context);
+
+struct AudioPowerStats {
+    uint32_t coldStarts;    // Amp and HFXO were off
+    uint32_t warmStarts;    // Inside the hold-off, amp still up
+    uint32_t lastWakeUs;    // Play call to first real sample leaving I2S
+    uint32_t maxWakeUs;
+};
+
 class GeekWatchAudio {
 public:
     /**
@@ -23,8 +62,11 @@ public:
      * @param sck I2S bit clock pin (BCLK)
      * @param lrck I2S word select pin (LRCLK/WS)
      * @param din I2S data pin (DIN/SD)
+     * @param sd Amp shutdown pin, high = on
+     * @param gain Amp gain strap pin, driven as set by AUDIO_GAIN_DB
      */
-    GeekWatchAudio(uint8_t sck, uint8_t lrck, uint8_t din);
+    GeekWatchAudio(uint8_t sck, uint8_t lrck, uint8_t din,
+                   uint8_t sd = I2S_SD_PIN, uint8_t gain = I2S_GAIN_PIN);
 
     /**
      * @brief Initialize I2S audio subsystem
@@ -50,11 +92,47 @@ public:
     bool play(const int16_t *samples, size_t numSamples, bool blocking = false);
 
     /**
-     * @brief Play a tone
+     * @brief Mix in an IMA-ADPCM clip, decoded straight into the DMA buffers
+     * @param clip Clip table entry (see wav2adpcm.py)
+     * @param blocking If true, wait for playback to complete
+     * @return Voice handle, MIXER_NO_VOICE if the mixer refused it
+     */
+    VoiceHandle playClip(const AdpcmClip &clip, AudioPriority priority = AUDIO_PRIORITY_HIGH,
+                         bool blocking = false);
+
+    /**
+     * @brief Mix in a producer as a voice, until it returns 0
+     */
+    VoiceHandle playStream(AudioProducer producer, void *context,
+                           AudioPriority priority = AUDIO_PRIORITY_NORMAL);
+
+    /**
+     * @brief Hold a mixer voice with silence, e.g. a pause between prompts
+     */
+    VoiceHandle playSilence(uint32_t duration, AudioPriority priority = AUDIO_PRIORITY_NORMAL);
+
+    /**
+     * @brief Stream from a producer until it returns 0
+     * @param producer Refill callback (runs in interrupt context)
+     * @param context Passed through to the producer
+     * @return false if not initialized
+     * @note Stops anything already playing first, mixer voices included
+     */
+    bool start(AudioProducer producer, void *context);
+
+    /**
+     * @brief Sleep until the current playback has finished
+     */
+    void wait();
+
+    /**
+     * @brief Mix in a tone
      * @param frequency Frequency in Hz
      * @param duration Duration in milliseconds
+     * @return Voice handle, MIXER_NO_VOICE if the mixer refused it
      */
-    void playTone(uint16_t frequency, uint32_t duration);
+    VoiceHandle playTone(uint16_t frequency, uint32_t duration,
+                         AudioPriority priority = AUDIO_PRIORITY_NORMAL);
 
     /**
      * @brief Check if audio is currently playing
@@ -74,33 +152,113 @@ public:
      */
     void stop();
 
+    /**
+     * @brief Buffers handed to the I2S DMA since begin(), for diagnostics
+     */
+    uint32_t buffersQueued() const { return _buffersQueued; }
+
+    /**
+     * @brief Voice control and mix timings
+     */
+    AudioMixer &mixer() { return _mixer; }
+
+    /**
+     * @brief Amp power cycles and wake-to-sound latency
+     */
+    const AudioPowerStats &powerStats() const { return _powerStats; }
+
+    bool ampPowered() const { return _ampPowered; }
+
+    // Called from the hold-off timer
+    void onHoldoffExpired();
+
+    // Called from I2S_IRQHandler
+    void onInterrupt();
+
 private:
     uint8_t _sck, _lrck, _din;
+    uint8_t _sdPin, _gainPin;
     uint32_t _sampleRate;
     uint8_t _bitDepth;
     uint8_t _volume;
     bool _isInitialized;
-    bool _isPlaying;
+    volatile bool _isPlaying;
 
     // Audio buffers
     int16_t *_audioBuffer[NUM_AUDIO_BUFFERS];
-    volatile uint8_t _currentBuffer;
+    volatile uint8_t _currentBuffer;    // Last one written to TXD.PTR
+
+    // Stream state
+    AudioProducer _producer;
+    void *_producerContext;
+    volatile uint8_t _tailBuffers;      // Buffers left to play after the producer ended
+    uint8_t _postrollBuffers;           // Tail length that covers AUDIO_POSTROLL_MS
+    size_t _prerollLeft;                // Silent samples still to send before the producer
+    volatile uint32_t _buffersQueued;
+    SemaphoreHandle_t _done;
+
+    // Source for play()
+    const int16_t *_source;
+    size_t _sourceLeft;
+
+    AudioMixer _mixer;
+
+    // Power gating
+    bool _ampPowered;
+    TimerHandle_t _holdoff;
+    uint32_t _wakeStart;                // DWT cycle count at the play call
+    uint32_t _wakePreroll;              // Preroll of this start, in us
+    volatile bool _measureWake;         // First TXPTRUPD still to come
+    AudioPowerStats _powerStats;
+
+    static size_t sampleProducer(int16_t *buffer, size_t numSamples, void *context);
+    static size_t mixerProducer(int16_t *buffer, size_t numSamples, void *context);
 
     /**
-     * @brief Configure nRF52 I2S peripheral
+     * @brief Make sure the stream is running the mixer after adding a voice
      */
-    bool configureI2S();
+    bool runMixer(VoiceHandle voice);
 
     /**
-     * @brief Generate tone samples
-     * @param samples Output buffer
-     * @param numSamples Number of samples to generate
-     * @param frequency Frequency in Hz
+     * @brief Stop the stream, leaving mixer voices alone
+     */
+    void halt();
+
+    /**
+     * @brief Bring the amp and HFXO up (or keep them up), cancel the hold-off
+     * @return true if they were off, so the stream needs a pre-roll
+     */
+    bool powerUp();
+
+    /**
+     * @brief Shut the amp down and release the HFXO
+     */
+    void powerDown();
+
+    /**
+     * @brief Start streaming, the peripheral must be stopped
      */
-    void generateTone(int16_t *samples, size_t numSamples, uint16_t frequency);
+    bool startStream(AudioProducer producer, void *context);
+
+    /**
+     * @brief Fill the first buffer and start the peripheral (also from the ISR)
+     * @return false if the producer had nothing, the peripheral is left stopped
+     */
+    bool queueFirst();
+
+    /**
+     * @brief Fill a buffer from the producer and pad it with silence
+     * @return false once the producer has nothing more
+     */
+    bool fillBuffer(uint8_t index);
+
+    /**
+     * @brief Configure nRF52 I2S peripheral
+     */
+    bool configureI2S();
 
     /**
-     * @brief Apply volume scaling to samples
+     * @brief Apply volume scaling to samples, two at a time on the DSP unit
      * @param samples Sample buffer
      * @param numSamples Number of samples
      */
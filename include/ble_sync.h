@@ -0,0 +1,174 @@
+/**
+ * @file ble_sync.h
+ * @brief BLE GATT service that streams the event log to a companion app
+ *
+ * One custom service with three characteristics:
+ * - control (write / write without response): START, ACK and STOP
+ * - data (notify): DATA and END packets, one per notification
+ * - live (read / notify): the stopwatch state, see live_state.h
+ * The packet format, windowing and resume cursor are SyncSession's, see
+ * sync_protocol.h; this file only moves its bytes over Bluefruit.
+ *
+ * The watch advertises when the reset dialog's "SUBMIT DATA" calls
+ * advertise(), and otherwise only to let a live state client back in:
+ * every 2s for LIVE_READVERTISE_S after such a client loses its link
+ * without hanging up (out of range, the phone's radio off), and for
+ * SYNC_ADVERTISE_S after boot, since a reset drops that link too. The
+ * radio is off the rest of the time. LIVE_READVERTISE_S 0 advertises
+ * until the client is back, which for a phone left behind costs more
+ * per hour than the live link did, see tools/live_model.cpp.
+ *
+ * On connect the watch asks for a 247-byte MTU, data length extension
+ * and the 2M PHY, and a 7.5ms interval with long connection events.
+ * Together that carries up to SYNC_HVN_QUEUE full notifications per
+ * event instead of one 20-byte one. A link that has gone quiet for
+ * SYNC_IDLE_MS is dropped, so the radio is only on while data actually
+ * moves.
+ *
+ * A client subscribed to the live state keeps the link instead. The
+ * state is notified only when it changes, and the link is switched
+ * between three speeds as the work at hand changes:
+ * - sync: 7.5ms while a log sync is sending
+ * - interactive: 30ms for LIVE_FAST_HOLD_MS after a button press, so
+ *   further changes and app requests go through at once
+ * - idle: 200ms with slave latency 7 otherwise, the watch only answers
+ *   every 1.6s unless it has a notification to send
+ * tools/live_model.cpp estimates the radio events per hour this costs.
+ *
+ * Bluefruit runs its callbacks in the BLE task. They only push into a
+ * ring and call notify; service(), from the main loop, does the rest.
+ */
+
+#ifndef BLE_SYNC_H
+#define BLE_SYNC_H
+
+#include <Arduino.h>
+#include <bluefruit.h>
+#include "config.h"
+#include "event_log.h"
+#include "event_queue.h"
+#include "sync_protocol.h"
+#include "live_state.h"
+
+#define SYNC_CONN_INTERVAL      6       // 7.5ms, in 1.25ms units
+#define SYNC_EVENT_LENGTH       6       // Radio time per connection event, same units
+#define SYNC_HVN_QUEUE          8       // Notifications queued per connection event
+#define SYNC_LINK_QUEUE         8       // BLE task -> loop (power of 2)
+#define SYNC_POLL_MS            8       // Top up the queue about once per event
+
+// Advertising intervals, in 0.625ms units
+#define SYNC_ADV_FAST_INTERVAL  32      // 20ms for the first SYNC_ADV_FAST_S...
+#define SYNC_ADV_SLOW_INTERVAL  244     // ...then 152.5ms
+#define SYNC_ADV_FAST_S         10
+#define LIVE_ADV_SLOW_INTERVAL  3200    // 2s while waiting for a live client to return
+
+// Connection parameters, intervals in 1.25ms units
+#define LIVE_FAST_INTERVAL      24      // 30ms after user interaction
+#define LIVE_IDLE_INTERVAL      160     // 200ms...
+#define LIVE_IDLE_LATENCY       7       // ...answering every 8th event when quiet
+#define LIVE_SUPERVISION_10MS   600     // 6s, over 3x the longest quiet stretch
+#define LIVE_FAST_HOLD_MS       3000
+
+typedef void (*SyncNotify)(void);
+
+// Serves SyncSession from the flash log
+class LogSyncSource : public SyncSource {
+public:
+    explicit LogSyncSource(EventLog& log) : _log(log) {}
+
+    void seek(uint32_t seq) override { _cursor = _log.seek(seq); }
+    bool next(LogRecord& record) override { return _log.read(_cursor, record); }
+
+private:
+    EventLog& _log;
+    LogCursor _cursor;
+};
+
+class BleSync {
+public:
+    explicit BleSync(EventLog& log);
+
+    /**
+     * @brief Start the SoftDevice and register the service
+     * @param notify Called (in the BLE task) whenever service() is due
+     */
+    bool begin(SyncNotify notify);
+
+    /**
+     * @brief Advertise for a while; the radio stays off otherwise
+     */
+    void advertise(uint16_t seconds);
+
+    /**
+     * @brief Handle link changes and commands, queue notifications
+     * @return Milliseconds until it wants to run again, 0 if only on notify
+     */
+    uint32_t service(uint32_t nowMs);
+
+    /**
+     * @brief Store the live state and notify a subscribed client
+     * @note Call on transitions only; the client extrapolates in between
+     */
+    void publish(const LiveState& state);
+
+    /**
+     * @brief The user did something: keep the link fast for a while
+     */
+    void interaction(uint32_t nowMs);
+
+    bool connected() const { return _conn != BLE_CONN_HANDLE_INVALID; }
+    const SyncSession& session() const { return _session; }
+
+private:
+    enum LinkEvent : uint8_t {
+        LINK_UP,
+        LINK_DOWN,
+        LINK_COMMAND,
+        LINK_LIVE,          // Live state notifications turned on or off
+    };
+
+    enum LinkSpeed : uint8_t {
+        SPEED_NONE,         // Nothing asked for yet on this link
+        SPEED_SYNC,
+        SPEED_FAST,
+        SPEED_IDLE,
+    };
+
+    struct LinkMessage {
+        LinkEvent event;
+        uint8_t length;
+        uint16_t conn;
+        uint8_t data[SYNC_COMMAND_MAX];
+    };
+
+    BLEService _service;
+    BLECharacteristic _control;
+    BLECharacteristic _data;
+    BLECharacteristic _live;
+    LogSyncSource _source;
+    SyncSession _session;
+    SyncNotify _notify;
+
+    EventRing<LinkMessage, SYNC_LINK_QUEUE, false> _link;
+    uint16_t _conn;
+    uint32_t _lastActivity;     // millis() of the last command or packet
+    uint32_t _fastUntil;        // millis() the interactive speed is held to
+    LinkSpeed _speed;
+    bool _liveClient;           // The connected client has the live state on
+    bool _started;
+    uint8_t _packet[SYNC_PAYLOAD_MAX];
+
+    void linkUp(uint16_t conn, uint32_t nowMs);
+    void linkDown(uint8_t reason);
+    void startAdvertising(uint16_t slowInterval, uint16_t seconds);
+    void setSpeed(BLEConnection* link, uint32_t nowMs);
+    void post(const LinkMessage& msg);
+
+    // Bluefruit callbacks, BLE task
+    static void onConnect(uint16_t conn);
+    static void onDisconnect(uint16_t conn, uint8_t reason);
+    static void onControl(uint16_t conn, BLECharacteristic* chr, uint8_t* data, uint16_t len);
+    static void onLiveCccd(uint16_t conn, BLECharacteristic* chr, uint16_t value);
+};
+
+#endif // BLE_SYNC_H
@@ -0,0 +1,123 @@
+/**
+ * @file button.h
+ * @brief Interrupt-driven button debouncing and gesture decoding
+ *
+ * The pin interrupt only timestamps the edge with the RTC tick count and
+ * wakes the main loop; nothing reads the pin until the contact has been
+ * quiet for BUTTON_DEBOUNCE_MS. That settle time, and the long-press,
+ * double-click and repeat timeouts, run on a one-shot RTC2 compare
+ * (channel 2), so a held button costs no wake-ups beyond the gestures it
+ * produces.
+ *
+ * Gestures are timed from the first edge of each bounce burst, not from
+ * when the loop got round to looking:
+ * - BUTTON_SHORT: released before the long press, no second click followed
+ * - BUTTON_DOUBLE: pressed again within BUTTON_DOUBLE_CLICK_MS of a short release
+ * - BUTTON_LONG: held for BUTTON_LONG_PRESS_MS
+ * - BUTTON_REPEAT: still held, every BUTTON_REPEAT_MS after the long press
+ */
+
+#ifndef BUTTON_H
+#define BUTTON_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "scheduler.h"
+
+// RTC2 compare channel for the one-shot gesture timer
+#define BUTTON_RTC_CHANNEL      2
+// Raw edges buffered between ISR and decoder (power of 2)
+#define BUTTON_EDGE_QUEUE       8
+#define BUTTON_EVENT_QUEUE      4
+
+enum ButtonGesture : uint8_t {
+    BUTTON_SHORT,
+    BUTTON_DOUBLE,
+    BUTTON_LONG,
+    BUTTON_REPEAT,
+};
+
+typedef void (*ButtonNotify)(void);
+
+struct ButtonEvent {
+    ButtonGesture gesture;
+    uint64_t at;            // Tick of the edge or timeout that produced it
+};
+
+class ButtonInput {
+public:
+    ButtonInput();
+
+    /**
+     * @brief Configure an active-low button with pull-up and edge interrupt
+     * @param rtc Running scheduler, woken by edges and the gesture timer
+     * @param notify Called (in ISR context) instead of waking rtc directly,
+     *               e.g. to post an event; poll() is due after each call
+     */
+    void begin(uint8_t pin, TicklessScheduler& rtc, ButtonNotify notify = nullptr);
+
+    /**
+     * @brief Decode pending edges and timeouts, then pop one gesture
+     * @param now Current tick (TicklessScheduler::now())
+     * @return true if ev was filled in
+     * @note Call until it returns false; re-arms the gesture timer
+     */
+    bool poll(uint64_t now, ButtonEvent& ev);
+
+    bool pressed() const { return _pressed; }
+
+    /**
+     * @brief Tick the decoder next needs to run at, UINT64_MAX if idle
+     * @note Valid once poll() has returned false
+     */
+    uint64_t nextDeadline() const;
+
+    // Called from the pin interrupt / RTC2_IRQHandler
+    void onEdge();
+    void onTimer();
+
+private:
+    enum State : uint8_t {
+        IDLE,
+        DOWN,               // Pressed, long press not reached yet
+        HELD,               // Long press fired, repeating
+        CLICKED,            // Short release, waiting for a second click
+        SWALLOW,            // Double click fired, ignore until released
+    };
+
+    uint8_t _pin;
+    TicklessScheduler* _rtc;
+    ButtonNotify _notify;
+
+    // ISR -> decoder, low 32 bits of the edge tick
+    volatile uint32_t _edges[BUTTON_EDGE_QUEUE];
+    volatile uint8_t _edgeHead;
+    uint8_t _edgeTail;
+
+    // Debounce
+    bool _settling;
+    bool _pressed;          // Debounced level
+    uint64_t _burstStart;   // First edge of the current bounce burst
+    uint64_t _lastEdge;
+
+    // Gestures
+    State _state;
+    uint64_t _timer;        // Deadline for the current state
+    uint64_t _downAt;       // Press that started the gesture
+    ButtonEvent _events[BUTTON_EVENT_QUEUE];
+    uint8_t _eventHead;
+    uint8_t _eventTail;
+
+    uint32_t _debounceTicks;
+    uint32_t _longTicks;
+    uint32_t _doubleTicks;
+    uint32_t _repeatTicks;
+
+    void timeouts(uint64_t until);
+    void transition(bool down, uint64_t at);
+    void emit(ButtonGesture gesture, uint64_t at);
+    void armTimer(uint64_t now);
+    void wake();
+};
+
+#endif // BUTTON_H
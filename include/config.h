@@ -30,6 +30,10 @@
 // Display refresh rate (Hz) - Sharp displays need periodic VCOM toggle
 #define DISPLAY_REFRESH_RATE 1
 
+// Panels with EXTMODE tied HIGH take VCOM from the EXTCOMIN pin instead of
+// the serial VCOM bit. Define its GPIO to have PPI drive it
+// #define DISPLAY_EXTCOMIN_PIN 10  // Example: P0.10 - EXTCOMIN
+
 // ========== Audio Configuration (I2S) ==========
 // MAX98357A I2S Audio Amplifier
 // Silkscreen: LRC=P0.11, BCLK=P1.00, DIN=P0.24, GAIN=P0.22, SD=P0.20
@@ -43,6 +47,51 @@
 #define AUDIO_SAMPLE_RATE   16000  // 16kHz for speech
 #define AUDIO_BIT_DEPTH     16     // 16-bit samples
 
+// Amp power gating: SD is driven high only around playback
+#define AUDIO_GAIN_DB       9      // 6 = GAIN high, 9 = GAIN floating, 12 = GAIN low
+#define AUDIO_PREROLL_MS    5      // Silence after the amp wakes, covers its turn-on
+#define AUDIO_POSTROLL_MS   10     // Silence clocked out before I2S stops
+#define AUDIO_HOLDOFF_MS    2000   // Amp and HFXO stay up this long for the next sound
+
+// Speak the elapsed time when a stopwatch is paused. Needs voice_clips.h/.cpp,
+// generated from one recording per word with: wav2adpcm.py --speech
+#define VOICE_PROMPTS       false
+
+// ========== Button Configuration ==========
+#define BUTTON_DEBOUNCE_MS      50    // Contact must be quiet this long
+#define BUTTON_LONG_PRESS_MS    1000
+#define BUTTON_DOUBLE_CLICK_MS  250   // 0 = no double click, short press fires on release
+#define BUTTON_REPEAT_MS        250   // Hold-repeat after a long press, 0 = off
+
+// ========== Reminder Configuration ==========
+#define NAG_AFTER_MIN       90    // Geek stopwatch running this long gets a reminder
+#define NAG_REPEAT_MIN      15    // Then again this often until it stops
+#define QUIET_START_HOUR    22    // No reminders from 22:00...
+#define QUIET_END_HOUR      7     // ...until 07:00 (equal = never quiet)
+#define NAG_TONE_HZ         880   // Beep, or the elapsed time with VOICE_PROMPTS
+#define NAG_TONE_MS         150
+
+// ========== Event Log (internal flash) ==========
+// A ring of 4kB pages ending where the bootloader's InternalFS starts; the
+// firmware image must stay below EVENTLOG_FLASH_END - EVENTLOG_PAGES * 4kB
+#define EVENTLOG_FLASH_END      0xED000
+#define EVENTLOG_PAGES          8       // 32kB, one of them always kept erased
+#define EVENTLOG_FLUSH_MS       10000   // Staged records reach flash within this
+#define EVENTLOG_FLUSH_RECORDS  8       // ...or as soon as this many are waiting
+
+// ========== BLE Sync ==========
+// Session log sync to the companion app; radio is off unless syncing
+#define BLE_SYNC            true
+#define SYNC_ADVERTISE_S    60      // Advertising after "SUBMIT DATA", and after boot
+#define SYNC_IDLE_MS        2000    // A link this quiet is dropped
+#define LIVE_READVERTISE_S  300     // Advertising after a live client's link drops; 0 = until it's back
+
+// ========== Display Mirror ==========
+// Streams the screen over USB CDC for tools/mirror_decode.cpp while a
+// host has the port open; shares the port with DEBUG_SERIAL output
+#define DISPLAY_MIRROR      false
+#define MIRROR_KEY_FRAMES   60      // Packets between keyframes
+
 // ========== Power Management ==========
 #define ENABLE_LOW_POWER_MODE  true
 #define SLEEP_TIMEOUT_MS       30000  // 30 seconds
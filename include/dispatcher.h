@@ -0,0 +1,112 @@
+/**
+ * @file dispatcher.h
+ * @brief Priority run-to-completion event dispatcher
+ *
+ * ISRs and application code post small events; the main loop calls
+ * dispatch(), which runs the subscribed handler for each one until every
+ * queue is empty, then goes back to sleep. There is one lock-free ring
+ * per priority (event_queue.h) and the highest non-empty ring is always
+ * served first, re-checked after every handler, so a button event posted
+ * while a redraw is queued runs before it. Handlers run to completion and
+ * are never preempted by other handlers.
+ *
+ * Types subscribed as coalescing are queued at most once at a time:
+ * posting one that is already waiting is a no-op. That suits "something
+ * changed, go look" events such as redraw requests or bouncing edges.
+ *
+ * For every type the dispatcher records how often it ran, the worst and
+ * total latency from post() to the handler starting, and the longest
+ * handler run, in RTC ticks. Each ring tracks its high-water mark and the
+ * events it had to drop.
+ */
+
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+
+#include <Arduino.h>
+#include "scheduler.h"
+#include "event_queue.h"
+
+#define DISPATCH_MAX_TYPES      32      // One pending bit each
+#define DISPATCH_QUEUE_DEPTH    16
+
+enum DispatchPriority : uint8_t {
+    PRIORITY_HIGH,
+    PRIORITY_NORMAL,
+    PRIORITY_LOW,
+    DISPATCH_PRIORITIES
+};
+
+struct Event {
+    uint8_t type;
+    uint32_t data;          // Handler-defined payload
+    uint32_t postedAt;      // Low 32 bits of the RTC tick at post()
+};
+
+typedef void (*EventHandler)(const Event& ev);
+
+struct HandlerStats {
+    uint32_t count;
+    uint32_t maxLatency;    // Ticks from post() to handler start
+    uint32_t totalLatency;
+    uint32_t maxRun;        // Ticks spent in the handler
+};
+
+class Dispatcher {
+public:
+    Dispatcher();
+
+    /**
+     * @param rtc Time source for the latency stats and wake-ups
+     */
+    void begin(TicklessScheduler& rtc);
+
+    /**
+     * @brief Route an event type to a handler
+     * @param coalesce Keep at most one of these queued
+     * @return false if type is out of range
+     */
+    bool subscribe(uint8_t type, DispatchPriority priority, EventHandler handler,
+                   bool coalesce = false);
+
+    /**
+     * @brief Queue an event from the task or an ISR, without waking anyone
+     * @return false if nobody subscribed or its queue was full
+     */
+    bool post(uint8_t type, uint32_t data = 0);
+
+    /**
+     * @brief post() and cut the main loop's sleep short
+     */
+    bool postFromISR(uint8_t type, uint32_t data = 0);
+
+    /**
+     * @brief Run handlers, highest priority first, until all queues are empty
+     * @return Number of handlers run
+     */
+    uint16_t dispatch();
+
+    bool pending() const;
+
+    const HandlerStats& stats(uint8_t type) const { return _stats[type % DISPATCH_MAX_TYPES]; }
+    uint16_t highWater(DispatchPriority priority) const { return _queues[priority].highWater(); }
+    uint32_t dropped(DispatchPriority priority) const { return _queues[priority].dropped(); }
+    void resetStats();
+
+private:
+    struct Route {
+        EventHandler handler;
+        DispatchPriority priority;
+        bool coalesce;
+    };
+
+    TicklessScheduler* _rtc;
+    Route _routes[DISPATCH_MAX_TYPES];
+    HandlerStats _stats[DISPATCH_MAX_TYPES];
+    EventRing<Event, DISPATCH_QUEUE_DEPTH> _queues[DISPATCH_PRIORITIES];
+    std::atomic<uint32_t> _queued;  // Coalescing types currently in a queue
+
+    void run(const Event& ev);
+};
+
+#endif // DISPATCHER_H
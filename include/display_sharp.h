@@ -2,19 +2,51 @@
  * @file display_sharp.h
  * @brief Simple driver for Sharp Memory Display LS011B7DH03
  * 
- * Protocol: SPI Mode 0, MSB first, up to 2MHz
+ * Protocol: SPI Mode 0, LSB first, up to 2MHz
  * Commands:
  * - 0x80: Write line(s)
  * - 0x20: VCOM toggle (must be done at least once per second)
  * - 0x04: Clear display
+ *
+ * refresh() only sends the lines that changed since the last push. A shadow
+ * copy of what the panel currently shows is compared row by row against the
+ * framebuffer, and the dirty rows go out in a single multi-line write.
+ * Drawing primitives mark the rows they touch, so only those rows are
+ * compared. Code that writes framebuffer[] directly must call markRows()
+ * (or invalidate()) afterwards. lastRows() hands the rows that changed on
+ * the panel to anything else that follows the screen, such as the mirror
+ * stream (mirror_codec.h): the rows the last frame sent, plus any that
+ * clearDisplay(), fillScreen() or drawLine() wrote before it.
+ * Frames are sent by SPIM3 EasyDMA with hardware chip select (sharp_spim.h).
+ *
+ * The wire frames are double buffered: swapBuffers() packs the dirty rows
+ * into the back frame, starts clocking it out and returns immediately, so
+ * the next frame can be drawn into the framebuffer while the previous one
+ * is still on the wire. refresh() is the blocking version.
+ *
+ * beginAutoVCOM() hands VCOM inversion to the RTC and PPI (sharp_vcom.h),
+ * after which toggleVCOM() is a no-op and frames carry whatever polarity
+ * the panel currently has.
  */
 
 #ifndef DISPLAY_SHARP_H
 #define DISPLAY_SHARP_H
 
 #include <Arduino.h>
-#include <SPI.h>
 #include "config.h"
+#include "sharp_spim.h"
+#include "sharp_vcom.h"
+
+// Sharp command bits (LSB-first wire format)
+#define SHARP_CMD_WRITE     0x01  // M0: write line(s)
+#define SHARP_CMD_VCOM      0x02  // M1: VCOM polarity
+#define SHARP_CMD_CLEAR     0x04  // M2: clear all
+
+// One line on the wire: address + pixel data + dummy byte
+#define SHARP_LINE_BYTES    (DISPLAY_WIDTH / 8)
+#define SHARP_LINE_FRAME    (1 + SHARP_LINE_BYTES + 1)
+// Largest write frame: command + every line + trailer
+#define SHARP_FRAME_MAX     (1 + DISPLAY_HEIGHT * SHARP_LINE_FRAME + 1)
 
 class SharpDisplay {
 public:
@@ -23,10 +55,52 @@ public:
     bool begin();
     void clearDisplay();
     void setPixel(uint8_t x, uint8_t y, bool white);
+    
+    // Framebuffer primitives - clipped, whole bytes with edge masks
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, bool white);
+    void drawHLine(int16_t x, int16_t y, int16_t w, bool white);
+    void drawVLine(int16_t x, int16_t y, int16_t h, bool white);
+    void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, bool white);
+    
+    /**
+     * @brief Draw a 1-bpp bitmap, set bits in the given color, others untouched
+     * @param bitmap Rows of ceil(w/8) bytes, LSB = leftmost pixel (framebuffer order)
+     */
+    void blit(int16_t x, int16_t y, const uint8_t* bitmap, uint8_t w, uint8_t h, bool white);
+    
+    // Text from the 5x7 font atlas, 6 pixel advance per scale step
+    void drawChar(int16_t x, int16_t y, char c, uint8_t scale = 1, bool white = false);
+    void drawText(int16_t x, int16_t y, const char* text, uint8_t scale = 1, bool white = false);
     void drawLine(uint8_t y, const uint8_t* lineData);
-    void refresh();
+    void refresh();                     // Send changed lines and wait
+    void swapBuffers();                 // Send changed lines, don't wait
+    bool transferBusy() const;
+    void waitTransfer();
     void toggleVCOM();
-    void clearFramebuffer();
+    
+    /**
+     * @brief Invert VCOM in the background at DISPLAY_REFRESH_RATE
+     * @param rtc Scheduler that owns RTC2, already started
+     */
+    void beginAutoVCOM(TicklessScheduler& rtc);
+    void endAutoVCOM();
+    bool autoVCOM() const { return vcom.running(); }
+    void clearFramebuffer(bool white = false);
+    
+    // Dirty-row tracking
+    void invalidate();                  // Force next refresh() to send every line
+    void markRows(int16_t y, int16_t h);  // Rows written outside the primitives
+    uint8_t lastRefreshLines() const { return lastLines; }
+    const uint32_t* lastRows() const { return sentRows; }  // Bit y = row y changed
+    
+    /**
+     * @brief Build the write frame for all rows that differ from the shadow
+     * @param out Buffer of at least SHARP_FRAME_MAX bytes
+     * @param vcom VCOM bit to encode in the command byte
+     * @return Frame length in bytes, 0 if no row changed
+     * @note Updates the shadow buffer for every row it emits
+     */
+    size_t buildFrame(uint8_t* out, bool vcom);
     
     // Test patterns
     void fillScreen(bool white);
@@ -37,9 +111,25 @@ public:
     
 private:
     bool vcomState;
+    bool fullRefresh;       // Shadow is not trusted, send every line
+    uint8_t lastLines;      // Lines sent by the last refresh()
+    uint32_t touchedRows[(DISPLAY_HEIGHT + 31) / 32];  // Drawn into since last frame
+    uint32_t sentRows[(DISPLAY_HEIGHT + 31) / 32];     // Changed up to the last buildFrame()
+    uint32_t panelRows[(DISPLAY_HEIGHT + 31) / 32];    // Written directly since then
+    
+    // What the panel currently shows
+    uint8_t shadow[DISPLAY_HEIGHT][SHARP_LINE_BYTES];
+    uint8_t txFrame[2][SHARP_FRAME_MAX];  // Front (on the wire) / back
+    uint8_t txBack;         // Index of the frame that is free to build into
+    uint8_t cmdFrame[2];    // VCOM / clear frames
+    SharpSpim spim;
+    SharpVcom vcom;
     
+    uint8_t vcomBit() const;  // M1 bit for the next frame
+    void startFrame(const uint8_t* frame, size_t len);
+    void sendFrame(const uint8_t* frame, size_t len);
+    static void setRows(uint32_t* rows, int16_t y, int16_t h);
     void sendCommand(uint8_t cmd);
-    uint8_t reverseByte(uint8_t b);
 };
 
 #endif // DISPLAY_SHARP_H
@@ -0,0 +1,149 @@
+/**
+ * @file dsp.h
+ * @brief Q15 sample kernels on the Cortex-M4 DSP instructions
+ *
+ * Two 16-bit samples share a 32-bit word, and the M4 SIMD instructions
+ * work on both halves at once: __SMULBB/__SMULTB multiply the bottom or
+ * top half by a Q15 gain, __SSAT clamps the result back to 16 bits and
+ * __QADD16 adds two pairs of samples with saturation. The kernels below
+ * process a word per iteration, with one scalar step for an odd tail.
+ *
+ * Without __ARM_FEATURE_DSP (a host build), or with DSP_REFERENCE
+ * defined, the same kernels run on plain C versions of those
+ * instructions. Both paths compute exactly the same results, so host
+ * output can be compared bit for bit with the firmware.
+ *
+ * DSP_HOST_SIMD selects the SIMD path without the hardware, for a host
+ * test that supplies bit-exact models of the intrinsics and checks the
+ * two paths against each other (tools/dsp_test.cpp).
+ */
+
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if (defined(__ARM_FEATURE_DSP) || defined(DSP_HOST_SIMD)) && !defined(DSP_REFERENCE)
+#define DSP_USE_SIMD        1
+#else
+#define DSP_USE_SIMD        0
+#endif
+
+#define Q15_ONE             32767
+
+// Bottom half of a times bottom half of b
+static inline int32_t dspSmulbb(uint32_t a, uint32_t b) {
+#if DSP_USE_SIMD
+    return __SMULBB(a, b);
+#else
+    return (int32_t)(int16_t)a * (int16_t)b;
+#endif
+}
+
+// Top half of a times bottom half of b
+static inline int32_t dspSmultb(uint32_t a, uint32_t b) {
+#if DSP_USE_SIMD
+    return __SMULTB(a, b);
+#else
+    return (int32_t)(int16_t)(a >> 16) * (int16_t)b;
+#endif
+}
+
+static inline int32_t dspSsat16(int32_t x) {
+#if DSP_USE_SIMD
+    return __SSAT(x, 16);
+#else
+    return x > 32767 ? 32767 : (x < -32768 ? -32768 : x);
+#endif
+}
+
+// Saturating add of both halves
+static inline uint32_t dspQadd16(uint32_t a, uint32_t b) {
+#if DSP_USE_SIMD
+    return __QADD16(a, b);
+#else
+    int32_t lo = dspSsat16((int16_t)a + (int16_t)b);
+    int32_t hi = dspSsat16((int16_t)(a >> 16) + (int16_t)(b >> 16));
+    return ((uint32_t)lo & 0xFFFF) | ((uint32_t)hi << 16);
+#endif
+}
+
+// Bottom half from lo, top half from hi
+static inline uint32_t dspPack(int32_t lo, int32_t hi) {
+#if DSP_USE_SIMD
+    return __PKHBT(lo, hi, 16);
+#else
+    return ((uint32_t)lo & 0xFFFF) | ((uint32_t)hi << 16);
+#endif
+}
+
+// Unaligned-safe word access; compiles to a single LDR/STR on the M4
+static inline uint32_t dspLoad2(const int16_t *p) {
+    uint32_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+static inline void dspStore2(int16_t *p, uint32_t w) {
+    memcpy(p, &w, sizeof(w));
+}
+
+/**
+ * @brief samples *= gain, saturating
+ * @param gain Q15, 0..Q15_ONE for attenuation
+ */
+static inline void q15Scale(int16_t *samples, size_t numSamples, int16_t gain) {
+    uint32_t g = (uint16_t)gain;
+    size_t pairs = numSamples >> 1;
+    while (pairs--) {
+        uint32_t w = dspLoad2(samples);
+        int32_t lo = dspSsat16(dspSmulbb(w, g) >> 15);
+        int32_t hi = dspSsat16(dspSmultb(w, g) >> 15);
+        dspStore2(samples, dspPack(lo, hi));
+        samples += 2;
+    }
+    if (numSamples & 1) {
+        *samples = (int16_t)dspSsat16(dspSmulbb((uint16_t)*samples, g) >> 15);
+    }
+}
+
+/**
+ * @brief dst += src, saturating
+ */
+static inline void q15Mix(int16_t *dst, const int16_t *src, size_t numSamples) {
+    size_t pairs = numSamples >> 1;
+    while (pairs--) {
+        dspStore2(dst, dspQadd16(dspLoad2(dst), dspLoad2(src)));
+        dst += 2;
+        src += 2;
+    }
+    if (numSamples & 1) {
+        *dst = (int16_t)dspSsat16(*dst + *src);
+    }
+}
+
+/**
+ * @brief dst += src * gain, saturating
+ * @param gain Q15
+ */
+static inline void q15MixScaled(int16_t *dst, const int16_t *src, size_t numSamples,
+                                int16_t gain) {
+    uint32_t g = (uint16_t)gain;
+    size_t pairs = numSamples >> 1;
+    while (pairs--) {
+        uint32_t w = dspLoad2(src);
+        int32_t lo = dspSsat16(dspSmulbb(w, g) >> 15);
+        int32_t hi = dspSsat16(dspSmultb(w, g) >> 15);
+        dspStore2(dst, dspQadd16(dspLoad2(dst), dspPack(lo, hi)));
+        dst += 2;
+        src += 2;
+    }
+    if (numSamples & 1) {
+        int32_t s = dspSsat16(dspSmulbb((uint16_t)*src, g) >> 15);
+        *dst = (int16_t)dspSsat16(*dst + s);
+    }
+}
+
+#endif // DSP_H
@@ -0,0 +1,172 @@
+/**
+ * @file event_log.h
+ * @brief Append-only session event log in internal flash
+ *
+ * Stopwatch starts, switches, pauses and resets are appended as small
+ * records to a ring of EVENTLOG_PAGES flash pages, so they survive power
+ * loss and can be synced later. append() only copies the record into a
+ * RAM staging ring; flash is touched from service(), which does at most
+ * one bounded step per call (a frame of records, a page header or one
+ * slice of an erase), so the caller can interleave it with UI work.
+ * Records are delta/varint coded as described in log_codec.h.
+ *
+ * Pages are written in rotation, which spreads wear evenly over the
+ * region. The page after the one being filled is always erased ahead of
+ * time, so moving on to it never waits for an 85ms page erase; it costs
+ * one page of retention. Each page starts with a header carrying a
+ * sequence number, and each frame has its own CRC. After a reset the
+ * newest page is found from the headers alone and only that page is
+ * scanned: frames end at the first blank slot, and a frame torn by
+ * power loss fails its CRC and is skipped.
+ *
+ * Without the SoftDevice the NVMC is driven directly and erases run as
+ * EVENTLOG_ERASE_STEP_MS partial erases. With it, writes and erases go
+ * through sd_flash_*, which complete asynchronously between radio
+ * events; service() polls for completion by reading the flash back.
+ */
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "log_codec.h"
+
+#define EVENTLOG_PAGE_SIZE      LOG_PAGE_SIZE
+#define EVENTLOG_FLASH_START    (EVENTLOG_FLASH_END - EVENTLOG_PAGES * EVENTLOG_PAGE_SIZE)
+#define EVENTLOG_STAGING        32      // Records held in RAM (power of 2)
+#define EVENTLOG_ERASE_STEP_MS  10      // Partial erase slice (NVMC only)
+#define EVENTLOG_SD_TIMEOUT_MS  500     // Reissue a SoftDevice operation after this
+#define EVENTLOG_POLL_MS        20      // Come back this often while one is in flight
+
+// Position of a reader in the log
+struct LogCursor {
+    uint8_t page;
+    LogPageReader reader;
+};
+
+struct EventLogStats {
+    uint32_t written;       // Records committed to flash since begin()
+    uint32_t dropped;       // Records refused because staging was full
+    uint32_t torn;          // Bad frames found by begin() in the last page
+    uint32_t pagesErased;
+    uint32_t maxStepUs;     // Longest service() step
+};
+
+class EventLog {
+public:
+    EventLog();
+
+    /**
+     * @brief Find the newest page and the end of its records
+     * @note Formats the region if no page has a valid header; that first
+     *       erase blocks for a page erase
+     */
+    bool begin();
+
+    /**
+     * @brief Stage a record, never touches flash
+     * @return false if staging is full and the record was dropped
+     */
+    bool append(LogEventType type, uint8_t category, uint32_t time);
+
+    /**
+     * @brief Do one bounded step of flash work
+     * @return true if more work is left; see waiting() for when to come back
+     */
+    bool service();
+
+    /**
+     * @brief A SoftDevice flash operation is in flight; poll again later
+     */
+    bool waiting() const { return _op != OP_NONE; }
+
+    /**
+     * @brief Run service() until everything staged is in flash
+     */
+    void flush();
+
+    uint8_t staged() const { return _count; }
+    uint32_t nextSeq() const { return _seq; }
+
+    /**
+     * @brief Cursor at the oldest record still in flash
+     */
+    LogCursor oldest() const;
+
+    /**
+     * @brief Cursor at the record numbered seq, or the first one after it
+     * @note Picks the page from the page headers, then decodes within it
+     */
+    LogCursor seek(uint32_t seq) const;
+
+    /**
+     * @brief Read the record at cursor and move past it
+     * @return false at the end of the flashed records; staged ones are not seen
+     */
+    bool read(LogCursor &cursor, LogRecord &record) const;
+
+    const EventLogStats &stats() const { return _stats; }
+
+private:
+    enum FlashOp : uint8_t {
+        OP_NONE,
+        OP_WRITE,
+        OP_ERASE,
+    };
+
+    uint8_t _tail;          // Page being appended to
+    uint16_t _offset;       // Next free byte in it
+    uint32_t _pageSeq;
+    uint32_t _seq;          // Given to the next record appended
+    uint32_t _lastTime;     // Of the last record in the tail page, deltas start here
+
+    LogRecord _staging[EVENTLOG_STAGING];
+    uint8_t _first;         // Oldest staged record
+    uint8_t _count;
+
+    bool _eraseNext;        // Page after the tail still needs erasing
+    uint8_t _eraseSlices;   // Partial erases done on it so far
+    LogPageHeader _header;  // Source of a header write, kept until it lands
+    uint32_t _frame[(LOG_FRAME_MAX_BYTES + 3) / 4];   // Source of a frame write
+    uint8_t _frameRecords;
+    uint32_t _frameTime;    // Time of its last record
+
+    FlashOp _op;            // SoftDevice operation in flight
+    bool _opIssued;         // false if the SoftDevice was busy, retried on the next poll
+    uint32_t _opAddr;
+    const uint32_t *_opData;
+    uint16_t _opWords;
+    uint32_t _opStartedAt;  // millis()
+
+    EventLogStats _stats;
+
+    static uint32_t pageAddr(uint8_t page);
+    static const LogPageHeader &pageHeader(uint8_t page);
+    static bool blank(const uint32_t *words, size_t count);
+
+    uint8_t nextPage(uint8_t page) const { return (page + 1) % EVENTLOG_PAGES; }
+    bool format();
+    void scanTail();
+    size_t limit(uint8_t page) const;
+    bool step();
+    void openNextPage();
+    void eraseStep();
+
+    // A write or erase has completed
+    void landed();
+    void erased();
+
+    /**
+     * @brief Program words at addr
+     * @return true once they are in flash, false while the SoftDevice has them
+     */
+    bool program(uint32_t addr, const uint32_t *data, uint16_t words);
+
+    // SoftDevice path: hand an operation over and poll for it
+    void start(FlashOp op, uint32_t addr, const uint32_t *data, uint16_t words);
+    bool issue();
+    bool opFinished();
+};
+
+#endif // EVENT_LOG_H
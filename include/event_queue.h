@@ -0,0 +1,123 @@
+/**
+ * @file event_queue.h
+ * @brief Fixed-capacity lock-free ring for passing events out of ISRs
+ *
+ * Bounded ring with a sequence number per cell (Vyukov style). Producers
+ * claim a slot with a compare-and-swap on the head index, fill it, then
+ * publish it by bumping the cell's sequence; the single consumer only
+ * takes cells that have been published. There is no lock and no
+ * interrupt masking, so any ISR can push while the task is pushing or
+ * popping, and a producer preempted half way through only holds back the
+ * consumer, never corrupts the ring.
+ *
+ * With MultiProducer = false the head is advanced with a plain store,
+ * for a queue fed by exactly one context (SPSC).
+ *
+ * On Cortex-M4 std::atomic<uint32_t> compiles to LDREX/STREX, so this is
+ * lock-free in hardware.
+ */
+
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint16_t N, bool MultiProducer = true>
+class EventRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "EventRing size must be a power of 2");
+
+public:
+    EventRing() : _head(0), _tail(0), _highWater(0), _dropped(0) {
+        for (uint16_t i = 0; i < N; i++) {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Add an item, from any context
+     * @return false if the ring was full (counted in dropped())
+     */
+    bool push(const T& item) {
+        uint32_t pos = _head.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &_cells[pos & (N - 1)];
+            uint32_t seq = cell->seq.load(std::memory_order_acquire);
+            int32_t diff = (int32_t)(seq - pos);
+            if (diff == 0) {
+                // Slot is free for this lap, try to claim it
+                if (!MultiProducer) {
+                    _head.store(pos + 1, std::memory_order_relaxed);
+                    break;
+                }
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+                // pos was reloaded by the failed CAS
+            } else if (diff < 0) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->item = item;
+        cell->seq.store(pos + 1, std::memory_order_release);
+
+        // High-water mark, lock-free max
+        uint32_t used = pos + 1 - _tail.load(std::memory_order_relaxed);
+        uint32_t mark = _highWater.load(std::memory_order_relaxed);
+        while (used > mark &&
+               !_highWater.compare_exchange_weak(mark, used, std::memory_order_relaxed)) {
+        }
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest published item, single consumer only
+     */
+    bool pop(T& out) {
+        uint32_t pos = _tail.load(std::memory_order_relaxed);
+        Cell& cell = _cells[pos & (N - 1)];
+        uint32_t seq = cell.seq.load(std::memory_order_acquire);
+        if ((int32_t)(seq - (pos + 1)) < 0) {
+            return false;  // Empty, or the next producer hasn't finished
+        }
+
+        out = cell.item;
+        cell.seq.store(pos + N, std::memory_order_release);  // Free for the next lap
+        _tail.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool empty() const {
+        uint32_t pos = _tail.load(std::memory_order_relaxed);
+        uint32_t seq = _cells[pos & (N - 1)].seq.load(std::memory_order_acquire);
+        return (int32_t)(seq - (pos + 1)) < 0;
+    }
+
+    static uint16_t capacity() { return N; }
+    uint16_t highWater() const { return _highWater.load(std::memory_order_relaxed); }
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+    void resetStats() {
+        _highWater.store(0, std::memory_order_relaxed);
+        _dropped.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct Cell {
+        std::atomic<uint32_t> seq;
+        T item;
+    };
+
+    Cell _cells[N];
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+    std::atomic<uint32_t> _highWater;
+    std::atomic<uint32_t> _dropped;
+};
+
+#endif // EVENT_QUEUE_H
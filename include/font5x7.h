@@ -0,0 +1,55 @@
+/**
+ * @file font5x7.h
+ * @brief 5x7 bitmap font atlas for printable ASCII
+ *
+ * Glyphs are generated at compile time from the column table in
+ * font5x7.cpp and stored row-major in framebuffer bit order (bit 0 =
+ * leftmost pixel), so a glyph row can be OR-ed or masked straight into
+ * the framebuffer with SharpDisplay::blit(). Lookup is a single index
+ * by character code.
+ *
+ * A pre-expanded 2x atlas (10x14) is kept alongside for the large
+ * stopwatch digits, so scaled text needs no per-pixel work either.
+ */
+
+#ifndef FONT5X7_H
+#define FONT5X7_H
+
+#include <Arduino.h>
+
+#define FONT_WIDTH          5
+#define FONT_HEIGHT         7
+#define FONT_FIRST_CHAR     0x20  // ' '
+#define FONT_LAST_CHAR      0x7E  // '~'
+#define FONT_GLYPH_COUNT    (FONT_LAST_CHAR - FONT_FIRST_CHAR + 1)
+
+struct FontGlyph {
+    uint8_t rows[FONT_HEIGHT];              // 5 bits used per row
+};
+
+struct FontGlyph2x {
+    uint8_t rows[FONT_HEIGHT * 2][2];       // 10 bits per row, little endian
+};
+
+struct FontAtlas {
+    FontGlyph glyphs[FONT_GLYPH_COUNT];
+    FontGlyph2x glyphs2x[FONT_GLYPH_COUNT];
+};
+
+extern const FontAtlas fontAtlas;
+
+// Characters outside printable ASCII render as a space
+inline uint8_t fontIndex(char c) {
+    uint8_t i = (uint8_t)c - FONT_FIRST_CHAR;
+    return (i < FONT_GLYPH_COUNT) ? i : 0;
+}
+
+inline const FontGlyph& fontGlyph(char c) {
+    return fontAtlas.glyphs[fontIndex(c)];
+}
+
+inline const FontGlyph2x& fontGlyph2x(char c) {
+    return fontAtlas.glyphs2x[fontIndex(c)];
+}
+
+#endif // FONT5X7_H
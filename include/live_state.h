@@ -0,0 +1,85 @@
+/**
+ * @file live_state.h
+ * @brief Wire format of the live stopwatch state characteristic
+ *
+ * Header-only and free of Arduino dependencies, shared by the firmware
+ * (ble_sync.cpp) and the host model (tools/live_model.cpp).
+ *
+ * The watch notifies this only when the state changes: a start, switch,
+ * pause or reset. Running time is never pushed; the client extrapolates
+ * it, adding the time since the notification arrived to the active
+ * category's elapsed seconds. Notifications go out during the connection
+ * event after the change, so that is the extrapolation error.
+ *
+ *   change (2)     counts up with every transition, a jump means one was missed
+ *   active (1)     running category, 0xFF if paused
+ *   count (1)      categories that follow
+ *   baseTime (4)   watch wall clock (local epoch seconds) when sampled
+ *   elapsed (4)    seconds per category at baseTime, count times
+ *
+ * Little endian. With two categories it is 16 bytes, one notification
+ * at the default MTU.
+ */
+
+#ifndef LIVE_STATE_H
+#define LIVE_STATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "stopwatch.h"
+
+#define LIVE_STATE_HEADER   8
+#define LIVE_STATE_MAX      (LIVE_STATE_HEADER + 4 * STOPWATCH_MAX_CATEGORIES)
+
+struct LiveState {
+    uint16_t change;
+    uint8_t active;
+    uint8_t count;
+    uint32_t baseTime;
+    uint32_t elapsed[STOPWATCH_MAX_CATEGORIES];
+};
+
+inline size_t liveStateEncode(const LiveState &state, uint8_t *out) {
+    uint8_t count = state.count < STOPWATCH_MAX_CATEGORIES ? state.count
+                                                           : STOPWATCH_MAX_CATEGORIES;
+    uint32_t words[1 + STOPWATCH_MAX_CATEGORIES];
+    words[0] = state.baseTime;
+    for (uint8_t i = 0; i < count; i++) {
+        words[1 + i] = state.elapsed[i];
+    }
+
+    out[0] = (uint8_t)state.change;
+    out[1] = (uint8_t)(state.change >> 8);
+    out[2] = state.active;
+    out[3] = count;
+    for (uint8_t w = 0; w <= count; w++) {
+        for (uint8_t b = 0; b < 4; b++) {
+            out[4 + w * 4 + b] = (uint8_t)(words[w] >> (8 * b));
+        }
+    }
+    return LIVE_STATE_HEADER + 4 * count;
+}
+
+inline bool liveStateDecode(const uint8_t *in, size_t len, LiveState &state) {
+    if (len < LIVE_STATE_HEADER || in[3] > STOPWATCH_MAX_CATEGORIES ||
+        len < (size_t)LIVE_STATE_HEADER + 4 * in[3]) {
+        return false;
+    }
+    uint32_t words[1 + STOPWATCH_MAX_CATEGORIES];
+    state.change = in[0] | (uint16_t)(in[1] << 8);
+    state.active = in[2];
+    state.count = in[3];
+    for (uint8_t w = 0; w <= state.count; w++) {
+        words[w] = 0;
+        for (uint8_t b = 0; b < 4; b++) {
+            words[w] |= (uint32_t)in[4 + w * 4 + b] << (8 * b);
+        }
+    }
+    state.baseTime = words[0];
+    for (uint8_t i = 0; i < state.count; i++) {
+        state.elapsed[i] = words[1 + i];
+    }
+    return true;
+}
+
+#endif // LIVE_STATE_H
@@ -0,0 +1,294 @@
+/**
+ * @file log_codec.h
+ * @brief Compact on-flash format of the session event log
+ *
+ * Header-only and free of Arduino dependencies, so the firmware
+ * (event_log.cpp) and the host decoder (tools/logdump.cpp) share one
+ * definition of the format.
+ *
+ * A log page starts with a LogPageHeader giving the sequence number and
+ * wall-clock time the page starts from. These are the seek points: a
+ * reader picks the page by its header and decodes at most one page to
+ * reach any record. The rest of the page is a run of frames, one per
+ * flash write:
+ *
+ *   count (1) | payload length (1) | CRC-16 of the frame (2) | payload
+ *
+ * padded with 0xFF to a whole word. Within the payload each record is
+ *
+ *   tag byte: LogEventType in the high nibble, category in the low
+ *             nibble (0xF = none)
+ *   zigzag varint: seconds since the record before it in the page, or
+ *             since the page's base time for the first
+ *
+ * Sequence numbers are implicit, one up from the record before. A
+ * typical switch, minutes after the last one, costs 3 bytes instead of
+ * a fixed 12, plus 4 bytes of frame header shared by every record in
+ * the same write.
+ *
+ * A frame torn by power loss fails its CRC and is skipped whole. Deltas
+ * only ever chain through frames that landed, because after a reset
+ * the writer resumes from the last good record just as a reader would.
+ */
+
+#ifndef LOG_CODEC_H
+#define LOG_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define LOG_PAGE_SIZE           4096
+#define LOG_PAGE_MAGIC          0x4C32      // "L2"
+#define LOG_FRAME_MAX_RECORDS   16
+#define LOG_RECORD_MAX_BYTES    6           // Tag + 5-byte varint
+#define LOG_FRAME_MAX_BYTES     (4 + LOG_FRAME_MAX_RECORDS * LOG_RECORD_MAX_BYTES)
+#define LOG_CATEGORY_NONE       0xFF
+
+enum LogEventType : uint8_t {
+    LOG_BOOT,               // Watch started
+    LOG_SWITCH,             // Category started, switched to, or paused (LOG_CATEGORY_NONE)
+    LOG_RESET,              // All stopwatches cleared
+};
+
+struct LogRecord {
+    uint32_t seq;           // Record number, counts on across pages and boots
+    uint32_t time;          // Local epoch seconds
+    uint8_t type;           // LogEventType
+    uint8_t category;       // 0-14, or LOG_CATEGORY_NONE
+};
+
+struct LogPageHeader {
+    uint32_t magic;         // LOG_PAGE_MAGIC << 16 | CRC of the words after it
+    uint32_t pageSeq;       // Counts up with every page opened
+    uint32_t firstSeq;      // seq of the first record in the page
+    uint32_t baseTime;      // The first record's time is a delta from this
+};
+
+struct LogFrameHeader {
+    uint8_t count;
+    uint8_t length;         // Payload bytes
+    uint16_t crc;           // CRC-16 of count, length and the payload
+};
+
+// CRC-16/CCITT-FALSE, continued from crc
+inline uint16_t logCrc16(const void *data, size_t len, uint16_t crc = 0xFFFF) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    while (len--) {
+        crc ^= (uint16_t)*bytes++ << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Small magnitudes of either sign become small unsigned values
+inline uint32_t zigzagEncode(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// LEB128: 7 bits per byte, low first, high bit set on all but the last
+inline uint8_t varintPut(uint8_t *out, uint32_t v) {
+    uint8_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+inline bool varintGet(const uint8_t *&in, const uint8_t *end, uint32_t &v) {
+    v = 0;
+    for (uint8_t shift = 0; shift < 35 && in < end; shift += 7) {
+        uint8_t byte = *in++;
+        v |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Tag byte and time delta of one record, at most LOG_RECORD_MAX_BYTES
+inline uint8_t logRecordPut(uint8_t *out, const LogRecord &record, uint32_t prevTime) {
+    out[0] = (uint8_t)(record.type << 4) | (record.category < 0xF ? record.category : 0xF);
+    return 1 + varintPut(out + 1, zigzagEncode((int32_t)(record.time - prevTime)));
+}
+
+// Everything but seq, which is implicit wherever records are stored
+inline bool logRecordGet(const uint8_t *&in, const uint8_t *end, LogRecord &record,
+                         uint32_t prevTime) {
+    if (in >= end) return false;
+    uint8_t tag = *in++;
+    uint32_t delta;
+    if (!varintGet(in, end, delta)) return false;
+    record.time = prevTime + zigzagDecode(delta);
+    record.type = tag >> 4;
+    record.category = (tag & 0xF) == 0xF ? LOG_CATEGORY_NONE : tag & 0xF;
+    return true;
+}
+
+inline size_t logFrameSize(const LogFrameHeader &header) {
+    return (sizeof(LogFrameHeader) + header.length + 3) & ~(size_t)3;
+}
+
+inline uint16_t logFrameCrc(const LogFrameHeader &header, const uint8_t *payload) {
+    return logCrc16(payload, header.length, logCrc16(&header, 2));
+}
+
+inline void logPageHeaderInit(LogPageHeader &header, uint32_t pageSeq, uint32_t firstSeq,
+                              uint32_t baseTime) {
+    header.pageSeq = pageSeq;
+    header.firstSeq = firstSeq;
+    header.baseTime = baseTime;
+    header.magic = ((uint32_t)LOG_PAGE_MAGIC << 16) | logCrc16(&header.pageSeq, 12);
+}
+
+inline bool logPageHeaderValid(const LogPageHeader &header) {
+    return (header.magic >> 16) == LOG_PAGE_MAGIC &&
+           (header.magic & 0xFFFF) == logCrc16(&header.pageSeq, 12);
+}
+
+/**
+ * Builds one frame in a word-aligned buffer of LOG_FRAME_MAX_BYTES
+ */
+class LogFrameEncoder {
+public:
+    /**
+     * @param prevTime Time of the record before, in the same page
+     * @param room Bytes left in the page, padding included
+     */
+    void begin(uint8_t *out, uint32_t prevTime, size_t room) {
+        _out = out;
+        _prevTime = prevTime;
+        _room = room < LOG_FRAME_MAX_BYTES ? room : LOG_FRAME_MAX_BYTES;
+        _count = 0;
+        _length = 0;
+    }
+
+    /**
+     * @return false if the frame is full, record not added
+     */
+    bool add(const LogRecord &record) {
+        uint8_t bytes[LOG_RECORD_MAX_BYTES];
+        uint8_t n = logRecordPut(bytes, record, _prevTime);
+
+        if (_count >= LOG_FRAME_MAX_RECORDS ||
+            ((sizeof(LogFrameHeader) + _length + n + 3) & ~(size_t)3) > _room) {
+            return false;
+        }
+        memcpy(_out + sizeof(LogFrameHeader) + _length, bytes, n);
+        _length += n;
+        _count++;
+        _prevTime = record.time;
+        return true;
+    }
+
+    /**
+     * @brief Write the header and padding
+     * @return Frame size in bytes, a multiple of 4; 0 if nothing was added
+     */
+    size_t finish() {
+        if (_count == 0) return 0;
+        LogFrameHeader header;
+        header.count = _count;
+        header.length = _length;
+        header.crc = logFrameCrc(header, _out + sizeof(LogFrameHeader));
+        memcpy(_out, &header, sizeof(header));
+
+        size_t size = logFrameSize(header);
+        memset(_out + sizeof(LogFrameHeader) + _length, 0xFF,
+               size - sizeof(LogFrameHeader) - _length);
+        return size;
+    }
+
+    uint8_t count() const { return _count; }
+    uint32_t prevTime() const { return _prevTime; }
+
+private:
+    uint8_t *_out;
+    uint32_t _prevTime;
+    size_t _room;
+    uint8_t _count;
+    uint8_t _length;
+};
+
+/**
+ * Walks the records of one page image, skipping torn frames
+ */
+class LogPageReader {
+public:
+    LogPageReader() : _page(nullptr), _offset(0), _pos(0), _seq(0), _time(0), _torn(0) {}
+
+    /**
+     * @return false if the page has no valid header
+     */
+    bool begin(const uint8_t *page) {
+        LogPageHeader header;
+        memcpy(&header, page, sizeof(header));
+        _page = page;
+        _offset = sizeof(LogPageHeader);
+        _pos = 0;
+        _torn = 0;
+        _seq = header.firstSeq;
+        _time = header.baseTime;
+        return logPageHeaderValid(header);
+    }
+
+    /**
+     * @brief Decode the next record
+     * @param limit Bytes of the page to look at, less while it is being written
+     * @return false at the first blank frame slot or the limit
+     */
+    bool next(LogRecord &record, size_t limit = LOG_PAGE_SIZE) {
+        while (_offset + sizeof(LogFrameHeader) <= limit) {
+            LogFrameHeader header;
+            memcpy(&header, _page + _offset, sizeof(header));
+            const uint8_t *payload = _page + _offset + sizeof(LogFrameHeader);
+            size_t size = logFrameSize(header);
+
+            if (header.count == 0xFF && header.length == 0xFF && header.crc == 0xFFFF) {
+                return false;  // Blank, nothing written from here on
+            }
+            if (_offset + size > limit) {
+                return false;
+            }
+            if (_pos == 0 && logFrameCrc(header, payload) != header.crc) {
+                _torn++;
+                _offset += size;
+                continue;
+            }
+
+            const uint8_t *in = payload + _pos;
+            if (logRecordGet(in, payload + header.length, record, _time)) {
+                record.seq = _seq++;
+                _time = record.time;
+                _pos = in - payload;
+                return true;
+            }
+            _offset += size;
+            _pos = 0;
+        }
+        return false;
+    }
+
+    // Where the next frame goes, once next() has returned false
+    size_t end() const { return _offset; }
+    uint32_t seq() const { return _seq; }
+    uint32_t time() const { return _time; }
+    uint32_t torn() const { return _torn; }
+
+private:
+    const uint8_t *_page;
+    size_t _offset;         // Frame being read
+    size_t _pos;            // Next record in its payload, 0 = not yet checked
+    uint32_t _seq;          // Given to the next record
+    uint32_t _time;         // Time of the record before
+    uint32_t _torn;
+};
+
+#endif // LOG_CODEC_H
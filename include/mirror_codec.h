@@ -0,0 +1,316 @@
+/**
+ * @file mirror_codec.h
+ * @brief Compressed stream that mirrors the Sharp display on a host
+ *
+ * Header-only and free of Arduino dependencies, shared by the firmware
+ * (main.cpp, over USB CDC) and the host decoder (tools/mirror_decode.cpp).
+ *
+ * Each packet carries the rows that changed since the packet before,
+ * XORed with what the viewer already has, so unchanged pixels come out
+ * as zero bytes and a redrawn digit is a few short literals in long zero
+ * runs. The rows to send are the ones SharpDisplay::lastRows() reports
+ * after every frame, the same dirty set the driver put on the wire plus
+ * any rows clearDisplay() wiped; the encoder never compares rows itself.
+ *
+ *   sync (2)       0xA5 0x5A, lets the host find packets in a byte stream
+ *   type (1)       MIRROR_KEY or MIRROR_DELTA
+ *   frame (1)      counts up per packet, a jump means one was lost
+ *   length (2)     body bytes, little endian
+ *   crc (2)        CRC-16 of type, frame, length and body
+ *   body           row mask (MIRROR_MASK_BYTES, bit y = row y) followed
+ *                  by the XOR bytes of those rows, top to bottom, RLE coded
+ *
+ * RLE control byte c: below 0x80, c + 1 literal bytes follow; from 0x80
+ * the next byte repeats c - 0x80 + MIRROR_RUN_MIN times. Runs may span
+ * rows.
+ *
+ * A keyframe has every row and is XORed with a blank frame, so it holds
+ * the plain pixels. The encoder sends one first, every keyInterval
+ * packets, and on request; a viewer that missed a packet waits for the
+ * next one.
+ */
+
+#ifndef MIRROR_CODEC_H
+#define MIRROR_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "config.h"
+#include "log_codec.h"
+
+#define MIRROR_ROWS         DISPLAY_HEIGHT
+#define MIRROR_ROW_BYTES    (DISPLAY_WIDTH / 8)
+#define MIRROR_FRAME_BYTES  (MIRROR_ROWS * MIRROR_ROW_BYTES)
+#define MIRROR_MASK_BYTES   ((MIRROR_ROWS + 7) / 8)
+#define MIRROR_HEADER       8
+#define MIRROR_SYNC0        0xA5
+#define MIRROR_SYNC1        0x5A
+#define MIRROR_LITERAL_MAX  128
+#define MIRROR_RUN_MIN      3
+#define MIRROR_RUN_MAX      (0x7F + MIRROR_RUN_MIN)
+// Worst case: all literals, one control byte per MIRROR_LITERAL_MAX
+#define MIRROR_BODY_MAX     (MIRROR_MASK_BYTES + MIRROR_FRAME_BYTES + \
+                             (MIRROR_FRAME_BYTES + MIRROR_LITERAL_MAX - 1) / MIRROR_LITERAL_MAX)
+#define MIRROR_PACKET_MAX   (MIRROR_HEADER + MIRROR_BODY_MAX)
+
+enum MirrorPacketType : uint8_t {
+    MIRROR_KEY = 0x01,
+    MIRROR_DELTA = 0x02,
+};
+
+typedef uint8_t MirrorFrame[MIRROR_ROWS][MIRROR_ROW_BYTES];
+
+/**
+ * Streaming PackBits-style writer, one byte at a time, no scratch buffer
+ */
+class MirrorRleWriter {
+public:
+    explicit MirrorRleWriter(uint8_t *out) : _out(out), _pos(0), _literal(-1), _runLen(0),
+                                             _runByte(0) {}
+
+    void put(uint8_t b) {
+        if (_runLen && b == _runByte && _runLen < MIRROR_RUN_MAX) {
+            _runLen++;
+            return;
+        }
+        flushRun();
+        _runByte = b;
+        _runLen = 1;
+    }
+
+    // Bytes written, after the last put()
+    size_t finish() {
+        flushRun();
+        return _pos;
+    }
+
+private:
+    uint8_t *_out;
+    size_t _pos;
+    long _literal;          // Control byte of the open literal, -1 if none
+    uint8_t _runLen;
+    uint8_t _runByte;
+
+    void flushRun() {
+        if (_runLen >= MIRROR_RUN_MIN) {
+            _literal = -1;
+            _out[_pos++] = 0x80 + (_runLen - MIRROR_RUN_MIN);
+            _out[_pos++] = _runByte;
+        } else {
+            // Too short to pay for its control byte, extend the literal
+            for (uint8_t i = 0; i < _runLen; i++) {
+                if (_literal < 0 || _out[_literal] == MIRROR_LITERAL_MAX - 1) {
+                    _literal = _pos;
+                    _out[_pos++] = 0xFF;  // Becomes 0 with the first byte
+                }
+                _out[_literal]++;
+                _out[_pos++] = _runByte;
+            }
+        }
+        _runLen = 0;
+    }
+};
+
+/**
+ * Keeps the frame the viewer holds and turns dirty rows into packets
+ */
+class MirrorEncoder {
+public:
+    MirrorEncoder() : _keyInterval(0), _sinceKey(0), _frame(0), _keyDue(true) {
+        memset(_reference, 0, sizeof(_reference));
+        memset(_rows, 0, sizeof(_rows));
+    }
+
+    /**
+     * @param keyInterval Packets between keyframes, 0 for only on request
+     */
+    void begin(uint16_t keyInterval) {
+        _keyInterval = keyInterval;
+        _keyDue = true;
+    }
+
+    // A new viewer, or one that lost packets, needs a full frame
+    void requestKey() { _keyDue = true; }
+
+    /**
+     * @brief Add rows the display just sent, bit y = row y
+     * @note Rows add up until the next encode(), so frames can be skipped
+     */
+    void markRows(const uint32_t *rows) {
+        for (uint8_t i = 0; i < (MIRROR_ROWS + 31) / 32; i++) {
+            _rows[i] |= rows[i];
+        }
+    }
+
+    bool pending() const {
+        if (_keyDue) return true;
+        for (uint8_t i = 0; i < (MIRROR_ROWS + 31) / 32; i++) {
+            if (_rows[i]) return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Encode the marked rows of frame as the next packet
+     * @param out Buffer of at least MIRROR_PACKET_MAX bytes
+     * @return Packet length, 0 if nothing changed
+     */
+    size_t encode(const MirrorFrame &frame, uint8_t *out) {
+        if (!pending()) return 0;
+        bool key = _keyDue || (_keyInterval && _sinceKey >= _keyInterval);
+        if (key) {
+            memset(_reference, 0, sizeof(_reference));
+            memset(_rows, 0xFF, sizeof(_rows));
+        }
+
+        uint8_t *body = out + MIRROR_HEADER;
+        memset(body, 0, MIRROR_MASK_BYTES);
+        MirrorRleWriter rle(body + MIRROR_MASK_BYTES);
+        for (uint8_t y = 0; y < MIRROR_ROWS; y++) {
+            if (!(_rows[y >> 5] & (1UL << (y & 31)))) continue;
+            body[y >> 3] |= 1 << (y & 7);
+            for (uint8_t x = 0; x < MIRROR_ROW_BYTES; x++) {
+                rle.put(frame[y][x] ^ _reference[y][x]);
+            }
+            memcpy(_reference[y], frame[y], MIRROR_ROW_BYTES);
+        }
+        size_t length = MIRROR_MASK_BYTES + rle.finish();
+
+        out[0] = MIRROR_SYNC0;
+        out[1] = MIRROR_SYNC1;
+        out[2] = key ? MIRROR_KEY : MIRROR_DELTA;
+        out[3] = _frame++;
+        out[4] = (uint8_t)length;
+        out[5] = (uint8_t)(length >> 8);
+        uint16_t crc = logCrc16(out + 2, 4);
+        crc = logCrc16(body, length, crc);
+        out[6] = (uint8_t)crc;
+        out[7] = (uint8_t)(crc >> 8);
+
+        memset(_rows, 0, sizeof(_rows));
+        _keyDue = false;
+        _sinceKey = key ? 0 : _sinceKey + 1;
+        return MIRROR_HEADER + length;
+    }
+
+private:
+    MirrorFrame _reference;     // What the viewer has
+    uint32_t _rows[(MIRROR_ROWS + 31) / 32];
+    uint16_t _keyInterval;
+    uint16_t _sinceKey;
+    uint8_t _frame;
+    bool _keyDue;
+};
+
+/**
+ * Rebuilds frames from a byte stream that may hold other output too
+ */
+class MirrorDecoder {
+public:
+    enum Result : uint8_t {
+        MIRROR_MORE,        // Need more bytes
+        MIRROR_FRAME,       // frame() holds a new picture
+        MIRROR_SKIPPED,     // A packet that can't be applied, waiting for a keyframe
+        MIRROR_BAD,         // CRC or format error, resynchronizing
+    };
+
+    MirrorDecoder() : _fill(0), _need(2), _synced(false), _last(0), _lost(0) {
+        memset(_frame, 0, sizeof(_frame));
+    }
+
+    Result push(uint8_t b) {
+        // Hunt for the sync bytes, everything else is not ours
+        if (_fill < 2) {
+            if (b == (_fill ? MIRROR_SYNC1 : MIRROR_SYNC0)) {
+                _packet[_fill++] = b;
+            } else {
+                _fill = b == MIRROR_SYNC0 ? 1 : 0;
+            }
+            _need = MIRROR_HEADER;
+            return MIRROR_MORE;
+        }
+        _packet[_fill++] = b;
+        if (_fill == MIRROR_HEADER) {
+            size_t length = _packet[4] | (size_t)_packet[5] << 8;
+            if (length < MIRROR_MASK_BYTES || length > MIRROR_BODY_MAX) {
+                _fill = 0;
+                return MIRROR_BAD;
+            }
+            _need = MIRROR_HEADER + length;
+        }
+        if (_fill < _need) return MIRROR_MORE;
+        _fill = 0;
+        return apply(_packet, _need);
+    }
+
+    const MirrorFrame &frame() const { return _frame; }
+    uint32_t lost() const { return _lost; }
+
+private:
+    uint8_t _packet[MIRROR_PACKET_MAX];
+    size_t _fill;
+    size_t _need;
+    MirrorFrame _frame;
+    bool _synced;           // Have a keyframe and every packet since
+    uint8_t _last;
+    uint32_t _lost;
+
+    Result apply(const uint8_t *packet, size_t len) {
+        const uint8_t *body = packet + MIRROR_HEADER;
+        size_t length = len - MIRROR_HEADER;
+        uint16_t crc = logCrc16(packet + 2, 4);
+        crc = logCrc16(body, length, crc);
+        if ((packet[6] | (uint16_t)packet[7] << 8) != crc) return MIRROR_BAD;
+
+        uint8_t type = packet[2];
+        if (type != MIRROR_KEY && type != MIRROR_DELTA) return MIRROR_BAD;
+        if (type == MIRROR_DELTA && (!_synced || packet[3] != (uint8_t)(_last + 1))) {
+            if (_synced) _lost += (uint8_t)(packet[3] - _last - 1);
+            _synced = false;
+            return MIRROR_SKIPPED;
+        }
+
+        // Into a copy, so a malformed body leaves the last good frame
+        MirrorFrame next;
+        if (type == MIRROR_KEY) {
+            memset(next, 0, sizeof(next));
+        } else {
+            memcpy(next, _frame, sizeof(next));
+        }
+        const uint8_t *in = body + MIRROR_MASK_BYTES;
+        const uint8_t *end = body + length;
+        uint8_t run = 0;
+        uint8_t runByte = 0;
+        bool literal = false;
+        for (uint8_t y = 0; y < MIRROR_ROWS; y++) {
+            if (!(body[y >> 3] & (1 << (y & 7)))) continue;
+            for (uint8_t x = 0; x < MIRROR_ROW_BYTES; x++) {
+                if (!run) {
+                    if (in >= end) return MIRROR_BAD;
+                    uint8_t c = *in++;
+                    literal = c < 0x80;
+                    run = literal ? c + 1 : c - 0x80 + MIRROR_RUN_MIN;
+                    if (!literal) {
+                        if (in >= end) return MIRROR_BAD;
+                        runByte = *in++;
+                    }
+                }
+                if (literal) {
+                    if (in >= end) return MIRROR_BAD;
+                    runByte = *in++;
+                }
+                next[y][x] ^= runByte;
+                run--;
+            }
+        }
+        if (run || in != end) return MIRROR_BAD;
+
+        memcpy(_frame, next, sizeof(_frame));
+        _synced = true;
+        _last = packet[3];
+        return MIRROR_FRAME;
+    }
+};
+
+#endif // MIRROR_CODEC_H
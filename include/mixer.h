@@ -0,0 +1,133 @@
+/**
+ * @file mixer.h
+ * @brief Fixed-voice audio mixer run from the I2S refill interrupt
+ *
+ * Up to MIXER_VOICES sounds play at once: ADPCM clips, synth tones,
+ * streams from an AudioProducer, and silence pads. A silence pad
+ * produces nothing audible but holds a voice and its priority, e.g. for
+ * a pause inside a spoken phrase. Every voice lives in a static slot
+ * and its state is rendered in MIXER_CHUNK_SAMPLES pieces through one
+ * static scratch buffer, so nothing is ever allocated.
+ *
+ * Each voice has a priority. While a higher-priority voice is playing,
+ * lower ones are ducked by MIXER_DUCK_GAIN so a spoken reminder stays
+ * intelligible over a beep. When every slot is busy, a new voice takes
+ * the slot of the lowest-priority voice (the oldest of equals) if that
+ * is not above its own priority; otherwise it is refused.
+ *
+ * Voices are summed with saturating Q15 arithmetic (dsp.h). The work
+ * per buffer is bounded by MIXER_VOICES renders plus mixes of one
+ * buffer each; the DWT cycle counter measures every call against the
+ * time the buffer takes to play, so the margin over the display DMA
+ * and everything else in the system can be checked at run time.
+ */
+
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "adpcm.h"
+#include "synth.h"
+#include "dsp.h"
+
+#define MIXER_VOICES        4
+#define MIXER_CHUNK_SAMPLES 128     // Scratch size, per render call
+#define MIXER_DUCK_GAIN     8192    // -12dB, Q15
+
+// Producer for a stream voice (same shape as the one in audio.h)
+typedef size_t (*MixerSource)(int16_t *buffer, size_t numSamples, void *context);
+
+enum AudioPriority : uint8_t {
+    AUDIO_PRIORITY_LOW,             // Ambient ticks, key clicks
+    AUDIO_PRIORITY_NORMAL,          // Beeps and alerts
+    AUDIO_PRIORITY_HIGH,            // Speech
+};
+
+// Identifies one started voice, stale once it has finished or been replaced
+typedef uint16_t VoiceHandle;
+#define MIXER_NO_VOICE      0
+
+struct MixerStats {
+    uint32_t buffers;               // mix() calls
+    uint32_t lastCycles;            // CPU cycles the last mix() took
+    uint32_t maxCycles;
+    uint32_t budgetCycles;          // Cycles the last buffer takes to play
+    uint32_t steals;                // Voices cut short by a new one
+    uint32_t rejected;              // Voices refused, all slots outranked them
+};
+
+class AudioMixer {
+public:
+    AudioMixer();
+
+    /**
+     * @brief Set the rate tones are generated at and start the cycle counter
+     */
+    void begin(uint32_t sampleRate);
+
+    /**
+     * @brief Start a voice
+     * @param gain Voice level, Q15 (Q15_ONE = as recorded)
+     * @return Handle, or MIXER_NO_VOICE if every slot outranked it
+     */
+    VoiceHandle playClip(const AdpcmClip &clip, AudioPriority priority,
+                         int16_t gain = Q15_ONE);
+    VoiceHandle playTone(uint16_t frequency, uint32_t durationMs, AudioPriority priority,
+                         int16_t gain = Q15_ONE);
+    VoiceHandle playStream(MixerSource source, void *context, AudioPriority priority,
+                           int16_t gain = Q15_ONE);
+    VoiceHandle playSilence(uint32_t durationMs, AudioPriority priority);
+
+    void stopVoice(VoiceHandle voice);
+    void stopAll();
+
+    bool isActive(VoiceHandle voice) const;
+    bool active() const;
+
+    /**
+     * @brief Render and sum every voice into out (I2S interrupt)
+     * @return Samples until the last voice ended, 0 if none were playing
+     */
+    size_t mix(int16_t *out, size_t numSamples);
+
+    const MixerStats &stats() const { return _stats; }
+    void resetStats();
+
+private:
+    enum VoiceKind : uint8_t {
+        VOICE_IDLE,
+        VOICE_CLIP,
+        VOICE_TONE,
+        VOICE_STREAM,
+        VOICE_SILENCE,
+    };
+
+    struct Voice {
+        volatile VoiceKind kind;    // Written last when starting a voice
+        AudioPriority priority;
+        uint8_t generation;
+        int16_t gain;
+        uint32_t order;             // Start order, oldest goes first on a tie
+        AdpcmDecoder clip;
+        ToneSynth tone;
+        MixerSource source;
+        void *context;
+        uint32_t silenceLeft;
+    };
+
+    Voice _voices[MIXER_VOICES];
+    uint32_t _sampleRate;
+    uint32_t _order;
+    MixerStats _stats;
+
+    /**
+     * @brief Pick a slot for a new voice, in a critical section
+     * @return Slot index, -1 if refused
+     */
+    int8_t claim(AudioPriority priority);
+    VoiceHandle publish(uint8_t slot, VoiceKind kind);
+    size_t render(Voice &voice, int16_t *out, size_t numSamples);
+};
+
+#endif // MIXER_H
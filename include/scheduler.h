@@ -0,0 +1,85 @@
+/**
+ * @file scheduler.h
+ * @brief Tickless sleep scheduling on the nRF52 RTC2
+ *
+ * RTC2 runs from the 32.768kHz LFCLK with no prescaler and keeps counting
+ * while the CPU sleeps. Its 24-bit counter is extended in software with an
+ * overflow count, giving a monotonic tick count that never wraps in
+ * practice. The main loop computes its next real deadline and calls
+ * sleepUntil(), which programs compare channel 0 and blocks the task; the
+ * CPU stays in System ON idle until the compare fires or an ISR calls
+ * wakeFromISR().
+ *
+ * RTC0 belongs to the SoftDevice and RTC1 to the FreeRTOS tick, so RTC2
+ * is the one left for the application.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+#define RTC_TICK_HZ         32768
+#define RTC_COUNTER_BITS    24
+#define RTC_COUNTER_MASK    ((1UL << RTC_COUNTER_BITS) - 1)
+#define RTC_CHANNELS        4
+
+typedef void (*RtcCompareHandler)(void);
+
+class TicklessScheduler {
+public:
+    TicklessScheduler();
+
+    /**
+     * @brief Start RTC2 and enable its overflow/compare interrupts
+     */
+    void begin();
+
+    /**
+     * @brief Monotonic 32.768kHz ticks since begin()
+     * @note Safe to call from any context
+     */
+    uint64_t now() const;
+
+    static uint64_t msToTicks(uint32_t ms) { return ((uint64_t)ms * RTC_TICK_HZ + 999) / 1000; }
+    static uint32_t ticksToMs(uint64_t ticks) { return (uint32_t)((ticks * 1000) / RTC_TICK_HZ); }
+
+    /**
+     * @brief Sleep until a tick deadline, or until wakeFromISR() is called
+     * @param deadline Absolute tick count (see now())
+     */
+    void sleepUntil(uint64_t deadline);
+
+    /**
+     * @brief Sleep for a number of milliseconds, or until woken
+     */
+    void sleepFor(uint32_t ms);
+
+    /**
+     * @brief Cut the current sleep short (button edges etc.)
+     */
+    void wakeFromISR();
+
+    /**
+     * @brief Number of times the loop has been woken, for power diagnostics
+     */
+    uint32_t wakeups() const { return _wakeups; }
+
+    /**
+     * @brief Hand a spare compare channel (1-3) to another module
+     * @param handler Runs in the RTC2 ISR when the channel fires, or nullptr
+     * @note The module programs CC[channel] and its INTEN/EVTEN bits itself
+     */
+    void attachCompare(uint8_t channel, RtcCompareHandler handler);
+
+    // Called from RTC2_IRQHandler
+    void onInterrupt();
+
+private:
+    volatile uint32_t _overflows;
+    volatile uint32_t _wakeups;
+    SemaphoreHandle_t _wake;
+    volatile RtcCompareHandler _compareHandlers[RTC_CHANNELS];
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,127 @@
+/**
+ * @file session_totals.h
+ * @brief Per-category time totals by hour and by day
+ *
+ * Answers "how long did I geek today / this week" without replaying raw
+ * events. Totals live in two fixed rings of buckets, one per hour for
+ * the last TOTALS_HOURS hours and one per day for the last TOTALS_DAYS
+ * days. A bucket is found by its hour or day number modulo the ring
+ * size, and a stale one is cleared when its slot is reused, so reading
+ * or crediting any bucket is O(1) and nothing is ever shifted.
+ *
+ * The store follows the same records the event log gets (apply()). Time
+ * is credited to the running category when it stops or switches, and at
+ * each hour boundary while it runs (roll()), so an update never spans
+ * more than one hour. Queries also count the run still in progress.
+ *
+ * Totals are derived entirely from the event log. They are persisted by
+ * replaying the log through apply() at boot, so they need no flash
+ * writes of their own. The replay can only restore what the log still
+ * holds: a busy week of short sessions can wrap the log's pages in less
+ * than the TOTALS_DAYS the day ring spans, and then days before from()
+ * come back partial or empty.
+ *
+ * Times are local epoch seconds, as in the log. The totals assume they
+ * only move forward: a record earlier than the latest one means the
+ * clock started over (the firmware used to restart it at the same time
+ * of day 0 on every boot), and everything credited before it is
+ * dropped, since it can't be placed on the new time line. latest() is
+ * where the clock must resume at boot for that never to happen again.
+ */
+
+#ifndef SESSION_TOTALS_H
+#define SESSION_TOTALS_H
+
+#include <stdint.h>
+#include "log_codec.h"
+#include "stopwatch.h"
+
+#define TOTALS_HOURS            48      // Two days of hourly buckets
+#define TOTALS_DAYS             35      // Five weeks of daily buckets
+#define TOTALS_CATEGORIES       STOPWATCH_MAX_CATEGORIES
+#define TOTALS_EMPTY            UINT32_MAX
+
+struct HourTotals {
+    uint32_t hour;                          // Epoch hour, TOTALS_EMPTY if unused
+    uint16_t seconds[TOTALS_CATEGORIES];    // At most 3600 each
+};
+
+struct DayTotals {
+    uint32_t day;                           // Epoch day, TOTALS_EMPTY if unused
+    uint32_t seconds[TOTALS_CATEGORIES];
+};
+
+class SessionTotals {
+public:
+    SessionTotals();
+
+    void clear();
+
+    /**
+     * @brief Follow a log record: switches, pauses, resets and boots
+     * @note A boot drops the run that was open before it; power was lost
+     *       at some unknown point after its last record
+     */
+    void apply(const LogRecord &record);
+
+    /**
+     * @brief Credit the running category up to time and carry on
+     */
+    void roll(uint32_t time);
+
+    /**
+     * @brief Epoch second of the next hour boundary to roll() at
+     * @return TOTALS_EMPTY if nothing is running
+     */
+    uint32_t nextRoll() const;
+
+    uint8_t active() const { return _active; }
+
+    /**
+     * @brief Time of the oldest record the totals were built from
+     * @return TOTALS_EMPTY if no record has been applied
+     */
+    uint32_t from() const { return _from; }
+
+    /**
+     * @brief Time of the newest record applied, 0 if none
+     */
+    uint32_t latest() const { return _latest; }
+
+    /**
+     * @brief Seconds spent in a category during an epoch hour or day
+     * @param now Current time, counts the run in progress up to it
+     * @return 0 once the bucket has left its ring
+     */
+    uint32_t hourSeconds(uint32_t hour, uint8_t category, uint32_t now) const;
+    uint32_t daySeconds(uint32_t day, uint8_t category, uint32_t now) const;
+
+    /**
+     * @brief Seconds over days consecutive days ending with lastDay
+     */
+    uint32_t daysSeconds(uint32_t lastDay, uint8_t days, uint8_t category, uint32_t now) const;
+
+    /**
+     * @brief Raw buckets, e.g. for sync
+     * @return nullptr if the hour or day has no bucket
+     */
+    const HourTotals *hourBucket(uint32_t hour) const;
+    const DayTotals *dayBucket(uint32_t day) const;
+
+private:
+    HourTotals _hours[TOTALS_HOURS];
+    DayTotals _days[TOTALS_DAYS];
+    uint8_t _active;        // Running category, or STOPWATCH_NONE
+    uint32_t _since;        // Credited up to here
+    uint32_t _from;
+    uint32_t _latest;
+
+    void switchTo(uint8_t category, uint32_t time);
+    void credit(uint32_t from, uint32_t to);
+    void add(uint32_t hour, uint32_t seconds);
+
+    // Seconds of the run in progress within [start, end)
+    uint32_t open(uint8_t category, uint32_t start, uint32_t end, uint32_t now) const;
+};
+
+#endif // SESSION_TOTALS_H
@@ -0,0 +1,84 @@
+/**
+ * @file sharp_spim.h
+ * @brief EasyDMA SPIM frame transport for the Sharp Memory Display
+ *
+ * A whole Sharp write frame (command, lines, trailer) is laid out in RAM
+ * and clocked out by SPIM3 in a single EasyDMA transaction. SPIM3 is the
+ * only nRF52840 SPIM with a hardware CSN, and it supports the active-high
+ * chip select the Sharp panel needs, so the CPU never touches the CS pin
+ * and can sleep for the whole transfer.
+ *
+ * nRF52840 anomaly 198: SPIM3 can clock out corrupted bytes when the CPU
+ * or another EasyDMA master touches the RAM block it is reading from.
+ * The frames stay in ordinary RAM; like nrfx, the driver sets the
+ * workaround register (0x40000E00) to give SPIM3 the blocks a frame
+ * occupies. The bits are held for as long as SPIM3 is enabled, since a
+ * loaded standby frame can be started through PPI at any time, and the
+ * register's previous value is restored when SPIM3 goes idle.
+ *
+ * Note: this takes over SPIM3, which the Arduino SPI object also uses.
+ * Don't mix SPI.transfer() calls with this transport.
+ */
+
+#ifndef SHARP_SPIM_H
+#define SHARP_SPIM_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// SPIM3 clock, see FREQUENCY in begin()
+#define SHARP_SPIM_HZ       500000
+
+class SharpSpim {
+public:
+    SharpSpim();
+
+    /**
+     * @brief Configure SPIM3 pins, mode and hardware chip select
+     * @param sck SPI clock pin
+     * @param mosi SPI data pin
+     * @param cs Chip select pin (driven active-high by SPIM3)
+     */
+    void begin(uint8_t sck, uint8_t mosi, uint8_t cs);
+
+    /**
+     * @brief Start clocking out a frame, returns immediately
+     * @param frame Frame bytes, must stay valid and unmodified until done
+     * @param len Frame length in bytes
+     * @note Waits for any transfer still in flight first
+     */
+    void start(const uint8_t* frame, size_t len);
+
+    /**
+     * @brief Sleep until the current transfer has finished
+     */
+    void wait();
+
+    bool busy() const { return _busy; }
+
+    /**
+     * @brief Frame to leave loaded between transfers, or nullptr for none
+     *
+     * While a standby frame is set SPIM3 stays enabled with TXD pointing at
+     * it, so a PPI-triggered START sends it without any CPU involvement.
+     * Safe to call from an ISR; takes effect once the current transfer ends.
+     */
+    void setStandby(const uint8_t* frame, size_t len);
+
+    // PPI task endpoint that starts the loaded frame
+    uint32_t startTask() const { return (uint32_t)&NRF_SPIM3->TASKS_START; }
+
+    // Called from SPIM3_IRQHandler
+    void onEnd();
+
+private:
+    volatile bool _busy;
+    const uint8_t* volatile _standby;
+    volatile size_t _standbyLen;
+    SemaphoreHandle_t _done;
+    uint32_t _ramPriorityIdle;  // Anomaly 198 register value while idle
+
+    void idle();            // Disable SPIM3 until the next frame
+};
+
+#endif // SHARP_SPIM_H
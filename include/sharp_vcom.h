@@ -0,0 +1,71 @@
+/**
+ * @file sharp_vcom.h
+ * @brief Background VCOM inversion for the Sharp Memory Display
+ *
+ * The panel's common electrode has to be inverted periodically or the
+ * liquid crystal picks up a DC bias. Instead of the main loop sending a
+ * VCOM frame every second, RTC2 compare channel 1 is routed through PPI
+ * to the hardware:
+ *
+ * - Serial VCOM (default): the compare event starts SPIM3, which clocks
+ *   out a prebuilt 2-byte VCOM frame with hardware chip select.
+ * - EXTCOMIN (DISPLAY_EXTCOMIN_PIN defined, panel EXTMODE tied high): the
+ *   compare event toggles the EXTCOMIN pin through a GPIOTE task.
+ *
+ * The RTC compare does not reload itself, so a short RTC2 interrupt moves
+ * the compare on by one period and points SPIM3 at the frame with the
+ * opposite polarity. No task wakes up and the main loop can sleep through
+ * any number of inversions.
+ */
+
+#ifndef SHARP_VCOM_H
+#define SHARP_VCOM_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "scheduler.h"
+#include "sharp_spim.h"
+
+// RTC2 compare channel driving the inversion (0 is the scheduler's)
+#define VCOM_RTC_CHANNEL        1
+
+class SharpVcom {
+public:
+    SharpVcom();
+
+    /**
+     * @brief Start inverting VCOM in the background
+     * @param spim Transport the serial VCOM frames go out on
+     * @param rtc Running scheduler, owner of RTC2
+     * @param hz Inversions per second
+     */
+    void begin(SharpSpim& spim, TicklessScheduler& rtc, uint8_t hz);
+    void end();
+
+    bool running() const { return _running; }
+
+    /**
+     * @brief VCOM bit the panel currently has, for frames sent in between
+     */
+    bool polarity() const { return _polarity; }
+
+    /**
+     * @brief Keep the next inversion clear of a foreground frame
+     * @param len Length of the frame about to be started, in bytes
+     * @note Call from the task, after the previous frame has finished
+     */
+    void beforeTransfer(size_t len);
+
+    // Called from RTC2_IRQHandler on compare channel 1
+    void onCompare();
+
+private:
+    SharpSpim* _spim;
+    uint32_t _period;           // RTC ticks between inversions
+    volatile uint32_t _lastCompare;
+    volatile bool _polarity;
+    bool _running;
+    uint8_t _frames[2][2];      // VCOM low / high frames
+};
+
+#endif // SHARP_VCOM_H
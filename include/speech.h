@@ -0,0 +1,123 @@
+/**
+ * @file speech.h
+ * @brief Spoken durations built from one clip per word
+ *
+ * SpeechPhrase turns a number or a duration into a list of dictionary
+ * words ("two hours fifteen minutes"), so flash holds about forty short
+ * word clips instead of a recording for every phrase. It is plain data
+ * and does no I/O, so the word sequences can be checked on a host.
+ *
+ * SpeechPlayer speaks a phrase as a single mixer voice. Its producer
+ * walks the word list inside the I2S refill: when a clip runs out part
+ * way through a buffer, the next clip's decoder starts in the same
+ * buffer, so words follow each other with no gap and no dependence on
+ * when the main loop gets to run.
+ *
+ * The dictionary is an array of clips indexed by SpeechWord, generated
+ * from one WAV per word by wav2adpcm.py --speech. Words without a clip
+ * are skipped.
+ */
+
+#ifndef SPEECH_H
+#define SPEECH_H
+
+#include <Arduino.h>
+#include "adpcm.h"
+#include "audio.h"
+
+#define SPEECH_MAX_WORDS    16
+#define SPEECH_MAX_NUMBER   999     // Larger numbers are clamped
+
+// Dictionary order; wav2adpcm.py --speech keeps the same list
+enum SpeechWord : uint8_t {
+    WORD_ZERO, WORD_ONE, WORD_TWO, WORD_THREE, WORD_FOUR,
+    WORD_FIVE, WORD_SIX, WORD_SEVEN, WORD_EIGHT, WORD_NINE,
+    WORD_TEN, WORD_ELEVEN, WORD_TWELVE, WORD_THIRTEEN, WORD_FOURTEEN,
+    WORD_FIFTEEN, WORD_SIXTEEN, WORD_SEVENTEEN, WORD_EIGHTEEN, WORD_NINETEEN,
+    WORD_TWENTY, WORD_THIRTY, WORD_FORTY, WORD_FIFTY,
+    WORD_SIXTY, WORD_SEVENTY, WORD_EIGHTY, WORD_NINETY,
+    WORD_HUNDRED,
+    WORD_HOUR, WORD_HOURS,
+    WORD_MINUTE, WORD_MINUTES,
+    WORD_SECOND, WORD_SECONDS,
+    PHRASE_GEEKING_FOR,     // "You have been geeking for"
+    PHRASE_LIVING_FOR,      // "You have been living for"
+    SPEECH_WORD_COUNT
+};
+
+class SpeechPhrase {
+public:
+    SpeechPhrase() : _count(0) {}
+
+    void clear() { _count = 0; }
+
+    /**
+     * @return false if the phrase is full
+     */
+    bool add(SpeechWord word);
+
+    /**
+     * @brief Append a number in words, e.g. 115 = "one hundred fifteen"
+     */
+    bool addNumber(uint16_t n);
+
+    /**
+     * @brief Append "H hours M minutes", leaving out zero parts
+     * @note Seconds are only spoken when there are no hours or minutes
+     */
+    bool addDuration(uint32_t hours, uint8_t minutes, uint8_t seconds);
+
+    /**
+     * @brief Append an elapsed time in seconds as addDuration() words
+     */
+    bool addElapsed(uint32_t seconds);
+
+    uint8_t count() const { return _count; }
+    SpeechWord word(uint8_t i) const { return _words[i]; }
+
+private:
+    SpeechWord _words[SPEECH_MAX_WORDS];
+    uint8_t _count;
+
+    bool addUnit(uint32_t n, SpeechWord one, SpeechWord many);
+};
+
+class SpeechPlayer {
+public:
+    SpeechPlayer();
+
+    /**
+     * @param dictionary SPEECH_WORD_COUNT clips indexed by SpeechWord
+     */
+    void begin(GeekWatchAudio &audio, const AdpcmClip *const *dictionary);
+
+    /**
+     * @brief Speak a phrase, replacing the one being spoken
+     * @return false if nothing in it has a clip or the mixer refused it
+     */
+    bool say(const SpeechPhrase &phrase, AudioPriority priority = AUDIO_PRIORITY_HIGH);
+
+    void stop();
+
+    bool speaking() const;
+
+private:
+    GeekWatchAudio *_audio;
+    const AdpcmClip *const *_dictionary;
+    VoiceHandle _voice;
+
+    // Read by the producer in the I2S interrupt while the voice is active
+    SpeechPhrase _phrase;
+    uint8_t _next;          // Word after the one being decoded
+    AdpcmDecoder _decoder;
+
+    /**
+     * @brief Point the decoder at the next word that has a clip
+     * @return false at the end of the phrase
+     */
+    bool nextClip();
+
+    static size_t producer(int16_t *buffer, size_t numSamples, void *context);
+};
+
+#endif // SPEECH_H
@@ -0,0 +1,84 @@
+/**
+ * @file stopwatch.h
+ * @brief Timestamp-based stopwatch engine for N time categories
+ *
+ * Each category entry stores the ticks accumulated by finished runs plus
+ * the timestamp its current run started at. Nothing is incremented while a
+ * stopwatch runs; elapsed time is derived from the free-running RTC tick
+ * count only when someone asks (usually the display), so there is no
+ * per-second work and no drift from late or missed loop iterations.
+ *
+ * Timestamps are whatever monotonic tick count the caller passes in
+ * (TicklessScheduler::now() on the watch), at STOPWATCH_TICK_HZ.
+ */
+
+#ifndef STOPWATCH_H
+#define STOPWATCH_H
+
+#include <stdint.h>
+
+#define STOPWATCH_MAX_CATEGORIES    4
+#define STOPWATCH_NONE              0xFF
+#define STOPWATCH_TICK_HZ           32768
+
+// Display limit, same as the old 99:59:59 clamp
+#define STOPWATCH_MAX_SECONDS       (99UL * 3600 + 59 * 60 + 59)
+
+struct StopwatchEntry {
+    uint64_t accumulated;   // Ticks from finished runs
+    uint64_t startedAt;     // Start of the current run, if running
+    bool running;
+};
+
+struct StopwatchTime {
+    uint8_t hours;
+    uint8_t minutes;
+    uint8_t seconds;
+};
+
+class StopwatchEngine {
+public:
+    /**
+     * @param count Number of categories in use (1..STOPWATCH_MAX_CATEGORIES)
+     */
+    explicit StopwatchEngine(uint8_t count);
+
+    uint8_t count() const { return _count; }
+    uint8_t active() const { return _active; }
+    bool isRunning(uint8_t id) const { return id < _count && _entries[id].running; }
+    bool anyRunning() const { return _active != STOPWATCH_NONE; }
+
+    /**
+     * @brief Make id the running category, pausing the previous one
+     * @param id Category, or STOPWATCH_NONE to pause everything
+     */
+    void switchTo(uint8_t id, uint64_t now);
+
+    /**
+     * @brief Advance to the next category (or start the first one)
+     * @return The category now running
+     */
+    uint8_t cycle(uint64_t now);
+
+    /**
+     * @brief Pause all categories and zero their totals
+     */
+    void reset();
+
+    uint64_t elapsedTicks(uint8_t id, uint64_t now) const;
+    uint32_t elapsedSeconds(uint8_t id, uint64_t now) const;
+    StopwatchTime elapsed(uint8_t id, uint64_t now) const;
+
+    /**
+     * @brief Tick at which the running category's seconds next change
+     * @return Absolute tick, or UINT64_MAX if nothing is running
+     */
+    uint64_t nextSecond(uint64_t now) const;
+
+private:
+    StopwatchEntry _entries[STOPWATCH_MAX_CATEGORIES];
+    uint8_t _count;
+    uint8_t _active;        // Only one category runs at a time
+};
+
+#endif // STOPWATCH_H
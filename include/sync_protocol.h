@@ -0,0 +1,196 @@
+/**
+ * @file sync_protocol.h
+ * @brief Transport-independent framing and resume logic for log sync
+ *
+ * Moves event log records to a client in packets sized to whatever the
+ * link carries per notification (ATT MTU - 3 over BLE). Nothing here
+ * knows about the radio: the BLE service (ble_sync.h) feeds control
+ * writes to command() and sends what nextPacket() builds, and the host
+ * loopback tool (tools/sync_loopback.cpp) runs the same code against a
+ * modelled link.
+ *
+ * Client to watch, little endian:
+ *
+ *   START  0x01 | fromSeq (4) | window (1)
+ *   ACK    0x02 | nextSeq (4)      everything before nextSeq is stored
+ *   STOP   0x03
+ *
+ * Watch to client:
+ *
+ *   DATA   0x10 | count (1) | firstSeq (4) | baseTime (4) | records
+ *   END    0x11 | nextSeq (4)      caught up, nothing newer yet
+ *
+ * Records are coded as in the flash log (log_codec.h): a tag byte and a
+ * zigzag varint of seconds since the record before, the first one since
+ * baseTime. Sequence numbers are consecutive within a packet; a gap (a
+ * torn frame, or records lost to page rotation before fromSeq) starts a
+ * new packet.
+ *
+ * At most window DATA packets are unacknowledged at a time. ACKs are
+ * cumulative, and the highest one is the resume cursor: a START from
+ * SYNC_RESUME carries on after it, e.g. after a dropped connection.
+ * Anything sent but not acknowledged is sent again.
+ */
+
+#ifndef SYNC_PROTOCOL_H
+#define SYNC_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "log_codec.h"
+
+#define SYNC_MTU_MAX            247                 // ATT MTU asked for
+#define SYNC_PAYLOAD_MAX        (SYNC_MTU_MAX - 3)  // Notification payload at that MTU
+#define SYNC_PAYLOAD_MIN        20                  // At the default 23-byte MTU
+#define SYNC_WINDOW_MAX         16                  // DATA packets in flight
+#define SYNC_COMMAND_MAX        6                   // Longest control write
+#define SYNC_DATA_HEADER        10
+#define SYNC_RESUME             0xFFFFFFFF          // START fromSeq: after the last ACK
+
+enum SyncOpcode : uint8_t {
+    SYNC_CMD_START = 0x01,
+    SYNC_CMD_ACK   = 0x02,
+    SYNC_CMD_STOP  = 0x03,
+    SYNC_PKT_DATA  = 0x10,
+    SYNC_PKT_END   = 0x11,
+};
+
+struct SyncStats {
+    uint32_t packets;       // DATA packets built, resends included
+    uint32_t records;
+    uint32_t bytes;         // Notification payload, END included
+    uint32_t rewinds;       // Unacknowledged packets given up and sent again
+};
+
+/**
+ * Where records come from: the flash log on the watch, anything on a host
+ */
+class SyncSource {
+public:
+    virtual ~SyncSource() {}
+
+    /**
+     * @brief Position at seq, or the oldest record after it still held
+     */
+    virtual void seek(uint32_t seq) = 0;
+
+    /**
+     * @brief Read a record and move past it
+     * @return false if there is none yet; may return true on a later call
+     */
+    virtual bool next(LogRecord &record) = 0;
+};
+
+/**
+ * Watch side of a sync: commands in, packets out
+ */
+class SyncSession {
+public:
+    SyncSession();
+
+    void begin(SyncSource &source);
+
+    /**
+     * @brief Notification payload the link carries now (MTU - 3)
+     */
+    void setPayload(uint16_t bytes);
+
+    /**
+     * @brief Handle a control write from the client
+     * @return false if it was malformed and ignored
+     */
+    bool command(const uint8_t *data, size_t len);
+
+    /**
+     * @brief Build the next notification, if the window allows one
+     * @param out At least SYNC_PAYLOAD_MAX bytes
+     * @return Its length, 0 if there is nothing to send now
+     */
+    size_t nextPacket(uint8_t *out);
+
+    /**
+     * @brief Send everything unacknowledged again, e.g. after a failed send
+     */
+    void rewind();
+
+    /**
+     * @brief The link went away; the resume cursor is kept
+     */
+    void stop();
+
+    bool running() const { return _running; }
+
+    /**
+     * @brief END sent and every DATA packet acknowledged
+     */
+    bool caughtUp() const { return _running && _endSent && _inflightCount == 0; }
+
+    uint32_t acked() const { return _acked; }
+    const SyncStats &stats() const { return _stats; }
+
+private:
+    SyncSource *_source;
+    uint16_t _payload;
+    uint8_t _window;
+    bool _running;
+    bool _endSent;          // Since the last DATA packet
+    uint32_t _acked;        // Resume cursor: the client has everything before it
+    uint32_t _sent;         // seq after the last record sent
+
+    // End seq of each unacknowledged DATA packet, oldest first
+    uint32_t _inflight[SYNC_WINDOW_MAX];
+    uint8_t _inflightFirst;
+    uint8_t _inflightCount;
+
+    LogRecord _pending;     // Read from the source but not sent yet
+    bool _hasPending;
+
+    SyncStats _stats;
+
+    void restart(uint32_t from);
+    size_t endPacket(uint8_t *out);
+};
+
+typedef void (*SyncRecordHandler)(const LogRecord &record, void *context);
+
+/**
+ * Client side: decodes packets and writes the commands, used by the
+ * loopback tool and as the reference for companion apps
+ */
+class SyncClient {
+public:
+    SyncClient();
+
+    void begin(SyncRecordHandler handler, void *context);
+
+    /**
+     * @return Command length
+     */
+    size_t start(uint8_t *out, uint32_t fromSeq, uint8_t window);
+    size_t ack(uint8_t *out) const;
+    size_t stop(uint8_t *out) const;
+
+    /**
+     * @brief Decode a notification and hand its new records over
+     * @return false if it was malformed
+     */
+    bool receive(const uint8_t *data, size_t len);
+
+    uint32_t nextSeq() const { return _nextSeq; }
+    bool caughtUp() const { return _caughtUp; }
+    uint32_t records() const { return _records; }
+    uint32_t duplicates() const { return _duplicates; }
+    uint32_t gaps() const { return _gaps; }
+
+private:
+    SyncRecordHandler _handler;
+    void *_context;
+    uint32_t _nextSeq;      // Expected next, all before it handed over
+    bool _started;
+    bool _caughtUp;
+    uint32_t _records;
+    uint32_t _duplicates;   // Resent records already handed over
+    uint32_t _gaps;         // Records missing on the watch
+};
+
+#endif // SYNC_PROTOCOL_H
@@ -0,0 +1,86 @@
+/**
+ * @file synth.h
+ * @brief Fixed-point wavetable oscillator with attack/decay envelope
+ *
+ * A 32-bit phase accumulator steps through a 256-entry Q15 wavetable;
+ * the top 8 bits pick the entry and the next 15 interpolate linearly to
+ * its neighbour, so tones are clean without a float sin() per sample.
+ * Every tone ramps up over SYNTH_ATTACK_MS and back down over
+ * SYNTH_DECAY_MS before it ends, which removes the click a square edge
+ * makes when the amp starts or stops mid-cycle.
+ *
+ * The default table is a sine built at compile time, so it lives in
+ * flash with no startup cost.
+ */
+
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <Arduino.h>
+
+#define SYNTH_TABLE_BITS    8
+#define SYNTH_TABLE_SIZE    (1 << SYNTH_TABLE_BITS)
+#define SYNTH_AMPLITUDE     8192    // -12dBFS, Q15
+#define SYNTH_ATTACK_MS     5
+#define SYNTH_DECAY_MS      20
+
+// One full cycle plus a copy of entry 0, so interpolation never wraps
+struct Wavetable {
+    int16_t entries[SYNTH_TABLE_SIZE + 1];
+};
+
+extern const Wavetable sineWave;
+
+class ToneSynth {
+public:
+    ToneSynth();
+
+    /**
+     * @brief Use another waveform for the following tones
+     */
+    void setWavetable(const Wavetable &table) { _table = table.entries; }
+
+    /**
+     * @brief Start a tone, replacing any that is playing
+     * @param amplitude Envelope peak, Q15
+     */
+    void start(uint16_t frequency, uint32_t durationMs, uint32_t sampleRate,
+               int16_t amplitude = SYNTH_AMPLITUDE);
+
+    /**
+     * @brief Begin the decay now instead of at the end of the tone
+     */
+    void release();
+
+    /**
+     * @brief Generate the next samples
+     * @return Samples written, 0 once the tone has ended
+     */
+    size_t render(int16_t *out, size_t maxSamples);
+
+    bool active() const { return _left > 0; }
+
+private:
+    enum Stage : uint8_t {
+        ATTACK,
+        SUSTAIN,
+        DECAY,
+    };
+
+    const int16_t *_table;
+    uint32_t _phase;
+    uint32_t _step;         // Phase increment per sample
+    uint32_t _left;         // Samples until silence
+    uint32_t _decayLength;  // Samples the decay takes
+    Stage _stage;
+
+    // Envelope level in Q15 << 8, so short ramps still move every sample
+    int32_t _level;
+    int32_t _peak;
+    int32_t _attackStep;
+    int32_t _decayStep;
+
+    void beginDecay();
+};
+
+#endif // SYNTH_H
@@ -0,0 +1,123 @@
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timer wheel for reminders, nags and timeouts
+ *
+ * Timers are caller-owned nodes linked into one of TIMER_WHEEL_LEVELS
+ * wheels of 64 slots. A slot at level 0 covers one granule of
+ * 2^TIMER_WHEEL_SHIFT RTC ticks and each level up covers 64 times as
+ * much, so a timer is filed in the coarsest slot that still separates it
+ * from now. Starting and cancelling a timer is a list insert or unlink,
+ * O(1) whatever the number of timers. As time passes, a higher slot is
+ * re-filed into the levels below once the cursor reaches it. The top
+ * wheel wraps, its slots behind the cursor holding the next lap, and a
+ * timer further out than that waits in the last of them to be re-filed.
+ *
+ * A 64-bit occupancy mask per level lets advance() jump straight over
+ * empty time instead of stepping through every granule, and lets
+ * nextDeadline() find the earliest timer by looking at one slot per
+ * level, or on the top wheel the first few. That deadline is the exact tick it was set for, so the loop can
+ * program one RTC compare for it and sleep instead of polling timeouts.
+ *
+ * Callbacks run from advance() in the caller's context, typically the
+ * main loop, in the order the timers were due, and may start or cancel
+ * any timer, including their own. Nothing here is ISR safe.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+#define TIMER_WHEEL_SHIFT       10      // Granule = 1024 ticks = 31.25ms
+#define TIMER_WHEEL_LEVELS      5       // 2^30 granules, about a year
+#define TIMER_WHEEL_SLOTS       64
+
+class WheelTimer;
+typedef void (*WheelCallback)(WheelTimer& timer);
+
+class WheelTimer {
+public:
+    WheelTimer(WheelCallback callback = nullptr, void* context = nullptr)
+        : callback(callback), context(context), _next(nullptr), _prev(nullptr),
+          _expires(0), _period(0), _level(TIMER_IDLE), _slot(0) {}
+
+    WheelCallback callback;
+    void* context;
+
+    bool active() const { return _level != TIMER_IDLE; }
+
+    /**
+     * @brief Tick the timer is due at; next due tick for a repeating timer
+     */
+    uint64_t expires() const { return _expires; }
+
+private:
+    friend class TimerWheel;
+
+    enum : uint8_t {
+        TIMER_IDLE = 0xFF,
+        TIMER_FIRING = 0xFE,    // On the due list, about to be called back
+    };
+
+    WheelTimer* _next;
+    WheelTimer* _prev;
+    uint64_t _expires;
+    uint64_t _period;       // Ticks, 0 = one-shot
+    uint8_t _level;
+    uint8_t _slot;
+};
+
+class TimerWheel {
+public:
+    TimerWheel();
+
+    /**
+     * @brief Start the wheel at the current RTC tick
+     */
+    void begin(uint64_t now);
+
+    /**
+     * @brief (Re)start a timer
+     * @param expires Absolute RTC tick; a tick already past fires on the
+     *                next advance()
+     * @param period Repeat every this many ticks after that, 0 = once
+     */
+    void start(WheelTimer& timer, uint64_t expires, uint64_t period = 0);
+
+    /**
+     * @brief Stop a timer, no-op if it isn't running
+     */
+    void cancel(WheelTimer& timer);
+
+    /**
+     * @brief Run the callback of every timer due at or before now
+     * @return Number of callbacks run
+     */
+    uint16_t advance(uint64_t now);
+
+    /**
+     * @brief Tick the earliest timer is due at, UINT64_MAX if none is running
+     */
+    uint64_t nextDeadline() const;
+
+    uint16_t count() const { return _count; }
+
+private:
+    WheelTimer* _slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t _occupied[TIMER_WHEEL_LEVELS];     // Bit per non-empty slot
+    uint64_t _cursor;       // Granule being processed, earlier ones are done
+    WheelTimer* _due;       // Timers about to be called back
+    uint16_t _count;
+
+    void file(WheelTimer& timer);
+    void unlink(WheelTimer& timer);
+    void cascade(uint8_t level);
+    void collect(uint64_t now);
+
+    /**
+     * @brief First granule after the cursor at which a slot needs work
+     */
+    uint64_t nextGranule() const;
+};
+
+#endif // TIMER_WHEEL_H
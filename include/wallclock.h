@@ -0,0 +1,79 @@
+/**
+ * @file wallclock.h
+ * @brief Wall-clock time derived on demand from the 32.768kHz RTC
+ *
+ * Nothing counts seconds. The clock keeps an anchor (an RTC tick and the
+ * epoch second it corresponds to) and works out the current time from
+ * the extended RTC tick count only when asked. A ppm trim corrects for
+ * crystal error, so the CPU never has to wake up just to keep time.
+ *
+ * Ticks are the monotonic, overflow-extended count from
+ * TicklessScheduler::now(); the 24-bit hardware counter itself wraps
+ * every 512 seconds.
+ */
+
+#ifndef WALLCLOCK_H
+#define WALLCLOCK_H
+
+#include <stdint.h>
+
+#define WALLCLOCK_TICK_HZ       32768
+#define SECONDS_PER_DAY         86400UL
+
+struct WallTime {
+    uint8_t hours;          // 1-12
+    uint8_t minutes;
+    uint8_t seconds;
+    bool isPM;
+};
+
+class WallClock {
+public:
+    WallClock();
+
+    /**
+     * @brief Set the time
+     * @param epochSeconds Local time as seconds since 1970-01-01
+     * @param now Current RTC tick
+     */
+    void setTime(uint32_t epochSeconds, uint64_t now);
+
+    /**
+     * @brief Set the time of day, keeping the current date
+     * @param hours 0-23
+     */
+    void setTimeOfDay(uint8_t hours, uint8_t minutes, uint8_t seconds, uint64_t now);
+
+    /**
+     * @brief Crystal trim in parts per million
+     * @param ppm Positive if the RTC runs slow (time is added)
+     * @note Re-anchors at now so the correction doesn't apply retroactively
+     */
+    void setTrimPpm(int32_t ppm, uint64_t now);
+    int32_t trimPpm() const { return _trimPpm; }
+
+    /**
+     * @brief Local epoch seconds at an RTC tick
+     */
+    uint32_t epochSeconds(uint64_t now) const;
+
+    /**
+     * @brief Time of day (12-hour) at an RTC tick
+     */
+    WallTime timeOfDay(uint64_t now) const;
+
+    /**
+     * @brief First RTC tick at which epochSeconds() moves past its value at now
+     */
+    uint64_t nextSecond(uint64_t now) const;
+
+private:
+    uint64_t _anchorTicks;      // RTC tick the anchor was taken at
+    uint64_t _anchorTime;       // Corrected time at the anchor, in ticks since epoch
+    int32_t _trimPpm;
+
+    // Trim-corrected ticks since the epoch at an RTC tick
+    uint64_t correctedTicks(uint64_t now) const;
+};
+
+#endif // WALLCLOCK_H
@@ -0,0 +1,149 @@
+/**
+ * @file widgets.h
+ * @brief Retained-mode widgets with damage tracking for the watch face
+ *
+ * Each widget caches the value it last rendered. Setting a new value
+ * compares it against the cache and records a damage rectangle covering
+ * only the glyph cells that changed; render() then redraws just those
+ * cells. Since the framebuffer is no longer cleared every frame, the
+ * display driver only sees (and sends) the rows that were redrawn.
+ *
+ * Widgets are statically allocated by the caller; nothing here uses the heap.
+ */
+
+#ifndef WIDGETS_H
+#define WIDGETS_H
+
+#include <Arduino.h>
+#include "display_sharp.h"
+
+#define LABEL_MAX_CHARS     24
+
+struct Rect {
+    int16_t x, y, w, h;
+
+    bool empty() const { return w <= 0 || h <= 0; }
+    bool intersects(const Rect& o) const;
+    void unite(const Rect& o);
+};
+
+class Widget {
+public:
+    Widget(int16_t x, int16_t y, int16_t w, int16_t h);
+
+    const Rect& bounds() const { return _bounds; }
+    const Rect& damage() const { return _damage; }
+    bool isDamaged() const { return !_damage.empty(); }
+
+    /**
+     * @brief Redraw everything on the next render()
+     */
+    void invalidate();
+
+    /**
+     * @brief Redraw the damaged parts and clear the damage
+     */
+    void render(SharpDisplay& display);
+
+protected:
+    Rect _bounds;
+    Rect _damage;
+    bool _full;             // Whole widget needs redrawing
+
+    void addDamage(int16_t x, int16_t y, int16_t w, int16_t h);
+
+    /**
+     * @brief Draw the widget
+     * @param full Bounds have just been cleared, draw everything
+     */
+    virtual void draw(SharpDisplay& display, bool full) = 0;
+};
+
+/**
+ * @brief HH:MM:SS readout, digits at 6 pixel advance with narrow colons
+ */
+class TimeWidget : public Widget {
+public:
+    TimeWidget(int16_t x, int16_t y, uint8_t scale);
+
+    void set(uint8_t hours, uint8_t minutes, uint8_t seconds);
+
+protected:
+    void draw(SharpDisplay& display, bool full) override;
+
+private:
+    uint8_t _scale;
+    uint8_t _digits[6];
+    uint8_t _changed;       // Bit per digit cell
+
+    int16_t cellX(uint8_t i) const;
+};
+
+/**
+ * @brief Fixed-width text, only changed characters are redrawn
+ */
+class LabelWidget : public Widget {
+public:
+    LabelWidget(int16_t x, int16_t y, uint8_t maxChars, uint8_t scale);
+
+    void setText(const char* text);
+
+protected:
+    void draw(SharpDisplay& display, bool full) override;
+
+private:
+    uint8_t _scale;
+    uint8_t _maxChars;
+    char _text[LABEL_MAX_CHARS];
+    uint32_t _changed;      // Bit per character cell
+};
+
+/**
+ * @brief Boxed message with a single-digit countdown
+ */
+class DialogWidget : public Widget {
+public:
+    DialogWidget(int16_t x, int16_t y, int16_t w, int16_t h, const char* message);
+
+    void setCountdown(uint8_t digit);
+
+protected:
+    void draw(SharpDisplay& display, bool full) override;
+
+private:
+    const char* _message;
+    uint8_t _countdown;
+
+    int16_t countdownX() const;
+    int16_t countdownY() const;
+};
+
+/**
+ * @brief Fixed set of widgets plus an optional modal dialog on top
+ *
+ * While the modal is shown, widgets underneath it keep their damage and
+ * are redrawn in full once it closes.
+ */
+class WidgetScreen {
+public:
+    WidgetScreen(Widget* const* widgets, uint8_t count, Widget* modal = nullptr);
+
+    void invalidate();
+    void showModal(bool show);
+    bool modalVisible() const { return _modalVisible; }
+
+    /**
+     * @brief Render all damaged widgets
+     * @return true if anything was drawn
+     */
+    bool render(SharpDisplay& display);
+
+private:
+    Widget* const* _widgets;
+    uint8_t _count;
+    Widget* _modal;
+    bool _modalVisible;
+    bool _modalChanged;
+};
+
+#endif // WIDGETS_H
@@ -0,0 +1,105 @@
+/**
+ * @file adpcm.cpp
+ * @brief Implementation of the streaming IMA-ADPCM decoder
+ */
+
+#include "adpcm.h"
+
+static const int16_t stepTable[89] = {
+        7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+       19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+       50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+      130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+      337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+      876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+     2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+     5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t indexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+AdpcmDecoder::AdpcmDecoder()
+    : _clip(nullptr), _next(nullptr), _nibbles(nullptr), _left(0), _blockLeft(0),
+      _highNibble(false), _predictor(0), _stepIndex(0) {
+}
+
+void AdpcmDecoder::begin(const AdpcmClip *clip) {
+    _clip = clip;
+    _next = clip ? clip->data : nullptr;
+    _left = clip ? clip->numSamples : 0;
+    _blockLeft = 0;
+}
+
+size_t AdpcmDecoder::read(int16_t *out, size_t maxSamples) {
+    size_t produced = 0;
+    
+    while (produced < maxSamples && _left) {
+        if (_blockLeft == 0) {
+            // Block header: first sample verbatim, then the step index
+            const uint8_t *block = _next;
+            _predictor = (int16_t)(block[0] | (block[1] << 8));
+            _stepIndex = block[2] > 88 ? 88 : block[2];
+            _nibbles = block + ADPCM_HEADER_BYTES;
+            _highNibble = false;
+            _blockLeft = adpcmBlockSamples(_clip->blockBytes) - 1;
+            _next = block + _clip->blockBytes;
+            
+            out[produced++] = _predictor;
+            _left--;
+            continue;
+        }
+        
+        size_t run = maxSamples - produced;
+        if (run > _blockLeft) run = _blockLeft;
+        if (run > _left) run = _left;
+        _blockLeft -= run;
+        _left -= run;
+        
+        // Work on locals so the loop stays in registers
+        const uint8_t *in = _nibbles;
+        bool high = _highNibble;
+        int32_t predictor = _predictor;
+        int32_t index = _stepIndex;
+        int16_t *dst = out + produced;
+        produced += run;
+        
+        while (run--) {
+            uint8_t nibble;
+            if (high) {
+                nibble = *in++ >> 4;
+            } else {
+                nibble = *in & 0x0F;
+            }
+            high = !high;
+            
+            int32_t step = stepTable[index];
+            int32_t diff = step >> 3;
+            if (nibble & 4) diff += step;
+            if (nibble & 2) diff += step >> 1;
+            if (nibble & 1) diff += step >> 2;
+            predictor += (nibble & 8) ? -diff : diff;
+            if (predictor > 32767) predictor = 32767;
+            else if (predictor < -32768) predictor = -32768;
+            
+            index += indexTable[nibble];
+            if (index < 0) index = 0;
+            else if (index > 88) index = 88;
+            
+            *dst++ = (int16_t)predictor;
+        }
+        
+        _nibbles = in;
+        _highNibble = high;
+        _predictor = (int16_t)predictor;
+        _stepIndex = (uint8_t)index;
+    }
+    return produced;
+}
+
+size_t AdpcmDecoder::producer(int16_t *buffer, size_t numSamples, void *context) {
+    return ((AdpcmDecoder *)context)->read(buffer, numSamples);
+}
@@ -0,0 +1,498 @@
+/**
+ * @file audio.cpp
+ * @brief Implementation of the EasyDMA I2S audio driver
+ */
+
+#include "audio.h"
+#include "dsp.h"
+#include <nrf_sdm.h>
+#include <nrf_soc.h>
+
+// Samples are 16-bit mono, packed two per 32-bit DMA word
+#define AUDIO_BUFFER_WORDS  (AUDIO_BUFFER_SIZE / 2)
+
+// I2S clocking for the supported sample rates (LRCK = MCK / RATIO)
+struct I2SClock {
+    uint32_t sampleRate;
+    uint32_t mckFreq;
+    uint32_t ratio;
+};
+
+static const I2SClock i2sClocks[] = {
+    {  8000, I2S_CONFIG_MCKFREQ_MCKFREQ_32MDIV125, I2S_CONFIG_RATIO_RATIO_32X },  //  8000Hz
+    { 16000, I2S_CONFIG_MCKFREQ_MCKFREQ_32MDIV63,  I2S_CONFIG_RATIO_RATIO_32X },  // 15873Hz
+    { 22050, I2S_CONFIG_MCKFREQ_MCKFREQ_32MDIV15,  I2S_CONFIG_RATIO_RATIO_96X },  // 22222Hz
+    { 32000, I2S_CONFIG_MCKFREQ_MCKFREQ_32MDIV31,  I2S_CONFIG_RATIO_RATIO_32X },  // 32258Hz
+    { 44100, I2S_CONFIG_MCKFREQ_MCKFREQ_32MDIV15,  I2S_CONFIG_RATIO_RATIO_48X },  // 44444Hz
+};
+
+// EasyDMA can only read from RAM, and needs word alignment
+static int16_t audioStorage[NUM_AUDIO_BUFFERS][AUDIO_BUFFER_SIZE] __attribute__((aligned(4)));
+
+static GeekWatchAudio* activeAudio = nullptr;
+
+static void holdoffExpired(TimerHandle_t) {
+    if (activeAudio) {
+        activeAudio->onHoldoffExpired();
+    }
+}
+
+// The HFXO is shared with the SoftDevice's radio once it runs, so request
+// and release it through its API then; it stays up while anyone needs it.
+// Without the SoftDevice the crystal may already be running for someone
+// else (USB CDC for DEBUG_SERIAL and DISPLAY_MIRROR starts it), and
+// stopping it under them kills the port, so only stop what we started
+enum HfxoHold : uint8_t {
+    HFXO_NOT_HELD,
+    HFXO_SOFTDEVICE,    // Requested through the SoftDevice
+    HFXO_STARTED,       // Started here, stopped on release
+    HFXO_BORROWED,      // Was already running, left alone
+};
+
+static HfxoHold hfxoHold = HFXO_NOT_HELD;
+
+static bool hfxoRunning() {
+    uint32_t stat = NRF_CLOCK->HFCLKSTAT;
+    return (stat & CLOCK_HFCLKSTAT_STATE_Msk) &&
+           ((stat & CLOCK_HFCLKSTAT_SRC_Msk) >> CLOCK_HFCLKSTAT_SRC_Pos) == CLOCK_HFCLKSTAT_SRC_Xtal;
+}
+
+static void hfxoRequest() {
+    if (hfxoHold != HFXO_NOT_HELD) return;
+    
+    uint8_t sdEnabled = 0;
+    sd_softdevice_is_enabled(&sdEnabled);
+    if (sdEnabled) {
+        uint32_t running = 0;
+        sd_clock_hfclk_request();
+        do {
+            sd_clock_hfclk_is_running(&running);
+        } while (!running);
+        hfxoHold = HFXO_SOFTDEVICE;
+    } else if (hfxoRunning()) {
+        hfxoHold = HFXO_BORROWED;
+    } else {
+        NRF_CLOCK->EVENTS_HFCLKSTARTED = 0;
+        NRF_CLOCK->TASKS_HFCLKSTART = 1;
+        while (!NRF_CLOCK->EVENTS_HFCLKSTARTED) {
+        }
+        hfxoHold = HFXO_STARTED;
+    }
+}
+
+// Give it back the way it was taken, even if the SoftDevice has changed state since
+static void hfxoRelease() {
+    if (hfxoHold == HFXO_SOFTDEVICE) {
+        sd_clock_hfclk_release();
+    } else if (hfxoHold == HFXO_STARTED) {
+        NRF_CLOCK->TASKS_HFCLKSTOP = 1;
+    }
+    hfxoHold = HFXO_NOT_HELD;
+}
+
+// GAIN strap, only driven while the amp is on
+static void ampGain(uint8_t pin) {
+    #if AUDIO_GAIN_DB == 6
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, HIGH);
+    #elif AUDIO_GAIN_DB == 12
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+    #else
+    pinMode(pin, INPUT);  // Floating = 9dB
+    #endif
+}
+
+GeekWatchAudio::GeekWatchAudio(uint8_t sck, uint8_t lrck, uint8_t din, uint8_t sd, uint8_t gain)
+    : _sck(sck), _lrck(lrck), _din(din), _sdPin(sd), _gainPin(gain), _sampleRate(AUDIO_SAMPLE_RATE),
+      _bitDepth(AUDIO_BIT_DEPTH), _volume(255), _isInitialized(false), _isPlaying(false),
+      _currentBuffer(0), _producer(nullptr), _producerContext(nullptr), _tailBuffers(0),
+      _postrollBuffers(2), _prerollLeft(0), _buffersQueued(0), _done(nullptr),
+      _source(nullptr), _sourceLeft(0), _ampPowered(false), _holdoff(nullptr), _wakeStart(0),
+      _wakePreroll(0), _measureWake(false) {
+    memset(&_powerStats, 0, sizeof(_powerStats));
+    for (uint8_t i = 0; i < NUM_AUDIO_BUFFERS; i++) {
+        _audioBuffer[i] = audioStorage[i];
+    }
+}
+
+bool GeekWatchAudio::begin(uint32_t sampleRate, uint8_t bitDepth) {
+    _sampleRate = sampleRate;
+    _bitDepth = bitDepth;
+    
+    // Buffers are int16_t, 24/32-bit samples would need wider ones
+    if (bitDepth != 16) {
+        #if DEBUG_SERIAL
+        Serial.println("Audio: only 16-bit samples are supported");
+        #endif
+        return false;
+    }
+    
+    if (!configureI2S()) {
+        #if DEBUG_SERIAL
+        Serial.print("Audio: unsupported sample rate ");
+        Serial.println(sampleRate);
+        #endif
+        return false;
+    }
+    
+    // Amp off until something plays
+    pinMode(_sdPin, OUTPUT);
+    digitalWrite(_sdPin, LOW);
+    pinMode(_gainPin, INPUT);
+    _ampPowered = false;
+    
+    // Tail of silent buffers: the last one is cut by STOP, the others
+    // cover the post-roll
+    uint32_t postroll = (uint32_t)(((uint64_t)AUDIO_POSTROLL_MS * sampleRate) / 1000);
+    uint32_t silent = (postroll + AUDIO_BUFFER_SIZE - 1) / AUDIO_BUFFER_SIZE;
+    _postrollBuffers = 1 + (silent ? silent : 1);
+    
+    _mixer.begin(sampleRate);
+    activeAudio = this;
+    if (!_done) {
+        _done = xSemaphoreCreateBinary();
+    }
+    if (!_holdoff) {
+        _holdoff = xTimerCreate("amp", pdMS_TO_TICKS(AUDIO_HOLDOFF_MS), pdFALSE, nullptr,
+                                holdoffExpired);
+    }
+    
+    // Refills must outrank the display transfer so audio never underruns
+    NRF_I2S->EVENTS_TXPTRUPD = 0;
+    NRF_I2S->EVENTS_STOPPED = 0;
+    NRF_I2S->INTENSET = I2S_INTENSET_TXPTRUPD_Msk | I2S_INTENSET_STOPPED_Msk;
+    NVIC_ClearPendingIRQ(I2S_IRQn);
+    NVIC_SetPriority(I2S_IRQn, 2);
+    NVIC_EnableIRQ(I2S_IRQn);
+    
+    _isInitialized = true;
+    return true;
+}
+
+void GeekWatchAudio::end() {
+    if (!_isInitialized) return;
+    
+    stop();
+    NVIC_DisableIRQ(I2S_IRQn);
+    NRF_I2S->INTENCLR = I2S_INTENCLR_TXPTRUPD_Msk | I2S_INTENCLR_STOPPED_Msk;
+    NRF_I2S->ENABLE = I2S_ENABLE_ENABLE_Disabled;
+    if (_holdoff) {
+        xTimerStop(_holdoff, 0);
+    }
+    powerDown();
+    _isInitialized = false;
+}
+
+bool GeekWatchAudio::configureI2S() {
+    const I2SClock* clock = nullptr;
+    for (size_t i = 0; i < sizeof(i2sClocks) / sizeof(i2sClocks[0]); i++) {
+        if (i2sClocks[i].sampleRate == _sampleRate) {
+            clock = &i2sClocks[i];
+            break;
+        }
+    }
+    if (!clock) return false;
+    
+    NRF_I2S->ENABLE = I2S_ENABLE_ENABLE_Disabled;
+    
+    // MAX98357A needs no MCK on a pin, but master mode derives SCK from it
+    NRF_I2S->PSEL.MCK = I2S_PSEL_MCK_CONNECT_Disconnected << I2S_PSEL_MCK_CONNECT_Pos;
+    NRF_I2S->PSEL.SCK = _sck;
+    NRF_I2S->PSEL.LRCK = _lrck;
+    NRF_I2S->PSEL.SDOUT = _din;
+    NRF_I2S->PSEL.SDIN = I2S_PSEL_SDIN_CONNECT_Disconnected << I2S_PSEL_SDIN_CONNECT_Pos;
+    
+    NRF_I2S->CONFIG.MODE = I2S_CONFIG_MODE_MODE_Master;
+    NRF_I2S->CONFIG.TXEN = I2S_CONFIG_TXEN_TXEN_Enabled;
+    NRF_I2S->CONFIG.RXEN = I2S_CONFIG_RXEN_RXEN_Disabled;
+    NRF_I2S->CONFIG.MCKEN = I2S_CONFIG_MCKEN_MCKEN_Enabled;
+    NRF_I2S->CONFIG.MCKFREQ = clock->mckFreq;
+    NRF_I2S->CONFIG.RATIO = clock->ratio;
+    NRF_I2S->CONFIG.SWIDTH = I2S_CONFIG_SWIDTH_SWIDTH_16Bit;
+    NRF_I2S->CONFIG.ALIGN = I2S_CONFIG_ALIGN_ALIGN_Left;
+    NRF_I2S->CONFIG.FORMAT = I2S_CONFIG_FORMAT_FORMAT_I2S;
+    // Mono in the left slot; the amp's SD level picks the channel it plays
+    NRF_I2S->CONFIG.CHANNELS = I2S_CONFIG_CHANNELS_CHANNELS_Left;
+    
+    NRF_I2S->RXTXD.MAXCNT = AUDIO_BUFFER_WORDS;
+    return true;
+}
+
+bool GeekWatchAudio::start(AudioProducer producer, void *context) {
+    if (!_isInitialized || !producer) return false;
+    
+    stop();
+    return startStream(producer, context);
+}
+
+bool GeekWatchAudio::powerUp() {
+    // Cancel first: the timer task outranks us, so after this returns
+    // the hold-off has either been stopped or has already powered down
+    if (_holdoff) {
+        xTimerStop(_holdoff, 0);
+    }
+    if (_ampPowered) {
+        _powerStats.warmStarts++;
+        return false;
+    }
+    
+    hfxoRequest();
+    ampGain(_gainPin);
+    digitalWrite(_sdPin, HIGH);
+    _ampPowered = true;
+    _powerStats.coldStarts++;
+    return true;
+}
+
+void GeekWatchAudio::powerDown() {
+    if (!_ampPowered) return;
+    
+    digitalWrite(_sdPin, LOW);
+    pinMode(_gainPin, INPUT);
+    hfxoRelease();
+    _ampPowered = false;
+}
+
+void GeekWatchAudio::onHoldoffExpired() {
+    if (!_isPlaying) {
+        powerDown();
+    }
+}
+
+bool GeekWatchAudio::startStream(AudioProducer producer, void *context) {
+    _wakeStart = DWT->CYCCNT;
+    
+    // Silence while a cold amp comes out of shutdown
+    _prerollLeft = 0;
+    if (powerUp()) {
+        _prerollLeft = (size_t)(((uint64_t)AUDIO_PREROLL_MS * _sampleRate) / 1000);
+    }
+    _wakePreroll = (uint32_t)(((uint64_t)_prerollLeft * 1000000) / _sampleRate);
+    
+    _producer = producer;
+    _producerContext = context;
+    _measureWake = true;
+    if (!queueFirst()) {
+        _measureWake = false;
+        if (_holdoff) {
+            xTimerStart(_holdoff, 0);  // Nothing to play, power down later
+        }
+    }
+    return true;
+}
+
+bool GeekWatchAudio::queueFirst() {
+    _tailBuffers = 0;
+    _currentBuffer = 0;
+    
+    // Only the first buffer is filled up front, the second is filled when
+    // the first TXPTRUPD says the peripheral has taken this one
+    if (!fillBuffer(0)) return false;
+    
+    NRF_I2S->ENABLE = I2S_ENABLE_ENABLE_Enabled;
+    NRF_I2S->TXD.PTR = (uint32_t)(uintptr_t)_audioBuffer[0];
+    NRF_I2S->RXTXD.MAXCNT = AUDIO_BUFFER_WORDS;
+    NRF_I2S->EVENTS_TXPTRUPD = 0;
+    NRF_I2S->EVENTS_STOPPED = 0;
+    _buffersQueued++;
+    
+    _isPlaying = true;
+    NRF_I2S->TASKS_START = 1;
+    return true;
+}
+
+bool GeekWatchAudio::fillBuffer(uint8_t index) {
+    int16_t *buffer = _audioBuffer[index];
+    size_t offset = 0;
+    if (_prerollLeft) {
+        offset = _prerollLeft < AUDIO_BUFFER_SIZE ? _prerollLeft : AUDIO_BUFFER_SIZE;
+        memset(buffer, 0, offset * sizeof(int16_t));
+        _prerollLeft -= offset;
+    }
+    
+    size_t space = AUDIO_BUFFER_SIZE - offset;
+    size_t written = (_producer && space) ? _producer(buffer + offset, space, _producerContext) : 0;
+    if (written > space) written = space;
+    if (written < space) {
+        memset(buffer + offset + written, 0, (space - written) * sizeof(int16_t));
+    }
+    return written > 0 || _prerollLeft > 0;
+}
+
+void GeekWatchAudio::onInterrupt() {
+    if (NRF_I2S->EVENTS_TXPTRUPD) {
+        NRF_I2S->EVENTS_TXPTRUPD = 0;
+        
+        // The first buffer has started; the real samples follow the pre-roll
+        if (_measureWake) {
+            _measureWake = false;
+            uint32_t us = (DWT->CYCCNT - _wakeStart) / (SystemCoreClock / 1000000) + _wakePreroll;
+            _powerStats.lastWakeUs = us;
+            if (us > _powerStats.maxWakeUs) _powerStats.maxWakeUs = us;
+        }
+        
+        // _currentBuffer has just been latched and is playing, so the
+        // other one is free: refill it and queue it behind
+        if (_tailBuffers) {
+            if (_producer == mixerProducer && _mixer.active()) {
+                // A voice was added during the post-roll: mix again
+                _tailBuffers = 0;
+            } else if (--_tailBuffers == 0) {
+                // Producer is done: count the silent post-roll buffers
+                // down, stop once the last one has been latched
+                NRF_I2S->TASKS_STOP = 1;
+                return;
+            }
+        }
+        
+        uint8_t next = _currentBuffer ^ 1;
+        if (_tailBuffers) {
+            memset(_audioBuffer[next], 0, AUDIO_BUFFER_SIZE * sizeof(int16_t));
+        } else if (!fillBuffer(next)) {
+            _tailBuffers = _postrollBuffers;
+        }
+        NRF_I2S->TXD.PTR = (uint32_t)(uintptr_t)_audioBuffer[next];
+        _currentBuffer = next;
+        _buffersQueued++;
+    }
+    
+    if (NRF_I2S->EVENTS_STOPPED) {
+        NRF_I2S->EVENTS_STOPPED = 0;
+        
+        // A voice was added after the last refill asked for the stop; the
+        // amp is still up, so start straight over without a pre-roll
+        if (_producer == mixerProducer && _mixer.active() && queueFirst()) {
+            return;
+        }
+        
+        NRF_I2S->ENABLE = I2S_ENABLE_ENABLE_Disabled;  // Clocks off until the next start()
+        _producer = nullptr;
+        _isPlaying = false;
+        
+        // Amp and HFXO stay up a while in case another sound follows
+        BaseType_t woken = pdFALSE;
+        xTimerResetFromISR(_holdoff, &woken);
+        xSemaphoreGiveFromISR(_done, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+void GeekWatchAudio::wait() {
+    while (_isPlaying) {
+        xSemaphoreTake(_done, portMAX_DELAY);
+    }
+}
+
+bool GeekWatchAudio::play(const int16_t *samples, size_t numSamples, bool blocking) {
+    if (!samples || numSamples == 0) return false;
+    
+    stop();
+    _source = samples;
+    _sourceLeft = numSamples;
+    if (!start(sampleProducer, this)) return false;
+    
+    if (blocking) {
+        wait();
+    }
+    return true;
+}
+
+VoiceHandle GeekWatchAudio::playClip(const AdpcmClip &clip, AudioPriority priority,
+                                     bool blocking) {
+    VoiceHandle voice = _mixer.playClip(clip, priority);
+    if (!runMixer(voice)) return MIXER_NO_VOICE;
+    
+    if (blocking) {
+        wait();
+    }
+    return voice;
+}
+
+VoiceHandle GeekWatchAudio::playTone(uint16_t frequency, uint32_t duration,
+                                     AudioPriority priority) {
+    VoiceHandle voice = _mixer.playTone(frequency, duration, priority);
+    return runMixer(voice) ? voice : MIXER_NO_VOICE;
+}
+
+VoiceHandle GeekWatchAudio::playStream(AudioProducer producer, void *context,
+                                       AudioPriority priority) {
+    VoiceHandle voice = _mixer.playStream(producer, context, priority);
+    return runMixer(voice) ? voice : MIXER_NO_VOICE;
+}
+
+VoiceHandle GeekWatchAudio::playSilence(uint32_t duration, AudioPriority priority) {
+    VoiceHandle voice = _mixer.playSilence(duration, priority);
+    return runMixer(voice) ? voice : MIXER_NO_VOICE;
+}
+
+bool GeekWatchAudio::runMixer(VoiceHandle voice) {
+    if (!_isInitialized) {
+        _mixer.stopVoice(voice);
+        return false;
+    }
+    if (voice == MIXER_NO_VOICE) return false;
+    
+    // Already mixing: the next refill picks it up. That holds while the
+    // stream winds down too, the interrupt leaves the post-roll or
+    // restarts from STOPPED when it finds a voice, so never wait here
+    taskENTER_CRITICAL();
+    bool mixing = _isPlaying && _producer == mixerProducer;
+    taskEXIT_CRITICAL();
+    if (mixing) return true;
+    
+    halt();  // A voice outranks an exclusive play()
+    return startStream(mixerProducer, this);
+}
+
+bool GeekWatchAudio::isPlaying() {
+    return _isPlaying;
+}
+
+void GeekWatchAudio::setVolume(uint8_t volume) {
+    _volume = volume;
+}
+
+void GeekWatchAudio::stop() {
+    _mixer.stopAll();
+    halt();
+}
+
+void GeekWatchAudio::halt() {
+    if (!_isPlaying) return;
+    
+    NRF_I2S->TASKS_STOP = 1;
+    wait();
+}
+
+size_t GeekWatchAudio::sampleProducer(int16_t *buffer, size_t numSamples, void *context) {
+    GeekWatchAudio *audio = (GeekWatchAudio *)context;
+    size_t n = audio->_sourceLeft < numSamples ? audio->_sourceLeft : numSamples;
+    
+    memcpy(buffer, audio->_source, n * sizeof(int16_t));
+    audio->applyVolume(buffer, n);
+    audio->_source += n;
+    audio->_sourceLeft -= n;
+    return n;
+}
+
+size_t GeekWatchAudio::mixerProducer(int16_t *buffer, size_t numSamples, void *context) {
+    GeekWatchAudio *audio = (GeekWatchAudio *)context;
+    size_t n = audio->_mixer.mix(buffer, numSamples);
+    
+    audio->applyVolume(buffer, n);
+    return n;
+}
+
+void GeekWatchAudio::applyVolume(int16_t *samples, size_t numSamples) {
+    if (_volume == 255) return;  // Unity
+    
+    // (s * (volume + 1)) >> 8, as a Q15 gain
+    q15Scale(samples, numSamples, (int16_t)((_volume + 1) << 7));
+}
+
+extern "C" void I2S_IRQHandler(void) {
+    if (activeAudio) {
+        activeAudio->onInterrupt();
+    }
+}
@@ -0,0 +1,251 @@
+/**
+ * @file ble_sync.cpp
+ * @brief Implementation of the BLE log sync service
+ */
+
+#include "ble_sync.h"
+
+// 6765656b-7761-7463-6800-00000000000x ("geekwatch"), least significant byte first
+static const uint8_t SYNC_SERVICE_UUID[16] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x68, 0x63, 0x74, 0x61, 0x77, 0x6B, 0x65, 0x65, 0x67
+};
+static const uint8_t SYNC_CONTROL_UUID[16] = {
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x68, 0x63, 0x74, 0x61, 0x77, 0x6B, 0x65, 0x65, 0x67
+};
+static const uint8_t SYNC_DATA_UUID[16] = {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x68, 0x63, 0x74, 0x61, 0x77, 0x6B, 0x65, 0x65, 0x67
+};
+static const uint8_t SYNC_LIVE_UUID[16] = {
+    0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x68, 0x63, 0x74, 0x61, 0x77, 0x6B, 0x65, 0x65, 0x67
+};
+
+// Bluefruit callbacks are plain functions
+static BleSync* activeSync = nullptr;
+
+BleSync::BleSync(EventLog& log)
+    : _service(SYNC_SERVICE_UUID), _control(SYNC_CONTROL_UUID), _data(SYNC_DATA_UUID),
+      _live(SYNC_LIVE_UUID), _source(log), _notify(nullptr), _conn(BLE_CONN_HANDLE_INVALID),
+      _lastActivity(0), _fastUntil(0), _speed(SPEED_NONE), _liveClient(false), _started(false) {
+}
+
+bool BleSync::begin(SyncNotify notify) {
+    activeSync = this;
+    _notify = notify;
+    _session.begin(_source);
+    
+    // Big MTU, long events and a deep notification queue; must precede begin()
+    Bluefruit.configPrphConn(SYNC_MTU_MAX, SYNC_EVENT_LENGTH, SYNC_HVN_QUEUE, 1);
+    if (!Bluefruit.begin()) return false;
+    Bluefruit.autoConnLed(false);
+    Bluefruit.setTxPower(0);
+    Bluefruit.setName("GeekWatch");
+    Bluefruit.Periph.setConnectCallback(onConnect);
+    Bluefruit.Periph.setDisconnectCallback(onDisconnect);
+    
+    _service.begin();
+    _control.setProperties(CHR_PROPS_WRITE | CHR_PROPS_WRITE_WO_RESP);
+    _control.setPermission(SECMODE_NO_ACCESS, SECMODE_OPEN);
+    _control.setMaxLen(SYNC_COMMAND_MAX);
+    _control.setWriteCallback(onControl);
+    _control.begin();
+    _data.setProperties(CHR_PROPS_NOTIFY);
+    _data.setPermission(SECMODE_OPEN, SECMODE_NO_ACCESS);
+    _data.setMaxLen(SYNC_PAYLOAD_MAX);
+    _data.begin();
+    _live.setProperties(CHR_PROPS_READ | CHR_PROPS_NOTIFY);
+    _live.setPermission(SECMODE_OPEN, SECMODE_NO_ACCESS);
+    _live.setMaxLen(LIVE_STATE_MAX);
+    _live.setCccdWriteCallback(onLiveCccd);
+    _live.begin();
+    
+    Bluefruit.Advertising.addFlags(BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE);
+    Bluefruit.Advertising.addService(_service);
+    Bluefruit.ScanResponse.addName();
+    Bluefruit.Advertising.restartOnDisconnect(false);   // linkDown() decides
+    Bluefruit.Advertising.setFastTimeout(SYNC_ADV_FAST_S);
+    
+    // A live client from before a reset lost its link without knowing
+    // why; give it a while to find the watch again
+    startAdvertising(LIVE_ADV_SLOW_INTERVAL, SYNC_ADVERTISE_S);
+    _started = true;
+    return true;
+}
+
+void BleSync::advertise(uint16_t seconds) {
+    if (connected()) return;
+    
+    // Possibly still out slowly for a lost live client; the user is
+    // waiting now, so start over fast
+    if (Bluefruit.Advertising.isRunning()) Bluefruit.Advertising.stop();
+    startAdvertising(SYNC_ADV_SLOW_INTERVAL, seconds);
+}
+
+void BleSync::startAdvertising(uint16_t slowInterval, uint16_t seconds) {
+    Bluefruit.Advertising.setInterval(SYNC_ADV_FAST_INTERVAL, slowInterval);
+    Bluefruit.Advertising.start(seconds);
+}
+
+void BleSync::publish(const LiveState& state) {
+    if (!_started) return;
+    uint8_t value[LIVE_STATE_MAX];
+    size_t len = liveStateEncode(state, value);
+    _live.write(value, len);
+    if (connected() && _live.notifyEnabled(_conn)) {
+        _live.notify(_conn, value, len);
+    }
+}
+
+void BleSync::interaction(uint32_t nowMs) {
+    _fastUntil = nowMs + LIVE_FAST_HOLD_MS;
+    if (connected() && _notify) _notify();  // service() picks the speed
+}
+
+void BleSync::post(const LinkMessage& msg) {
+    _link.push(msg);
+    if (_notify) _notify();
+}
+
+void BleSync::onConnect(uint16_t conn) {
+    if (!activeSync) return;
+    LinkMessage msg = { LINK_UP, 0, conn, {} };
+    activeSync->post(msg);
+}
+
+void BleSync::onDisconnect(uint16_t conn, uint8_t reason) {
+    if (!activeSync) return;
+    LinkMessage msg = { LINK_DOWN, 1, conn, { reason } };
+    activeSync->post(msg);
+}
+
+void BleSync::onLiveCccd(uint16_t conn, BLECharacteristic* chr, uint16_t value) {
+    (void)chr;
+    if (!activeSync) return;
+    LinkMessage msg = { LINK_LIVE, 1, conn, {} };
+    msg.data[0] = (value & BLE_GATT_HVX_NOTIFICATION) != 0;
+    activeSync->post(msg);
+}
+
+void BleSync::onControl(uint16_t conn, BLECharacteristic* chr, uint8_t* data, uint16_t len) {
+    (void)chr;
+    if (!activeSync) return;
+    LinkMessage msg = { LINK_COMMAND, 0, conn, {} };
+    msg.length = len < SYNC_COMMAND_MAX ? len : SYNC_COMMAND_MAX;
+    memcpy(msg.data, data, msg.length);
+    activeSync->post(msg);
+}
+
+void BleSync::linkUp(uint16_t conn, uint32_t nowMs) {
+    _conn = conn;
+    _lastActivity = nowMs;
+    
+    // Ask for everything that shortens a sync; the central may refuse any
+    // of it, and the session adapts to whatever MTU is agreed
+    BLEConnection* link = Bluefruit.Connection(conn);
+    if (!link) return;
+    link->requestPHY(BLE_GAP_PHY_2MBPS);
+    link->requestDataLengthUpdate();
+    link->requestMtuExchange(SYNC_MTU_MAX);
+    
+    // Fast while the client discovers and subscribes
+    _speed = SPEED_NONE;
+    _fastUntil = nowMs + LIVE_FAST_HOLD_MS;
+    setSpeed(link, nowMs);
+}
+
+void BleSync::linkDown(uint8_t reason) {
+    // The resume cursor survives for the next connection
+    _conn = BLE_CONN_HANDLE_INVALID;
+    _session.stop();
+    
+    // A live client that lost the link rather than hanging up wants it
+    // back: let it find the watch again for a while, or for good if
+    // LIVE_READVERTISE_S is 0. A sync client is done, and the user can
+    // ask for another sync from the dialog
+    bool lost = reason != BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION &&
+                reason != BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION;
+    if (_liveClient && lost) startAdvertising(LIVE_ADV_SLOW_INTERVAL, LIVE_READVERTISE_S);
+    _liveClient = false;
+}
+
+void BleSync::setSpeed(BLEConnection* link, uint32_t nowMs) {
+    LinkSpeed speed = SPEED_IDLE;
+    if (_session.running() && !_session.caughtUp()) {
+        speed = SPEED_SYNC;
+    } else if ((int32_t)(_fastUntil - nowMs) > 0) {
+        speed = SPEED_FAST;
+    }
+    if (speed == _speed) return;  // Each request is a link layer procedure
+    _speed = speed;
+    
+    switch (speed) {
+        case SPEED_SYNC:
+            link->requestConnectionParameter(SYNC_CONN_INTERVAL, 0, LIVE_SUPERVISION_10MS);
+            break;
+        case SPEED_FAST:
+            link->requestConnectionParameter(LIVE_FAST_INTERVAL, 0, LIVE_SUPERVISION_10MS);
+            break;
+        default:
+            link->requestConnectionParameter(LIVE_IDLE_INTERVAL, LIVE_IDLE_LATENCY,
+                                             LIVE_SUPERVISION_10MS);
+            break;
+    }
+}
+
+uint32_t BleSync::service(uint32_t nowMs) {
+    LinkMessage msg;
+    while (_link.pop(msg)) {
+        switch (msg.event) {
+            case LINK_UP:
+                linkUp(msg.conn, nowMs);
+                break;
+            case LINK_DOWN:
+                linkDown(msg.data[0]);
+                break;
+            case LINK_LIVE:
+                if (msg.conn == _conn) _liveClient = msg.data[0];
+                break;
+            case LINK_COMMAND:
+                _session.command(msg.data, msg.length);
+                _lastActivity = nowMs;
+                break;
+        }
+    }
+    if (!connected()) return 0;
+    
+    BLEConnection* link = Bluefruit.Connection(_conn);
+    if (!link) return 0;
+    
+    // Nothing has moved for a while: give the radio back, unless the
+    // client stays for the live state
+    bool live = _live.notifyEnabled(_conn);
+    if (!live && nowMs - _lastActivity >= SYNC_IDLE_MS) {
+        link->disconnect();
+        return 0;
+    }
+    
+    // Fill the queue for the next connection event, no further
+    _session.setPayload(link->getMtu() - 3);
+    uint8_t queued = 0;
+    while (queued < SYNC_HVN_QUEUE && _data.notifyEnabled(_conn)) {
+        size_t len = _session.nextPacket(_packet);
+        if (!len) break;
+        if (!_data.notify(_conn, _packet, len)) {
+            _session.rewind();  // Queue full or link gone, send from the last ACK
+            break;
+        }
+        queued++;
+        _lastActivity = nowMs;
+    }
+    
+    setSpeed(link, nowMs);
+    
+    // More to send: back next event; otherwise for the idle check or the
+    // end of the interactive spell, whichever comes first
+    if (queued == SYNC_HVN_QUEUE) return SYNC_POLL_MS;
+    uint32_t next = live ? 0 : SYNC_IDLE_MS - (nowMs - _lastActivity);
+    if (_speed == SPEED_FAST) {
+        uint32_t left = _fastUntil - nowMs;
+        if (!next || left < next) next = left;
+    }
+    return next;
+}
@@ -0,0 +1,207 @@
+/**
+ * @file button.cpp
+ * @brief Implementation of the button debouncer and gesture decoder
+ */
+
+#include "button.h"
+
+// The RTC can miss a compare value less than 2 ticks ahead of COUNTER
+#define BUTTON_MIN_COMPARE_TICKS    2
+
+static ButtonInput* activeButton = nullptr;
+
+static void buttonEdgeISR() {
+    if (activeButton) {
+        activeButton->onEdge();
+    }
+}
+
+static void buttonTimerISR() {
+    if (activeButton) {
+        activeButton->onTimer();
+    }
+}
+
+ButtonInput::ButtonInput()
+    : _pin(0), _rtc(nullptr), _notify(nullptr), _edgeHead(0), _edgeTail(0),
+      _settling(false), _pressed(false), _burstStart(0), _lastEdge(0),
+      _state(IDLE), _timer(UINT64_MAX), _downAt(0), _eventHead(0), _eventTail(0),
+      _debounceTicks(0), _longTicks(0), _doubleTicks(0), _repeatTicks(0) {
+}
+
+void ButtonInput::begin(uint8_t pin, TicklessScheduler& rtc, ButtonNotify notify) {
+    activeButton = this;
+    _pin = pin;
+    _rtc = &rtc;
+    _notify = notify;
+    
+    _debounceTicks = TicklessScheduler::msToTicks(BUTTON_DEBOUNCE_MS);
+    _longTicks = TicklessScheduler::msToTicks(BUTTON_LONG_PRESS_MS);
+    _doubleTicks = TicklessScheduler::msToTicks(BUTTON_DOUBLE_CLICK_MS);
+    _repeatTicks = TicklessScheduler::msToTicks(BUTTON_REPEAT_MS);
+    
+    pinMode(pin, INPUT_PULLUP);
+    _pressed = digitalRead(pin) == LOW;  // Active low
+    
+    rtc.attachCompare(BUTTON_RTC_CHANNEL, buttonTimerISR);
+    // Both edges, GPIOTE IN event underneath
+    attachInterrupt(digitalPinToInterrupt(pin), buttonEdgeISR, CHANGE);
+}
+
+void ButtonInput::onEdge() {
+    // Timestamp only, the level is read once the contact has settled
+    uint8_t head = _edgeHead;
+    _edges[head & (BUTTON_EDGE_QUEUE - 1)] = (uint32_t)_rtc->now();
+    _edgeHead = head + 1;
+    wake();
+}
+
+void ButtonInput::onTimer() {
+    // One-shot: poll() re-arms it for the next deadline
+    NRF_RTC2->INTENCLR = RTC_INTENCLR_COMPARE2_Msk;
+    wake();
+}
+
+void ButtonInput::wake() {
+    if (_notify) {
+        _notify();
+    } else {
+        _rtc->wakeFromISR();
+    }
+}
+
+bool ButtonInput::poll(uint64_t now, ButtonEvent& ev) {
+    // Drain edges; if the ISR lapped us only the newest ones are left,
+    // which still gives the right settle time
+    uint8_t head = _edgeHead;
+    if ((uint8_t)(head - _edgeTail) > BUTTON_EDGE_QUEUE) {
+        _edgeTail = head - BUTTON_EDGE_QUEUE;
+    }
+    while (_edgeTail != head) {
+        uint32_t low = _edges[_edgeTail & (BUTTON_EDGE_QUEUE - 1)];
+        _edgeTail++;
+        uint64_t at = now - (uint32_t)((uint32_t)now - low);
+        if (!_settling) {
+            _burstStart = at;
+            _settling = true;
+        }
+        _lastEdge = at;
+    }
+    
+    // Quiet for the debounce time: a single read gives the settled level
+    if (_settling && now >= _lastEdge + _debounceTicks) {
+        _settling = false;
+        bool down = digitalRead(_pin) == LOW;
+        if (down != _pressed) {
+            timeouts(_burstStart);
+            _pressed = down;
+            transition(down, _burstStart);
+        }
+    }
+    
+    // A timeout can't fire past an edge that hasn't settled yet
+    timeouts(_settling ? _burstStart : now);
+    
+    if (_eventTail == _eventHead) {
+        armTimer(now);
+        return false;
+    }
+    ev = _events[_eventTail % BUTTON_EVENT_QUEUE];
+    _eventTail++;
+    return true;
+}
+
+uint64_t ButtonInput::nextDeadline() const {
+    // Timeouts wait for the edge in flight to settle, see poll()
+    if (_settling) return _lastEdge + _debounceTicks;
+    return _timer;
+}
+
+void ButtonInput::timeouts(uint64_t until) {
+    while (_timer <= until) {
+        uint64_t at = _timer;
+        switch (_state) {
+            case DOWN:
+                emit(BUTTON_LONG, at);
+                _state = HELD;
+                _timer = _repeatTicks ? at + _repeatTicks : UINT64_MAX;
+                break;
+            case HELD:
+                emit(BUTTON_REPEAT, at);
+                _timer = at + _repeatTicks;
+                break;
+            case CLICKED:
+                // No second click came, it was a single one
+                emit(BUTTON_SHORT, _downAt);
+                _state = IDLE;
+                _timer = UINT64_MAX;
+                break;
+            default:
+                _timer = UINT64_MAX;
+                break;
+        }
+    }
+}
+
+void ButtonInput::transition(bool down, uint64_t at) {
+    if (down) {
+        if (_state == CLICKED) {
+            emit(BUTTON_DOUBLE, at);
+            _state = SWALLOW;
+            _timer = UINT64_MAX;
+        } else {
+            _state = DOWN;
+            _downAt = at;
+            _timer = at + _longTicks;
+        }
+        return;
+    }
+    
+    if (_state == DOWN) {
+        if (_doubleTicks) {
+            _state = CLICKED;
+            _timer = at + _doubleTicks;
+        } else {
+            emit(BUTTON_SHORT, _downAt);
+            _state = IDLE;
+            _timer = UINT64_MAX;
+        }
+    } else {
+        // End of a long press or a double click
+        _state = IDLE;
+        _timer = UINT64_MAX;
+    }
+}
+
+void ButtonInput::emit(ButtonGesture gesture, uint64_t at) {
+    if ((uint8_t)(_eventHead - _eventTail) >= BUTTON_EVENT_QUEUE) return;  // Full, drop
+    ButtonEvent& ev = _events[_eventHead % BUTTON_EVENT_QUEUE];
+    ev.gesture = gesture;
+    ev.at = at;
+    _eventHead++;
+}
+
+void ButtonInput::armTimer(uint64_t now) {
+    uint64_t deadline = nextDeadline();
+    if (deadline == UINT64_MAX) {
+        NRF_RTC2->INTENCLR = RTC_INTENCLR_COMPARE2_Msk;
+        return;
+    }
+    
+    // now may be stale by the time CC is written (SoftDevice, higher
+    // priority ISRs). A compare at or too close to COUNTER won't fire
+    // until the counter comes round again (~512s), so check against a
+    // fresh read and push the compare out until it is armed in time. A
+    // timeout that was already due fires a few ticks late instead
+    for (;;) {
+        if (deadline <= now + BUTTON_MIN_COMPARE_TICKS) {
+            deadline = now + BUTTON_MIN_COMPARE_TICKS + 1;
+        }
+        NRF_RTC2->CC[BUTTON_RTC_CHANNEL] = (uint32_t)deadline & RTC_COUNTER_MASK;
+        NRF_RTC2->EVENTS_COMPARE[BUTTON_RTC_CHANNEL] = 0;
+        NRF_RTC2->INTENSET = RTC_INTENSET_COMPARE2_Msk;
+        
+        now = _rtc->now();
+        if (now + BUTTON_MIN_COMPARE_TICKS < deadline) return;
+    }
+}
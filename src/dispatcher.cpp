@@ -0,0 +1,110 @@
+/**
+ * @file dispatcher.cpp
+ * @brief Implementation of the run-to-completion event dispatcher
+ */
+
+#include "dispatcher.h"
+
+Dispatcher::Dispatcher() : _rtc(nullptr), _queued(0) {
+    memset(_routes, 0, sizeof(_routes));
+    memset(_stats, 0, sizeof(_stats));
+}
+
+void Dispatcher::begin(TicklessScheduler& rtc) {
+    _rtc = &rtc;
+}
+
+bool Dispatcher::subscribe(uint8_t type, DispatchPriority priority, EventHandler handler,
+                           bool coalesce) {
+    if (type >= DISPATCH_MAX_TYPES || priority >= DISPATCH_PRIORITIES) return false;
+    _routes[type].priority = priority;
+    _routes[type].coalesce = coalesce;
+    _routes[type].handler = handler;
+    return true;
+}
+
+bool Dispatcher::post(uint8_t type, uint32_t data) {
+    if (type >= DISPATCH_MAX_TYPES) return false;
+    const Route& route = _routes[type];
+    if (!route.handler) return false;
+    
+    uint32_t bit = 1UL << type;
+    if (route.coalesce) {
+        if (_queued.fetch_or(bit, std::memory_order_acq_rel) & bit) {
+            return true;  // Already waiting, the handler will see this too
+        }
+    }
+    
+    Event ev;
+    ev.type = type;
+    ev.data = data;
+    ev.postedAt = _rtc ? (uint32_t)_rtc->now() : 0;
+    
+    if (!_queues[route.priority].push(ev)) {
+        if (route.coalesce) {
+            _queued.fetch_and(~bit, std::memory_order_acq_rel);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool Dispatcher::postFromISR(uint8_t type, uint32_t data) {
+    bool queued = post(type, data);
+    if (queued && _rtc) {
+        _rtc->wakeFromISR();
+    }
+    return queued;
+}
+
+uint16_t Dispatcher::dispatch() {
+    uint16_t ran = 0;
+    Event ev;
+    for (;;) {
+        // Highest priority first, re-checked after every handler
+        uint8_t p = 0;
+        while (p < DISPATCH_PRIORITIES && !_queues[p].pop(ev)) {
+            p++;
+        }
+        if (p == DISPATCH_PRIORITIES) break;
+        
+        run(ev);
+        ran++;
+    }
+    return ran;
+}
+
+bool Dispatcher::pending() const {
+    for (uint8_t p = 0; p < DISPATCH_PRIORITIES; p++) {
+        if (!_queues[p].empty()) return true;
+    }
+    return false;
+}
+
+void Dispatcher::resetStats() {
+    memset(_stats, 0, sizeof(_stats));
+    for (uint8_t p = 0; p < DISPATCH_PRIORITIES; p++) {
+        _queues[p].resetStats();
+    }
+}
+
+void Dispatcher::run(const Event& ev) {
+    const Route& route = _routes[ev.type];
+    
+    // Clear first, so a post from inside the handler queues a fresh one
+    if (route.coalesce) {
+        _queued.fetch_and(~(1UL << ev.type), std::memory_order_acq_rel);
+    }
+    
+    uint32_t start = _rtc ? (uint32_t)_rtc->now() : 0;
+    route.handler(ev);
+    uint32_t end = _rtc ? (uint32_t)_rtc->now() : 0;
+    
+    HandlerStats& s = _stats[ev.type];
+    uint32_t latency = start - ev.postedAt;
+    uint32_t runTime = end - start;
+    s.count++;
+    s.totalLatency += latency;
+    if (latency > s.maxLatency) s.maxLatency = latency;
+    if (runTime > s.maxRun) s.maxRun = runTime;
+}
@@ -4,39 +4,31 @@
  */
 
 #include "display_sharp.h"
+#include "font5x7.h"
 
-SharpDisplay::SharpDisplay() : vcomState(false) {
+SharpDisplay::SharpDisplay() : vcomState(false), fullRefresh(true), lastLines(0), txBack(0) {
     memset(framebuffer, 0, sizeof(framebuffer));
+    memset(shadow, 0, sizeof(shadow));
+    memset(touchedRows, 0, sizeof(touchedRows));
+    memset(sentRows, 0, sizeof(sentRows));
+    memset(panelRows, 0, sizeof(panelRows));
 }
 
 bool SharpDisplay::begin() {
     #if DEBUG_SERIAL
     Serial.println("Display: Initializing 3-wire SPI Sharp Memory Display...");
-    #endif
-    
-    // CS starts LOW, goes HIGH for entire command frame
-    pinMode(DISPLAY_CS_PIN, OUTPUT);
-    digitalWrite(DISPLAY_CS_PIN, LOW);
-    #if DEBUG_SERIAL
-    Serial.print("  CS pin (");
-    Serial.print(DISPLAY_CS_PIN);
-    Serial.println("): LOW (idle)");
-    
-    // Configure custom SPI pins
-    Serial.print("  SPI pins - SCK: ");
+    Serial.print("  SPIM3 pins - SCK: ");
     Serial.print(DISPLAY_SCK_PIN);
     Serial.print(", SI: ");
-    Serial.println(DISPLAY_MOSI_PIN);
+    Serial.print(DISPLAY_MOSI_PIN);
+    Serial.print(", CS: ");
+    Serial.println(DISPLAY_CS_PIN);
     #endif
     
-    SPI.setPins(0xFF, DISPLAY_SCK_PIN, DISPLAY_MOSI_PIN);
-    SPI.begin();
-    
-    // Sharp Memory Display: LSB first per datasheet, Mode 0, max 2MHz
-    // Use 500kHz for lower power consumption
-    SPI.beginTransaction(SPISettings(500000, LSBFIRST, SPI_MODE0));
+    // CS is driven by SPIM3 hardware, HIGH for the entire command frame
+    spim.begin(DISPLAY_SCK_PIN, DISPLAY_MOSI_PIN, DISPLAY_CS_PIN);
     #if DEBUG_SERIAL
-    Serial.println("  SPI: 500kHz, LSB-first, Mode 0 (3-wire protocol)");
+    Serial.println("  SPIM3: 500kHz, LSB-first, Mode 0, EasyDMA, hardware CS");
     #endif
     
     delay(100);
@@ -47,9 +39,6 @@ bool SharpDisplay::begin() {
     #endif
     clearDisplay();
     
-    // End transaction to save power when not in use
-    SPI.endTransaction();
-    
     #if DEBUG_SERIAL
     Serial.println("Display: Ready!");
     #endif
@@ -62,27 +51,19 @@ void SharpDisplay::clearDisplay() {
     Serial.println("Clear (all black)");
     #endif
     
-    // Start SPI transaction
-    SPI.beginTransaction(SPISettings(500000, LSBFIRST, SPI_MODE0));
-    
-    // 3-wire SPI: CS HIGH for entire frame
-    delayMicroseconds(3);
-    digitalWrite(DISPLAY_CS_PIN, HIGH);
-    delayMicroseconds(3);
-    
     // Command: M2=1 (clear 0x04), M1=VCOM (0x02) - LSB-first format
-    uint8_t cmd = 0x04 | (vcomState ? 0x02 : 0x00);
-    SPI.transfer(cmd);
-    SPI.transfer(0x00);  // Trailer
-    
-    delayMicroseconds(1);
-    digitalWrite(DISPLAY_CS_PIN, LOW);
-    
-    // End SPI transaction to save power
-    SPI.endTransaction();
+    cmdFrame[0] = SHARP_CMD_CLEAR | vcomBit();
+    cmdFrame[1] = 0x00;  // Trailer
+    sendFrame(cmdFrame, 2);
     
     vcomState = !vcomState;
     memset(framebuffer, 0, sizeof(framebuffer));
+    
+    // Panel is now all black, which is exactly what a zeroed shadow says
+    memset(shadow, 0, sizeof(shadow));
+    memset(touchedRows, 0, sizeof(touchedRows));
+    setRows(panelRows, 0, DISPLAY_HEIGHT);
+    fullRefresh = false;
 }
 
 void SharpDisplay::setPixel(uint8_t x, uint8_t y, bool white) {
@@ -91,6 +72,8 @@ void SharpDisplay::setPixel(uint8_t x, uint8_t y, bool white) {
     uint8_t byteIndex = x / 8;
     uint8_t bitIndex = x % 8;
     
+    touchedRows[y >> 5] |= 1UL << (y & 31);
+    
     // 0xFF = white, 0x00 = black
     if (white) {
         framebuffer[y][byteIndex] |= (1 << bitIndex);
@@ -99,90 +82,288 @@ void SharpDisplay::setPixel(uint8_t x, uint8_t y, bool white) {
     }
 }
 
-void SharpDisplay::drawLine(uint8_t y, const uint8_t* lineData) {
-    if (y >= DISPLAY_HEIGHT) return;
-    
-    digitalWrite(DISPLAY_CS_PIN, HIGH);
-    delayMicroseconds(10);
-    
-    // Send write command
-    uint8_t cmd = 0x80 | (vcomState ? 0x40 : 0x00);
-    SPI.transfer(cmd);
-    
-    // Send line address (1-based)
-    SPI.transfer(reverseByte(y + 1));
+// Bits first..last (inclusive) of a framebuffer byte
+static inline uint8_t spanMask(uint8_t first, uint8_t last) {
+    return (uint8_t)((0xFF << first) & (0xFF >> (7 - last)));
+}
+
+// Set or clear pixels [x0, x1) in one row
+static inline void fillSpan(uint8_t* row, int16_t x0, int16_t x1, bool white) {
+    int16_t b0 = x0 >> 3;
+    int16_t b1 = (x1 - 1) >> 3;
+    
+    if (b0 == b1) {
+        uint8_t m = spanMask(x0 & 7, (x1 - 1) & 7);
+        if (white) row[b0] |= m; else row[b0] &= ~m;
+        return;
+    }
     
-    // Send line data (20 bytes for 160 pixels)
-    for (int i = 0; i < DISPLAY_WIDTH / 8; i++) {
-        SPI.transfer(reverseByte(lineData[i]));
+    uint8_t left = spanMask(x0 & 7, 7);
+    uint8_t right = spanMask(0, (x1 - 1) & 7);
+    if (white) {
+        row[b0] |= left;
+        row[b1] |= right;
+    } else {
+        row[b0] &= ~left;
+        row[b1] &= ~right;
     }
     
-    // Send trailer
-    SPI.transfer(0x00);
-    SPI.transfer(0x00);
+    // Whole bytes in between
+    if (b1 - b0 > 1) {
+        memset(&row[b0 + 1], white ? 0xFF : 0x00, b1 - b0 - 1);
+    }
+}
+
+void SharpDisplay::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, bool white) {
+    // Clip to screen
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > DISPLAY_WIDTH) w = DISPLAY_WIDTH - x;
+    if (y + h > DISPLAY_HEIGHT) h = DISPLAY_HEIGHT - y;
+    if (w <= 0 || h <= 0) return;
+    
+    markRows(y, h);
+    for (int16_t row = y; row < y + h; row++) {
+        fillSpan(framebuffer[row], x, x + w, white);
+    }
+}
+
+void SharpDisplay::drawHLine(int16_t x, int16_t y, int16_t w, bool white) {
+    fillRect(x, y, w, 1, white);
+}
+
+void SharpDisplay::drawVLine(int16_t x, int16_t y, int16_t h, bool white) {
+    if (x < 0 || x >= DISPLAY_WIDTH) return;
+    if (y < 0) { h += y; y = 0; }
+    if (y + h > DISPLAY_HEIGHT) h = DISPLAY_HEIGHT - y;
+    if (h <= 0) return;
+    
+    markRows(y, h);
+    uint8_t byteIndex = x >> 3;
+    uint8_t mask = 1 << (x & 7);
+    for (int16_t row = y; row < y + h; row++) {
+        if (white) framebuffer[row][byteIndex] |= mask;
+        else framebuffer[row][byteIndex] &= ~mask;
+    }
+}
+
+void SharpDisplay::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, bool white) {
+    if (w <= 0 || h <= 0) return;
+    drawHLine(x, y, w, white);
+    drawHLine(x, y + h - 1, w, white);
+    drawVLine(x, y + 1, h - 2, white);
+    drawVLine(x + w - 1, y + 1, h - 2, white);
+}
+
+void SharpDisplay::blit(int16_t x, int16_t y, const uint8_t* bitmap, uint8_t w, uint8_t h, bool white) {
+    uint8_t stride = (w + 7) >> 3;
+    uint8_t lastMask = (w & 7) ? (uint8_t)(0xFF >> (8 - (w & 7))) : 0xFF;
+    uint8_t shift = x & 7;
+    int16_t firstByte = x >> 3;  // Floors for negative x too
+    
+    markRows(y, h);
+    
+    for (uint8_t r = 0; r < h; r++) {
+        int16_t dy = y + r;
+        if (dy < 0) continue;
+        if (dy >= DISPLAY_HEIGHT) break;
+        
+        uint8_t* row = framebuffer[dy];
+        const uint8_t* src = bitmap + r * stride;
+        
+        for (uint8_t i = 0; i < stride; i++) {
+            uint8_t b = (i == stride - 1) ? (src[i] & lastMask) : src[i];
+            if (!b) continue;
+            
+            // A source byte straddles at most two framebuffer bytes
+            uint16_t bits = (uint16_t)b << shift;
+            int16_t idx = firstByte + i;
+            for (uint8_t k = 0; k < 2; k++, idx++, bits >>= 8) {
+                uint8_t m = bits & 0xFF;
+                if (!m || idx < 0 || idx >= SHARP_LINE_BYTES) continue;
+                if (white) row[idx] |= m; else row[idx] &= ~m;
+            }
+        }
+    }
+}
+
+void SharpDisplay::drawChar(int16_t x, int16_t y, char c, uint8_t scale, bool white) {
+    // Glyph rows are already in framebuffer bit order, one blit per glyph
+    if (scale == 1) {
+        blit(x, y, fontGlyph(c).rows, FONT_WIDTH, FONT_HEIGHT, white);
+    } else if (scale == 2) {
+        blit(x, y, fontGlyph2x(c).rows[0], FONT_WIDTH * 2, FONT_HEIGHT * 2, white);
+    } else {
+        // No pre-expanded atlas for other scales, draw one block per pixel
+        const FontGlyph& glyph = fontGlyph(c);
+        for (uint8_t row = 0; row < FONT_HEIGHT; row++) {
+            for (uint8_t col = 0; col < FONT_WIDTH; col++) {
+                if (glyph.rows[row] & (1 << col)) {
+                    fillRect(x + col * scale, y + row * scale, scale, scale, white);
+                }
+            }
+        }
+    }
+}
+
+void SharpDisplay::drawText(int16_t x, int16_t y, const char* text, uint8_t scale, bool white) {
+    for (; *text; text++, x += (FONT_WIDTH + 1) * scale) {
+        drawChar(x, y, *text, scale, white);
+    }
+}
+
+void SharpDisplay::clearFramebuffer(bool white) {
+    memset(framebuffer, white ? 0xFF : 0x00, sizeof(framebuffer));
+    markRows(0, DISPLAY_HEIGHT);
+}
+
+void SharpDisplay::drawLine(uint8_t y, const uint8_t* lineData) {
+    if (y >= DISPLAY_HEIGHT) return;
     
-    delayMicroseconds(10);
-    digitalWrite(DISPLAY_CS_PIN, LOW);
+    // Single-line write frame: command, address, data, dummy, trailer
+    uint8_t* frame = txFrame[txBack];
+    uint8_t* p = frame;
+    *p++ = SHARP_CMD_WRITE | vcomBit();
+    *p++ = y + 1;
+    memcpy(p, lineData, SHARP_LINE_BYTES);
+    p += SHARP_LINE_BYTES;
+    *p++ = 0x00;
+    *p++ = 0x00;
+    sendFrame(frame, p - frame);
+    
+    // The panel row may now differ from the framebuffer; compare it next frame
+    memcpy(shadow[y], lineData, SHARP_LINE_BYTES);
+    setRows(panelRows, y, 1);
+    markRows(y, 1);
 }
 
-void SharpDisplay::refresh() {
-    // Start SPI transaction only when needed
-    SPI.beginTransaction(SPISettings(500000, LSBFIRST, SPI_MODE0));
+void SharpDisplay::invalidate() {
+    fullRefresh = true;
+}
+
+void SharpDisplay::setRows(uint32_t* rows, int16_t y, int16_t h) {
+    if (y < 0) { h += y; y = 0; }
+    if (y + h > DISPLAY_HEIGHT) h = DISPLAY_HEIGHT - y;
+    for (int16_t row = y; row < y + h; row++) {
+        rows[row >> 5] |= 1UL << (row & 31);
+    }
+}
+
+void SharpDisplay::markRows(int16_t y, int16_t h) {
+    setRows(touchedRows, y, h);
+}
+
+size_t SharpDisplay::buildFrame(uint8_t* out, bool vcom) {
+    uint8_t* p = out;
+    uint8_t lines = 0;
     
-    digitalWrite(DISPLAY_CS_PIN, HIGH);
-    delayMicroseconds(10);
+    // Write command (LSB-first: 0x01 = write, 0x02 = VCOM)
+    *p++ = SHARP_CMD_WRITE | (vcom ? SHARP_CMD_VCOM : 0x00);
     
-    // Send write command (LSB-first: 0x01 = write, 0x02 = VCOM)
-    uint8_t cmd = 0x01 | (vcomState ? 0x02 : 0x00);
-    SPI.transfer(cmd);
+    // Rows clearDisplay(), fillScreen() or drawLine() put on the panel since
+    // the last frame count as sent too, whether or not this frame restores them
+    memcpy(sentRows, panelRows, sizeof(sentRows));
+    memset(panelRows, 0, sizeof(panelRows));
     
-    // Send all lines (1-based addressing)
     for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++) {
-        // Line address (1-based) - no reversal needed with LSBFIRST
-        SPI.transfer(y + 1);
-        
-        // Line data - no reversal needed with LSBFIRST
-        for (int i = 0; i < DISPLAY_WIDTH / 8; i++) {
-            SPI.transfer(framebuffer[y][i]);
+        if (!fullRefresh) {
+            if (!(touchedRows[y >> 5] & (1UL << (y & 31)))) {
+                continue;  // Not drawn into since the last frame
+            }
+            if (memcmp(framebuffer[y], shadow[y], SHARP_LINE_BYTES) == 0) {
+                continue;  // Redrawn, but the panel already shows this line
+            }
         }
+        memcpy(shadow[y], framebuffer[y], SHARP_LINE_BYTES);
+        sentRows[y >> 5] |= 1UL << (y & 31);
         
-        // Dummy byte after each line
-        SPI.transfer(0x00);
+        *p++ = y + 1;  // Line address (1-based) - no reversal with LSBFIRST
+        memcpy(p, framebuffer[y], SHARP_LINE_BYTES);
+        p += SHARP_LINE_BYTES;
+        *p++ = 0x00;   // Dummy byte after each line
+        lines++;
     }
     
-    // Final trailer byte
-    SPI.transfer(0x00);
+    fullRefresh = false;
+    memset(touchedRows, 0, sizeof(touchedRows));
+    lastLines = lines;
+    if (lines == 0) return 0;
     
-    delayMicroseconds(10);
-    digitalWrite(DISPLAY_CS_PIN, LOW);
-    
-    // End SPI transaction to save power
-    SPI.endTransaction();
+    *p++ = 0x00;  // Final trailer byte
+    return p - out;
+}
+
+uint8_t SharpDisplay::vcomBit() const {
+    // In auto mode the RTC owns the polarity; just don't disturb it
+    bool high = vcom.running() ? vcom.polarity() : vcomState;
+    return high ? SHARP_CMD_VCOM : 0x00;
+}
+
+void SharpDisplay::startFrame(const uint8_t* frame, size_t len) {
+    spim.wait();
+    vcom.beforeTransfer(len);
+    spim.start(frame, len);
+}
+
+void SharpDisplay::sendFrame(const uint8_t* frame, size_t len) {
+    // One EasyDMA transaction, CPU sleeps until SPIM3 signals END
+    startFrame(frame, len);
+    spim.wait();
+}
+
+void SharpDisplay::swapBuffers() {
+    // The back frame is never the one in flight, so no need to wait here
+    uint8_t* frame = txFrame[txBack];
+    size_t len = buildFrame(frame, vcomBit() != 0);
+    
+    // Nothing changed - still flip VCOM so the panel never sees DC bias
+    if (len == 0) {
+        toggleVCOM();
+        return;
+    }
     
+    // Only waits if the previous frame is still being clocked out
+    startFrame(frame, len);
+    txBack ^= 1;
     vcomState = !vcomState;
 }
 
+void SharpDisplay::refresh() {
+    swapBuffers();
+    spim.wait();
+}
+
+bool SharpDisplay::transferBusy() const {
+    return spim.busy();
+}
+
+void SharpDisplay::waitTransfer() {
+    spim.wait();
+}
+
 void SharpDisplay::toggleVCOM() {
-    // VCOM toggle only (no data write)
-    SPI.beginTransaction(SPISettings(500000, LSBFIRST, SPI_MODE0));
-    
-    delayMicroseconds(3);
-    digitalWrite(DISPLAY_CS_PIN, HIGH);
-    delayMicroseconds(3);
+    if (vcom.running()) return;  // RTC + PPI are doing it
     
+    // VCOM toggle only (no data write)
     // Command: M1=VCOM (0x02), M0=0, M2=0 - LSB-first format
-    uint8_t cmd = vcomState ? 0x02 : 0x00;
-    SPI.transfer(cmd);
-    SPI.transfer(0x00);
-    
-    delayMicroseconds(1);
-    digitalWrite(DISPLAY_CS_PIN, LOW);
-    
-    SPI.endTransaction();
+    cmdFrame[0] = vcomBit();
+    cmdFrame[1] = 0x00;
+    sendFrame(cmdFrame, 2);
     
     vcomState = !vcomState;
 }
 
+void SharpDisplay::beginAutoVCOM(TicklessScheduler& rtc) {
+    spim.wait();
+    vcom.begin(spim, rtc, DISPLAY_REFRESH_RATE);
+}
+
+void SharpDisplay::endAutoVCOM() {
+    spim.wait();
+    vcom.end();
+    vcomState = !vcom.polarity();  // Carry on inverting from where it was
+}
+
 void SharpDisplay::fillScreen(bool white) {
     #if DEBUG_SERIAL
     Serial.print("Filling ");
@@ -192,62 +373,49 @@ void SharpDisplay::fillScreen(bool white) {
     Serial.println(" lines");
     #endif
     
-    SPI.beginTransaction(SPISettings(500000, LSBFIRST, SPI_MODE0));
-    
-    // 3-wire SPI: CS HIGH for entire frame
-    delayMicroseconds(3);  // tsSCS min = 3us
-    digitalWrite(DISPLAY_CS_PIN, HIGH);
-    delayMicroseconds(3);  // CS setup before data
-    
     // Command byte (LSB-first): M0=write (0x01), M1=VCOM (0x02)
-    uint8_t cmd = 0x01 | (vcomState ? 0x02 : 0x00);
+    uint8_t cmd = SHARP_CMD_WRITE | vcomBit();
     #if DEBUG_SERIAL
     Serial.print("  CMD byte: 0b");
     Serial.print(cmd, BIN);
     Serial.print(" (0x");
     Serial.print(cmd, HEX);
     Serial.print(") VCOM=");
-    Serial.print(vcomState ? "1" : "0");
+    Serial.print((cmd & SHARP_CMD_VCOM) ? "1" : "0");
     Serial.println(")");
     #endif
     
-    SPI.transfer(cmd);
-    
     // Correct polarity: 0xFF = white (pixel on), 0x00 = black (pixel off)
     uint8_t pixelByte = white ? 0xFF : 0x00;
     #if DEBUG_SERIAL
     Serial.print("  Pixel byte: 0x");
     Serial.println(pixelByte, HEX);
-    Serial.print("  Sending ");
-    Serial.print(DISPLAY_HEIGHT);
-    Serial.println(" lines...");
     #endif
     
-    // Send all lines (1-based addressing)
+    uint8_t* frame = txFrame[txBack];
+    uint8_t* p = frame;
+    *p++ = cmd;
+    
+    // All lines (1-based addressing), 160 pixels = 20 bytes per line
     for (uint8_t line = 1; line <= DISPLAY_HEIGHT; line++) {
-        SPI.transfer(line);  // Line address (1-based) - no reversal with LSBFIRST
-        
-        // 160 pixels = 20 bytes per line - no reversal with LSBFIRST
-        for (int i = 0; i < 20; i++) {
-            SPI.transfer(pixelByte);
-        }
-        
-        // Dummy byte after each line
-        SPI.transfer(0x00);
+        *p++ = line;
+        memset(p, pixelByte, SHARP_LINE_BYTES);
+        p += SHARP_LINE_BYTES;
+        *p++ = 0x00;  // Dummy byte after each line
     }
     
     // Trailer (8 dummy bits minimum)
-    SPI.transfer(0x00);
-    
-    #if DEBUG_SERIAL
-    Serial.println("  Frame complete, CS going LOW");
-    #endif
-    delayMicroseconds(1);  // thSCS min = 1us  
-    digitalWrite(DISPLAY_CS_PIN, LOW);  // CS low completes frame
-    
-    SPI.endTransaction();
+    *p++ = 0x00;
+    sendFrame(frame, p - frame);
     
     vcomState = !vcomState;
+    
+    // Panel contents are known again; the framebuffer is not touched, so
+    // every row is compared next frame and the ones that differ go back
+    memset(shadow, pixelByte, sizeof(shadow));
+    fullRefresh = false;
+    setRows(panelRows, 0, DISPLAY_HEIGHT);
+    markRows(0, DISPLAY_HEIGHT);
 }
 
 void SharpDisplay::drawTestPattern() {
@@ -277,11 +445,3 @@ void SharpDisplay::drawTestPattern() {
     
     refresh();
 }
-
-// Sharp displays need LSB first bit ordering
-uint8_t SharpDisplay::reverseByte(uint8_t b) {
-    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
-    b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
-    b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
-    return b;
-}
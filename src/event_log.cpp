@@ -0,0 +1,349 @@
+/**
+ * @file event_log.cpp
+ * @brief Implementation of the append-only flash event log
+ */
+
+#include "event_log.h"
+#include <nrf_sdm.h>
+#include <nrf_soc.h>
+
+#define PAGE_ERASE_MS       85          // tERASEPAGE, nRF52840 product spec
+#define PAGE_WORDS          (EVENTLOG_PAGE_SIZE / 4)
+
+static_assert(sizeof(LogPageHeader) % 4 == 0, "Headers are written as whole words");
+static_assert((EVENTLOG_STAGING & (EVENTLOG_STAGING - 1)) == 0,
+              "EVENTLOG_STAGING must be a power of 2");
+
+static bool softDeviceEnabled() {
+    uint8_t sdEnabled = 0;
+    sd_softdevice_is_enabled(&sdEnabled);
+    return sdEnabled;
+}
+
+static void nvmcWait() {
+    while (NRF_NVMC->READY == NVMC_READY_READY_Busy) {
+    }
+}
+
+static void nvmcWrite(uint32_t addr, const uint32_t *data, uint16_t words) {
+    volatile uint32_t *dst = (volatile uint32_t *)addr;
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Wen;
+    nvmcWait();
+    for (uint16_t i = 0; i < words; i++) {
+        dst[i] = data[i];
+        nvmcWait();
+    }
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren;
+    nvmcWait();
+}
+
+// One slice of a page erase; the CPU stalls for its duration
+static void nvmcErasePartial(uint32_t addr) {
+    NRF_NVMC->ERASEPAGEPARTIALCFG = EVENTLOG_ERASE_STEP_MS;
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Een;
+    nvmcWait();
+    NRF_NVMC->ERASEPAGEPARTIAL = addr;
+    nvmcWait();
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren;
+    nvmcWait();
+}
+
+EventLog::EventLog()
+    : _tail(0), _offset(0), _pageSeq(0), _seq(0), _lastTime(0), _first(0), _count(0),
+      _eraseNext(false), _eraseSlices(0), _frameRecords(0), _frameTime(0),
+      _op(OP_NONE), _opIssued(false),
+      _opAddr(0), _opData(nullptr), _opWords(0), _opStartedAt(0) {
+    memset(&_header, 0, sizeof(_header));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+uint32_t EventLog::pageAddr(uint8_t page) {
+    return EVENTLOG_FLASH_START + (uint32_t)page * EVENTLOG_PAGE_SIZE;
+}
+
+const LogPageHeader &EventLog::pageHeader(uint8_t page) {
+    return *(const LogPageHeader *)pageAddr(page);
+}
+
+bool EventLog::blank(const uint32_t *words, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (words[i] != 0xFFFFFFFF) return false;
+    }
+    return true;
+}
+
+bool EventLog::begin() {
+    int16_t newest = -1;
+    for (uint8_t page = 0; page < EVENTLOG_PAGES; page++) {
+        if (logPageHeaderValid(pageHeader(page)) &&
+            (newest < 0 || pageHeader(page).pageSeq > pageHeader(newest).pageSeq)) {
+            newest = page;
+        }
+    }
+    if (newest < 0) return format();
+    
+    _tail = newest;
+    _pageSeq = pageHeader(_tail).pageSeq;
+    scanTail();
+    
+    // An erase or header write cut short by power loss leaves it dirty
+    _eraseNext = !blank((const uint32_t *)pageAddr(nextPage(_tail)), PAGE_WORDS);
+    _eraseSlices = 0;
+    return true;
+}
+
+bool EventLog::format() {
+    // Pretend the last page is full: service() erases page 0 and opens it
+    _tail = EVENTLOG_PAGES - 1;
+    _pageSeq = 0;
+    _seq = 0;
+    _lastTime = 0;
+    _offset = EVENTLOG_PAGE_SIZE;
+    _eraseNext = true;
+    _eraseSlices = 0;
+    flush();
+    return logPageHeaderValid(pageHeader(_tail));
+}
+
+void EventLog::scanTail() {
+    // Decode to the first blank frame slot, past any torn frames
+    LogPageReader reader;
+    LogRecord record;
+    reader.begin((const uint8_t *)pageAddr(_tail));
+    while (reader.next(record)) {
+    }
+    
+    _offset = reader.end();
+    _seq = reader.seq();
+    _lastTime = reader.time();
+    _stats.torn += reader.torn();
+}
+
+// Bytes of a page that hold finished writes
+size_t EventLog::limit(uint8_t page) const {
+    return page == _tail ? _offset : EVENTLOG_PAGE_SIZE;
+}
+
+bool EventLog::append(LogEventType type, uint8_t category, uint32_t time) {
+    if (_count >= EVENTLOG_STAGING) {
+        _stats.dropped++;
+        return false;
+    }
+    
+    LogRecord &record = _staging[(_first + _count) & (EVENTLOG_STAGING - 1)];
+    record.seq = _seq++;
+    record.time = time;
+    record.type = type;
+    record.category = category;
+    _count++;
+    return true;
+}
+
+bool EventLog::service() {
+    uint32_t started = micros();
+    bool more = step();
+    uint32_t took = micros() - started;
+    if (took > _stats.maxStepUs) _stats.maxStepUs = took;
+    return more;
+}
+
+bool EventLog::step() {
+    if (_op != OP_NONE) {
+        if (!opFinished()) return true;
+        FlashOp op = _op;
+        _op = OP_NONE;
+        if (op == OP_WRITE) {
+            landed();
+        } else {
+            erased();
+        }
+    }
+    
+    // Keep the next page ready before anything else, so the tail can
+    // always move on without waiting for an erase
+    if (_eraseNext) {
+        eraseStep();
+        return true;
+    }
+    
+    if (_offset >= EVENTLOG_PAGE_SIZE) {
+        openNextPage();
+        return true;
+    }
+    
+    if (_count == 0) return false;
+    
+    // As many staged records as fit in one frame and what is left of the page
+    LogFrameEncoder encoder;
+    encoder.begin((uint8_t *)_frame, _lastTime, EVENTLOG_PAGE_SIZE - _offset);
+    for (uint8_t i = 0; i < _count; i++) {
+        if (!encoder.add(_staging[(_first + i) & (EVENTLOG_STAGING - 1)])) break;
+    }
+    size_t size = encoder.finish();
+    if (size == 0) {
+        openNextPage();
+        return true;
+    }
+    
+    _frameRecords = encoder.count();
+    _frameTime = encoder.prevTime();
+    if (program(pageAddr(_tail) + _offset, _frame, size / 4)) {
+        landed();
+    }
+    return _count > 0 || _op != OP_NONE;
+}
+
+void EventLog::flush() {
+    while (service()) {
+        if (waiting()) delay(1);
+    }
+}
+
+void EventLog::openNextPage() {
+    _tail = nextPage(_tail);
+    _pageSeq++;
+    _offset = 0;  // Nothing goes in until the header has landed
+    
+    // Deltas restart from the first record the page will hold
+    if (_count) _lastTime = _staging[_first].time;
+    logPageHeaderInit(_header, _pageSeq, _seq - _count, _lastTime);
+    
+    // The page after this one holds the oldest records, they go now
+    _eraseNext = true;
+    _eraseSlices = 0;
+    
+    if (program(pageAddr(_tail), (const uint32_t *)&_header, sizeof(LogPageHeader) / 4)) {
+        landed();
+    }
+}
+
+void EventLog::landed() {
+    if (_offset == 0) {
+        _offset = sizeof(LogPageHeader);
+        return;
+    }
+    
+    _first = (_first + _frameRecords) & (EVENTLOG_STAGING - 1);
+    _count -= _frameRecords;
+    _offset += _opWords * sizeof(uint32_t);
+    _lastTime = _frameTime;
+    _stats.written += _frameRecords;
+}
+
+void EventLog::eraseStep() {
+    uint32_t addr = pageAddr(nextPage(_tail));
+    if (softDeviceEnabled()) {
+        // The SoftDevice fits the erase between radio events itself
+        start(OP_ERASE, addr, nullptr, 0);
+        return;
+    }
+    
+    nvmcErasePartial(addr);
+    _eraseSlices++;
+    if (_eraseSlices * EVENTLOG_ERASE_STEP_MS >= PAGE_ERASE_MS &&
+        blank((const uint32_t *)addr, PAGE_WORDS)) {
+        erased();
+    }
+}
+
+void EventLog::erased() {
+    _eraseNext = false;
+    _eraseSlices = 0;
+    _stats.pagesErased++;
+}
+
+bool EventLog::program(uint32_t addr, const uint32_t *data, uint16_t words) {
+    _opWords = words;
+    if (softDeviceEnabled()) {
+        start(OP_WRITE, addr, data, words);
+        return false;
+    }
+    nvmcWrite(addr, data, words);
+    return true;
+}
+
+void EventLog::start(FlashOp op, uint32_t addr, const uint32_t *data, uint16_t words) {
+    _op = op;
+    _opAddr = addr;
+    _opData = data;
+    _opWords = words;
+    _opIssued = issue();
+    _opStartedAt = millis();
+}
+
+bool EventLog::issue() {
+    uint32_t err;
+    if (_op == OP_WRITE) {
+        err = sd_flash_write((uint32_t *)_opAddr, _opData, _opWords);
+    } else {
+        err = sd_flash_page_erase(_opAddr / EVENTLOG_PAGE_SIZE);
+    }
+    return err == NRF_SUCCESS;  // NRF_ERROR_BUSY: someone else is using flash
+}
+
+bool EventLog::opFinished() {
+    if (!_opIssued) {
+        _opIssued = issue();
+        _opStartedAt = millis();
+        return false;
+    }
+    
+    // Read it back rather than take the SoC event from the BLE task
+    bool done;
+    if (_op == OP_WRITE) {
+        done = memcmp((const void *)_opAddr, _opData, _opWords * sizeof(uint32_t)) == 0;
+    } else {
+        done = blank((const uint32_t *)_opAddr, PAGE_WORDS);
+    }
+    if (done) return true;
+    
+    // Timed out between radio events, or failed: try again
+    if (millis() - _opStartedAt >= EVENTLOG_SD_TIMEOUT_MS) {
+        _opIssued = issue();
+        _opStartedAt = millis();
+    }
+    return false;
+}
+
+LogCursor EventLog::oldest() const {
+    // Pages after the tail, in ring order, hold ever newer records
+    LogCursor cursor;
+    for (uint8_t i = 1; i <= EVENTLOG_PAGES; i++) {
+        cursor.page = (_tail + i) % EVENTLOG_PAGES;
+        if (cursor.reader.begin((const uint8_t *)pageAddr(cursor.page))) break;
+    }
+    return cursor;
+}
+
+LogCursor EventLog::seek(uint32_t seq) const {
+    // The newest page that starts at or before seq holds it
+    LogCursor cursor = oldest();
+    for (uint8_t page = nextPage(cursor.page); page != nextPage(_tail); page = nextPage(page)) {
+        const LogPageHeader &header = pageHeader(page);
+        if (!logPageHeaderValid(header)) continue;
+        if (header.firstSeq > seq) break;
+        cursor.page = page;
+    }
+    cursor.reader.begin((const uint8_t *)pageAddr(cursor.page));
+    
+    // Then decode up to it
+    LogCursor probe = cursor;
+    LogRecord record;
+    while (read(probe, record) && record.seq < seq) {
+        cursor = probe;
+    }
+    return cursor;
+}
+
+bool EventLog::read(LogCursor &cursor, LogRecord &record) const {
+    while (!cursor.reader.next(record, limit(cursor.page))) {
+        if (cursor.page == _tail) return false;
+        
+        // End of a full page, on to the next one that has a header
+        do {
+            cursor.page = nextPage(cursor.page);
+        } while (!cursor.reader.begin((const uint8_t *)pageAddr(cursor.page)) &&
+                 cursor.page != _tail);
+    }
+    return true;
+}
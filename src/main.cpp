@@ -1,427 +1,451 @@
 #include <Arduino.h>
 #include <Adafruit_TinyUSB.h>
 #include "display_sharp.h"
+#include "widgets.h"
+#include "scheduler.h"
+#include "button.h"
+#include "dispatcher.h"
+#include "stopwatch.h"
+#include "wallclock.h"
+#include "timer_wheel.h"
+#include "event_log.h"
+#include "session_totals.h"
+#include "audio.h"
 #include "config.h"
+#if VOICE_PROMPTS
+#include "speech.h"
+#include "voice_clips.h"
+#endif
+#if BLE_SYNC
+#include "ble_sync.h"
+#endif
+#if DISPLAY_MIRROR
+#include "mirror_codec.h"
+#endif
 #include <nrf_rtc.h>
 #include <nrf_power.h>
 
 SharpDisplay display;
+TicklessScheduler scheduler;
 
-// Button configuration
+// Button configuration (timings in config.h)
 #define BUTTON_PIN 43  // P1.11 = 32 + 11 = 43
-#define LONG_PRESS_MS 1000
-#define DEBOUNCE_MS 50
 
 // LED configuration (to disable status LED)
 #define STATUS_LED_PIN 15  // P0.15 - Red LED on SuperMini board
 
-// Button state
-volatile bool buttonInterruptFlag = false;
-bool buttonPressed = HIGH;
-unsigned long buttonPressTime = 0;
-bool longPressHandled = false;
-unsigned long lastDebounceTime = 0;
-bool lastButtonState = HIGH;
-
-// Display state
-bool displayDirty = true;  // Flag to track if display needs update
-
-// Clock state
-uint8_t hours = 11;
-uint8_t minutes = 37;
-uint8_t seconds = 0;
-bool isPM = false;  // AM
-unsigned long lastClockUpdate = 0;
-
-// Stopwatch state
-uint16_t stopwatch1_millis = 0;  // milliseconds (0-999)
-uint8_t stopwatch1_seconds = 0;
-uint8_t stopwatch1_minutes = 0;
-uint8_t stopwatch1_hours = 0;
-uint16_t stopwatch2_millis = 0;
-uint8_t stopwatch2_seconds = 0;
-uint8_t stopwatch2_minutes = 0;
-uint8_t stopwatch2_hours = 0;
-
-bool stopwatch1_running = false;
-bool stopwatch2_running = false;
-unsigned long lastStopwatchUpdate = 0;
-
-// Reset confirmation state
-bool showResetConfirm = false;
-unsigned long resetConfirmStartTime = 0;
-#define RESET_CONFIRM_MS 3000
+// Button: edges are timestamped in the ISR, gestures decoded in the loop
+ButtonInput button;
 
-// 5x7 font for digits
-const uint8_t font5x7[][5] = {
-    {0x3E, 0x51, 0x49, 0x45, 0x3E}, // 0
-    {0x00, 0x42, 0x7F, 0x40, 0x00}, // 1
-    {0x42, 0x61, 0x51, 0x49, 0x46}, // 2
-    {0x21, 0x41, 0x45, 0x4B, 0x31}, // 3
-    {0x18, 0x14, 0x12, 0x7F, 0x10}, // 4
-    {0x27, 0x45, 0x45, 0x45, 0x39}, // 5
-    {0x3C, 0x4A, 0x49, 0x49, 0x30}, // 6
-    {0x01, 0x71, 0x09, 0x05, 0x03}, // 7
-    {0x36, 0x49, 0x49, 0x49, 0x36}, // 8
-    {0x06, 0x49, 0x49, 0x29, 0x1E}, // 9
+// Events - ISRs and expired deadlines post them, loop() dispatches
+enum AppEvent : uint8_t {
+    EVT_BUTTON,             // Edge or gesture timeout, run the decoder
+    EVT_CONFIRM_TIMEOUT,    // Reset dialog ran out
+    EVT_NAG,                // Geek time reminder is due
+    EVT_LOG_WRITE,          // Staged log records are due for flash
+    EVT_TOTALS_ROLL,        // An hour boundary passed with a category running
+    EVT_SYNC,               // BLE link or command, or the sync is due to send more
+    EVT_REDRAW,             // Something on screen changed
 };
+Dispatcher dispatcher;
 
-void drawDigit(uint8_t x, uint8_t y, uint8_t digit, uint8_t scale = 1) {
-    if (digit > 9) return;
-    
-    for (uint8_t col = 0; col < 5; col++) {
-        uint8_t colData = font5x7[digit][col];
-        for (uint8_t row = 0; row < 7; row++) {
-            if (colData & (1 << row)) {
-                for (uint8_t sy = 0; sy < scale; sy++) {
-                    for (uint8_t sx = 0; sx < scale; sx++) {
-                        display.setPixel(x + col * scale + sx, y + row * scale + sy, false);
-                    }
-                }
-            }
-        }
-    }
+// Reminders and timeouts; the loop sleeps until the earliest one
+TimerWheel timers;
+
+// Timer callback that posts the event type stored in its context
+void postTimerEvent(WheelTimer& timer) {
+    dispatcher.post((uint8_t)(uintptr_t)timer.context);
 }
 
-void drawChar(uint8_t x, uint8_t y, char c, uint8_t scale = 1) {
-    // 5x7 font data
-    const uint8_t charData[][5] = {
-        {0x7E, 0x09, 0x09, 0x09, 0x7E}, // A
-        {0x7F, 0x49, 0x49, 0x49, 0x36}, // B
-        {0x3E, 0x41, 0x41, 0x41, 0x22}, // C
-        {0x7F, 0x41, 0x41, 0x22, 0x1C}, // D
-        {0x7F, 0x49, 0x49, 0x49, 0x41}, // E
-        {0x3E, 0x41, 0x49, 0x49, 0x7A}, // G
-        {0x00, 0x41, 0x7F, 0x41, 0x00}, // I
-        {0x7F, 0x40, 0x40, 0x40, 0x40}, // L
-        {0x7F, 0x02, 0x04, 0x02, 0x7F}, // M
-        {0x7F, 0x04, 0x08, 0x10, 0x7F}, // N
-        {0x7F, 0x09, 0x09, 0x09, 0x06}, // P
-        {0x46, 0x49, 0x49, 0x49, 0x31}, // S
-        {0x01, 0x01, 0x7F, 0x01, 0x01}, // T
-        {0x3F, 0x40, 0x40, 0x40, 0x3F}, // U
-        {0x02, 0x01, 0x59, 0x09, 0x06}, // ? (question mark)
-        {0x00, 0x00, 0x00, 0x00, 0x00}, // space
-    };
-    
-    const uint8_t* data = nullptr;
-    if (c == 'A') data = charData[0];
-    else if (c == 'B') data = charData[1];
-    else if (c == 'C') data = charData[2];
-    else if (c == 'D') data = charData[3];
-    else if (c == 'E') data = charData[4];
-    else if (c == 'G') data = charData[5];
-    else if (c == 'I') data = charData[6];
-    else if (c == 'L') data = charData[7];
-    else if (c == 'M') data = charData[8];
-    else if (c == 'N') data = charData[9];
-    else if (c == 'P') data = charData[10];
-    else if (c == 'S') data = charData[11];
-    else if (c == 'T') data = charData[12];
-    else if (c == 'U') data = charData[13];
-    else if (c == '?') data = charData[14];
-    else if (c == ' ') data = charData[15];
-    else return;
-    
-    if (!data) return;
-    
-    for (uint8_t col = 0; col < 5; col++) {
-        uint8_t colData = data[col];
-        for (uint8_t row = 0; row < 7; row++) {
-            if (colData & (1 << row)) {
-                for (uint8_t sy = 0; sy < scale; sy++) {
-                    for (uint8_t sx = 0; sx < scale; sx++) {
-                        display.setPixel(x + col * scale + sx, y + row * scale + sy, false);
-                    }
-                }
-            }
-        }
-    }
+WheelTimer confirmTimer(postTimerEvent, (void*)EVT_CONFIRM_TIMEOUT);
+WheelTimer nagTimer(postTimerEvent, (void*)EVT_NAG);
+WheelTimer logTimer(postTimerEvent, (void*)EVT_LOG_WRITE);
+WheelTimer rollTimer(postTimerEvent, (void*)EVT_TOTALS_ROLL);
+WheelTimer syncTimer(postTimerEvent, (void*)EVT_SYNC);
+
+// Coalesced, so any number of changes cost one redraw
+void requestRedraw() {
+    dispatcher.post(EVT_REDRAW);
 }
 
-void drawColon(uint8_t x, uint8_t y, uint8_t scale = 1) {
-    for (uint8_t sy = 0; sy < scale; sy++) {
-        for (uint8_t sx = 0; sx < scale; sx++) {
-            display.setPixel(x + sx, y + scale * 2 + sy, false);
-            display.setPixel(x + sx, y + scale * 4 + sy, false);
-        }
-    }
+// Watch face layout
+TimeWidget clockTime(2, 2, 1);              // HH:MM:SS
+LabelWidget clockAmPm(43, 2, 2, 1);         // AM/PM
+LabelWidget sw1Active(-2, 20, 1, 2);        // Active indicator, blank first column off-screen
+TimeWidget sw1Time(8, 20, 2);
+LabelWidget sw1Label(90, 20, 1, 2);
+LabelWidget sw2Active(-2, 38, 1, 2);
+TimeWidget sw2Time(8, 38, 2);
+LabelWidget sw2Label(90, 38, 1, 2);
+DialogWidget resetDialog(6, 19, 148, 30, "SUBMIT DATA AND SLEEP?");
+
+Widget* const faceWidgets[] = {
+    &clockTime, &clockAmPm,
+    &sw1Active, &sw1Time, &sw1Label,
+    &sw2Active, &sw2Time, &sw2Label,
+};
+WidgetScreen face(faceWidgets, sizeof(faceWidgets) / sizeof(faceWidgets[0]), &resetDialog);
+
+// Clock state - derived from RTC2 ticks, nothing counts seconds
+WallClock wallClock;
+uint64_t clockRedrawAt = 0;  // Tick when the shown seconds change
+
+// Stopwatch state - category 0 = geek (G), 1 = life (L)
+#define NUM_STOPWATCHES 2
+StopwatchEngine stopwatches(NUM_STOPWATCHES);
+uint64_t stopwatchRedrawAt = UINT64_MAX;  // Tick when the shown seconds change
+
+// Speaker, powered only while something plays
+GeekWatchAudio audio(I2S_SCK_PIN, I2S_LRCK_PIN, I2S_DIN_PIN);
+
+#if VOICE_PROMPTS
+// Word clips for elapsed-time announcements
+SpeechPlayer speech;
+
+// "You have been geeking for two hours fifteen minutes"
+void announceElapsed(uint8_t id, uint64_t at) {
+    uint32_t seconds = stopwatches.elapsedSeconds(id, at);
+    SpeechPhrase phrase;
+    phrase.add(id == 0 ? PHRASE_GEEKING_FOR : PHRASE_LIVING_FOR);
+    phrase.addElapsed(seconds);
+    speech.say(phrase);
+}
+#endif
+
+// Session history in flash, written in the background through logTimer
+EventLog eventLog;
+
+#if BLE_SYNC
+// Streams the log to the companion app after "SUBMIT DATA"
+BleSync bleSync(eventLog);
+
+// BLE task
+void syncNotify() {
+    dispatcher.postFromISR(EVT_SYNC);
 }
 
-void updateClock() {
-    seconds++;
-    displayDirty = true;  // Clock changed, need to redraw
-    if (seconds >= 60) {
-        seconds = 0;
-        minutes++;
-        if (minutes >= 60) {
-            minutes = 0;
-            hours++;
-            if (hours == 12) {
-                isPM = !isPM;  // Toggle AM/PM at 12:00
-            }
-            if (hours > 12) {
-                hours = 1;
-            }
-        }
+// Stopwatch state as of a transition; the app extrapolates from it
+uint16_t liveChanges = 0;
+
+void publishLive(uint64_t at) {
+    LiveState state;
+    state.change = liveChanges++;
+    state.active = stopwatches.active();
+    state.count = NUM_STOPWATCHES;
+    state.baseTime = wallClock.epochSeconds(at);
+    for (uint8_t i = 0; i < NUM_STOPWATCHES; i++) {
+        state.elapsed[i] = stopwatches.elapsedSeconds(i, at);
     }
+    bleSync.publish(state);
+}
+#endif
+
+#if DISPLAY_MIRROR
+// Screen copy for a host on the USB port, fed the rows each frame sent
+MirrorEncoder mirror;
+uint8_t mirrorPacket[MIRROR_PACKET_MAX];
+bool mirrorHost = false;
+
+void mirrorFrame() {
+    mirror.markRows(display.lastRows());
+    
+    // Nobody listening: rows keep adding up, a new viewer starts from a keyframe
+    bool host = Serial;
+    if (host && !mirrorHost) mirror.requestKey();
+    mirrorHost = host;
+    if (!host) return;
+    
+    size_t len = mirror.encode(display.framebuffer, mirrorPacket);
+    if (len) Serial.write(mirrorPacket, len);
 }
+#endif
 
-void updateStopwatches() {
-    unsigned long now = millis();
-    unsigned long elapsed = now - lastStopwatchUpdate;
-    lastStopwatchUpdate = now;
-    
-    if (stopwatch1_running) {
-        stopwatch1_millis += elapsed;
-        while (stopwatch1_millis >= 1000) {
-            stopwatch1_millis -= 1000;
-            stopwatch1_seconds++;
-            displayDirty = true;  // Stopwatch changed
-            if (stopwatch1_seconds >= 60) {
-                stopwatch1_seconds = 0;
-                stopwatch1_minutes++;
-                if (stopwatch1_minutes >= 60) {
-                    stopwatch1_minutes = 0;
-                    stopwatch1_hours++;
-                    if (stopwatch1_hours >= 100) {
-                        stopwatch1_hours = 99;
-                        stopwatch1_minutes = 59;
-                        stopwatch1_seconds = 59;
-                        stopwatch1_millis = 999;
-                    }
-                }
-            }
-        }
+// Hourly and daily totals, fed the same records as the log
+SessionTotals totals;
+
+// Keep totals credited hour by hour while a category runs
+void updateRoll(uint64_t at) {
+    uint32_t due = totals.nextRoll();
+    if (due == TOTALS_EMPTY) {
+        timers.cancel(rollTimer);
+        return;
     }
+    uint32_t seconds = wallClock.epochSeconds(at);
+    uint32_t left = due > seconds ? due - seconds : 0;
+    timers.start(rollTimer, at + (uint64_t)left * RTC_TICK_HZ);
+}
+
+void logEvent(LogEventType type, uint8_t category, uint64_t at) {
+    LogRecord record;
+    record.seq = eventLog.nextSeq();
+    record.time = wallClock.epochSeconds(at);
+    record.type = type;
+    record.category = category;
+    eventLog.append(type, category, record.time);
+    totals.apply(record);
+    updateRoll(at);
+    #if BLE_SYNC
+    publishLive(at);
+    #endif
     
-    if (stopwatch2_running) {
-        stopwatch2_millis += elapsed;
-        while (stopwatch2_millis >= 1000) {
-            stopwatch2_millis -= 1000;
-            stopwatch2_seconds++;
-            displayDirty = true;  // Stopwatch changed
-            if (stopwatch2_seconds >= 60) {
-                stopwatch2_seconds = 0;
-                stopwatch2_minutes++;
-                if (stopwatch2_minutes >= 60) {
-                    stopwatch2_minutes = 0;
-                    stopwatch2_hours++;
-                    if (stopwatch2_hours >= 100) {
-                        stopwatch2_hours = 99;
-                        stopwatch2_minutes = 59;
-                        stopwatch2_seconds = 59;
-                        stopwatch2_millis = 999;
-                    }
-                }
-            }
-        }
+    // Batch records, but don't leave them in RAM for long
+    uint64_t now = scheduler.now();
+    if (eventLog.staged() >= EVENTLOG_FLUSH_RECORDS || type == LOG_RESET) {
+        timers.start(logTimer, now);
+    } else if (!logTimer.active()) {
+        timers.start(logTimer, now + TicklessScheduler::msToTicks(EVENTLOG_FLUSH_MS));
     }
 }
 
-void resetStopwatches() {
-    stopwatch1_millis = 0;
-    stopwatch1_seconds = 0;
-    stopwatch1_minutes = 0;
-    stopwatch1_hours = 0;
-    stopwatch2_millis = 0;
-    stopwatch2_seconds = 0;
-    stopwatch2_minutes = 0;
-    stopwatch2_hours = 0;
-    stopwatch1_running = false;
-    stopwatch2_running = false;
-    displayDirty = true;  // Display needs update
+// Reset confirmation state, the dialog times out through confirmTimer
+bool showResetConfirm = false;
+#define RESET_CONFIRM_MS 3000
+
+#define MINUTE_TICKS ((uint64_t)60 * RTC_TICK_HZ)
+
+// Nag from NAG_AFTER_MIN into a geek session, every NAG_REPEAT_MIN after
+void updateNag(uint64_t at) {
+    if (!stopwatches.isRunning(0)) {
+        timers.cancel(nagTimer);
+    } else if (!nagTimer.active()) {
+        timers.start(nagTimer, at + NAG_AFTER_MIN * MINUTE_TICKS, NAG_REPEAT_MIN * MINUTE_TICKS);
+    }
+}
+
+// Local hour within QUIET_START_HOUR..QUIET_END_HOUR, which may span midnight
+bool quietHours(uint64_t at) {
+    uint8_t hour = (wallClock.epochSeconds(at) / 3600) % 24;
+    if (QUIET_START_HOUR <= QUIET_END_HOUR) {
+        return hour >= QUIET_START_HOUR && hour < QUIET_END_HOUR;
+    }
+    return hour >= QUIET_START_HOUR || hour < QUIET_END_HOUR;
 }
 
-// Button interrupt handler
-void buttonISR() {
-    buttonInterruptFlag = true;
+void resetStopwatches() {
+    uint64_t now = scheduler.now();
+    stopwatches.reset();
+    logEvent(LOG_RESET, STOPWATCH_NONE, now);
+    updateNag(now);
+    requestRedraw();  // Display needs update
 }
 
-void handleButtonPress() {
+void handleButtonPress(uint64_t at) {
     if (showResetConfirm) {
         // Button pressed during reset confirmation - do the reset
         resetStopwatches();
         showResetConfirm = false;
+        timers.cancel(confirmTimer);
+        #if BLE_SYNC
+        bleSync.advertise(SYNC_ADVERTISE_S);
+        #endif
         #if DEBUG_SERIAL
         Serial.println("Stopwatches reset!");
         #endif
     } else {
-        // Normal press - toggle between stopwatches
-        if (!stopwatch1_running && !stopwatch2_running) {
-            // First press - start stopwatch 1
-            stopwatch1_running = true;
-            #if DEBUG_SERIAL
-            Serial.println("Stopwatch 1 started");
-            #endif
-        } else {
-            // Toggle between stopwatches
-            bool temp = stopwatch1_running;
-            stopwatch1_running = stopwatch2_running;
-            stopwatch2_running = temp;
-            #if DEBUG_SERIAL
-            Serial.print("Switched to stopwatch ");
-            Serial.println(stopwatch1_running ? "1" : "2");
-            #endif
-        }
+        // Normal press - start the first stopwatch, or move to the next one
+        // Switch at the moment of the press, not when it was decoded
+        stopwatches.cycle(at);
+        logEvent(LOG_SWITCH, stopwatches.active(), at);
+        updateNag(at);
+        #if DEBUG_SERIAL
+        Serial.print("Switched to stopwatch ");
+        Serial.println(stopwatches.active() + 1);
+        #endif
     }
-    displayDirty = true;  // Button action requires display update
+    requestRedraw();  // Button action requires display update
 }
 
 void handleLongPress() {
     if (!showResetConfirm) {
         showResetConfirm = true;
-        resetConfirmStartTime = millis();
-        displayDirty = true;  // Show confirmation dialog
+        timers.start(confirmTimer, scheduler.now() + TicklessScheduler::msToTicks(RESET_CONFIRM_MS));
+        requestRedraw();  // Show confirmation dialog
         #if DEBUG_SERIAL
         Serial.println("Reset confirmation - press button within 3 seconds to confirm");
         #endif
     }
 }
 
-void updateButton() {
-    // Only process if interrupt flag is set, button is currently pressed, or debounce is in progress
-    if (!buttonInterruptFlag && buttonPressed == HIGH && lastButtonState == HIGH) {
+void handleDoubleClick(uint64_t at) {
+    if (showResetConfirm) {
+        handleButtonPress(at);  // Still a yes
         return;
     }
-    buttonInterruptFlag = false;
-    
-    bool reading = digitalRead(BUTTON_PIN);
     
-    // Debounce
-    if (reading != lastButtonState) {
-        lastDebounceTime = millis();
+    // Pause whatever is running
+    uint8_t paused = stopwatches.active();
+    stopwatches.switchTo(STOPWATCH_NONE, at);
+    if (paused != STOPWATCH_NONE) {
+        logEvent(LOG_SWITCH, STOPWATCH_NONE, at);
     }
-    
-    if ((millis() - lastDebounceTime) > DEBOUNCE_MS) {
-        if (reading != buttonPressed) {
-            buttonPressed = reading;
-            
-            if (buttonPressed == LOW) {  // Button pressed (active low with pullup)
-                buttonPressTime = millis();
-                longPressHandled = false;
-            } else {  // Button released
-                unsigned long pressDuration = millis() - buttonPressTime;
-                if (pressDuration < LONG_PRESS_MS && !longPressHandled) {
-                    handleButtonPress();
-                }
-            }
-        }
+    updateNag(at);
+    #if DEBUG_SERIAL
+    Serial.println("Stopwatches paused");
+    #endif
+    #if VOICE_PROMPTS
+    if (paused != STOPWATCH_NONE) {
+        announceElapsed(paused, at);
     }
-    
-    // Check for long press
-    if (buttonPressed == LOW && !longPressHandled) {
-        if (millis() - buttonPressTime >= LONG_PRESS_MS) {
+    #endif
+    requestRedraw();
+}
+
+void handleButton(const ButtonEvent& ev) {
+    #if BLE_SYNC
+    bleSync.interaction(millis());
+    #endif
+    switch (ev.gesture) {
+        case BUTTON_SHORT:
+            handleButtonPress(ev.at);
+            break;
+        case BUTTON_DOUBLE:
+            handleDoubleClick(ev.at);
+            break;
+        case BUTTON_LONG:
             handleLongPress();
-            longPressHandled = true;
-        }
+            break;
+        case BUTTON_REPEAT:
+            break;  // Nothing repeats yet
     }
-    
-    lastButtonState = reading;
 }
 
 void drawDisplay() {
-    // Clear framebuffer (white background)
-    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-        for (int x = 0; x < DISPLAY_WIDTH / 8; x++) {
-            display.framebuffer[y][x] = 0xFF;
-        }
+    // Push current state into the widgets; only changed cells get damaged
+    uint64_t ticks = scheduler.now();
+    WallTime clock = wallClock.timeOfDay(ticks);
+    clockTime.set(clock.hours, clock.minutes, clock.seconds);
+    clockAmPm.setText(clock.isPM ? "PM" : "AM");
+    clockRedrawAt = wallClock.nextSecond(ticks);
+    
+    // Stopwatch HH:MM:SS is derived from timestamps only here
+    StopwatchTime sw1 = stopwatches.elapsed(0, ticks);
+    StopwatchTime sw2 = stopwatches.elapsed(1, ticks);
+    sw1Active.setText(stopwatches.isRunning(0) ? "I" : " ");
+    sw1Time.set(sw1.hours, sw1.minutes, sw1.seconds);
+    sw2Active.setText(stopwatches.isRunning(1) ? "I" : " ");
+    sw2Time.set(sw2.hours, sw2.minutes, sw2.seconds);
+    stopwatchRedrawAt = stopwatches.nextSecond(ticks);
+    
+    face.showModal(showResetConfirm);
+    if (showResetConfirm) {
+        uint64_t due = confirmTimer.expires();
+        uint32_t timeLeft = due > ticks ? TicklessScheduler::ticksToMs(due - ticks) : 0;
+        resetDialog.setCountdown((timeLeft / 1000) + 1);
     }
     
-    // Draw clock in top left (HH:MM:SS AM/PM)
-    uint8_t x = 2, y = 2;
-    drawDigit(x, y, hours / 10, 1);
-    drawDigit(x + 6, y, hours % 10, 1);
-    drawColon(x + 12, y, 1);
-    drawDigit(x + 14, y, minutes / 10, 1);
-    drawDigit(x + 20, y, minutes % 10, 1);
-    drawColon(x + 26, y, 1);
-    drawDigit(x + 28, y, seconds / 10, 1);
-    drawDigit(x + 34, y, seconds % 10, 1);
-    // AM/PM
-    drawChar(x + 41, y, isPM ? 'P' : 'A', 1);
-    drawChar(x + 47, y, 'M', 1);
-    
-    // Draw stopwatches in center (bigger)
-    uint8_t sw_y = 20;
-    uint8_t scale = 2;
-    
-    // Stopwatch 1
-    uint8_t sw1_x = 8;
-    if (stopwatch1_running) drawChar(sw1_x - 6, sw_y, 'I', scale);  // Active indicator
-    drawDigit(sw1_x, sw_y, stopwatch1_hours / 10, scale);
-    drawDigit(sw1_x + 12, sw_y, stopwatch1_hours % 10, scale);
-    drawColon(sw1_x + 24, sw_y, scale);
-    drawDigit(sw1_x + 28, sw_y, stopwatch1_minutes / 10, scale);
-    drawDigit(sw1_x + 40, sw_y, stopwatch1_minutes % 10, scale);
-    drawColon(sw1_x + 52, sw_y, scale);
-    drawDigit(sw1_x + 56, sw_y, stopwatch1_seconds / 10, scale);
-    drawDigit(sw1_x + 68, sw_y, stopwatch1_seconds % 10, scale);
-    drawChar(sw1_x + 82, sw_y, 'G', scale);  // Label
-    
-    // Stopwatch 2
-    uint8_t sw2_x = 8;
-    uint8_t sw2_y = sw_y + 18;
-    if (stopwatch2_running) drawChar(sw2_x - 6, sw2_y, 'I', scale);  // Active indicator
-    drawDigit(sw2_x, sw2_y, stopwatch2_hours / 10, scale);
-    drawDigit(sw2_x + 12, sw2_y, stopwatch2_hours % 10, scale);
-    drawColon(sw2_x + 24, sw2_y, scale);
-    drawDigit(sw2_x + 28, sw2_y, stopwatch2_minutes / 10, scale);
-    drawDigit(sw2_x + 40, sw2_y, stopwatch2_minutes % 10, scale);
-    drawColon(sw2_x + 52, sw2_y, scale);
-    drawDigit(sw2_x + 56, sw2_y, stopwatch2_seconds / 10, scale);
-    drawDigit(sw2_x + 68, sw2_y, stopwatch2_seconds % 10, scale);
-    drawChar(sw2_x + 82, sw2_y, 'L', scale);  // Label
-    
-    // Draw reset confirmation box if active
-    if (showResetConfirm) {
-        unsigned long timeLeft = RESET_CONFIRM_MS - (millis() - resetConfirmStartTime);
-        if (timeLeft > RESET_CONFIRM_MS) timeLeft = 0;  // Handle overflow
-        uint8_t secondsLeft = (timeLeft / 1000) + 1;
-        
-        // Draw centered box (148x30 pixels, centered on 160x68 screen)
-        uint8_t box_x = 6;
-        uint8_t box_y = 19;
-        uint8_t box_w = 148;
-        uint8_t box_h = 30;
-        
-        // Fill box interior with white
-        for (uint8_t y = box_y + 1; y < box_y + box_h - 1; y++) {
-            for (uint8_t x = box_x + 1; x < box_x + box_w - 1; x++) {
-                display.setPixel(x, y, true);
-            }
-        }
-        
-        // Draw black border
-        for (uint8_t x = box_x; x < box_x + box_w; x++) {
-            display.setPixel(x, box_y, false);  // Top
-            display.setPixel(x, box_y + box_h - 1, false);  // Bottom
-        }
-        for (uint8_t y = box_y; y < box_y + box_h; y++) {
-            display.setPixel(box_x, y, false);  // Left
-            display.setPixel(box_x + box_w - 1, y, false);  // Right
-        }
-        
-        // Draw "SUBMIT DATA AND SLEEP?" on one line
-        const char* message = "SUBMIT DATA AND SLEEP?";
-        uint8_t text_x = box_x + 6;
-        uint8_t text_y = box_y + 6;
-        for (uint8_t i = 0; message[i] != '\0'; i++) {
-            drawChar(text_x + i * 6, text_y, message[i], 1);
-        }
-        
-        // Draw countdown centered below text
-        uint8_t countdown_x = box_x + box_w / 2 - 3;
-        drawDigit(countdown_x, box_y + 18, secondsLeft, 1);
+    // Redraw damaged cells only; the driver sends only the rows they touch
+    face.render(display);
+    
+    // Returns as soon as the transfer has started; the framebuffer is
+    // free to draw into again while the lines are clocked out
+    display.swapBuffers();
+    #if DISPLAY_MIRROR
+    mirrorFrame();
+    #endif
+}
+
+// Event handlers
+void onButtonEvent(const Event&) {
+    ButtonEvent ev;
+    while (button.poll(scheduler.now(), ev)) {
+        handleButton(ev);
+    }
+}
+
+void onConfirmTimeout(const Event&) {
+    if (!showResetConfirm) return;  // Answered in the meantime
+    showResetConfirm = false;
+    requestRedraw();
+    #if DEBUG_SERIAL
+    Serial.println("Reset cancelled");
+    #endif
+}
+
+void onNag(const Event&) {
+    uint64_t at = scheduler.now();
+    if (!stopwatches.isRunning(0) || quietHours(at)) return;
+    
+    #if VOICE_PROMPTS
+    announceElapsed(0, at);
+    #else
+    audio.playTone(NAG_TONE_HZ, NAG_TONE_MS);
+    #endif
+    #if DEBUG_SERIAL
+    Serial.println("Geek time reminder");
+    #endif
+}
+
+// One bounded flash step per event, so button handling runs in between
+void onLogWrite(const Event&) {
+    if (eventLog.service()) {
+        uint32_t ms = eventLog.waiting() ? EVENTLOG_POLL_MS : 0;
+        timers.start(logTimer, scheduler.now() + TicklessScheduler::msToTicks(ms));
+    }
+}
+
+void onTotalsRoll(const Event&) {
+    uint64_t at = scheduler.now();
+    totals.roll(wallClock.epochSeconds(at));
+    updateRoll(at);
+}
+
+#if BLE_SYNC
+void onSync(const Event&) {
+    uint32_t ms = bleSync.service(millis());
+    if (ms) {
+        timers.start(syncTimer, scheduler.now() + TicklessScheduler::msToTicks(ms));
+    } else {
+        timers.cancel(syncTimer);
     }
+}
+#endif
+
+void onRedraw(const Event&) {
+    drawDisplay();
+}
+
+// Pin interrupt and gesture timer, ISR context
+void buttonNotify() {
+    dispatcher.postFromISR(EVT_BUTTON);
+}
+
+// Pull next down to the time left until an RTC tick deadline, rounded up
+// to whole milliseconds (0 if already due)
+static void earliestTick(unsigned long& next, uint64_t ticks, uint64_t due) {
+    if (due == UINT64_MAX) return;
+    unsigned long left = 0;
+    if (due > ticks) {
+        left = TicklessScheduler::ticksToMs(due - ticks) + 1;
+    }
+    if (left < next) next = left;
+}
+
+// Milliseconds until the loop next has real work to do
+unsigned long msUntilNextDeadline() {
+    unsigned long next = 1000;
+    
+    // Next clock second (also redraws the reset countdown) and the
+    // running stopwatch's next second
+    uint64_t ticks = scheduler.now();
+    earliestTick(next, ticks, clockRedrawAt);
+    earliestTick(next, ticks, stopwatchRedrawAt);
+    
+    // Dialog timeout and reminders: one deadline however many are pending
+    earliestTick(next, ticks, timers.nextDeadline());
     
-    display.refresh();
-    displayDirty = false;  // Display is now up to date
+    // Button settle and gesture timeouts wake us through their own RTC
+    // compare (see button.h); waking at them here as well is the backstop
+    // if that compare is ever lost, loop() then posts EVT_BUTTON itself
+    earliestTick(next, ticks, button.nextDeadline());
+    
+    return next;
 }
 
 void setup() {
-    #if DEBUG_SERIAL
+    #if DEBUG_SERIAL || DISPLAY_MIRROR
     Serial.begin(115200);
+    #endif
+    #if DEBUG_SERIAL
     delay(2000);
     
     Serial.println("\n========================================");
@@ -433,10 +457,6 @@ void setup() {
     pinMode(STATUS_LED_PIN, OUTPUT);
     digitalWrite(STATUS_LED_PIN, LOW);  // LOW = off for active-high LED
     
-    // Initialize button with interrupt
-    pinMode(BUTTON_PIN, INPUT_PULLUP);
-    attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), buttonISR, CHANGE);
-    
     #if DEBUG_SERIAL
     Serial.print("Initializing display... ");
     #endif
@@ -454,103 +474,119 @@ void setup() {
     #if DEBUG_SERIAL
     Serial.println("Button on P1.11 (pin 43) - interrupt driven");
     Serial.println("Press: Switch stopwatch");
+    Serial.println("Double click: Pause");
     Serial.println("Long press: Reset confirm");
     Serial.println("Power optimizations: ENABLED");
     Serial.println("========================================\n");
     #endif
     
+    scheduler.begin();
+    
+    // First boot only; after that the log says where the clock got to
+    wallClock.setTimeOfDay(11, 37, 0, scheduler.now());
+    
+    // VCOM inverts from RTC2 + PPI from here on, the loop needn't wake for it
+    display.beginAutoVCOM(scheduler);
+    
+    // Button presses run first, redraws once everything else is done
+    dispatcher.begin(scheduler);
+    dispatcher.subscribe(EVT_BUTTON, PRIORITY_HIGH, onButtonEvent, true);
+    dispatcher.subscribe(EVT_CONFIRM_TIMEOUT, PRIORITY_NORMAL, onConfirmTimeout, true);
+    dispatcher.subscribe(EVT_NAG, PRIORITY_NORMAL, onNag, true);
+    dispatcher.subscribe(EVT_LOG_WRITE, PRIORITY_LOW, onLogWrite, true);
+    dispatcher.subscribe(EVT_TOTALS_ROLL, PRIORITY_LOW, onTotalsRoll, true);
+    #if BLE_SYNC
+    dispatcher.subscribe(EVT_SYNC, PRIORITY_NORMAL, onSync, true);
+    #endif
+    dispatcher.subscribe(EVT_REDRAW, PRIORITY_LOW, onRedraw, true);
+    
+    timers.begin(scheduler.now());
+    
+    // Recovers the log from its newest page; formats it on first boot
+    eventLog.begin();
+    
+    // Totals aren't stored separately, the log rebuilds them
+    LogCursor cursor = eventLog.oldest();
+    LogRecord record;
+    while (eventLog.read(cursor, record)) {
+        totals.apply(record);
+    }
+    
+    // Resume the clock from the newest record rather than from the same
+    // time every boot, so records never go back over the ones before.
+    // Time spent powered off is lost until something sets the clock
+    if (totals.latest() > wallClock.epochSeconds(scheduler.now())) {
+        wallClock.setTime(totals.latest(), scheduler.now());
+    }
+    logEvent(LOG_BOOT, STOPWATCH_NONE, scheduler.now());
+    #if DEBUG_SERIAL
+    uint32_t today = wallClock.epochSeconds(scheduler.now()) / SECONDS_PER_DAY;
+    Serial.print("Geek time today: ");
+    Serial.print(totals.daySeconds(today, 0, 0) / 60);
+    Serial.print(" min, this week: ");
+    Serial.print(totals.daysSeconds(today, 7, 0, 0) / 60);
+    Serial.print(" min, log from day ");
+    Serial.println(totals.from() / SECONDS_PER_DAY);
+    #endif
+    
+    #if BLE_SYNC
+    // SoftDevice from here on: log writes go through sd_flash_*
+    bleSync.begin(syncNotify);
+    publishLive(scheduler.now());
+    #endif
+    
+    #if DISPLAY_MIRROR
+    mirror.begin(MIRROR_KEY_FRAMES);
+    #endif
+    
+    audio.begin();
+    #if VOICE_PROMPTS
+    speech.begin(audio, speechDictionary);
+    #endif
+    
+    // Button with edge interrupt, needs RTC2 running for its timestamps
+    button.begin(BUTTON_PIN, scheduler, buttonNotify);
+    
     // Configure low power mode
     #if ENABLE_LOW_POWER_MODE
     // Enable DC/DC converter for better power efficiency
     sd_power_dcdc_mode_set(NRF_POWER_DCDC_ENABLE);
     #endif
     
-    lastStopwatchUpdate = millis();
+    // White background, widgets draw on top and keep it up to date
+    display.clearFramebuffer(true);
+    sw1Label.setText("G");
+    sw2Label.setText("L");
+    face.invalidate();
+    
     drawDisplay();
 }
 
 void loop() {
-    unsigned long now = millis();
+    uint64_t ticks = scheduler.now();
     
-    // Update button state (only when interrupt fires or button held)
-    updateButton();
+    // Expired timers post their events; everything else is posted by ISRs
+    timers.advance(ticks);
     
-    // Check reset confirmation timeout
-    if (showResetConfirm && (now - resetConfirmStartTime >= RESET_CONFIRM_MS)) {
-        showResetConfirm = false;
-        displayDirty = true;
-        #if DEBUG_SERIAL
-        Serial.println("Reset cancelled");
-        #endif
-    }
-    
-    // Update clock every second
-    if (now - lastClockUpdate >= 1000) {
-        lastClockUpdate = now;
-        updateClock();
+    // Clock and stopwatches keep time by themselves, only the shown
+    // seconds change
+    if (ticks >= clockRedrawAt || ticks >= stopwatchRedrawAt) {
+        requestRedraw();
     }
     
-    // Update stopwatches - only update every second (not 10ms) to save power
-    // The milliseconds aren't displayed anyway
-    if (now - lastStopwatchUpdate >= 1000) {
-        unsigned long elapsed = now - lastStopwatchUpdate;
-        lastStopwatchUpdate = now;
-        
-        // Simplified update - just track seconds
-        if (stopwatch1_running) {
-            stopwatch1_seconds++;
-            displayDirty = true;
-            if (stopwatch1_seconds >= 60) {
-                stopwatch1_seconds = 0;
-                stopwatch1_minutes++;
-                if (stopwatch1_minutes >= 60) {
-                    stopwatch1_minutes = 0;
-                    stopwatch1_hours++;
-                    if (stopwatch1_hours >= 100) {
-                        stopwatch1_hours = 99;
-                        stopwatch1_minutes = 59;
-                        stopwatch1_seconds = 59;
-                    }
-                }
-            }
-        }
-        
-        if (stopwatch2_running) {
-            stopwatch2_seconds++;
-            displayDirty = true;
-            if (stopwatch2_seconds >= 60) {
-                stopwatch2_seconds = 0;
-                stopwatch2_minutes++;
-                if (stopwatch2_minutes >= 60) {
-                    stopwatch2_minutes = 0;
-                    stopwatch2_hours++;
-                    if (stopwatch2_hours >= 100) {
-                        stopwatch2_hours = 99;
-                        stopwatch2_minutes = 59;
-                        stopwatch2_seconds = 59;
-                    }
-                }
-            }
-        }
+    // A button timeout that is due but hasn't been decoded
+    if (ticks >= button.nextDeadline()) {
+        dispatcher.post(EVT_BUTTON);
     }
     
-    // Only redraw display when something changed
-    if (displayDirty) {
-        drawDisplay();
-    }
+    // Run everything queued, highest priority first, then sleep
+    dispatcher.dispatch();
     
     // Sleep until next event (power optimization)
     #if ENABLE_LOW_POWER_MODE
-    // Calculate time until next wakeup needed
-    unsigned long nextUpdate = 1000;  // Default: wake every second for clock
-    
-    // If nothing is running and no confirmation dialog, can sleep longer
-    if (!stopwatch1_running && !stopwatch2_running && !showResetConfirm) {
-        nextUpdate = 1000;  // Just update clock every second
-    }
-    
-    // Short delay for debouncing and power savings
-    delay(50);  // 50ms sleep between checks
+    // Tickless: one RTC compare for the nearest deadline; posts from ISRs
+    // (button edges, gesture timeouts) cut the sleep short
+    scheduler.sleepFor(msUntilNextDeadline());
     #else
     delay(10);  // Minimal delay in non-low-power mode
     #endif
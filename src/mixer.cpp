@@ -0,0 +1,240 @@
+/**
+ * @file mixer.cpp
+ * @brief Implementation of the fixed-voice audio mixer
+ */
+
+#include "mixer.h"
+
+// Only mix() touches this, and it only runs in the I2S interrupt
+static int16_t mixScratch[MIXER_CHUNK_SAMPLES] __attribute__((aligned(4)));
+
+AudioMixer::AudioMixer() : _sampleRate(AUDIO_SAMPLE_RATE), _order(0) {
+    for (uint8_t i = 0; i < MIXER_VOICES; i++) {
+        _voices[i].kind = VOICE_IDLE;
+        _voices[i].priority = AUDIO_PRIORITY_LOW;
+        _voices[i].generation = 0;
+        _voices[i].gain = Q15_ONE;
+        _voices[i].order = 0;
+        _voices[i].source = nullptr;
+        _voices[i].context = nullptr;
+        _voices[i].silenceLeft = 0;
+    }
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void AudioMixer::begin(uint32_t sampleRate) {
+    _sampleRate = sampleRate;
+    
+    // Free-running cycle counter for the mix timings
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+int8_t AudioMixer::claim(AudioPriority priority) {
+    int8_t victim = -1;
+    for (uint8_t i = 0; i < MIXER_VOICES; i++) {
+        const Voice &v = _voices[i];
+        if (v.kind == VOICE_IDLE) return i;
+        
+        if (victim < 0 || v.priority < _voices[victim].priority ||
+            (v.priority == _voices[victim].priority &&
+             (int32_t)(v.order - _voices[victim].order) < 0)) {
+            victim = i;
+        }
+    }
+    
+    if (_voices[victim].priority > priority) {
+        _stats.rejected++;
+        return -1;
+    }
+    _voices[victim].kind = VOICE_IDLE;
+    _stats.steals++;
+    return victim;
+}
+
+VoiceHandle AudioMixer::publish(uint8_t slot, VoiceKind kind) {
+    Voice &v = _voices[slot];
+    v.order = _order++;
+    if (++v.generation == 0) v.generation = 1;
+    v.kind = kind;
+    return (VoiceHandle)(((uint16_t)v.generation << 8) | (slot + 1));
+}
+
+VoiceHandle AudioMixer::playClip(const AdpcmClip &clip, AudioPriority priority, int16_t gain) {
+    if (!clip.data || clip.numSamples == 0) return MIXER_NO_VOICE;
+    
+    VoiceHandle handle = MIXER_NO_VOICE;
+    taskENTER_CRITICAL();
+    int8_t slot = claim(priority);
+    if (slot >= 0) {
+        Voice &v = _voices[slot];
+        v.priority = priority;
+        v.gain = gain;
+        v.clip.begin(&clip);
+        handle = publish(slot, VOICE_CLIP);
+    }
+    taskEXIT_CRITICAL();
+    return handle;
+}
+
+VoiceHandle AudioMixer::playTone(uint16_t frequency, uint32_t durationMs,
+                                 AudioPriority priority, int16_t gain) {
+    if (frequency == 0 || durationMs == 0) return MIXER_NO_VOICE;
+    
+    VoiceHandle handle = MIXER_NO_VOICE;
+    taskENTER_CRITICAL();
+    int8_t slot = claim(priority);
+    if (slot >= 0) {
+        Voice &v = _voices[slot];
+        v.priority = priority;
+        v.gain = gain;
+        v.tone.start(frequency, durationMs, _sampleRate);
+        handle = publish(slot, VOICE_TONE);
+    }
+    taskEXIT_CRITICAL();
+    return handle;
+}
+
+VoiceHandle AudioMixer::playStream(MixerSource source, void *context, AudioPriority priority,
+                                   int16_t gain) {
+    if (!source) return MIXER_NO_VOICE;
+    
+    VoiceHandle handle = MIXER_NO_VOICE;
+    taskENTER_CRITICAL();
+    int8_t slot = claim(priority);
+    if (slot >= 0) {
+        Voice &v = _voices[slot];
+        v.priority = priority;
+        v.gain = gain;
+        v.source = source;
+        v.context = context;
+        handle = publish(slot, VOICE_STREAM);
+    }
+    taskEXIT_CRITICAL();
+    return handle;
+}
+
+VoiceHandle AudioMixer::playSilence(uint32_t durationMs, AudioPriority priority) {
+    if (durationMs == 0) return MIXER_NO_VOICE;
+    
+    VoiceHandle handle = MIXER_NO_VOICE;
+    taskENTER_CRITICAL();
+    int8_t slot = claim(priority);
+    if (slot >= 0) {
+        Voice &v = _voices[slot];
+        v.priority = priority;
+        v.silenceLeft = (uint32_t)(((uint64_t)durationMs * _sampleRate) / 1000);
+        handle = publish(slot, VOICE_SILENCE);
+    }
+    taskEXIT_CRITICAL();
+    return handle;
+}
+
+void AudioMixer::stopVoice(VoiceHandle voice) {
+    taskENTER_CRITICAL();
+    if (isActive(voice)) {
+        _voices[(voice & 0xFF) - 1].kind = VOICE_IDLE;
+    }
+    taskEXIT_CRITICAL();
+}
+
+void AudioMixer::stopAll() {
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < MIXER_VOICES; i++) {
+        _voices[i].kind = VOICE_IDLE;
+    }
+    taskEXIT_CRITICAL();
+}
+
+bool AudioMixer::isActive(VoiceHandle voice) const {
+    uint8_t slot = (voice & 0xFF) - 1;
+    if (slot >= MIXER_VOICES) return false;
+    const Voice &v = _voices[slot];
+    return v.kind != VOICE_IDLE && v.generation == (voice >> 8);
+}
+
+bool AudioMixer::active() const {
+    for (uint8_t i = 0; i < MIXER_VOICES; i++) {
+        if (_voices[i].kind != VOICE_IDLE) return true;
+    }
+    return false;
+}
+
+void AudioMixer::resetStats() {
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+size_t AudioMixer::render(Voice &voice, int16_t *out, size_t numSamples) {
+    switch (voice.kind) {
+        case VOICE_CLIP:
+            return voice.clip.read(out, numSamples);
+        case VOICE_TONE:
+            return voice.tone.render(out, numSamples);
+        case VOICE_STREAM: {
+            size_t n = voice.source(out, numSamples, voice.context);
+            return n < numSamples ? n : numSamples;
+        }
+        case VOICE_SILENCE: {
+            size_t n = voice.silenceLeft < numSamples ? voice.silenceLeft : numSamples;
+            voice.silenceLeft -= n;
+            return n;
+        }
+        default:
+            return 0;
+    }
+}
+
+size_t AudioMixer::mix(int16_t *out, size_t numSamples) {
+    uint32_t start = DWT->CYCCNT;
+    memset(out, 0, numSamples * sizeof(int16_t));
+    
+    // Ducking is decided once per buffer, from who is playing at its start
+    uint8_t top = 0;
+    bool any = false;
+    for (uint8_t i = 0; i < MIXER_VOICES; i++) {
+        if (_voices[i].kind != VOICE_IDLE) {
+            if (!any || _voices[i].priority > top) top = _voices[i].priority;
+            any = true;
+        }
+    }
+    
+    size_t longest = 0;
+    for (uint8_t i = 0; any && i < MIXER_VOICES; i++) {
+        Voice &v = _voices[i];
+        if (v.kind == VOICE_IDLE) continue;
+        
+        int16_t gain = v.gain;
+        if (v.priority < top) {
+            gain = (int16_t)(((int32_t)gain * MIXER_DUCK_GAIN) >> 15);
+        }
+        
+        size_t done = 0;
+        while (done < numSamples) {
+            size_t want = numSamples - done;
+            if (want > MIXER_CHUNK_SAMPLES) want = MIXER_CHUNK_SAMPLES;
+            size_t got = render(v, mixScratch, want);
+            
+            if (got && v.kind != VOICE_SILENCE) {
+                if (gain == Q15_ONE) {
+                    q15Mix(out + done, mixScratch, got);
+                } else {
+                    q15MixScaled(out + done, mixScratch, got, gain);
+                }
+            }
+            done += got;
+            if (got < want) {
+                v.kind = VOICE_IDLE;  // Source ran dry, the slot is free
+                break;
+            }
+        }
+        if (done > longest) longest = done;
+    }
+    
+    uint32_t cycles = DWT->CYCCNT - start;
+    _stats.buffers++;
+    _stats.lastCycles = cycles;
+    if (cycles > _stats.maxCycles) _stats.maxCycles = cycles;
+    _stats.budgetCycles = (uint32_t)(((uint64_t)SystemCoreClock * numSamples) / _sampleRate);
+    return longest;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file scheduler.cpp
+ * @brief Implementation of the RTC2 tickless scheduler
+ */
+
+#include "scheduler.h"
+
+// The RTC can miss a compare value less than 2 ticks ahead of COUNTER
+#define RTC_MIN_COMPARE_TICKS   2
+// Longest single sleep, keeps the compare well inside one counter period
+#define RTC_MAX_SLEEP_TICKS     (RTC_COUNTER_MASK >> 1)
+// Backstop on the semaphore wait past the deadline, should the compare be lost
+#define RTC_SLEEP_SLACK_MS      20
+
+static TicklessScheduler* activeScheduler = nullptr;
+
+TicklessScheduler::TicklessScheduler() : _overflows(0), _wakeups(0), _wake(nullptr) {
+    for (uint8_t ch = 0; ch < RTC_CHANNELS; ch++) {
+        _compareHandlers[ch] = nullptr;
+    }
+}
+
+void TicklessScheduler::begin() {
+    activeScheduler = this;
+    if (!_wake) {
+        _wake = xSemaphoreCreateBinary();
+    }
+    
+    // LFCLK is already running for the FreeRTOS tick (RTC1)
+    NRF_RTC2->TASKS_STOP = 1;
+    NRF_RTC2->TASKS_CLEAR = 1;
+    NRF_RTC2->PRESCALER = 0;  // 32.768kHz, ~30.5us per tick
+    
+    NRF_RTC2->EVENTS_OVRFLW = 0;
+    NRF_RTC2->EVENTS_COMPARE[0] = 0;
+    NRF_RTC2->INTENSET = RTC_INTENSET_OVRFLW_Msk;
+    
+    NVIC_ClearPendingIRQ(RTC2_IRQn);
+    NVIC_SetPriority(RTC2_IRQn, 2);  // Above other app IRQs, see now()
+    NVIC_EnableIRQ(RTC2_IRQn);
+    
+    NRF_RTC2->TASKS_START = 1;
+}
+
+uint64_t TicklessScheduler::now() const {
+    uint32_t hi, lo;
+    do {
+        hi = _overflows;
+        lo = NRF_RTC2->COUNTER;
+    } while (hi != _overflows);
+    
+    // Caller outranks the RTC2 IRQ and the counter has wrapped but the
+    // overflow hasn't been counted yet
+    if (NRF_RTC2->EVENTS_OVRFLW && lo < (RTC_COUNTER_MASK >> 1)) {
+        hi++;
+    }
+    
+    return ((uint64_t)hi << RTC_COUNTER_BITS) | lo;
+}
+
+void TicklessScheduler::sleepUntil(uint64_t deadline) {
+    uint64_t start = now();
+    if (deadline <= start + RTC_MIN_COMPARE_TICKS) return;
+    
+    uint64_t ticks = deadline - start;
+    if (ticks > RTC_MAX_SLEEP_TICKS) {
+        ticks = RTC_MAX_SLEEP_TICKS;  // Caller re-evaluates and sleeps again
+    }
+    
+    NRF_RTC2->CC[0] = (uint32_t)(start + ticks) & RTC_COUNTER_MASK;
+    NRF_RTC2->EVENTS_COMPARE[0] = 0;
+    NRF_RTC2->INTENSET = RTC_INTENSET_COMPARE0_Msk;
+    
+    // The SoftDevice or an ISR may have held us up since start was read.
+    // If the counter is already at or too close to CC the compare won't
+    // fire until the counter comes round again (~512s), so don't wait on
+    // it. Past this check it is armed in time and latches even if we are
+    // preempted again before the take below
+    if (now() + RTC_MIN_COMPARE_TICKS >= start + ticks) {
+        NRF_RTC2->INTENCLR = RTC_INTENCLR_COMPARE0_Msk;
+        NRF_RTC2->EVENTS_COMPARE[0] = 0;
+        _wakeups++;
+        return;
+    }
+    
+    // Nothing else to run: FreeRTOS suppresses its tick and the idle task
+    // sleeps with WFE until RTC2 or a GPIO interrupt fires. A wake-up given
+    // while we were still awake is kept and returns at once, so an event
+    // posted just before this call is never slept through. The timeout
+    // only matters if the compare is lost anyway; it bounds the damage to
+    // a late wake instead of a missed one
+    xSemaphoreTake(_wake, pdMS_TO_TICKS(ticksToMs(ticks) + RTC_SLEEP_SLACK_MS));
+    
+    NRF_RTC2->INTENCLR = RTC_INTENCLR_COMPARE0_Msk;
+    _wakeups++;
+}
+
+void TicklessScheduler::sleepFor(uint32_t ms) {
+    sleepUntil(now() + msToTicks(ms));
+}
+
+void TicklessScheduler::attachCompare(uint8_t channel, RtcCompareHandler handler) {
+    if (channel == 0 || channel >= RTC_CHANNELS) return;  // 0 is sleepUntil()'s
+    _compareHandlers[channel] = handler;
+}
+
+void TicklessScheduler::wakeFromISR() {
+    if (!_wake) return;
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(_wake, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void TicklessScheduler::onInterrupt() {
+    if (NRF_RTC2->EVENTS_OVRFLW) {
+        NRF_RTC2->EVENTS_OVRFLW = 0;
+        _overflows++;
+    }
+    
+    if (NRF_RTC2->EVENTS_COMPARE[0]) {
+        NRF_RTC2->EVENTS_COMPARE[0] = 0;
+        NRF_RTC2->INTENCLR = RTC_INTENCLR_COMPARE0_Msk;
+        wakeFromISR();
+    }
+    
+    for (uint8_t ch = 1; ch < RTC_CHANNELS; ch++) {
+        if (NRF_RTC2->EVENTS_COMPARE[ch]) {
+            NRF_RTC2->EVENTS_COMPARE[ch] = 0;
+            RtcCompareHandler handler = _compareHandlers[ch];
+            if (handler) handler();
+        }
+    }
+}
+
+extern "C" void RTC2_IRQHandler(void) {
+    if (activeScheduler) {
+        activeScheduler->onInterrupt();
+    }
+}
@@ -0,0 +1,144 @@
+/**
+ * @file session_totals.cpp
+ * @brief Implementation of the hourly and daily time totals
+ */
+
+#include "session_totals.h"
+#include "wallclock.h"
+#include <string.h>
+
+#define SECONDS_PER_HOUR    3600UL
+#define HOURS_PER_DAY       24
+
+SessionTotals::SessionTotals() {
+    clear();
+}
+
+void SessionTotals::clear() {
+    memset(_hours, 0, sizeof(_hours));
+    memset(_days, 0, sizeof(_days));
+    for (uint8_t i = 0; i < TOTALS_HOURS; i++) {
+        _hours[i].hour = TOTALS_EMPTY;
+    }
+    for (uint8_t i = 0; i < TOTALS_DAYS; i++) {
+        _days[i].day = TOTALS_EMPTY;
+    }
+    _active = STOPWATCH_NONE;
+    _since = 0;
+    _from = TOTALS_EMPTY;
+    _latest = 0;
+}
+
+void SessionTotals::apply(const LogRecord &record) {
+    // The clock started over: what came before is on another time line
+    if (record.time < _latest) clear();
+    if (_from == TOTALS_EMPTY) _from = record.time;
+    _latest = record.time;
+    
+    switch (record.type) {
+        case LOG_BOOT:
+            _active = STOPWATCH_NONE;
+            break;
+        case LOG_SWITCH:
+            switchTo(record.category, record.time);
+            break;
+        case LOG_RESET:
+            // Clears the stopwatches, not the history
+            switchTo(STOPWATCH_NONE, record.time);
+            break;
+    }
+}
+
+void SessionTotals::switchTo(uint8_t category, uint32_t time) {
+    roll(time);
+    _active = category < TOTALS_CATEGORIES ? category : STOPWATCH_NONE;
+    _since = time;
+}
+
+void SessionTotals::roll(uint32_t time) {
+    if (_active == STOPWATCH_NONE) return;
+    
+    // The clock was set back: nothing to credit, carry on from here
+    if (time > _since) credit(_since, time);
+    _since = time;
+}
+
+uint32_t SessionTotals::nextRoll() const {
+    if (_active == STOPWATCH_NONE) return TOTALS_EMPTY;
+    return (_since / SECONDS_PER_HOUR + 1) * SECONDS_PER_HOUR;
+}
+
+void SessionTotals::credit(uint32_t from, uint32_t to) {
+    // Only hours the day ring can still hold; a clock set forward could
+    // otherwise make this walk years
+    uint32_t horizon = TOTALS_DAYS * HOURS_PER_DAY * SECONDS_PER_HOUR;
+    if (to - from > horizon) from = to - horizon;
+    
+    // One pass per hour touched, a single one when roll() keeps up
+    while (from < to) {
+        uint32_t hour = from / SECONDS_PER_HOUR;
+        uint32_t end = (hour + 1) * SECONDS_PER_HOUR;
+        if (end > to) end = to;
+        add(hour, end - from);
+        from = end;
+    }
+}
+
+void SessionTotals::add(uint32_t hour, uint32_t seconds) {
+    // A slot holding an older bucket is taken over; one holding a newer
+    // bucket means this time is too old to keep
+    HourTotals &h = _hours[hour % TOTALS_HOURS];
+    if (h.hour == TOTALS_EMPTY || h.hour < hour) {
+        memset(&h, 0, sizeof(h));
+        h.hour = hour;
+    }
+    if (h.hour == hour) h.seconds[_active] += seconds;
+    
+    uint32_t day = hour / HOURS_PER_DAY;
+    DayTotals &d = _days[day % TOTALS_DAYS];
+    if (d.day == TOTALS_EMPTY || d.day < day) {
+        memset(&d, 0, sizeof(d));
+        d.day = day;
+    }
+    if (d.day == day) d.seconds[_active] += seconds;
+}
+
+uint32_t SessionTotals::open(uint8_t category, uint32_t start, uint32_t end, uint32_t now) const {
+    if (category != _active || _active == STOPWATCH_NONE) return 0;
+    if (start < _since) start = _since;
+    if (end > now) end = now;
+    return end > start ? end - start : 0;
+}
+
+const HourTotals *SessionTotals::hourBucket(uint32_t hour) const {
+    const HourTotals &h = _hours[hour % TOTALS_HOURS];
+    return h.hour == hour ? &h : nullptr;
+}
+
+const DayTotals *SessionTotals::dayBucket(uint32_t day) const {
+    const DayTotals &d = _days[day % TOTALS_DAYS];
+    return d.day == day ? &d : nullptr;
+}
+
+uint32_t SessionTotals::hourSeconds(uint32_t hour, uint8_t category, uint32_t now) const {
+    if (category >= TOTALS_CATEGORIES) return 0;
+    const HourTotals *h = hourBucket(hour);
+    uint32_t seconds = h ? h->seconds[category] : 0;
+    return seconds + open(category, hour * SECONDS_PER_HOUR, (hour + 1) * SECONDS_PER_HOUR, now);
+}
+
+uint32_t SessionTotals::daySeconds(uint32_t day, uint8_t category, uint32_t now) const {
+    if (category >= TOTALS_CATEGORIES) return 0;
+    const DayTotals *d = dayBucket(day);
+    uint32_t seconds = d ? d->seconds[category] : 0;
+    return seconds + open(category, day * SECONDS_PER_DAY, (day + 1) * SECONDS_PER_DAY, now);
+}
+
+uint32_t SessionTotals::daysSeconds(uint32_t lastDay, uint8_t days, uint8_t category,
+                                    uint32_t now) const {
+    uint32_t seconds = 0;
+    for (uint8_t i = 0; i < days && i <= lastDay; i++) {
+        seconds += daySeconds(lastDay - i, category, now);
+    }
+    return seconds;
+}
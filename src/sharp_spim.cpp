@@ -0,0 +1,155 @@
+/**
+ * @file sharp_spim.cpp
+ * @brief Implementation of the EasyDMA SPIM frame transport
+ */
+
+#include "sharp_spim.h"
+
+// Sharp needs tsSCS >= 3us between CS rising and the first clock edge
+// CSNDUR is in 64MHz ticks: 192 ticks = 3us
+#define SHARP_CSNDUR        192
+
+// nRF52840 anomaly 198 workaround register: one bit per 8KB RAM block
+// below 0x20010000, bit 8 for everything above
+#define ANOMALY_198_REG     (*(volatile uint32_t *)0x40000E00)
+
+static SharpSpim* activeTransport = nullptr;
+
+// Workaround bits for the RAM blocks a frame occupies, as nrfx computes them
+static uint32_t ramBlocks(const uint8_t* frame, size_t len) {
+    if (!frame || len == 0) return 0;
+
+    uint32_t addr = (uint32_t)frame & ~0x1FFFUL;
+    uint32_t end = (uint32_t)frame + len;
+    if (addr >= 0x20010000) return 1UL << 8;
+
+    uint32_t blocks = 0;
+    uint32_t flag = 1UL << ((addr >> 13) & 0xFFFF);
+    do {
+        blocks |= flag;
+        flag <<= 1;
+        addr += 0x2000;
+    } while (addr < end && addr < 0x20012000);
+    return blocks;
+}
+
+SharpSpim::SharpSpim()
+    : _busy(false), _standby(nullptr), _standbyLen(0), _done(nullptr), _ramPriorityIdle(0) {
+}
+
+void SharpSpim::begin(uint8_t sck, uint8_t mosi, uint8_t cs) {
+    activeTransport = this;
+    if (!_done) {
+        _done = xSemaphoreCreateBinary();
+    }
+    _ramPriorityIdle = ANOMALY_198_REG;
+
+    // Idle levels while SPIM3 is disabled: clock low (mode 0), CS low (inactive)
+    pinMode(sck, OUTPUT);
+    digitalWrite(sck, LOW);
+    pinMode(mosi, OUTPUT);
+    digitalWrite(mosi, LOW);
+    pinMode(cs, OUTPUT);
+    digitalWrite(cs, LOW);
+
+    NRF_SPIM3->ENABLE = SPIM_ENABLE_ENABLE_Disabled;
+    NRF_SPIM3->PSEL.SCK = sck;
+    NRF_SPIM3->PSEL.MOSI = mosi;
+    NRF_SPIM3->PSEL.MISO = 0xFFFFFFFF;  // Not connected
+    NRF_SPIM3->PSEL.CSN = cs;
+
+    // Sharp Memory Display: LSB first, Mode 0, 500kHz (SHARP_SPIM_HZ) for lower power
+    NRF_SPIM3->FREQUENCY = SPIM_FREQUENCY_FREQUENCY_K500;
+    NRF_SPIM3->CONFIG = (SPIM_CONFIG_ORDER_LsbFirst << SPIM_CONFIG_ORDER_Pos) |
+                        (SPIM_CONFIG_CPHA_Leading << SPIM_CONFIG_CPHA_Pos) |
+                        (SPIM_CONFIG_CPOL_ActiveHigh << SPIM_CONFIG_CPOL_Pos);
+
+    // Hardware chip select, active HIGH for the whole frame
+    NRF_SPIM3->CSNPOL = SPIM_CSNPOL_CSNPOL_HIGH;
+    NRF_SPIM3->IFTIMING.CSNDUR = SHARP_CSNDUR;
+
+    NRF_SPIM3->RXD.PTR = 0;
+    NRF_SPIM3->RXD.MAXCNT = 0;
+    NRF_SPIM3->ORC = 0x00;
+
+    // END interrupts only for our own transfers, see start()
+    NRF_SPIM3->EVENTS_END = 0;
+    NRF_SPIM3->INTENCLR = SPIM_INTENCLR_END_Msk;
+    NVIC_ClearPendingIRQ(SPIM3_IRQn);
+    NVIC_SetPriority(SPIM3_IRQn, 3);
+    NVIC_EnableIRQ(SPIM3_IRQn);
+}
+
+void SharpSpim::start(const uint8_t* frame, size_t len) {
+    wait();
+    if (len == 0) return;
+
+    _busy = true;
+
+    // SPIM is only enabled while a frame is in flight (or a standby frame
+    // is loaded) to save power
+    NRF_SPIM3->ENABLE = SPIM_ENABLE_ENABLE_Enabled;
+    ANOMALY_198_REG = ramBlocks(frame, len) | ramBlocks(_standby, _standbyLen);
+    NRF_SPIM3->TXD.PTR = (uint32_t)frame;
+    NRF_SPIM3->TXD.MAXCNT = len;
+    NRF_SPIM3->EVENTS_END = 0;
+    NRF_SPIM3->INTENSET = SPIM_INTENSET_END_Msk;
+    NRF_SPIM3->TASKS_START = 1;
+}
+
+void SharpSpim::wait() {
+    while (_busy) {
+        // Blocks the task, the idle task puts the CPU to sleep
+        xSemaphoreTake(_done, portMAX_DELAY);
+    }
+}
+
+void SharpSpim::setStandby(const uint8_t* frame, size_t len) {
+    _standby = frame;
+    _standbyLen = len;
+    if (_busy) return;  // onEnd() picks it up
+
+    if (frame) {
+        NRF_SPIM3->ENABLE = SPIM_ENABLE_ENABLE_Enabled;
+        ANOMALY_198_REG = ramBlocks(frame, len);
+        NRF_SPIM3->TXD.PTR = (uint32_t)frame;
+        NRF_SPIM3->TXD.MAXCNT = len;
+    } else {
+        idle();
+    }
+}
+
+void SharpSpim::idle() {
+    NRF_SPIM3->ENABLE = SPIM_ENABLE_ENABLE_Disabled;
+    // nRF52840 anomaly 195: SPIM3 keeps drawing current after disable
+    *(volatile uint32_t *)0x4002F004 = 1;
+    ANOMALY_198_REG = _ramPriorityIdle;
+}
+
+void SharpSpim::onEnd() {
+    // Standby frames started through PPI end without waking anyone
+    NRF_SPIM3->INTENCLR = SPIM_INTENCLR_END_Msk;
+    if (_standby) {
+        // Only the standby frame is read from now on
+        ANOMALY_198_REG = ramBlocks(_standby, _standbyLen);
+        NRF_SPIM3->TXD.PTR = (uint32_t)_standby;
+        NRF_SPIM3->TXD.MAXCNT = _standbyLen;
+    } else {
+        idle();
+    }
+
+    _busy = false;
+
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(_done, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+extern "C" void SPIM3_IRQHandler(void) {
+    if (NRF_SPIM3->EVENTS_END) {
+        NRF_SPIM3->EVENTS_END = 0;
+        if (activeTransport) {
+            activeTransport->onEnd();
+        }
+    }
+}
@@ -0,0 +1,154 @@
+/**
+ * @file sharp_vcom.cpp
+ * @brief Implementation of background VCOM inversion
+ */
+
+#include "sharp_vcom.h"
+#include "display_sharp.h"
+#include <nrf_sdm.h>
+#include <nrf_soc.h>
+
+// PPI channel for the compare event (the SoftDevice keeps 17 and up)
+#define VCOM_PPI_CHANNEL        4
+// GPIOTE channel for EXTCOMIN, from the top so attachInterrupt() keeps the low ones
+#define VCOM_GPIOTE_CHANNEL     7
+
+// A 2-byte VCOM frame incl. chip select setup, with some slack
+#define VCOM_FRAME_US           40
+// RTC ticks that cover one VCOM frame plus the compare's own latency
+#define VCOM_GUARD_TICKS        3
+
+static SharpVcom* activeVcom = nullptr;
+
+static void vcomCompareISR() {
+    if (activeVcom) {
+        activeVcom->onCompare();
+    }
+}
+
+// PPI is shared with the SoftDevice once it runs, so go through its API then
+static void ppiConnect(uint8_t ch, uint32_t eep, uint32_t tep) {
+    uint8_t sdEnabled = 0;
+    sd_softdevice_is_enabled(&sdEnabled);
+    if (sdEnabled) {
+        sd_ppi_channel_assign(ch, (const volatile void*)eep, (const volatile void*)tep);
+        sd_ppi_channel_enable_set(1UL << ch);
+    } else {
+        NRF_PPI->CH[ch].EEP = eep;
+        NRF_PPI->CH[ch].TEP = tep;
+        NRF_PPI->CHENSET = 1UL << ch;
+    }
+}
+
+static void ppiDisconnect(uint8_t ch) {
+    uint8_t sdEnabled = 0;
+    sd_softdevice_is_enabled(&sdEnabled);
+    if (sdEnabled) {
+        sd_ppi_channel_enable_clr(1UL << ch);
+    } else {
+        NRF_PPI->CHENCLR = 1UL << ch;
+    }
+}
+
+// RTC ticks a frame of len bytes spends on the wire, rounded up
+static uint32_t transferTicks(size_t len) {
+    return (uint32_t)(((uint64_t)len * 8 * RTC_TICK_HZ + SHARP_SPIM_HZ - 1) / SHARP_SPIM_HZ);
+}
+
+SharpVcom::SharpVcom() : _spim(nullptr), _period(RTC_TICK_HZ), _lastCompare(0),
+                         _polarity(false), _running(false) {
+    // Command byte only (M1 = VCOM, M0 = M2 = 0), then the trailer
+    _frames[0][0] = 0x00;
+    _frames[0][1] = 0x00;
+    _frames[1][0] = SHARP_CMD_VCOM;
+    _frames[1][1] = 0x00;
+}
+
+void SharpVcom::begin(SharpSpim& spim, TicklessScheduler& rtc, uint8_t hz) {
+    if (_running) end();
+    
+    activeVcom = this;
+    _spim = &spim;
+    
+    #ifdef DISPLAY_EXTCOMIN_PIN
+    // One rising edge per inversion, so the pin toggles twice as often
+    _period = RTC_TICK_HZ / (2 * hz);
+    NRF_GPIOTE->CONFIG[VCOM_GPIOTE_CHANNEL] =
+        (GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos) |
+        ((DISPLAY_EXTCOMIN_PIN & 31) << GPIOTE_CONFIG_PSEL_Pos) |
+        ((DISPLAY_EXTCOMIN_PIN >> 5) << GPIOTE_CONFIG_PORT_Pos) |
+        (GPIOTE_CONFIG_POLARITY_Toggle << GPIOTE_CONFIG_POLARITY_Pos) |
+        (GPIOTE_CONFIG_OUTINIT_Low << GPIOTE_CONFIG_OUTINIT_Pos);
+    uint32_t task = (uint32_t)&NRF_GPIOTE->TASKS_OUT[VCOM_GPIOTE_CHANNEL];
+    #else
+    _period = RTC_TICK_HZ / hz;
+    spim.setStandby(_frames[!_polarity], 2);
+    uint32_t task = spim.startTask();
+    #endif
+    
+    rtc.attachCompare(VCOM_RTC_CHANNEL, vcomCompareISR);
+    
+    uint32_t now = NRF_RTC2->COUNTER;
+    _lastCompare = now;
+    NRF_RTC2->CC[VCOM_RTC_CHANNEL] = (now + _period) & RTC_COUNTER_MASK;
+    NRF_RTC2->EVENTS_COMPARE[VCOM_RTC_CHANNEL] = 0;
+    NRF_RTC2->EVTENSET = RTC_EVTENSET_COMPARE1_Msk;
+    NRF_RTC2->INTENSET = RTC_INTENSET_COMPARE1_Msk;
+    
+    ppiConnect(VCOM_PPI_CHANNEL, (uint32_t)&NRF_RTC2->EVENTS_COMPARE[VCOM_RTC_CHANNEL], task);
+    _running = true;
+}
+
+void SharpVcom::end() {
+    if (!_running) return;
+    
+    ppiDisconnect(VCOM_PPI_CHANNEL);
+    NRF_RTC2->EVTENCLR = RTC_EVTENCLR_COMPARE1_Msk;
+    NRF_RTC2->INTENCLR = RTC_INTENCLR_COMPARE1_Msk;
+    
+    #ifdef DISPLAY_EXTCOMIN_PIN
+    NRF_GPIOTE->CONFIG[VCOM_GPIOTE_CHANNEL] = 0;
+    #else
+    // A frame started just before the channel closed may still be going out
+    delayMicroseconds(VCOM_FRAME_US);
+    _spim->setStandby(nullptr, 0);
+    #endif
+    
+    _running = false;
+}
+
+void SharpVcom::beforeTransfer(size_t len) {
+    #ifndef DISPLAY_EXTCOMIN_PIN
+    if (!_running) return;
+    
+    uint32_t now = NRF_RTC2->COUNTER;
+    uint32_t next = NRF_RTC2->CC[VCOM_RTC_CHANNEL];
+    
+    // Inversion due while this frame is on the wire: do it right after
+    uint32_t window = transferTicks(len) + VCOM_GUARD_TICKS;
+    if (((next - now) & RTC_COUNTER_MASK) < window) {
+        NRF_RTC2->CC[VCOM_RTC_CHANNEL] = (now + window) & RTC_COUNTER_MASK;
+    }
+    
+    // One that fired a moment ago may still be clocking out
+    uint32_t later = NRF_RTC2->COUNTER;
+    if (((later - next) & RTC_COUNTER_MASK) < VCOM_GUARD_TICKS ||
+        ((later - _lastCompare) & RTC_COUNTER_MASK) < VCOM_GUARD_TICKS) {
+        delayMicroseconds(VCOM_FRAME_US);
+    }
+    #else
+    (void)len;  // EXTCOMIN doesn't share the bus
+    #endif
+}
+
+void SharpVcom::onCompare() {
+    // The frame (or pin edge) already went out in hardware, set up the next
+    uint32_t fired = NRF_RTC2->CC[VCOM_RTC_CHANNEL];
+    _lastCompare = fired;
+    NRF_RTC2->CC[VCOM_RTC_CHANNEL] = (fired + _period) & RTC_COUNTER_MASK;
+    
+    _polarity = !_polarity;
+    #ifndef DISPLAY_EXTCOMIN_PIN
+    _spim->setStandby(_frames[!_polarity], 2);
+    #endif
+}
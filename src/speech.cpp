@@ -0,0 +1,116 @@
+/**
+ * @file speech.cpp
+ * @brief Implementation of the phrase builder and gapless word player
+ */
+
+#include "speech.h"
+
+static const SpeechWord tensWords[] = {
+    WORD_TWENTY, WORD_THIRTY, WORD_FORTY, WORD_FIFTY,
+    WORD_SIXTY, WORD_SEVENTY, WORD_EIGHTY, WORD_NINETY
+};
+
+bool SpeechPhrase::add(SpeechWord word) {
+    if (_count >= SPEECH_MAX_WORDS) return false;
+    _words[_count++] = word;
+    return true;
+}
+
+bool SpeechPhrase::addNumber(uint16_t n) {
+    if (n > SPEECH_MAX_NUMBER) n = SPEECH_MAX_NUMBER;
+    
+    bool ok = true;
+    if (n >= 100) {
+        ok = add((SpeechWord)(WORD_ZERO + n / 100)) && add(WORD_HUNDRED);
+        n %= 100;
+        if (n == 0) return ok;
+    }
+    if (n < 20) {
+        return ok && add((SpeechWord)(WORD_ZERO + n));
+    }
+    ok = ok && add(tensWords[n / 10 - 2]);
+    if (n % 10) {
+        ok = ok && add((SpeechWord)(WORD_ZERO + n % 10));
+    }
+    return ok;
+}
+
+bool SpeechPhrase::addUnit(uint32_t n, SpeechWord one, SpeechWord many) {
+    return addNumber(n > SPEECH_MAX_NUMBER ? SPEECH_MAX_NUMBER : (uint16_t)n) &&
+           add(n == 1 ? one : many);
+}
+
+bool SpeechPhrase::addDuration(uint32_t hours, uint8_t minutes, uint8_t seconds) {
+    if (hours == 0 && minutes == 0) {
+        return addUnit(seconds, WORD_SECOND, WORD_SECONDS);
+    }
+    
+    bool ok = true;
+    if (hours) {
+        ok = addUnit(hours, WORD_HOUR, WORD_HOURS);
+    }
+    if (minutes) {
+        ok = ok && addUnit(minutes, WORD_MINUTE, WORD_MINUTES);
+    }
+    return ok;
+}
+
+bool SpeechPhrase::addElapsed(uint32_t seconds) {
+    return addDuration(seconds / 3600, (seconds / 60) % 60, seconds % 60);
+}
+
+SpeechPlayer::SpeechPlayer()
+    : _audio(nullptr), _dictionary(nullptr), _voice(MIXER_NO_VOICE), _next(0) {
+}
+
+void SpeechPlayer::begin(GeekWatchAudio &audio, const AdpcmClip *const *dictionary) {
+    _audio = &audio;
+    _dictionary = dictionary;
+}
+
+bool SpeechPlayer::say(const SpeechPhrase &phrase, AudioPriority priority) {
+    if (!_audio || !_dictionary) return false;
+    
+    // The producer must be off this phrase before it is overwritten
+    stop();
+    _phrase = phrase;
+    _next = 0;
+    if (!nextClip()) return false;
+    
+    _voice = _audio->playStream(producer, this, priority);
+    return _voice != MIXER_NO_VOICE;
+}
+
+void SpeechPlayer::stop() {
+    if (_audio && _voice != MIXER_NO_VOICE) {
+        _audio->mixer().stopVoice(_voice);
+    }
+    _voice = MIXER_NO_VOICE;
+}
+
+bool SpeechPlayer::speaking() const {
+    return _audio && _voice != MIXER_NO_VOICE && _audio->mixer().isActive(_voice);
+}
+
+bool SpeechPlayer::nextClip() {
+    while (_next < _phrase.count()) {
+        const AdpcmClip *clip = _dictionary[_phrase.word(_next++)];
+        if (clip && clip->data && clip->numSamples) {
+            _decoder.begin(clip);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t SpeechPlayer::producer(int16_t *buffer, size_t numSamples, void *context) {
+    SpeechPlayer *player = (SpeechPlayer *)context;
+    size_t written = 0;
+    
+    // Carry straight on into the next word within the same buffer
+    while (written < numSamples) {
+        written += player->_decoder.read(buffer + written, numSamples - written);
+        if (written < numSamples && !player->nextClip()) break;
+    }
+    return written;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file stopwatch.cpp
+ * @brief Implementation of the timestamp-based stopwatch engine
+ */
+
+#include "stopwatch.h"
+#include <string.h>
+
+StopwatchEngine::StopwatchEngine(uint8_t count)
+    : _count(count > STOPWATCH_MAX_CATEGORIES ? STOPWATCH_MAX_CATEGORIES : count),
+      _active(STOPWATCH_NONE) {
+    memset(_entries, 0, sizeof(_entries));
+}
+
+void StopwatchEngine::switchTo(uint8_t id, uint64_t now) {
+    if (id >= _count) id = STOPWATCH_NONE;
+    if (id == _active) return;
+    
+    // Fold the finished run into the total
+    if (_active != STOPWATCH_NONE) {
+        StopwatchEntry& prev = _entries[_active];
+        prev.accumulated += now - prev.startedAt;
+        prev.running = false;
+    }
+    
+    if (id != STOPWATCH_NONE) {
+        _entries[id].startedAt = now;
+        _entries[id].running = true;
+    }
+    _active = id;
+}
+
+uint8_t StopwatchEngine::cycle(uint64_t now) {
+    uint8_t next = (_active == STOPWATCH_NONE) ? 0 : (_active + 1) % _count;
+    switchTo(next, now);
+    return next;
+}
+
+void StopwatchEngine::reset() {
+    memset(_entries, 0, sizeof(_entries));
+    _active = STOPWATCH_NONE;
+}
+
+uint64_t StopwatchEngine::elapsedTicks(uint8_t id, uint64_t now) const {
+    if (id >= _count) return 0;
+    
+    const StopwatchEntry& e = _entries[id];
+    return e.running ? e.accumulated + (now - e.startedAt) : e.accumulated;
+}
+
+uint32_t StopwatchEngine::elapsedSeconds(uint8_t id, uint64_t now) const {
+    uint64_t seconds = elapsedTicks(id, now) / STOPWATCH_TICK_HZ;
+    return seconds > STOPWATCH_MAX_SECONDS ? STOPWATCH_MAX_SECONDS : (uint32_t)seconds;
+}
+
+StopwatchTime StopwatchEngine::elapsed(uint8_t id, uint64_t now) const {
+    // HH:MM:SS is only worked out here, when something is rendered
+    uint32_t total = elapsedSeconds(id, now);
+    
+    StopwatchTime t;
+    t.hours = total / 3600;
+    t.minutes = (total / 60) % 60;
+    t.seconds = total % 60;
+    return t;
+}
+
+uint64_t StopwatchEngine::nextSecond(uint64_t now) const {
+    if (_active == STOPWATCH_NONE) return UINT64_MAX;
+    if (elapsedSeconds(_active, now) >= STOPWATCH_MAX_SECONDS) return UINT64_MAX;
+    
+    uint64_t ticks = elapsedTicks(_active, now);
+    return now + (STOPWATCH_TICK_HZ - ticks % STOPWATCH_TICK_HZ);
+}
@@ -0,0 +1,210 @@
+/**
+ * @file sync_protocol.cpp
+ * @brief Implementation of the log sync framing and resume logic
+ */
+
+#include "sync_protocol.h"
+#include <string.h>
+
+#define END_PACKET_BYTES    5
+
+static void put32(uint8_t *out, uint32_t v) {
+    out[0] = (uint8_t)v;
+    out[1] = (uint8_t)(v >> 8);
+    out[2] = (uint8_t)(v >> 16);
+    out[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get32(const uint8_t *in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) |
+           ((uint32_t)in[3] << 24);
+}
+
+SyncSession::SyncSession()
+    : _source(nullptr), _payload(SYNC_PAYLOAD_MIN), _window(1), _running(false),
+      _endSent(false), _acked(0), _sent(0), _inflightFirst(0), _inflightCount(0),
+      _hasPending(false) {
+    memset(&_pending, 0, sizeof(_pending));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void SyncSession::begin(SyncSource &source) {
+    _source = &source;
+}
+
+void SyncSession::setPayload(uint16_t bytes) {
+    if (bytes < SYNC_PAYLOAD_MIN) bytes = SYNC_PAYLOAD_MIN;
+    if (bytes > SYNC_PAYLOAD_MAX) bytes = SYNC_PAYLOAD_MAX;
+    _payload = bytes;
+}
+
+bool SyncSession::command(const uint8_t *data, size_t len) {
+    if (len < 1 || !_source) return false;
+    
+    switch (data[0]) {
+        case SYNC_CMD_START: {
+            if (len < 6) return false;
+            uint32_t from = get32(data + 1);
+            _window = data[5];
+            if (_window < 1) _window = 1;
+            if (_window > SYNC_WINDOW_MAX) _window = SYNC_WINDOW_MAX;
+            _running = true;
+            restart(from == SYNC_RESUME ? _acked : from);
+            return true;
+        }
+        case SYNC_CMD_ACK: {
+            if (len < 5 || !_running) return false;
+            uint32_t seq = get32(data + 1);
+            if (seq > _sent) return false;  // Acks something never sent
+            if (seq > _acked) _acked = seq;
+            
+            // Cumulative: frees every packet that ends at or before it
+            while (_inflightCount && _inflight[_inflightFirst] <= _acked) {
+                _inflightFirst = (_inflightFirst + 1) % SYNC_WINDOW_MAX;
+                _inflightCount--;
+            }
+            return true;
+        }
+        case SYNC_CMD_STOP:
+            _running = false;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void SyncSession::restart(uint32_t from) {
+    _source->seek(from);
+    _acked = from;
+    _sent = from;
+    _inflightFirst = 0;
+    _inflightCount = 0;
+    _hasPending = false;
+    _endSent = false;
+}
+
+void SyncSession::rewind() {
+    if (!_running) return;
+    _stats.rewinds += _inflightCount;
+    restart(_acked);
+}
+
+void SyncSession::stop() {
+    _running = false;
+}
+
+size_t SyncSession::endPacket(uint8_t *out) {
+    out[0] = SYNC_PKT_END;
+    put32(out + 1, _sent);
+    _endSent = true;
+    _stats.bytes += END_PACKET_BYTES;
+    return END_PACKET_BYTES;
+}
+
+size_t SyncSession::nextPacket(uint8_t *out) {
+    if (!_running) return 0;
+    
+    if (!_hasPending) _hasPending = _source->next(_pending);
+    if (!_hasPending) {
+        // Say so once; records logged later go out as they come
+        return _endSent ? 0 : endPacket(out);
+    }
+    if (_inflightCount >= _window) return 0;
+    
+    // As many consecutive records as fit in the payload
+    uint32_t seq = _pending.seq;
+    uint32_t prevTime = _pending.time;
+    size_t pos = SYNC_DATA_HEADER;
+    uint8_t count = 0;
+    out[0] = SYNC_PKT_DATA;
+    put32(out + 2, seq);
+    put32(out + 6, prevTime);
+    
+    while (_hasPending && _pending.seq == seq && count < UINT8_MAX) {
+        uint8_t bytes[LOG_RECORD_MAX_BYTES];
+        uint8_t n = logRecordPut(bytes, _pending, prevTime);
+        if (pos + n > _payload) break;
+        memcpy(out + pos, bytes, n);
+        pos += n;
+        count++;
+        seq++;
+        prevTime = _pending.time;
+        _hasPending = _source->next(_pending);
+    }
+    out[1] = count;
+    
+    _inflight[(_inflightFirst + _inflightCount) % SYNC_WINDOW_MAX] = seq;
+    _inflightCount++;
+    _sent = seq;
+    _endSent = false;
+    _stats.packets++;
+    _stats.records += count;
+    _stats.bytes += pos;
+    return pos;
+}
+
+SyncClient::SyncClient()
+    : _handler(nullptr), _context(nullptr), _nextSeq(0), _started(false), _caughtUp(false),
+      _records(0), _duplicates(0), _gaps(0) {
+}
+
+void SyncClient::begin(SyncRecordHandler handler, void *context) {
+    _handler = handler;
+    _context = context;
+}
+
+size_t SyncClient::start(uint8_t *out, uint32_t fromSeq, uint8_t window) {
+    if (fromSeq != SYNC_RESUME) _nextSeq = fromSeq;
+    _started = true;
+    _caughtUp = false;
+    out[0] = SYNC_CMD_START;
+    put32(out + 1, fromSeq);
+    out[5] = window;
+    return 6;
+}
+
+size_t SyncClient::ack(uint8_t *out) const {
+    out[0] = SYNC_CMD_ACK;
+    put32(out + 1, _nextSeq);
+    return 5;
+}
+
+size_t SyncClient::stop(uint8_t *out) const {
+    out[0] = SYNC_CMD_STOP;
+    return 1;
+}
+
+bool SyncClient::receive(const uint8_t *data, size_t len) {
+    if (len < 1 || !_started) return false;
+    
+    if (data[0] == SYNC_PKT_END) {
+        if (len < END_PACKET_BYTES) return false;
+        _caughtUp = get32(data + 1) <= _nextSeq;
+        return true;
+    }
+    if (data[0] != SYNC_PKT_DATA || len < SYNC_DATA_HEADER) return false;
+    
+    uint8_t count = data[1];
+    uint32_t seq = get32(data + 2);
+    uint32_t prevTime = get32(data + 6);
+    const uint8_t *in = data + SYNC_DATA_HEADER;
+    _caughtUp = false;
+    
+    for (uint8_t i = 0; i < count; i++) {
+        LogRecord record;
+        if (!logRecordGet(in, data + len, record, prevTime)) return false;
+        prevTime = record.time;
+        record.seq = seq++;
+        
+        // Resends after a rewind overlap what already came in
+        if (record.seq < _nextSeq) {
+            _duplicates++;
+            continue;
+        }
+        _gaps += record.seq - _nextSeq;
+        _nextSeq = record.seq + 1;
+        _records++;
+        if (_handler) _handler(record, _context);
+    }
+    return true;
+}
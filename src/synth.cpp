@@ -0,0 +1,121 @@
+/**
+ * @file synth.cpp
+ * @brief Implementation of the wavetable oscillator and envelope
+ */
+
+#include "synth.h"
+#include "dsp.h"
+
+namespace {
+
+constexpr double SYNTH_PI = 3.14159265358979323846;
+
+// Taylor series, converges quickly for |x| <= pi/2
+constexpr double sinSeries(double x2, double term, int k) {
+    return k > 10 ? 0.0
+                  : term + sinSeries(x2, -term * x2 / ((2 * k + 2) * (2 * k + 3)), k + 1);
+}
+
+constexpr double sinReduced(double x) { return sinSeries(x * x, x, 0); }
+
+// sin(2 pi i / SYNTH_TABLE_SIZE), folded into [-pi/2, pi/2] first
+constexpr double sinEntry(int i) {
+    return i <= SYNTH_TABLE_SIZE / 4 ? sinReduced(2 * SYNTH_PI * i / SYNTH_TABLE_SIZE)
+         : i <= SYNTH_TABLE_SIZE * 3 / 4 ? sinReduced(SYNTH_PI - 2 * SYNTH_PI * i / SYNTH_TABLE_SIZE)
+         : sinReduced(2 * SYNTH_PI * i / SYNTH_TABLE_SIZE - 2 * SYNTH_PI);
+}
+
+constexpr int16_t toQ15(double x) {
+    return (int16_t)(x * 32767 + (x >= 0 ? 0.5 : -0.5));
+}
+
+// Index sequence 0..N-1 (std::index_sequence is C++14)
+template<uint16_t... Is> struct TableSeq {};
+template<uint16_t N, uint16_t... Is> struct MakeTableSeq : MakeTableSeq<N - 1, N - 1, Is...> {};
+template<uint16_t... Is> struct MakeTableSeq<0, Is...> { typedef TableSeq<Is...> type; };
+
+template<uint16_t... Is>
+constexpr Wavetable makeSineWave(TableSeq<Is...>) {
+    return Wavetable{{ toQ15(sinEntry(Is))... }};
+}
+
+} // namespace
+
+// Constant-initialized, so it lives in flash with no startup cost
+const Wavetable sineWave = makeSineWave(MakeTableSeq<SYNTH_TABLE_SIZE + 1>::type());
+
+ToneSynth::ToneSynth()
+    : _table(sineWave.entries), _phase(0), _step(0), _left(0), _decayLength(0), _stage(DECAY),
+      _level(0), _peak(0), _attackStep(0), _decayStep(0) {
+}
+
+void ToneSynth::start(uint16_t frequency, uint32_t durationMs, uint32_t sampleRate,
+                      int16_t amplitude) {
+    _phase = 0;
+    _step = (uint32_t)(((uint64_t)frequency << 32) / sampleRate);
+    _left = (uint32_t)(((uint64_t)durationMs * sampleRate) / 1000);
+    _peak = (int32_t)(amplitude < 0 ? 0 : amplitude) << 8;
+    _level = 0;
+    _stage = ATTACK;
+    
+    // Short tones split their length between the two ramps
+    uint32_t attack = SYNTH_ATTACK_MS * sampleRate / 1000;
+    _decayLength = SYNTH_DECAY_MS * sampleRate / 1000;
+    if (attack + _decayLength > _left) {
+        attack = _left / 4;
+        _decayLength = _left - attack;
+    }
+    _attackStep = attack ? _peak / (int32_t)attack : _peak;
+    if (_attackStep == 0) _attackStep = 1;
+}
+
+void ToneSynth::release() {
+    if (_left == 0 || _stage == DECAY) return;
+    
+    if (_left > _decayLength) {
+        _left = _decayLength;
+    }
+    beginDecay();
+}
+
+void ToneSynth::beginDecay() {
+    _stage = DECAY;
+    _decayStep = _left ? _level / (int32_t)_left : _level;
+}
+
+size_t ToneSynth::render(int16_t *out, size_t maxSamples) {
+    size_t n = _left < maxSamples ? _left : maxSamples;
+    const int16_t *table = _table;
+    uint32_t phase = _phase;
+    
+    for (size_t i = 0; i < n; i++) {
+        if (_stage == ATTACK) {
+            _level += _attackStep;
+            if (_level >= _peak) {
+                _level = _peak;
+                _stage = SUSTAIN;
+            }
+        }
+        if (_stage != DECAY && _left <= _decayLength) {
+            beginDecay();
+        }
+        if (_stage == DECAY) {
+            _level -= _decayStep;
+            if (_level < 0) _level = 0;
+        }
+        _left--;
+        
+        // Linear interpolation between neighbouring entries
+        uint32_t index = phase >> (32 - SYNTH_TABLE_BITS);
+        int32_t frac = (phase >> (17 - SYNTH_TABLE_BITS)) & 0x7FFF;
+        int32_t a = table[index];
+        int32_t b = table[index + 1];
+        int32_t osc = a + (((b - a) * frac) >> 15);
+        
+        out[i] = (int16_t)(dspSmulbb((uint16_t)osc, (uint16_t)(_level >> 8)) >> 15);
+        phase += _step;
+    }
+    
+    _phase = phase;
+    return n;
+}
@@ -0,0 +1,242 @@
+/**
+ * @file timer_wheel.cpp
+ * @brief Implementation of the hierarchical timer wheel
+ */
+
+#include "timer_wheel.h"
+
+#define SLOT_BITS       6
+#define SLOT_MASK       (TIMER_WHEEL_SLOTS - 1)
+#define TOP_LEVEL       (TIMER_WHEEL_LEVELS - 1)
+
+static_assert(TIMER_WHEEL_SLOTS == (1 << SLOT_BITS), "One occupancy bit per slot");
+
+// Granules covered by one slot at a level
+static inline uint64_t slotSpan(uint8_t level) {
+    return 1ULL << (SLOT_BITS * level);
+}
+
+// Occupancy bits for the slots after index
+static inline uint64_t slotsAfter(uint64_t mask, uint8_t index) {
+    return index >= SLOT_MASK ? 0 : mask & (~0ULL << (index + 1));
+}
+
+TimerWheel::TimerWheel() : _cursor(0), _due(nullptr), _count(0) {
+    for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (uint8_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            _slots[level][slot] = nullptr;
+        }
+        _occupied[level] = 0;
+    }
+}
+
+void TimerWheel::begin(uint64_t now) {
+    _cursor = now >> TIMER_WHEEL_SHIFT;
+}
+
+void TimerWheel::start(WheelTimer& timer, uint64_t expires, uint64_t period) {
+    cancel(timer);
+    timer._expires = expires;
+    timer._period = period;
+    file(timer);
+    _count++;
+}
+
+void TimerWheel::cancel(WheelTimer& timer) {
+    if (!timer.active()) return;
+    unlink(timer);
+    timer._level = WheelTimer::TIMER_IDLE;
+    _count--;
+}
+
+void TimerWheel::file(WheelTimer& timer) {
+    uint64_t granule = timer._expires >> TIMER_WHEEL_SHIFT;
+    if (granule < _cursor) granule = _cursor;  // Overdue, fires next advance()
+    
+    // The top wheel wraps: its slots behind the cursor's hold the next lap,
+    // so a timer just past the end of this one is filed like any other.
+    // Further out it waits in the last of those slots and is re-filed
+    // from there
+    uint64_t topIndex = (_cursor >> (SLOT_BITS * TOP_LEVEL)) & SLOT_MASK;
+    uint64_t horizon = (_cursor | (slotSpan(TIMER_WHEEL_LEVELS) - 1)) +
+                       (topIndex << (SLOT_BITS * TOP_LEVEL));
+    if (granule > horizon) granule = horizon;
+    
+    // The lowest level whose slot span still contains both it and the cursor
+    uint8_t level = 0;
+    while (level < TOP_LEVEL &&
+           (granule >> (SLOT_BITS * (level + 1))) != (_cursor >> (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    uint8_t slot = (granule >> (SLOT_BITS * level)) & SLOT_MASK;
+    
+    WheelTimer*& head = _slots[level][slot];
+    timer._prev = nullptr;
+    timer._next = head;
+    if (head) head->_prev = &timer;
+    head = &timer;
+    _occupied[level] |= 1ULL << slot;
+    timer._level = level;
+    timer._slot = slot;
+}
+
+void TimerWheel::unlink(WheelTimer& timer) {
+    WheelTimer*& head = timer._level == WheelTimer::TIMER_FIRING
+                        ? _due : _slots[timer._level][timer._slot];
+    if (timer._prev) {
+        timer._prev->_next = timer._next;
+    } else {
+        head = timer._next;
+    }
+    if (timer._next) timer._next->_prev = timer._prev;
+    
+    if (timer._level != WheelTimer::TIMER_FIRING && !head) {
+        _occupied[timer._level] &= ~(1ULL << timer._slot);
+    }
+    timer._next = nullptr;
+    timer._prev = nullptr;
+}
+
+void TimerWheel::cascade(uint8_t level) {
+    uint8_t slot = (_cursor >> (SLOT_BITS * level)) & SLOT_MASK;
+    WheelTimer* timer = _slots[level][slot];
+    _slots[level][slot] = nullptr;
+    _occupied[level] &= ~(1ULL << slot);
+    
+    // The cursor is now inside this slot's span, so each one lands lower down
+    while (timer) {
+        WheelTimer* next = timer->_next;
+        file(*timer);
+        timer = next;
+    }
+}
+
+void TimerWheel::collect(uint64_t now) {
+    uint8_t slot = _cursor & SLOT_MASK;
+    WheelTimer* timer = _slots[0][slot];
+    
+    // Timers later in the granule than now stay put. The due list is kept
+    // in expiry order, so a late advance() that collects several granules
+    // still calls them back in the order they were due
+    while (timer) {
+        WheelTimer* next = timer->_next;
+        if (timer->_expires <= now) {
+            unlink(*timer);
+            timer->_level = WheelTimer::TIMER_FIRING;
+            WheelTimer* before = nullptr;
+            WheelTimer* after = _due;
+            while (after && after->_expires <= timer->_expires) {
+                before = after;
+                after = after->_next;
+            }
+            timer->_prev = before;
+            timer->_next = after;
+            if (after) after->_prev = timer;
+            if (before) {
+                before->_next = timer;
+            } else {
+                _due = timer;
+            }
+        }
+        timer = next;
+    }
+}
+
+uint64_t TimerWheel::nextGranule() const {
+    uint64_t next = UINT64_MAX;
+    for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint8_t index = (_cursor >> (SLOT_BITS * level)) & SLOT_MASK;
+        uint64_t later = slotsAfter(_occupied[level], index);
+        
+        // Start of that slot's span, within the span of the level above
+        uint64_t base = _cursor & ~(slotSpan(level + 1) - 1);
+        if (!later && level == TOP_LEVEL) {
+            later = _occupied[level];  // Behind the cursor, the next lap
+            base += slotSpan(level + 1);
+        }
+        if (!later) continue;
+        uint64_t granule = base + ((uint64_t)__builtin_ctzll(later) << (SLOT_BITS * level));
+        if (granule < next) next = granule;
+    }
+    return next;
+}
+
+uint16_t TimerWheel::advance(uint64_t now) {
+    uint64_t target = now >> TIMER_WHEEL_SHIFT;
+    
+    // Walk the cursor to now, stopping only where a slot has work
+    for (;;) {
+        for (uint8_t level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((_cursor & (slotSpan(level) - 1)) == 0) cascade(level);
+        }
+        collect(now);
+        if (_cursor >= target) break;
+        
+        uint64_t next = nextGranule();
+        _cursor = next < target ? next : target;
+    }
+    
+    // Callbacks only run once the wheel is consistent, so they can start
+    // and cancel freely; anything they start that is already due waits
+    // for the next advance()
+    uint16_t fired = 0;
+    while (_due) {
+        WheelTimer& timer = *_due;
+        unlink(timer);
+        timer._level = WheelTimer::TIMER_IDLE;
+        _count--;
+        
+        if (timer._period) {
+            // Skip periods missed while asleep rather than firing a burst
+            uint64_t missed = now >= timer._expires ? (now - timer._expires) / timer._period : 0;
+            start(timer, timer._expires + (missed + 1) * timer._period, timer._period);
+        }
+        
+        fired++;
+        if (timer.callback) timer.callback(timer);
+    }
+    return fired;
+}
+
+uint64_t TimerWheel::nextDeadline() const {
+    uint64_t deadline = UINT64_MAX;
+    for (const WheelTimer* timer = _due; timer; timer = timer->_next) {
+        if (timer->_expires < deadline) deadline = timer->_expires;
+    }
+    
+    // Within a level, slots in cursor order hold ever later granules, so
+    // only the first occupied one can hold that level's earliest timer
+    for (uint8_t level = 0; level < TOP_LEVEL; level++) {
+        uint8_t index = (_cursor >> (SLOT_BITS * level)) & SLOT_MASK;
+        uint64_t pending = _occupied[level] & (~0ULL << index);
+        if (!pending) continue;
+        
+        for (const WheelTimer* timer = _slots[level][__builtin_ctzll(pending)]; timer;
+             timer = timer->_next) {
+            if (timer->_expires < deadline) deadline = timer->_expires;
+        }
+    }
+    
+    // Except on the top wheel, which wraps round to the slots behind the
+    // cursor and where a timer past the horizon waits in a slot before
+    // its own. Those are only ever late, so the slots are walked in order
+    // until one starts after the earliest timer found
+    uint8_t index = (_cursor >> (SLOT_BITS * TOP_LEVEL)) & SLOT_MASK;
+    uint64_t lap = _cursor & ~(slotSpan(TIMER_WHEEL_LEVELS) - 1);
+    uint64_t pending = _occupied[TOP_LEVEL] & (~0ULL << index);
+    for (uint8_t pass = 0; pass < 2; pass++) {
+        while (pending) {
+            uint8_t slot = __builtin_ctzll(pending);
+            pending &= pending - 1;
+            uint64_t begins = lap + ((uint64_t)slot << (SLOT_BITS * TOP_LEVEL));
+            if (deadline >> TIMER_WHEEL_SHIFT < begins) return deadline;
+            
+            for (const WheelTimer* timer = _slots[TOP_LEVEL][slot]; timer; timer = timer->_next) {
+                if (timer->_expires < deadline) deadline = timer->_expires;
+            }
+        }
+        pending = _occupied[TOP_LEVEL] & ~(~0ULL << index);
+        lap += slotSpan(TIMER_WHEEL_LEVELS);
+    }
+    return deadline;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file wallclock.cpp
+ * @brief Implementation of the RTC-derived wall clock
+ */
+
+#include "wallclock.h"
+
+#define PPM_SCALE   1000000LL
+
+// Corrected elapsed ticks for raw elapsed ticks e (non-decreasing in e)
+static inline uint64_t applyTrim(uint64_t e, int32_t ppm) {
+    return e + (int64_t)e * ppm / PPM_SCALE;
+}
+
+WallClock::WallClock() : _anchorTicks(0), _anchorTime(0), _trimPpm(0) {
+}
+
+void WallClock::setTime(uint32_t epochSeconds, uint64_t now) {
+    _anchorTicks = now;
+    _anchorTime = (uint64_t)epochSeconds * WALLCLOCK_TICK_HZ;
+}
+
+void WallClock::setTimeOfDay(uint8_t hours, uint8_t minutes, uint8_t seconds, uint64_t now) {
+    uint32_t today = epochSeconds(now) / SECONDS_PER_DAY * SECONDS_PER_DAY;
+    setTime(today + hours * 3600UL + minutes * 60UL + seconds, now);
+}
+
+void WallClock::setTrimPpm(int32_t ppm, uint64_t now) {
+    // Keep everything up to now at the old trim
+    _anchorTime = correctedTicks(now);
+    _anchorTicks = now;
+    _trimPpm = ppm;
+}
+
+uint64_t WallClock::correctedTicks(uint64_t now) const {
+    uint64_t elapsed = (now > _anchorTicks) ? now - _anchorTicks : 0;
+    return _anchorTime + applyTrim(elapsed, _trimPpm);
+}
+
+uint32_t WallClock::epochSeconds(uint64_t now) const {
+    return (uint32_t)(correctedTicks(now) / WALLCLOCK_TICK_HZ);
+}
+
+WallTime WallClock::timeOfDay(uint64_t now) const {
+    uint32_t secondOfDay = epochSeconds(now) % SECONDS_PER_DAY;
+    uint8_t hours24 = secondOfDay / 3600;
+    
+    WallTime t;
+    t.minutes = (secondOfDay / 60) % 60;
+    t.seconds = secondOfDay % 60;
+    t.isPM = hours24 >= 12;
+    t.hours = hours24 % 12;
+    if (t.hours == 0) t.hours = 12;  // 12 AM / 12 PM
+    return t;
+}
+
+uint64_t WallClock::nextSecond(uint64_t now) const {
+    uint64_t target = (correctedTicks(now) / WALLCLOCK_TICK_HZ + 1) * WALLCLOCK_TICK_HZ;
+    uint64_t need = target - _anchorTime;
+    
+    // Invert the trim, then settle on the first raw tick that gets there.
+    // Split the division so need * PPM_SCALE can't overflow on long uptimes
+    uint64_t scale = PPM_SCALE + _trimPpm;
+    uint64_t e = need / scale * PPM_SCALE + need % scale * PPM_SCALE / scale;
+    while (applyTrim(e, _trimPpm) < need) e++;
+    while (e > 0 && applyTrim(e - 1, _trimPpm) >= need) e--;
+    
+    return _anchorTicks + e;
+}
@@ -0,0 +1,232 @@
+/**
+ * @file widgets.cpp
+ * @brief Implementation of the retained-mode watch face widgets
+ */
+
+#include "widgets.h"
+#include "font5x7.h"
+
+// Glyph advance at scale 1 (5 pixel glyph + 1 pixel gap)
+#define GLYPH_ADVANCE   (FONT_WIDTH + 1)
+
+// HH:MM:SS layout at scale 1: digit and colon x offsets
+static const uint8_t timeDigitX[6] = {0, 6, 14, 20, 28, 34};
+static const uint8_t timeColonX[2] = {12, 26};
+#define TIME_WIDTH      39
+
+bool Rect::intersects(const Rect& o) const {
+    if (empty() || o.empty()) return false;
+    return x < o.x + o.w && o.x < x + w && y < o.y + o.h && o.y < y + h;
+}
+
+void Rect::unite(const Rect& o) {
+    if (o.empty()) return;
+    if (empty()) {
+        *this = o;
+        return;
+    }
+    int16_t x1 = (x + w > o.x + o.w) ? x + w : o.x + o.w;
+    int16_t y1 = (y + h > o.y + o.h) ? y + h : o.y + o.h;
+    if (o.x < x) x = o.x;
+    if (o.y < y) y = o.y;
+    w = x1 - x;
+    h = y1 - y;
+}
+
+// ========== Widget ==========
+
+Widget::Widget(int16_t x, int16_t y, int16_t w, int16_t h)
+    : _bounds{x, y, w, h}, _damage{x, y, w, h}, _full(true) {
+}
+
+void Widget::invalidate() {
+    _full = true;
+    _damage = _bounds;
+}
+
+void Widget::addDamage(int16_t x, int16_t y, int16_t w, int16_t h) {
+    Rect r = {x, y, w, h};
+    _damage.unite(r);
+}
+
+void Widget::render(SharpDisplay& display) {
+    if (!isDamaged()) return;
+    
+    if (_full) {
+        display.fillRect(_bounds.x, _bounds.y, _bounds.w, _bounds.h, true);
+    }
+    draw(display, _full);
+    
+    _full = false;
+    _damage = Rect{0, 0, 0, 0};
+}
+
+// ========== TimeWidget ==========
+
+TimeWidget::TimeWidget(int16_t x, int16_t y, uint8_t scale)
+    : Widget(x, y, TIME_WIDTH * scale, FONT_HEIGHT * scale), _scale(scale), _changed(0) {
+    memset(_digits, 0xFF, sizeof(_digits));  // Nothing rendered yet
+}
+
+int16_t TimeWidget::cellX(uint8_t i) const {
+    return _bounds.x + timeDigitX[i] * _scale;
+}
+
+void TimeWidget::set(uint8_t hours, uint8_t minutes, uint8_t seconds) {
+    uint8_t digits[6] = {
+        (uint8_t)(hours / 10), (uint8_t)(hours % 10),
+        (uint8_t)(minutes / 10), (uint8_t)(minutes % 10),
+        (uint8_t)(seconds / 10), (uint8_t)(seconds % 10)
+    };
+    
+    for (uint8_t i = 0; i < 6; i++) {
+        if (digits[i] == _digits[i]) continue;
+        _digits[i] = digits[i];
+        _changed |= 1 << i;
+        addDamage(cellX(i), _bounds.y, FONT_WIDTH * _scale, _bounds.h);
+    }
+}
+
+void TimeWidget::draw(SharpDisplay& display, bool full) {
+    if (full) {
+        for (uint8_t i = 0; i < 2; i++) {
+            int16_t cx = _bounds.x + timeColonX[i] * _scale;
+            display.fillRect(cx, _bounds.y + _scale * 2, _scale, _scale, false);
+            display.fillRect(cx, _bounds.y + _scale * 4, _scale, _scale, false);
+        }
+        _changed = 0x3F;
+    }
+    
+    for (uint8_t i = 0; i < 6; i++) {
+        if (!(_changed & (1 << i))) continue;
+        if (!full) {
+            display.fillRect(cellX(i), _bounds.y, FONT_WIDTH * _scale, _bounds.h, true);
+        }
+        display.drawChar(cellX(i), _bounds.y, '0' + _digits[i], _scale);
+    }
+    _changed = 0;
+}
+
+// ========== LabelWidget ==========
+
+LabelWidget::LabelWidget(int16_t x, int16_t y, uint8_t maxChars, uint8_t scale)
+    : Widget(x, y, (maxChars * GLYPH_ADVANCE - 1) * scale, FONT_HEIGHT * scale),
+      _scale(scale), _maxChars(maxChars < LABEL_MAX_CHARS ? maxChars : LABEL_MAX_CHARS),
+      _changed(0) {
+    memset(_text, ' ', sizeof(_text));
+}
+
+void LabelWidget::setText(const char* text) {
+    bool ended = false;
+    for (uint8_t i = 0; i < _maxChars; i++) {
+        if (!ended && text[i] == '\0') ended = true;
+        char c = ended ? ' ' : text[i];
+        if (c == _text[i]) continue;
+        
+        _text[i] = c;
+        _changed |= 1UL << i;
+        addDamage(_bounds.x + i * GLYPH_ADVANCE * _scale, _bounds.y,
+                  FONT_WIDTH * _scale, _bounds.h);
+    }
+}
+
+void LabelWidget::draw(SharpDisplay& display, bool full) {
+    for (uint8_t i = 0; i < _maxChars; i++) {
+        int16_t cx = _bounds.x + i * GLYPH_ADVANCE * _scale;
+        if (full) {
+            if (_text[i] != ' ') display.drawChar(cx, _bounds.y, _text[i], _scale);
+        } else if (_changed & (1UL << i)) {
+            display.fillRect(cx, _bounds.y, FONT_WIDTH * _scale, _bounds.h, true);
+            display.drawChar(cx, _bounds.y, _text[i], _scale);
+        }
+    }
+    _changed = 0;
+}
+
+// ========== DialogWidget ==========
+
+DialogWidget::DialogWidget(int16_t x, int16_t y, int16_t w, int16_t h, const char* message)
+    : Widget(x, y, w, h), _message(message), _countdown(0) {
+}
+
+int16_t DialogWidget::countdownX() const {
+    return _bounds.x + _bounds.w / 2 - 3;
+}
+
+int16_t DialogWidget::countdownY() const {
+    return _bounds.y + 18;
+}
+
+void DialogWidget::setCountdown(uint8_t digit) {
+    if (digit == _countdown) return;
+    _countdown = digit;
+    addDamage(countdownX(), countdownY(), FONT_WIDTH, FONT_HEIGHT);
+}
+
+void DialogWidget::draw(SharpDisplay& display, bool full) {
+    if (full) {
+        // White interior (already cleared), black border, message on one line
+        display.drawRect(_bounds.x, _bounds.y, _bounds.w, _bounds.h, false);
+        display.drawText(_bounds.x + 6, _bounds.y + 6, _message);
+    } else {
+        display.fillRect(countdownX(), countdownY(), FONT_WIDTH, FONT_HEIGHT, true);
+    }
+    display.drawChar(countdownX(), countdownY(), '0' + _countdown);
+}
+
+// ========== WidgetScreen ==========
+
+WidgetScreen::WidgetScreen(Widget* const* widgets, uint8_t count, Widget* modal)
+    : _widgets(widgets), _count(count), _modal(modal),
+      _modalVisible(false), _modalChanged(false) {
+}
+
+void WidgetScreen::invalidate() {
+    for (uint8_t i = 0; i < _count; i++) {
+        _widgets[i]->invalidate();
+    }
+    if (_modal) _modal->invalidate();
+}
+
+void WidgetScreen::showModal(bool show) {
+    if (!_modal || show == _modalVisible) return;
+    _modalVisible = show;
+    _modalChanged = true;
+}
+
+bool WidgetScreen::render(SharpDisplay& display) {
+    bool drew = false;
+    
+    if (_modalChanged) {
+        _modalChanged = false;
+        const Rect& box = _modal->bounds();
+        if (_modalVisible) {
+            _modal->invalidate();
+        } else {
+            // Uncover whatever was underneath
+            display.fillRect(box.x, box.y, box.w, box.h, true);
+            for (uint8_t i = 0; i < _count; i++) {
+                if (_widgets[i]->bounds().intersects(box)) {
+                    _widgets[i]->invalidate();
+                }
+            }
+            drew = true;
+        }
+    }
+    
+    for (uint8_t i = 0; i < _count; i++) {
+        Widget* w = _widgets[i];
+        if (!w->isDamaged()) continue;
+        // Under the dialog: keep the damage for when it closes
+        if (_modalVisible && w->bounds().intersects(_modal->bounds())) continue;
+        w->render(display);
+        drew = true;
+    }
+    
+    if (_modalVisible && _modal->isDamaged()) {
+        _modal->render(display);
+        drew = true;
+    }
+    
+    return drew;
+}
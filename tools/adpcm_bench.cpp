@@ -0,0 +1,213 @@
+/**
+ * @file adpcm_bench.cpp
+ * @brief Host benchmark of the IMA-ADPCM decoder, per I2S buffer
+ *
+ * Build on the host from the repository root:
+ *
+ *     g++ -std=gnu++11 -O2 -Itools/host -Iinclude tools/adpcm_bench.cpp src/adpcm.cpp -o adpcm_bench
+ *     ./adpcm_bench [seconds]
+ *
+ * Encodes a synthetic voiced signal (10 seconds at AUDIO_SAMPLE_RATE by
+ * default) the way wav2adpcm.py does, then decodes it with the
+ * firmware's AdpcmDecoder in the chunk sizes the audio path asks for:
+ * MIXER_CHUNK_SAMPLES pieces inside the mixer and whole
+ * AUDIO_BUFFER_SIZE buffers for a direct stream. Each run is checked
+ * sample for sample against the encoder's own reconstruction, then
+ * timed. Reported per buffer: nanoseconds, timestamp-counter ticks
+ * (x86 only; the TSC runs at the nominal clock, not the core's), and
+ * the share of the buffer's play time spent decoding. On the watch,
+ * AudioMixer::stats() gives the same figure in M4 cycles.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+#include "config.h"
+#include "adpcm.h"
+#include "audio.h"
+
+#define DEFAULT_BLOCK_BYTES 256     // wav2adpcm.py --block default
+
+static const int16_t stepTable[89] = {
+        7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+       19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+       50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+      130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+      337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+      876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+     2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+     5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t indexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+// A voice-like test signal: a gliding pitch with a few formant-ish
+// harmonics, syllable-rate amplitude and a little breath noise
+static std::vector<int16_t> synthesize(uint32_t seconds) {
+    std::vector<int16_t> samples((size_t)seconds * AUDIO_SAMPLE_RATE);
+    std::mt19937 rng(5);
+    std::normal_distribution<double> noise(0.0, 300.0);
+    double phase = 0.0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        double t = (double)i / AUDIO_SAMPLE_RATE;
+        double pitch = 120.0 + 30.0 * sin(2 * M_PI * 0.7 * t);
+        phase += 2 * M_PI * pitch / AUDIO_SAMPLE_RATE;
+        double voiced = 0.6 * sin(phase) + 0.3 * sin(3 * phase) + 0.2 * sin(7 * phase) +
+                        0.1 * sin(13 * phase);
+        double syllable = 0.5 - 0.5 * cos(2 * M_PI * 4.0 * t);
+        double v = 14000.0 * syllable * voiced + noise(rng);
+        samples[i] = (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+    }
+    return samples;
+}
+
+/**
+ * @brief wav2adpcm.py's encode(), also returning the decoder's expected output
+ */
+static std::vector<uint8_t> encode(const std::vector<int16_t> &samples, uint16_t blockBytes,
+                                   std::vector<int16_t> &expected) {
+    size_t blockSamples = adpcmBlockSamples(blockBytes);
+    std::vector<uint8_t> out;
+    expected.clear();
+    int32_t index = 0;
+    for (size_t start = 0; start < samples.size(); start += blockSamples) {
+        size_t end = start + blockSamples < samples.size() ? start + blockSamples : samples.size();
+        int32_t predictor = samples[start];
+        out.push_back((uint8_t)(predictor & 0xFF));
+        out.push_back((uint8_t)((predictor >> 8) & 0xFF));
+        out.push_back((uint8_t)index);
+        out.push_back(0);
+        expected.push_back((int16_t)predictor);
+        
+        uint8_t packed = 0;
+        for (size_t i = start + 1; i < end; i++) {
+            int32_t step = stepTable[index];
+            int32_t diff = samples[i] - predictor;
+            uint8_t nibble = 0;
+            if (diff < 0) {
+                nibble = 8;
+                diff = -diff;
+            }
+            if (diff >= step) { nibble |= 4; diff -= step; }
+            if (diff >= step >> 1) { nibble |= 2; diff -= step >> 1; }
+            if (diff >= step >> 2) nibble |= 1;
+            
+            // Track the decoder so the next nibble codes what it will hear
+            int32_t delta = step >> 3;
+            if (nibble & 4) delta += step;
+            if (nibble & 2) delta += step >> 1;
+            if (nibble & 1) delta += step >> 2;
+            predictor += (nibble & 8) ? -delta : delta;
+            if (predictor > 32767) predictor = 32767;
+            else if (predictor < -32768) predictor = -32768;
+            index += indexTable[nibble];
+            if (index < 0) index = 0;
+            else if (index > 88) index = 88;
+            expected.push_back((int16_t)predictor);
+            
+            if ((i - start - 1) & 1) {
+                out.push_back(packed | (uint8_t)(nibble << 4));
+            } else {
+                packed = nibble;
+            }
+        }
+        if ((end - start - 1) & 1) out.push_back(packed);
+    }
+    return out;
+}
+
+static inline uint64_t tsc() {
+    #if HAVE_TSC
+    return __rdtsc();
+    #else
+    return 0;
+    #endif
+}
+
+/**
+ * @brief Decode the whole clip in chunk-sized reads, best of several passes
+ * @return false if the output doesn't match expected
+ */
+static bool run(const AdpcmClip &clip, const std::vector<int16_t> &expected, size_t chunk,
+                double &nsPerSample, double &ticksPerSample) {
+    std::vector<int16_t> out(expected.size());
+    AdpcmDecoder decoder;
+    nsPerSample = 1e9;
+    ticksPerSample = 1e18;
+    
+    for (int pass = 0; pass < 20; pass++) {
+        decoder.begin(&clip);
+        size_t done = 0;
+        auto start = std::chrono::steady_clock::now();
+        uint64_t ticks = tsc();
+        while (done < out.size()) {
+            size_t want = out.size() - done < chunk ? out.size() - done : chunk;
+            size_t got = decoder.read(&out[done], want);
+            if (got != want) return false;
+            done += got;
+        }
+        ticks = tsc() - ticks;
+        double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+        
+        if (pass == 0 && (out != expected || !decoder.done())) return false;
+        if (ns / out.size() < nsPerSample) nsPerSample = ns / out.size();
+        if ((double)ticks / out.size() < ticksPerSample) ticksPerSample = (double)ticks / out.size();
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    uint32_t seconds = argc >= 2 ? (uint32_t)atoi(argv[1]) : 10;
+    if (seconds == 0) seconds = 10;
+    
+    std::vector<int16_t> source = synthesize(seconds);
+    double bufferNs = 1e9 * AUDIO_BUFFER_SIZE / AUDIO_SAMPLE_RATE;
+    printf("%u s of voiced signal at %u Hz, %u-sample buffers (%.0f ms)\n\n", seconds,
+           AUDIO_SAMPLE_RATE, AUDIO_BUFFER_SIZE, bufferNs / 1e6);
+    printf("%6s %6s %7s %7s %9s %11s %12s %10s\n", "block", "chunk", "ratio", "SNR dB",
+           "ns/smpl", "ns/buffer", "TSC/buffer", "% of play");
+    
+    static const uint16_t blocks[] = { 64, DEFAULT_BLOCK_BYTES, 1024 };
+    static const size_t chunks[] = { MIXER_CHUNK_SAMPLES, AUDIO_BUFFER_SIZE };
+    for (uint16_t blockBytes : blocks) {
+        std::vector<int16_t> expected;
+        std::vector<uint8_t> data = encode(source, blockBytes, expected);
+        AdpcmClip clip = { data.data(), (uint32_t)source.size(), blockBytes };
+        
+        double signal = 0, error = 0;
+        for (size_t i = 0; i < source.size(); i++) {
+            signal += (double)source[i] * source[i];
+            error += (double)(source[i] - expected[i]) * (source[i] - expected[i]);
+        }
+        double ratio = (double)source.size() * 2 / data.size();
+        double snr = 10 * log10(signal / (error > 0 ? error : 1));
+        
+        for (size_t chunk : chunks) {
+            double ns, ticks;
+            if (!run(clip, expected, chunk, ns, ticks)) {
+                fprintf(stderr, "block %u, chunk %zu: decoder output differs from the encoder\n",
+                        blockBytes, chunk);
+                return 1;
+            }
+            printf("%6u %6zu %6.2fx %7.1f %9.2f %11.0f %12.0f %9.3f%%\n", blockBytes, chunk, ratio,
+                   snr, ns, ns * AUDIO_BUFFER_SIZE, HAVE_TSC ? ticks * AUDIO_BUFFER_SIZE : 0.0,
+                   100.0 * ns * AUDIO_BUFFER_SIZE / bufferNs);
+        }
+    }
+    printf("\noutput verified sample for sample against the encoder\n");
+    return 0;
+}
@@ -0,0 +1,440 @@
+/**
+ * @file audio_test.cpp
+ * @brief Host simulation of the I2S ping-pong buffer swap
+ *
+ * Build on the host from the repository root (the DMA pointer register
+ * is 32 bits, so the buffers must sit in the low 4GB: no PIE):
+ *
+ *     g++ -std=gnu++11 -O2 -no-pie -Itools/host -Iinclude tools/audio_test.cpp \
+ *         src/audio.cpp src/mixer.cpp src/synth.cpp src/adpcm.cpp -o audio_test
+ *     ./audio_test
+ *
+ * Runs the real GeekWatchAudio driver against a model of the nRF52 I2S
+ * peripheral. TASKS_START latches TXD.PTR and raises TXPTRUPD at once;
+ * every AUDIO_BUFFER_SIZE samples after that the buffer being played
+ * leaves the pins and TXD.PTR is latched again, raising TXPTRUPD.
+ * TASKS_STOP cuts the buffer being played and raises STOPPED. Each
+ * event calls the driver's interrupt handler, exactly as on the target.
+ *
+ * The checks: play() returns before a single buffer has played, the
+ * samples leaving the pins are pre-roll, source and post-roll silence
+ * with nothing dropped or repeated, a buffer is never written while the
+ * peripheral is playing it, and the driver is interrupted once per
+ * buffer. A voice added while the stream winds down, or after its last
+ * refill has asked for the stop, must play without the call blocking.
+ * Powering down must only stop the HFXO if audio started it. Exits
+ * non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <vector>
+#include "audio.h"
+#include "host/check.h"
+
+#define PREROLL_SAMPLES     ((size_t)AUDIO_PREROLL_MS * AUDIO_SAMPLE_RATE / 1000)
+#define POSTROLL_SAMPLES    ((size_t)AUDIO_POSTROLL_MS * AUDIO_SAMPLE_RATE / 1000)
+
+static GeekWatchAudio audio(I2S_SCK_PIN, I2S_LRCK_PIN, I2S_DIN_PIN);
+
+extern "C" void I2S_IRQHandler(void);
+
+// ========== Simulated peripheral ==========
+
+static struct {
+    bool running;
+    const int16_t *playing;         // Buffer latched from TXD.PTR
+    int16_t latched[AUDIO_BUFFER_SIZE];  // Its contents when latched
+    std::vector<int16_t> out;       // Samples that have left the pins
+    uint32_t latches;
+    uint32_t interrupts;
+    uint32_t repeats;               // Same buffer latched twice running
+    uint32_t overwrites;            // Buffer changed while playing
+    uint32_t doneGiven;
+    bool holdoffRunning;
+    TimerCallbackFunction_t holdoffCallback;
+    bool ampOn;
+    bool softDevice;
+    uint32_t sdRequests;
+    uint32_t sdReleases;
+} sim;
+
+static void interrupt() {
+    sim.interrupts++;
+    I2S_IRQHandler();
+}
+
+static void latch() {
+    const int16_t *ptr = (const int16_t *)(uintptr_t)NRF_I2S->TXD.PTR;
+    if (ptr == sim.playing) sim.repeats++;
+    sim.playing = ptr;
+    memcpy(sim.latched, ptr, sizeof(sim.latched));
+    sim.latches++;
+    NRF_I2S->EVENTS_TXPTRUPD = 1;
+    interrupt();
+}
+
+static void serviceOnce() {
+    if (NRF_I2S->TASKS_START) {
+        NRF_I2S->TASKS_START = 0;
+        CHECK(NRF_I2S->ENABLE == I2S_ENABLE_ENABLE_Enabled, "started while disabled");
+        CHECK(!sim.running, "started while running");
+        sim.running = true;
+        sim.playing = nullptr;
+        latch();
+    }
+    if (NRF_I2S->TASKS_STOP) {
+        NRF_I2S->TASKS_STOP = 0;
+        if (sim.running) {
+            sim.running = false;
+            sim.playing = nullptr;  // Cut short, never heard
+            NRF_I2S->EVENTS_STOPPED = 1;
+            interrupt();
+        }
+    }
+}
+
+// Act on tasks the driver has triggered since we last looked, including
+// any the resulting interrupts trigger
+static void service() {
+    while (NRF_I2S->TASKS_START || NRF_I2S->TASKS_STOP) {
+        serviceOnce();
+    }
+}
+
+// The latched buffer plays out and the next is latched, tasks the
+// interrupt triggers are left pending
+static void playBuffer() {
+    if (memcmp(sim.playing, sim.latched, sizeof(sim.latched)) != 0) sim.overwrites++;
+    sim.out.insert(sim.out.end(), sim.latched, sim.latched + AUDIO_BUFFER_SIZE);
+    latch();
+}
+
+// One buffer's worth of time
+static bool period() {
+    service();
+    if (!sim.running) return false;
+    
+    playBuffer();
+    service();
+    return true;
+}
+
+static void runToEnd() {
+    for (int i = 0; i < 100000 && period(); i++) {
+    }
+}
+
+static void resetSim() {
+    sim.out.clear();
+    sim.latches = 0;
+    sim.interrupts = 0;
+    sim.repeats = 0;
+    sim.overwrites = 0;
+}
+
+// Amp and HFXO off, as if the hold-off ran out
+static void coolDown() {
+    if (sim.holdoffRunning && sim.holdoffCallback) {
+        sim.holdoffRunning = false;
+        sim.holdoffCallback(nullptr);
+    }
+}
+
+// ========== Core and RTOS calls the driver makes ==========
+
+void pinMode(uint32_t, uint32_t) {}
+
+void digitalWrite(uint32_t pin, uint32_t value) {
+    if (pin == I2S_SD_PIN) sim.ampOn = value == HIGH;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return &sim.doneGiven;
+}
+
+// The caller blocks, so time passes until the stream stops
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) {
+    for (int i = 0; i < 100000 && !sim.doneGiven; i++) {
+        if (!period() && !sim.doneGiven) {
+            printf("FAIL: waiting on a stream that will never stop\n");
+            exit(1);
+        }
+    }
+    sim.doneGiven--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t, BaseType_t *) {
+    sim.doneGiven = 1;
+    return pdTRUE;
+}
+
+TimerHandle_t xTimerCreate(const char *, TickType_t, BaseType_t, void *,
+                           TimerCallbackFunction_t callback) {
+    sim.holdoffCallback = callback;
+    return &sim.holdoffCallback;
+}
+
+BaseType_t xTimerStart(TimerHandle_t, TickType_t) {
+    sim.holdoffRunning = true;
+    return pdTRUE;
+}
+
+BaseType_t xTimerStop(TimerHandle_t, TickType_t) {
+    sim.holdoffRunning = false;
+    return pdTRUE;
+}
+
+BaseType_t xTimerResetFromISR(TimerHandle_t, BaseType_t *) {
+    sim.holdoffRunning = true;
+    return pdTRUE;
+}
+
+uint32_t sd_softdevice_is_enabled(uint8_t *enabled) {
+    *enabled = sim.softDevice;
+    return 0;
+}
+
+uint32_t sd_clock_hfclk_request() { sim.sdRequests++; return 0; }
+uint32_t sd_clock_hfclk_release() { sim.sdReleases++; return 0; }
+uint32_t sd_clock_hfclk_is_running(uint32_t *running) { *running = 1; return 0; }
+
+// ========== Tests ==========
+
+static std::vector<int16_t> ramp(size_t n) {
+    std::vector<int16_t> samples(n);
+    for (size_t i = 0; i < n; i++) samples[i] = (int16_t)(1 + i % 30000);
+    return samples;
+}
+
+// Pre-roll (cold only), the source, then nothing but silence
+static void checkStream(const std::vector<int16_t> &source, bool cold, const char *name) {
+    size_t lead = cold ? PREROLL_SAMPLES : 0;
+    size_t bad = 0;
+    for (size_t i = 0; i < sim.out.size(); i++) {
+        int16_t want = (i >= lead && i - lead < source.size()) ? source[i - lead] : 0;
+        if (sim.out[i] != want) bad++;
+    }
+    CHECK(bad == 0, "%s: %zu samples differ", name, bad);
+    CHECK(sim.out.size() >= lead + source.size() + POSTROLL_SAMPLES,
+          "%s: %zu samples out, expected at least %zu", name, sim.out.size(),
+          lead + source.size() + POSTROLL_SAMPLES);
+    CHECK(sim.out.size() <= lead + source.size() + POSTROLL_SAMPLES + 2 * AUDIO_BUFFER_SIZE,
+          "%s: %zu samples out, tail too long", name, sim.out.size());
+    CHECK(sim.repeats == 0, "%s: a buffer was played twice running %u times", name, sim.repeats);
+    CHECK(sim.overwrites == 0, "%s: %u buffers written while playing", name, sim.overwrites);
+    
+    // One TXPTRUPD per buffer, plus STOPPED
+    CHECK(sim.interrupts == sim.latches + 1, "%s: %u interrupts for %u buffers", name,
+          sim.interrupts, sim.latches);
+    CHECK(!audio.isPlaying() && !sim.running, "%s: still playing", name);
+}
+
+static void testNonBlocking() {
+    coolDown();
+    resetSim();
+    std::vector<int16_t> source = ramp(5000);
+    
+    CHECK(audio.play(source.data(), source.size(), false), "play() refused");
+    CHECK(audio.isPlaying() && sim.out.empty(), "play() didn't return at once");
+    CHECK(sim.ampOn, "amp not powered for playback");
+    
+    // Start latches buffer 0 and the interrupt queues buffer 1 behind it
+    service();
+    CHECK(sim.latches == 1 && audio.buffersQueued() >= 2, "%u latched, %u queued after start",
+          sim.latches, audio.buffersQueued());
+    
+    runToEnd();
+    checkStream(source, true, "non-blocking");
+    CHECK(sim.ampOn && sim.holdoffRunning, "amp should stay up for the hold-off");
+    coolDown();
+    CHECK(!sim.ampOn, "amp still on after the hold-off");
+}
+
+// Lengths around the pre-roll and buffer boundaries, cold and warm
+static void testLengths() {
+    static const size_t lengths[] = { 1, 2, 431, 432, 433, 511, 512, 513, 1023, 1024, 1025,
+                                      AUDIO_BUFFER_SIZE * 7 + 3 };
+    for (size_t n : lengths) {
+        for (int warm = 0; warm < 2; warm++) {
+            if (!warm) coolDown();
+            resetSim();
+            std::vector<int16_t> source = ramp(n);
+            audio.play(source.data(), source.size(), false);
+            runToEnd();
+            char name[32];
+            snprintf(name, sizeof(name), "%zu samples %s", n, warm ? "warm" : "cold");
+            checkStream(source, !warm, name);
+        }
+    }
+}
+
+static void testBlocking() {
+    coolDown();
+    resetSim();
+    std::vector<int16_t> source = ramp(3000);
+    audio.play(source.data(), source.size(), true);
+    checkStream(source, true, "blocking");
+}
+
+static void testStop() {
+    resetSim();
+    std::vector<int16_t> source = ramp(20000);
+    audio.play(source.data(), source.size(), false);
+    for (int i = 0; i < 3; i++) period();
+    audio.stop();
+    CHECK(!audio.isPlaying() && !sim.running, "stop(): still playing");
+    size_t played = sim.out.size();
+    CHECK(!period() && sim.out.size() == played, "stop(): samples after stopping");
+    CHECK(sim.overwrites == 0 && sim.repeats == 0, "stop(): %u overwrites, %u repeats",
+          sim.overwrites, sim.repeats);
+}
+
+// A mixer voice streams the same way: tone, then silence
+static void testMixer() {
+    coolDown();
+    resetSim();
+    size_t toneSamples = (size_t)100 * AUDIO_SAMPLE_RATE / 1000;
+    CHECK(audio.playTone(1000, 100) != MIXER_NO_VOICE, "playTone() refused");
+    CHECK(audio.isPlaying() && sim.out.empty(), "playTone() didn't return at once");
+    runToEnd();
+    
+    size_t loud = 0, late = 0;
+    for (size_t i = 0; i < sim.out.size(); i++) {
+        if (sim.out[i] == 0) continue;
+        if (i >= PREROLL_SAMPLES && i < PREROLL_SAMPLES + toneSamples) {
+            loud++;
+        } else {
+            late++;
+        }
+    }
+    CHECK(loud > toneSamples / 2 && late == 0, "tone: %zu samples sounding, %zu outside it",
+          loud, late);
+    CHECK(sim.repeats == 0 && sim.overwrites == 0, "tone: %u repeats, %u overwrites",
+          sim.repeats, sim.overwrites);
+    CHECK(!audio.isPlaying(), "tone: still playing");
+}
+
+static size_t countSounding(size_t from) {
+    size_t n = 0;
+    for (size_t i = from; i < sim.out.size(); i++) {
+        if (sim.out[i] != 0) n++;
+    }
+    return n;
+}
+
+// A voice added while the stream plays its post-roll is picked up by the
+// interrupt; starting it must not wait for the tail to finish
+static void testVoiceDuringTail() {
+    coolDown();
+    resetSim();
+    audio.playTone(1000, 20);
+    service();
+    while (audio.mixer().active() && period()) {
+    }
+    CHECK(audio.isPlaying(), "tail: stream ended with the voice");
+    
+    size_t before = sim.out.size();
+    CHECK(audio.playTone(1500, 50) != MIXER_NO_VOICE, "tail: playTone() refused");
+    CHECK(sim.out.size() == before, "tail: playTone() blocked for %zu samples",
+          sim.out.size() - before);
+    runToEnd();
+    CHECK(countSounding(before) > (size_t)AUDIO_SAMPLE_RATE * 50 / 1000 / 2,
+          "tail: second tone not heard (%zu samples)", countSounding(before));
+    CHECK(sim.repeats == 0 && sim.overwrites == 0, "tail: %u repeats, %u overwrites",
+          sim.repeats, sim.overwrites);
+    CHECK(!audio.isPlaying() && !sim.running, "tail: still playing");
+}
+
+// The last refill has asked for the stop but STOPPED hasn't come yet
+static void testVoiceAfterLastRefill() {
+    coolDown();
+    resetSim();
+    audio.playTone(1000, 20);
+    service();
+    for (int i = 0; i < 1000 && !NRF_I2S->TASKS_STOP; i++) {
+        playBuffer();
+        if (!NRF_I2S->TASKS_STOP) service();
+    }
+    CHECK(NRF_I2S->TASKS_STOP && sim.running, "stop race: no stop pending");
+    
+    size_t before = sim.out.size();
+    CHECK(audio.playTone(1500, 50) != MIXER_NO_VOICE, "stop race: playTone() refused");
+    CHECK(sim.out.size() == before, "stop race: playTone() blocked for %zu samples",
+          sim.out.size() - before);
+    runToEnd();
+    CHECK(countSounding(before) > (size_t)AUDIO_SAMPLE_RATE * 50 / 1000 / 2,
+          "stop race: second tone not heard (%zu samples)", countSounding(before));
+    CHECK(!audio.isPlaying() && !sim.running, "stop race: still playing");
+}
+
+#define HFXO_RUNNING    (CLOCK_HFCLKSTAT_STATE_Msk | \
+                         (CLOCK_HFCLKSTAT_SRC_Xtal << CLOCK_HFCLKSTAT_SRC_Pos))
+
+// Play a short sound and let the amp power down again
+static void playAndCoolDown() {
+    static const int16_t beep[100] = { 1 };
+    coolDown();
+    NRF_CLOCK->TASKS_HFCLKSTART = 0;
+    NRF_CLOCK->TASKS_HFCLKSTOP = 0;
+    audio.play(beep, 100, true);
+    if (NRF_CLOCK->TASKS_HFCLKSTART) NRF_CLOCK->HFCLKSTAT = HFXO_RUNNING;
+    coolDown();
+}
+
+// The HFXO is only stopped if audio was the one that started it
+static void testHfxo() {
+    NRF_CLOCK->HFCLKSTAT = 0;
+    playAndCoolDown();
+    CHECK(NRF_CLOCK->TASKS_HFCLKSTART && NRF_CLOCK->TASKS_HFCLKSTOP,
+          "HFXO off: should be started and stopped again");
+    NRF_CLOCK->HFCLKSTAT = 0;
+    
+    // USB CDC already has it running
+    NRF_CLOCK->HFCLKSTAT = HFXO_RUNNING;
+    playAndCoolDown();
+    CHECK(!NRF_CLOCK->TASKS_HFCLKSTART && !NRF_CLOCK->TASKS_HFCLKSTOP,
+          "HFXO already running: started %u, stopped %u", NRF_CLOCK->TASKS_HFCLKSTART,
+          NRF_CLOCK->TASKS_HFCLKSTOP);
+    
+    // Running from the RC oscillator doesn't count
+    NRF_CLOCK->HFCLKSTAT = CLOCK_HFCLKSTAT_STATE_Msk;
+    playAndCoolDown();
+    CHECK(NRF_CLOCK->TASKS_HFCLKSTART && NRF_CLOCK->TASKS_HFCLKSTOP,
+          "HFINT running: HFXO should be started and stopped");
+    NRF_CLOCK->HFCLKSTAT = 0;
+    
+    // With the SoftDevice up it is requested and released through its API
+    sim.softDevice = true;
+    sim.sdRequests = sim.sdReleases = 0;
+    playAndCoolDown();
+    CHECK(sim.sdRequests == 1 && sim.sdReleases == 1 && !NRF_CLOCK->TASKS_HFCLKSTART &&
+          !NRF_CLOCK->TASKS_HFCLKSTOP, "SoftDevice: %u requests, %u releases", sim.sdRequests,
+          sim.sdReleases);
+    sim.softDevice = false;
+}
+
+int main() {
+    // The driver hands the DMA a 32-bit address
+    static int16_t probe;
+    if ((uintptr_t)(uint32_t)(uintptr_t)&probe != (uintptr_t)&probe) {
+        printf("static data above 4GB, build with -no-pie\n");
+        return 1;
+    }
+    
+    if (!audio.begin()) {
+        printf("FAIL: begin()\n");
+        return 1;
+    }
+    
+    testNonBlocking();
+    testLengths();
+    testBlocking();
+    testStop();
+    testMixer();
+    testVoiceDuringTail();
+    testVoiceAfterLastRefill();
+    testHfxo();
+    
+    return checkResult("I2S buffer swap OK");
+}
@@ -0,0 +1,354 @@
+/**
+ * @file display_test.cpp
+ * @brief Host test of the Sharp display driver's wire frames
+ *
+ * Build on the host from the repository root:
+ *
+ *     g++ -std=gnu++11 -O2 -Itools/host -Iinclude tools/display_test.cpp \
+ *         src/display_sharp.cpp src/font5x7.cpp -o display_test
+ *     ./display_test
+ *
+ * Runs the real SharpDisplay against a recording SPIM: every frame the
+ * driver starts is kept, byte for byte, and checked against the Sharp
+ * write format (command, then address / 20 data bytes / dummy per line,
+ * then a trailer). Exits non-zero if any check fails.
+ *
+ *     ./display_test --bench
+ *
+ * times the byte-wide primitives (fillRect, drawRect, blit,
+ * clearFramebuffer) against drawing the same pixels with setPixel(), the
+ * only path before them. Times are host nanoseconds, so only the ratios
+ * carry over to the Cortex-M4; both paths are plain loads, masks and
+ * stores with no host-only instructions.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "display_sharp.h"
+#include "font5x7.h"
+#include "host/check.h"
+
+// Frames the driver handed to SPIM3, in order
+static std::vector<std::vector<uint8_t> > sent;
+
+SharpSpim::SharpSpim()
+    : _busy(false), _standby(nullptr), _standbyLen(0), _done(nullptr), _ramPriorityIdle(0) {}
+void SharpSpim::begin(uint8_t, uint8_t, uint8_t) {}
+void SharpSpim::wait() {}
+void SharpSpim::start(const uint8_t* frame, size_t len) {
+    sent.push_back(std::vector<uint8_t>(frame, frame + len));
+}
+
+SharpVcom::SharpVcom() : _spim(nullptr), _period(RTC_TICK_HZ), _lastCompare(0), _polarity(false),
+                         _running(false) {}
+void SharpVcom::begin(SharpSpim&, TicklessScheduler&, uint8_t) {}
+void SharpVcom::end() {}
+void SharpVcom::beforeTransfer(size_t) {}
+
+/**
+ * @brief Check a write frame carries exactly the given rows of the framebuffer
+ */
+static void checkWriteFrame(const SharpDisplay& display, const std::vector<uint8_t>& frame,
+                            const std::vector<uint8_t>& rows, const char* name) {
+    size_t expected = 1 + rows.size() * SHARP_LINE_FRAME + 1;
+    CHECK(frame.size() == expected, "%s: %zu bytes, expected %zu", name, frame.size(), expected);
+    if (frame.size() != expected) return;
+    
+    CHECK((frame[0] & ~SHARP_CMD_VCOM) == SHARP_CMD_WRITE, "%s: command 0x%02X", name, frame[0]);
+    for (size_t i = 0; i < rows.size(); i++) {
+        const uint8_t* line = &frame[1 + i * SHARP_LINE_FRAME];
+        uint8_t y = rows[i];
+        CHECK(line[0] == y + 1, "%s: line %zu address %u, expected %u", name, i, line[0], y + 1);
+        CHECK(memcmp(line + 1, display.framebuffer[y], SHARP_LINE_BYTES) == 0,
+              "%s: row %u data differs from the framebuffer", name, y);
+        CHECK(line[1 + SHARP_LINE_BYTES] == 0x00, "%s: row %u dummy byte 0x%02X", name, y,
+              line[1 + SHARP_LINE_BYTES]);
+    }
+    CHECK(frame.back() == 0x00, "%s: trailer 0x%02X", name, frame.back());
+}
+
+static std::vector<uint8_t> allRows() {
+    std::vector<uint8_t> rows;
+    for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++) rows.push_back(y);
+    return rows;
+}
+
+// Fresh driver: nothing is known about the panel, so every line goes out
+static void testFullFrame() {
+    SharpDisplay display;
+    display.clearFramebuffer(true);
+    display.fillRect(10, 20, 30, 5, false);
+    sent.clear();
+    display.refresh();
+    
+    CHECK(sent.size() == 1, "full: %zu frames sent", sent.size());
+    if (sent.size() != 1) return;
+    checkWriteFrame(display, sent[0], allRows(), "full");
+    CHECK(sent[0].size() == SHARP_FRAME_MAX, "full: %zu bytes, SHARP_FRAME_MAX is %d",
+          sent[0].size(), SHARP_FRAME_MAX);
+    CHECK(display.lastRefreshLines() == DISPLAY_HEIGHT, "full: %u lines",
+          display.lastRefreshLines());
+}
+
+// After clearDisplay() the panel is known black: only rows drawn white go
+static void testPartialFrames() {
+    SharpDisplay display;
+    display.begin();
+    
+    sent.clear();
+    display.setPixel(5, 10, true);
+    display.refresh();
+    CHECK(sent.size() == 1, "one row: %zu frames sent", sent.size());
+    if (sent.size() == 1) {
+        checkWriteFrame(display, sent[0], std::vector<uint8_t>(1, 10), "one row");
+        CHECK(sent[0].size() == 1 + SHARP_LINE_FRAME + 1, "one row: %zu bytes", sent[0].size());
+    }
+    
+    // Rows in address order, whatever order they were drawn in
+    sent.clear();
+    display.drawHLine(0, 67, 8, true);
+    display.drawHLine(0, 3, 8, true);
+    display.setPixel(159, 40, true);
+    display.refresh();
+    std::vector<uint8_t> rows;
+    rows.push_back(3);
+    rows.push_back(40);
+    rows.push_back(67);
+    CHECK(sent.size() == 1, "three rows: %zu frames sent", sent.size());
+    if (sent.size() == 1) checkWriteFrame(display, sent[0], rows, "three rows");
+    
+    // Redrawn with the same pixels: compared, not sent
+    sent.clear();
+    display.setPixel(5, 10, true);
+    uint8_t scratch[SHARP_FRAME_MAX];
+    CHECK(display.buildFrame(scratch, false) == 0, "redraw: frame built for unchanged row");
+    CHECK(display.lastRefreshLines() == 0, "redraw: %u lines", display.lastRefreshLines());
+}
+
+// fillScreen() paints the panel behind the framebuffer's back: the next
+// frame must put back every row that differs from the fill
+static void testFillScreen() {
+    SharpDisplay display;
+    display.begin();
+    display.clearFramebuffer(true);
+    display.fillRect(0, 12, DISPLAY_WIDTH, 3, false);
+    display.setPixel(80, 50, false);
+    display.refresh();
+    
+    sent.clear();
+    display.fillScreen(true);
+    display.refresh();
+    std::vector<uint8_t> rows;
+    rows.push_back(12);
+    rows.push_back(13);
+    rows.push_back(14);
+    rows.push_back(50);
+    CHECK(sent.size() == 2, "fillScreen: %zu frames sent", sent.size());
+    if (sent.size() == 2) {
+        CHECK(sent[0].size() == SHARP_FRAME_MAX && sent[0][2] == 0xFF,
+              "fillScreen: fill frame malformed");
+        checkWriteFrame(display, sent[1], rows, "fillScreen restore");
+    }
+    
+    // Filled black: now every white row has to come back
+    sent.clear();
+    display.fillScreen(false);
+    display.refresh();
+    CHECK(sent.size() == 2, "fillScreen black: %zu frames sent", sent.size());
+    if (sent.size() == 2) {
+        CHECK(display.lastRefreshLines() == DISPLAY_HEIGHT - 3, "fillScreen black: %u lines",
+              display.lastRefreshLines());
+    }
+}
+
+// drawLine() writes one panel row directly; the next frame restores it
+static void testDrawLine() {
+    SharpDisplay display;
+    display.begin();
+    display.clearFramebuffer(true);
+    display.refresh();
+    
+    uint8_t pattern[SHARP_LINE_BYTES];
+    memset(pattern, 0x55, sizeof(pattern));
+    sent.clear();
+    display.drawLine(33, pattern);
+    display.refresh();
+    CHECK(sent.size() == 2, "drawLine: %zu frames sent", sent.size());
+    if (sent.size() == 2) {
+        CHECK(sent[0].size() == 1 + SHARP_LINE_FRAME + 1 && sent[0][1] == 34 &&
+              sent[0][2] == 0x55, "drawLine: line frame malformed");
+        checkWriteFrame(display, sent[1], std::vector<uint8_t>(1, 33), "drawLine restore");
+    }
+    
+    // Same data as the framebuffer: nothing to restore
+    sent.clear();
+    display.drawLine(34, display.framebuffer[34]);
+    display.refresh();
+    CHECK(sent.size() == 2 && sent[1].size() == 2, "drawLine same: restore frame sent");
+}
+
+static bool rowSet(const uint32_t* rows, uint8_t y) {
+    return rows[y >> 5] & (1UL << (y & 31));
+}
+
+// lastRows() is all a follower such as the mirror gets: copying only those
+// rows after each frame must keep its copy equal to the screen, and rows
+// written straight to the panel must be reported even when the frame that
+// follows puts them back
+static void testLastRows() {
+    SharpDisplay display;
+    display.begin();
+    display.clearFramebuffer(true);
+    display.fillRect(0, 20, DISPLAY_WIDTH, 4, false);
+    display.refresh();
+    uint8_t copy[DISPLAY_HEIGHT][SHARP_LINE_BYTES];
+    memcpy(copy, display.framebuffer, sizeof(copy));
+    
+    for (int step = 0; step < 4; step++) {
+        uint8_t pattern[SHARP_LINE_BYTES];
+        memset(pattern, 0x55, sizeof(pattern));
+        if (step == 0) display.clearDisplay();
+        if (step == 1) display.setPixel(7, 9, true);
+        if (step == 2) display.fillScreen(false);
+        if (step == 3) display.drawLine(30, pattern);
+        display.refresh();
+        
+        const uint32_t* rows = display.lastRows();
+        for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++) {
+            if (rowSet(rows, y)) memcpy(copy[y], display.framebuffer[y], SHARP_LINE_BYTES);
+        }
+        CHECK(memcmp(copy, display.framebuffer, sizeof(copy)) == 0,
+              "lastRows step %d: follower out of step with the screen", step);
+        
+        if (step == 0 || step == 2) {
+            bool all = true;
+            for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++) all = all && rowSet(rows, y);
+            CHECK(all, "lastRows step %d: rows the whole-panel write changed missing", step);
+        }
+        if (step == 3) CHECK(rowSet(rows, 30), "lastRows: drawLine row missing");
+    }
+    
+    // Reported once: the frame after that has nothing new
+    display.refresh();
+    bool none = true;
+    for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++) none = none && !rowSet(display.lastRows(), y);
+    CHECK(none, "lastRows: rows reported again by an empty frame");
+}
+
+// Nothing changed: no write frame, only the VCOM inversion
+static void testNoChange() {
+    SharpDisplay display;
+    display.begin();
+    display.refresh();
+    
+    sent.clear();
+    display.refresh();
+    CHECK(sent.size() == 1, "no change: %zu frames sent", sent.size());
+    if (sent.size() == 1) {
+        CHECK(sent[0].size() == 2, "no change: %zu bytes", sent[0].size());
+        CHECK((sent[0][0] & ~SHARP_CMD_VCOM) == 0x00 && sent[0][1] == 0x00,
+              "no change: %02X %02X is not a VCOM frame", sent[0][0], sent[0][1]);
+    }
+}
+
+// Every frame flips VCOM, whether it carries lines or not
+static void testVcomAlternates() {
+    SharpDisplay display;
+    display.begin();
+    sent.clear();
+    for (uint8_t i = 0; i < 6; i++) {
+        if (i & 1) display.setPixel(i, i, true);
+        display.refresh();
+    }
+    for (size_t i = 1; i < sent.size(); i++) {
+        CHECK((sent[i][0] ^ sent[i - 1][0]) & SHARP_CMD_VCOM, "vcom: frames %zu and %zu agree",
+              i - 1, i);
+    }
+}
+
+// Nanoseconds per call of fn, best of a few runs
+template<class Fn>
+static double timeNs(Fn fn) {
+    const int reps = 20000;
+    double best = 1e30;
+    for (int run = 0; run < 5; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < reps; i++) fn(i);
+        std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+        if (took.count() / reps < best) best = took.count() / reps;
+    }
+    return best;
+}
+
+static void report(const char* name, double pixelNs, double fastNs) {
+    printf("%-28s %10.1f %10.1f %8.1fx\n", name, pixelNs, fastNs, pixelNs / fastNs);
+}
+
+static int bench() {
+    static SharpDisplay display;
+    
+    // A 10x14 digit from the 2x atlas, as the stopwatch rows draw them
+    uint8_t glyph[14][2];
+    memcpy(glyph, fontGlyph2x('8').rows, sizeof(glyph));
+    
+    printf("%-28s %10s %10s %9s\n", "operation (ns per call)", "setPixel", "primitive", "speedup");
+    
+    // Reset dialog box, 148x30
+    report("fill 148x30 box", timeNs([](int i) {
+        for (int y = 19; y < 49; y++) {
+            for (int x = 6; x < 154; x++) display.setPixel(x, y, i & 1);
+        }
+    }), timeNs([](int i) {
+        display.fillRect(6, 19, 148, 30, i & 1);
+    }));
+    
+    report("outline 148x30", timeNs([](int i) {
+        for (int x = 6; x < 154; x++) {
+            display.setPixel(x, 19, i & 1);
+            display.setPixel(x, 48, i & 1);
+        }
+        for (int y = 20; y < 48; y++) {
+            display.setPixel(6, y, i & 1);
+            display.setPixel(153, y, i & 1);
+        }
+    }), timeNs([](int i) {
+        display.drawRect(6, 19, 148, 30, i & 1);
+    }));
+    
+    report("clear 160x68", timeNs([](int i) {
+        for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+            for (int x = 0; x < DISPLAY_WIDTH; x++) display.setPixel(x, y, i & 1);
+        }
+    }), timeNs([](int i) {
+        display.clearFramebuffer(i & 1);
+    }));
+    
+    // Unaligned, so blit() has to shift every source byte
+    report("10x14 glyph at x=37", timeNs([&glyph](int i) {
+        for (int r = 0; r < 14; r++) {
+            uint16_t bits = glyph[r][0] | (glyph[r][1] << 8);
+            for (int c = 0; c < 10; c++) {
+                if (bits & (1 << c)) display.setPixel(37 + c, 30 + r, i & 1);
+            }
+        }
+    }), timeNs([&glyph](int i) {
+        display.blit(37, 30, glyph[0], 10, 14, i & 1);
+    }));
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0) return bench();
+    
+    testFullFrame();
+    testPartialFrames();
+    testNoChange();
+    testVcomAlternates();
+    testFillScreen();
+    testDrawLine();
+    testLastRows();
+    
+    return checkResult("display frames OK");
+}
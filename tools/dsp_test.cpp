@@ -0,0 +1,240 @@
+/**
+ * @file dsp_test.cpp
+ * @brief Host test that the Q15 SIMD kernels match the reference path bit for bit
+ *
+ * Build on the host from the repository root:
+ *
+ *     g++ -std=gnu++11 -O2 -Itools/host -Iinclude tools/dsp_test.cpp src/synth.cpp -o dsp_test
+ *     ./dsp_test
+ *
+ * dsp.h is included twice: once as every host build sees it (the plain
+ * C reference path), and once more inside namespace simd with
+ * DSP_HOST_SIMD, over models of __SMULBB, __SMULTB, __SSAT, __QADD16
+ * and __PKHBT written from the instruction pseudocode in the ARMv7-M
+ * reference manual. The primitives are compared over every 16-bit
+ * sample at every gain the firmware uses, and the kernels over the
+ * wavetable, rendered tones and the mixer's inputs (full-scale voices,
+ * duck and volume gains, saturating sums, odd lengths, unaligned
+ * buffers). Exits non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include "audio.h"
+#include "synth.h"
+#include "host/check.h"
+
+// ========== Cortex-M4 DSP instructions, from the ARMv7-M pseudocode ==========
+
+// SignedSatQ(i, N) without the Q flag
+static inline int32_t armSignedSat(int64_t i, unsigned n) {
+    int64_t max = ((int64_t)1 << (n - 1)) - 1;
+    int64_t min = -((int64_t)1 << (n - 1));
+    return (int32_t)(i > max ? max : (i < min ? min : i));
+}
+
+static inline int32_t armSInt16(uint32_t bits) {
+    return (bits & 0x8000) ? (int32_t)(bits & 0xFFFF) - 0x10000 : (int32_t)(bits & 0xFFFF);
+}
+
+// SMULBB: SInt(Rn<15:0>) * SInt(Rm<15:0>)
+static inline int32_t __SMULBB(uint32_t rn, uint32_t rm) {
+    return armSInt16(rn) * armSInt16(rm);
+}
+
+// SMULTB: SInt(Rn<31:16>) * SInt(Rm<15:0>)
+static inline int32_t __SMULTB(uint32_t rn, uint32_t rm) {
+    return armSInt16(rn >> 16) * armSInt16(rm);
+}
+
+// SSAT Rd, #sat, Rn
+static inline int32_t __SSAT(int32_t rn, unsigned sat) {
+    return armSignedSat(rn, sat);
+}
+
+// QADD16: each halfword sum saturated to 16 bits
+static inline uint32_t __QADD16(uint32_t rn, uint32_t rm) {
+    uint32_t lo = (uint32_t)armSignedSat(armSInt16(rn) + armSInt16(rm), 16) & 0xFFFF;
+    uint32_t hi = (uint32_t)armSignedSat(armSInt16(rn >> 16) + armSInt16(rm >> 16), 16) & 0xFFFF;
+    return lo | (hi << 16);
+}
+
+// PKHBT Rd, Rn, Rm, LSL #shift: Rd<15:0> = Rn<15:0>, Rd<31:16> = (Rm << shift)<31:16>
+static inline uint32_t __PKHBT(uint32_t rn, uint32_t rm, unsigned shift) {
+    return (rn & 0xFFFF) | ((rm << shift) & 0xFFFF0000UL);
+}
+
+// ========== The same kernels on the SIMD path ==========
+
+#undef DSP_H
+#undef DSP_USE_SIMD
+#define DSP_HOST_SIMD
+namespace simd {
+#include "dsp.h"
+}
+#undef DSP_HOST_SIMD
+
+static_assert(DSP_USE_SIMD == 1, "second dsp.h should be on the SIMD path");
+
+// Every Q15 gain the firmware multiplies by, plus the edges
+static std::vector<int16_t> firmwareGains() {
+    std::vector<int16_t> gains = { 0, 1, 2, 16384, MIXER_DUCK_GAIN, Q15_ONE - 1, Q15_ONE,
+                                   -1, -16384, -32767, -32768 };
+    for (int volume = 0; volume < 255; volume++) {
+        gains.push_back((int16_t)((volume + 1) << 7));  // GeekWatchAudio::applyVolume()
+    }
+    gains.push_back((int16_t)(((int32_t)Q15_ONE * MIXER_DUCK_GAIN) >> 15));  // Ducked voice
+    for (int level = 0; level <= SYNTH_AMPLITUDE; level += 97) {
+        gains.push_back((int16_t)level);  // Envelope levels in ToneSynth::render()
+    }
+    return gains;
+}
+
+// Every 16-bit sample in either half, at every gain
+static void testPrimitives(const std::vector<int16_t> &gains) {
+    uint32_t bad = 0;
+    for (int16_t gain : gains) {
+        uint32_t g = (uint16_t)gain;
+        for (int32_t s = -32768; s <= 32767; s++) {
+            uint32_t w = ((uint32_t)(uint16_t)s << 16) | (uint16_t)(s * 7919);
+            if (dspSmulbb(w, g) != simd::dspSmulbb(w, g)) bad++;
+            if (dspSmultb(w, g) != simd::dspSmultb(w, g)) bad++;
+            int32_t p = dspSmulbb(w, g) >> 15;
+            if (dspSsat16(p) != simd::dspSsat16(p)) bad++;
+        }
+    }
+    CHECK(bad == 0, "multiply/saturate: %u mismatches", bad);
+    
+    // Saturating adds, every pairing of edge samples in both lanes plus random words
+    static const int16_t edges[] = { -32768, -32767, -16384, -1, 0, 1, 16383, 16384, 32766,
+                                     32767 };
+    bad = 0;
+    for (int16_t a : edges) {
+        for (int16_t b : edges) {
+            for (int16_t c : edges) {
+                uint32_t x = ((uint32_t)(uint16_t)a << 16) | (uint16_t)b;
+                uint32_t y = ((uint32_t)(uint16_t)c << 16) | (uint16_t)a;
+                if (dspQadd16(x, y) != simd::dspQadd16(x, y)) bad++;
+                if (dspPack(a, c) != simd::dspPack(a, c)) bad++;
+            }
+        }
+    }
+    std::mt19937 rng(15);
+    for (int i = 0; i < 4000000; i++) {
+        uint32_t x = rng(), y = rng();
+        if (dspQadd16(x, y) != simd::dspQadd16(x, y)) bad++;
+        if (dspSsat16((int32_t)x >> 14) != simd::dspSsat16((int32_t)x >> 14)) bad++;
+    }
+    CHECK(bad == 0, "add/pack: %u mismatches", bad);
+}
+
+// Inputs the mixer sees: the wavetable itself, tones, full-scale noise, clipping edges
+static std::vector<std::vector<int16_t> > mixerInputs() {
+    std::vector<std::vector<int16_t> > inputs;
+    std::vector<int16_t> table(sineWave.entries, sineWave.entries + SYNTH_TABLE_SIZE + 1);
+    for (int i = 0; i < 3; i++) table.insert(table.end(), table.begin(), table.begin() + 257);
+    inputs.push_back(table);
+    
+    static const uint16_t freqs[] = { 440, 1000, 2637, 7000 };
+    for (uint16_t f : freqs) {
+        for (int16_t amplitude : { (int16_t)SYNTH_AMPLITUDE, (int16_t)Q15_ONE }) {
+            ToneSynth tone;
+            tone.start(f, 60, AUDIO_SAMPLE_RATE, amplitude);
+            std::vector<int16_t> out(AUDIO_SAMPLE_RATE * 60 / 1000);
+            out.resize(tone.render(out.data(), out.size()));
+            inputs.push_back(out);
+        }
+    }
+    
+    std::mt19937 rng(16);
+    std::vector<int16_t> noise(1500);
+    for (int16_t &s : noise) s = (int16_t)rng();
+    inputs.push_back(noise);
+    
+    std::vector<int16_t> edges(1025);
+    for (size_t i = 0; i < edges.size(); i++) {
+        edges[i] = (i % 3 == 0) ? -32768 : (i % 3 == 1) ? 32767 : -1;
+    }
+    inputs.push_back(edges);
+    return inputs;
+}
+
+static void testKernels(const std::vector<int16_t> &gains) {
+    std::vector<std::vector<int16_t> > inputs = mixerInputs();
+    static const size_t lengths[] = { 0, 1, 2, 3, 127, 128, 129, 511, 512 };
+    uint32_t bad = 0, runs = 0;
+    
+    // A spare sample in front lets a buffer start on an odd halfword
+    std::vector<int16_t> refBuf(600), simdBuf(600);
+    for (size_t a = 0; a < inputs.size(); a++) {
+        const std::vector<int16_t> &src = inputs[a];
+        const std::vector<int16_t> &dst = inputs[(a + 1) % inputs.size()];
+        for (size_t len : lengths) {
+            if (len + 1 > src.size() || len + 1 > dst.size()) continue;
+            for (size_t offset = 0; offset < 2; offset++) {
+                int16_t *r = refBuf.data() + offset;
+                int16_t *s = simdBuf.data() + offset;
+                const int16_t *in = src.data() + (1 - offset);
+                
+                for (int16_t gain : gains) {
+                    memcpy(r, in, len * sizeof(int16_t));
+                    memcpy(s, in, len * sizeof(int16_t));
+                    q15Scale(r, len, gain);
+                    simd::q15Scale(s, len, gain);
+                    if (memcmp(r, s, len * sizeof(int16_t)) != 0) bad++;
+                    
+                    memcpy(r, dst.data(), len * sizeof(int16_t));
+                    memcpy(s, dst.data(), len * sizeof(int16_t));
+                    q15MixScaled(r, in, len, gain);
+                    simd::q15MixScaled(s, in, len, gain);
+                    if (memcmp(r, s, len * sizeof(int16_t)) != 0) bad++;
+                    runs += 2;
+                }
+                
+                memcpy(r, dst.data(), len * sizeof(int16_t));
+                memcpy(s, dst.data(), len * sizeof(int16_t));
+                q15Mix(r, in, len);
+                simd::q15Mix(s, in, len);
+                if (memcmp(r, s, len * sizeof(int16_t)) != 0) bad++;
+                runs++;
+            }
+        }
+    }
+    CHECK(bad == 0, "kernels: %u of %u runs differ", bad, runs);
+}
+
+// A full mixer buffer: every voice at once, some ducked, summed and then volume-scaled
+static void testMixdown() {
+    std::vector<std::vector<int16_t> > inputs = mixerInputs();
+    std::vector<int16_t> ref(AUDIO_BUFFER_SIZE), out(AUDIO_BUFFER_SIZE);
+    uint32_t bad = 0;
+    for (size_t first = 0; first < inputs.size(); first++) {
+        memset(ref.data(), 0, ref.size() * sizeof(int16_t));
+        memset(out.data(), 0, out.size() * sizeof(int16_t));
+        for (size_t v = 0; v < MIXER_VOICES; v++) {
+            const std::vector<int16_t> &voice = inputs[(first + v) % inputs.size()];
+            size_t n = voice.size() < ref.size() ? voice.size() : ref.size();
+            if (v == 0) {
+                q15Mix(ref.data(), voice.data(), n);
+                simd::q15Mix(out.data(), voice.data(), n);
+            } else {
+                q15MixScaled(ref.data(), voice.data(), n, MIXER_DUCK_GAIN);
+                simd::q15MixScaled(out.data(), voice.data(), n, MIXER_DUCK_GAIN);
+            }
+        }
+        q15Scale(ref.data(), ref.size(), 200 << 7);
+        simd::q15Scale(out.data(), out.size(), 200 << 7);
+        if (ref != out) bad++;
+    }
+    CHECK(bad == 0, "mixdown: %u of %zu buffers differ", bad, inputs.size());
+}
+
+int main() {
+    std::vector<int16_t> gains = firmwareGains();
+    testPrimitives(gains);
+    testKernels(gains);
+    testMixdown();
+    
+    return checkResult("reference and SIMD paths match bit for bit (%zu gains)", gains.size());
+}
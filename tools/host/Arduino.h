@@ -0,0 +1,74 @@
+/**
+ * @file Arduino.h
+ * @brief Just enough of the Arduino/nRF52 core to build drivers on the host
+ *
+ * Host harnesses in tools/ put this directory ahead of include/ so the
+ * firmware sources that only need the core's types build unchanged:
+ *
+ *     g++ -std=gnu++11 -Itools/host -Iinclude ...
+ *
+ * Peripheral classes (SharpSpim, SharpVcom, ...) are not built on the
+ * host; each harness defines the few members it links against and
+ * records what the driver asked of them. The same goes for the GPIO and
+ * FreeRTOS calls declared below: a harness that links a driver using
+ * them defines them, typically to advance its simulated peripheral.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nrf.h"
+
+#define BIN 2
+#define HEX 16
+#define DEC 10
+
+#define LOW     0
+#define HIGH    1
+#define INPUT   0
+#define OUTPUT  1
+
+inline void delay(uint32_t) {}
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t value);
+
+// ========== FreeRTOS ==========
+typedef long BaseType_t;
+typedef uint32_t TickType_t;
+typedef void* SemaphoreHandle_t;
+typedef void* TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define portMAX_DELAY           0xFFFFFFFFUL
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+#define portYIELD_FROM_ISR(x)   (void)(x)
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *woken);
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, BaseType_t reload, void *id,
+                           TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t *woken);
+
+// Serial output is dropped; harnesses print with stdio themselves
+struct HostSerial {
+    template<class T> void print(T, int = DEC) {}
+    template<class T> void println(T, int = DEC) {}
+    void println() {}
+    void begin(uint32_t) {}
+    operator bool() const { return false; }
+    size_t write(const uint8_t*, size_t n) { return n; }
+};
+static HostSerial Serial __attribute__((unused));
+
+#endif // HOST_ARDUINO_H
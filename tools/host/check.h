@@ -0,0 +1,47 @@
+/**
+ * @file check.h
+ * @brief Failure counting shared by the host tests
+ *
+ * CHECK() prints the file, line and a printf-style message for every
+ * condition that doesn't hold, and carries on so one run reports them
+ * all. main() ends with checkResult(), which prints the count and
+ * exits non-zero if anything failed, or the given summary if not.
+ */
+
+#ifndef HOST_CHECK_H
+#define HOST_CHECK_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+/**
+ * @brief Report the run and return main()'s exit code
+ * @param format Summary printed when every check passed
+ */
+static int checkResult(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+static int checkResult(const char *format, ...) {
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+    return 0;
+}
+
+#endif // HOST_CHECK_H
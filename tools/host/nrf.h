@@ -0,0 +1,115 @@
+/**
+ * @file nrf.h
+ * @brief Host stand-ins for the nRF52840 and Cortex-M4 registers the drivers touch
+ *
+ * Register blocks are plain structs with one instance each, shared by
+ * every translation unit, so a harness can play the peripheral: watch
+ * the TASKS_ registers the driver writes, raise EVENTS_ and call the
+ * driver's interrupt handler. Field names and bit values follow the
+ * nRF52840 headers for the fields that exist; anything a driver doesn't
+ * use is left out.
+ */
+
+#ifndef HOST_NRF_H
+#define HOST_NRF_H
+
+#include <stdint.h>
+
+typedef volatile uint32_t HostReg;
+
+// Taking a register's address gives a 32-bit bus address, as PPI
+// endpoints do on the target; nothing is ever written through it.
+struct HostRegister {
+    volatile uint32_t value;
+    uint32_t operator&() const { return 0x40000000UL; }
+};
+struct HostSpim { HostRegister TASKS_START; };
+static HostSpim hostSpim3;
+static HostSpim* const NRF_SPIM3 = &hostSpim3;
+
+// ========== I2S ==========
+struct HostI2s {
+    HostReg TASKS_START;
+    HostReg TASKS_STOP;
+    HostReg EVENTS_STOPPED;
+    HostReg EVENTS_TXPTRUPD;
+    HostReg INTENSET;
+    HostReg INTENCLR;
+    HostReg ENABLE;
+    struct {
+        HostReg MODE, RXEN, TXEN, MCKEN, MCKFREQ, RATIO, SWIDTH, ALIGN, FORMAT, CHANNELS;
+    } CONFIG;
+    struct { HostReg PTR; } TXD;
+    struct { HostReg MAXCNT; } RXTXD;
+    struct { HostReg MCK, SCK, LRCK, SDIN, SDOUT; } PSEL;
+};
+inline HostI2s* hostI2s() { static HostI2s regs; return &regs; }
+#define NRF_I2S (hostI2s())
+
+#define I2S_ENABLE_ENABLE_Disabled              0
+#define I2S_ENABLE_ENABLE_Enabled               1
+#define I2S_INTENSET_STOPPED_Msk                (1UL << 2)
+#define I2S_INTENSET_TXPTRUPD_Msk               (1UL << 5)
+#define I2S_INTENCLR_STOPPED_Msk                (1UL << 2)
+#define I2S_INTENCLR_TXPTRUPD_Msk               (1UL << 5)
+#define I2S_PSEL_MCK_CONNECT_Pos                31
+#define I2S_PSEL_MCK_CONNECT_Disconnected       1
+#define I2S_PSEL_SDIN_CONNECT_Pos               31
+#define I2S_PSEL_SDIN_CONNECT_Disconnected      1
+#define I2S_CONFIG_MODE_MODE_Master             0
+#define I2S_CONFIG_TXEN_TXEN_Enabled            1
+#define I2S_CONFIG_RXEN_RXEN_Disabled           0
+#define I2S_CONFIG_MCKEN_MCKEN_Enabled          1
+#define I2S_CONFIG_MCKFREQ_MCKFREQ_32MDIV15     0x11000000UL
+#define I2S_CONFIG_MCKFREQ_MCKFREQ_32MDIV31     0x08400000UL
+#define I2S_CONFIG_MCKFREQ_MCKFREQ_32MDIV63     0x04100000UL
+#define I2S_CONFIG_MCKFREQ_MCKFREQ_32MDIV125    0x020C0000UL
+#define I2S_CONFIG_RATIO_RATIO_32X              0
+#define I2S_CONFIG_RATIO_RATIO_48X              1
+#define I2S_CONFIG_RATIO_RATIO_96X              3
+#define I2S_CONFIG_SWIDTH_SWIDTH_16Bit          1
+#define I2S_CONFIG_ALIGN_ALIGN_Left             0
+#define I2S_CONFIG_FORMAT_FORMAT_I2S            0
+#define I2S_CONFIG_CHANNELS_CHANNELS_Left       1
+
+// ========== CLOCK ==========
+// The crystal is up as soon as it is asked for, so start-up waits return
+struct HostStartedEvent {
+    operator uint32_t() const { return 1; }
+    HostStartedEvent& operator=(uint32_t) { return *this; }
+};
+struct HostClock {
+    HostReg TASKS_HFCLKSTART;
+    HostReg TASKS_HFCLKSTOP;
+    HostStartedEvent EVENTS_HFCLKSTARTED;
+    HostReg HFCLKSTAT;
+};
+inline HostClock* hostClock() { static HostClock regs; return &regs; }
+#define NRF_CLOCK (hostClock())
+
+#define CLOCK_HFCLKSTAT_SRC_Pos                 0
+#define CLOCK_HFCLKSTAT_SRC_Msk                 (1UL << 0)
+#define CLOCK_HFCLKSTAT_SRC_Xtal                1
+#define CLOCK_HFCLKSTAT_STATE_Msk               (1UL << 16)
+
+// ========== Core ==========
+struct HostDwt { HostReg CTRL; HostReg CYCCNT; };
+inline HostDwt* hostDwt() { static HostDwt regs; return &regs; }
+#define DWT (hostDwt())
+#define DWT_CTRL_CYCCNTENA_Msk                  (1UL << 0)
+
+struct HostCoreDebug { HostReg DEMCR; };
+inline HostCoreDebug* hostCoreDebug() { static HostCoreDebug regs; return &regs; }
+#define CoreDebug (hostCoreDebug())
+#define CoreDebug_DEMCR_TRCENA_Msk              (1UL << 24)
+
+#define SystemCoreClock 64000000UL
+
+typedef int IRQn_Type;
+enum { I2S_IRQn = 37 };
+inline void NVIC_ClearPendingIRQ(IRQn_Type) {}
+inline void NVIC_SetPriority(IRQn_Type, uint32_t) {}
+inline void NVIC_EnableIRQ(IRQn_Type) {}
+inline void NVIC_DisableIRQ(IRQn_Type) {}
+
+#endif // HOST_NRF_H
@@ -0,0 +1,16 @@
+/**
+ * @file nrf_sdm.h
+ * @brief Host stand-in for the SoftDevice manager API
+ *
+ * Declared only; a harness that links a driver calling it decides
+ * whether the SoftDevice is "enabled".
+ */
+
+#ifndef HOST_NRF_SDM_H
+#define HOST_NRF_SDM_H
+
+#include <stdint.h>
+
+uint32_t sd_softdevice_is_enabled(uint8_t *enabled);
+
+#endif // HOST_NRF_SDM_H
@@ -0,0 +1,17 @@
+/**
+ * @file nrf_soc.h
+ * @brief Host stand-in for the SoftDevice SoC API (HFCLK requests)
+ *
+ * Declared only; a harness that links a driver calling it defines it.
+ */
+
+#ifndef HOST_NRF_SOC_H
+#define HOST_NRF_SOC_H
+
+#include <stdint.h>
+
+uint32_t sd_clock_hfclk_request();
+uint32_t sd_clock_hfclk_release();
+uint32_t sd_clock_hfclk_is_running(uint32_t *running);
+
+#endif // HOST_NRF_SOC_H
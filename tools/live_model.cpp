@@ -0,0 +1,205 @@
+/**
+ * @file live_model.cpp
+ * @brief Host model of radio events for live stopwatch state over BLE
+ *
+ * Build on the host from the repository root:
+ *
+ *     g++ -std=c++11 -O2 -Iinclude tools/live_model.cpp -o live_model
+ *     ./live_model [interactions per hour] [hours]
+ *
+ * Steps a connection event by event through a synthetic stretch of use
+ * (bursts of button presses, each a state transition) and counts the
+ * connection events the watch's radio takes part in, for a few ways of
+ * keeping a phone up to date:
+ *
+ * - full state every second on a fixed 15ms link, the naive approach
+ * - full state every second on the idle link (200ms, slave latency 7)
+ * - transitions only, on the idle link
+ * - transitions only with the adaptive link ble_sync.cpp uses: 30ms for
+ *   LIVE_FAST_HOLD_MS after each press, idle otherwise
+ *
+ * With slave latency the watch skips connection events while it has
+ * nothing to send, but wakes for any event it has a notification for.
+ * A new connection interval takes effect CONN_UPDATE_EVENTS events after
+ * it is asked for, at the old interval.
+ *
+ * Besides radio events per hour it reports notifications, payload bytes
+ * and how long a state change waits for its notification to go out.
+ *
+ * Last, what it costs to let a client that lost its link back in:
+ * ble_sync.cpp advertises at 20ms for SYNC_ADV_FAST_S, then every 2s,
+ * for LIVE_READVERTISE_S (config.h), and with 0 until the client is
+ * back however long that takes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "config.h"
+#include "live_state.h"
+
+#define CONN_UPDATE_EVENTS  6       // Instant of a connection update, at the least
+#define EVENT_RADIO_US      400     // Empty exchange incl. ramp-up, 1M PHY
+#define NOTIFY_RADIO_US     250     // Extra for a 16-byte notification
+#define ADV_EVENT_RADIO_US  1500    // Three channels, each a PDU and a scan request window
+#define CATEGORIES          2
+
+// Intervals in ms, as in ble_sync.h
+#define LIVE_FAST_MS        30.0
+#define LIVE_IDLE_MS        200.0
+#define LIVE_IDLE_LATENCY   7
+#define LIVE_FAST_HOLD_MS   3000.0
+#define ADV_FAST_MS         20.0
+#define ADV_FAST_S          10.0
+#define ADV_SLOW_MS         2000.0
+
+struct LinkParams {
+    double intervalMs;
+    int latency;
+};
+
+struct Strategy {
+    const char *name;
+    LinkParams idle;
+    LinkParams fast;
+    bool adaptive;          // Fast link for LIVE_FAST_HOLD_MS after a press
+    bool everySecond;       // Full state at 1Hz instead of on transitions
+};
+
+static const Strategy strategies[] = {
+    { "1Hz full state, 15ms",         { 15.0, 0 }, { 15.0, 0 }, false, true },
+    { "1Hz full state, idle link",    { LIVE_IDLE_MS, LIVE_IDLE_LATENCY }, { 0, 0 }, false, true },
+    { "transitions, idle link",       { LIVE_IDLE_MS, LIVE_IDLE_LATENCY }, { 0, 0 }, false, false },
+    { "transitions, adaptive link",   { LIVE_IDLE_MS, LIVE_IDLE_LATENCY }, { LIVE_FAST_MS, 0 },
+      true, false },
+};
+
+struct Result {
+    uint64_t events;
+    uint64_t notifications;
+    uint64_t bytes;
+    double waitTotalMs;
+    double waitMaxMs;
+};
+
+// Bursts of one to three presses a few seconds apart, spread over the run
+static std::vector<double> synthesize(double perHour, double hours) {
+    std::vector<double> presses;
+    srand(1);
+    double span = hours * 3600e3;
+    for (int i = 0; i < (int)(perHour * hours); i++) {
+        double at = (double)rand() / RAND_MAX * span;
+        int burst = 1 + rand() % 3;
+        for (int p = 0; p < burst; p++) {
+            presses.push_back(at + p * (500.0 + rand() % 3000));
+        }
+    }
+    std::sort(presses.begin(), presses.end());
+    return presses;
+}
+
+// Advertising events over the first seconds after a lost link
+static double advertisingEvents(double seconds) {
+    double fast = std::min(seconds, ADV_FAST_S);
+    return fast * 1000 / ADV_FAST_MS + (seconds - fast) * 1000 / ADV_SLOW_MS;
+}
+
+static Result simulate(const Strategy &s, const std::vector<double> &presses, double hours) {
+    Result r = {0, 0, 0, 0, 0};
+    double end = hours * 3600e3;
+    LinkParams params = s.idle;
+    LinkParams next = params;
+    int64_t updateAt = -1;      // Event index the pending update takes effect at
+    int64_t index = 0;
+    int skipped = 0;
+    double fastUntil = -1;
+    double nextSecond = 1000;
+    size_t press = 0;
+    std::vector<double> queued;  // Times the pending notifications were raised
+    
+    LiveState state = {};
+    state.count = CATEGORIES;
+    uint8_t buffer[LIVE_STATE_MAX];
+    size_t stateBytes = liveStateEncode(state, buffer);
+    
+    for (double t = 0; t < end; t += params.intervalMs, index++) {
+        // What happened since the last event
+        while (press < presses.size() && presses[press] <= t) {
+            queued.push_back(presses[press]);
+            if (s.adaptive) fastUntil = presses[press] + LIVE_FAST_HOLD_MS;
+            press++;
+        }
+        while (s.everySecond && nextSecond <= t) {
+            queued.push_back(nextSecond);
+            nextSecond += 1000;
+        }
+        
+        // Ask for the link speed now wanted, one procedure at a time
+        if (s.adaptive && updateAt < 0) {
+            LinkParams want = t < fastUntil ? s.fast : s.idle;
+            if (want.intervalMs != params.intervalMs) {
+                next = want;
+                updateAt = index + CONN_UPDATE_EVENTS;
+            }
+        }
+        
+        // The watch wakes for data, for the update instant, or when its
+        // latency runs out
+        bool instant = updateAt == index;
+        if (!queued.empty() || instant || skipped >= params.latency) {
+            r.events++;
+            skipped = 0;
+            for (double raised : queued) {
+                double wait = t - raised;
+                r.waitTotalMs += wait;
+                if (wait > r.waitMaxMs) r.waitMaxMs = wait;
+            }
+            r.notifications += queued.size();
+            r.bytes += queued.size() * stateBytes;
+            queued.clear();
+        } else {
+            skipped++;
+        }
+        if (instant) {
+            params = next;
+            updateAt = -1;
+        }
+    }
+    return r;
+}
+
+int main(int argc, char **argv) {
+    double perHour = argc >= 2 ? atof(argv[1]) : 4;
+    double hours = argc >= 3 ? atof(argv[2]) : 24;
+    if (hours <= 0) hours = 24;
+    std::vector<double> presses = synthesize(perHour, hours);
+    
+    printf("%.0f hours, %zu state changes (%.1f interactions an hour)\n\n", hours, presses.size(),
+           perHour);
+    printf("%-30s %12s %10s %10s %10s %10s %10s\n", "strategy", "events/hour", "notify/h",
+           "bytes/h", "radio ms/h", "wait avg", "wait max");
+    
+    for (const Strategy &s : strategies) {
+        Result r = simulate(s, presses, hours);
+        double radioMs = (r.events * EVENT_RADIO_US + r.notifications * NOTIFY_RADIO_US) / 1000.0;
+        double waitAvg = r.notifications ? r.waitTotalMs / r.notifications : 0;
+        printf("%-30s %12.0f %10.0f %10.0f %10.0f %8.0fms %8.0fms\n", s.name, r.events / hours,
+               r.notifications / hours, r.bytes / hours, radioMs / hours, waitAvg, r.waitMaxMs);
+    }
+    
+    // A client gone for the whole run, say a phone left at home
+    printf("\n%-30s %12s %10s\n", "re-advertising, lost client", "events", "radio ms");
+    double windows[] = { (double)LIVE_READVERTISE_S, hours * 3600 };
+    const char *names[] = { "LIVE_READVERTISE_S", "until back (0)" };
+    for (int i = 0; i < 2; i++) {
+        double seconds = windows[i] > 0 ? std::min(windows[i], hours * 3600) : hours * 3600;
+        double events = advertisingEvents(seconds);
+        char name[40];
+        snprintf(name, sizeof(name), "%s, %.0fs", names[i], seconds);
+        printf("%-30s %12.0f %10.0f\n", name, events, events * ADV_EVENT_RADIO_US / 1000.0);
+    }
+    printf("%-30s %12.0f %10.0f\n", "until back, per hour after", 3600e3 / ADV_SLOW_MS,
+           3600e3 / ADV_SLOW_MS * ADV_EVENT_RADIO_US / 1000.0);
+    return 0;
+}
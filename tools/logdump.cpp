@@ -0,0 +1,229 @@
+/**
+ * @file logdump.cpp
+ * @brief Host decoder for the session event log, with a codec benchmark
+ *
+ * Build on the host from the repository root:
+ *
+ *     g++ -std=c++11 -O2 -Iinclude tools/logdump.cpp -o logdump
+ *
+ * Decode a raw copy of the log region (EVENTLOG_PAGES * 4kB starting at
+ * EVENTLOG_FLASH_END - EVENTLOG_PAGES * 4kB, 0xE5000 by default), e.g.
+ * read with pyocd:
+ *
+ *     pyocd cmd -t nrf52840 -c "savemem 0xE5000 32768 eventlog.bin"
+ *     ./logdump eventlog.bin > events.csv
+ *
+ * Pages are put in order by their sequence numbers and every record is
+ * printed as CSV; torn frames are reported on stderr.
+ *
+ *     ./logdump --bench [days]
+ *
+ * encodes a synthetic stretch of stopwatch use (30 days by default) with
+ * the firmware's codec and reports bytes per event, retention in the
+ * log region and decode throughput.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "log_codec.h"
+
+#define FIXED_RECORD_BYTES  12      // Plain seq + time + type + category + CRC
+#define DEFAULT_LOG_PAGES   8       // EVENTLOG_PAGES in config.h
+
+static const char *typeName(uint8_t type) {
+    switch (type) {
+        case LOG_BOOT:      return "boot";
+        case LOG_SWITCH:    return "switch";
+        case LOG_RESET:     return "reset";
+        default:            return "unknown";
+    }
+}
+
+static int dump(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    std::vector<uint8_t> image;
+    uint8_t buffer[LOG_PAGE_SIZE];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        image.insert(image.end(), buffer, buffer + n);
+    }
+    fclose(f);
+    if (image.size() % LOG_PAGE_SIZE) {
+        fprintf(stderr, "%s: not a whole number of %d-byte pages\n", path, LOG_PAGE_SIZE);
+        return 1;
+    }
+    
+    // Oldest page first
+    std::vector<size_t> pages;
+    for (size_t page = 0; page < image.size() / LOG_PAGE_SIZE; page++) {
+        LogPageHeader header;
+        memcpy(&header, &image[page * LOG_PAGE_SIZE], sizeof(header));
+        if (logPageHeaderValid(header)) pages.push_back(page);
+    }
+    std::sort(pages.begin(), pages.end(), [&](size_t a, size_t b) {
+        LogPageHeader ha, hb;
+        memcpy(&ha, &image[a * LOG_PAGE_SIZE], sizeof(ha));
+        memcpy(&hb, &image[b * LOG_PAGE_SIZE], sizeof(hb));
+        return ha.pageSeq < hb.pageSeq;
+    });
+    
+    printf("seq,time,type,category\n");
+    uint32_t records = 0, torn = 0;
+    for (size_t page : pages) {
+        LogPageReader reader;
+        LogRecord record;
+        reader.begin(&image[page * LOG_PAGE_SIZE]);
+        while (reader.next(record)) {
+            time_t t = record.time;
+            char when[32];
+            strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+            if (record.category == LOG_CATEGORY_NONE) {
+                printf("%u,%s,%s,\n", record.seq, when, typeName(record.type));
+            } else {
+                printf("%u,%s,%s,%u\n", record.seq, when, typeName(record.type), record.category);
+            }
+            records++;
+        }
+        if (reader.torn()) {
+            fprintf(stderr, "page %zu: %u torn frame(s) skipped\n", page, reader.torn());
+        }
+        torn += reader.torn();
+    }
+    fprintf(stderr, "%zu pages, %u records, %u torn frames\n", pages.size(), records, torn);
+    return 0;
+}
+
+// A day of switching between geek (0) and life (1), a few pauses, and a
+// reset in the evening; times are epoch seconds
+static void synthesize(std::vector<LogRecord> &events, uint32_t days) {
+    std::mt19937 rng(1);
+    uint32_t seq = 0;
+    uint32_t day0 = 1767225600;  // 2026-01-01
+    for (uint32_t day = 0; day < days; day++) {
+        uint32_t t = day0 + day * 86400 + 7 * 3600 + rng() % 3600;
+        uint32_t end = day0 + day * 86400 + 23 * 3600;
+        if (day % 7 == 0) events.push_back({seq++, t - 60, LOG_BOOT, LOG_CATEGORY_NONE});
+        uint8_t category = 1;
+        while (t < end) {
+            events.push_back({seq++, t, LOG_SWITCH, category});
+            t += 300 + rng() % 5400;
+            if (rng() % 6 == 0) {
+                events.push_back({seq++, t, LOG_SWITCH, LOG_CATEGORY_NONE});
+                t += 60 + rng() % 1800;
+            }
+            category ^= 1;
+        }
+        events.push_back({seq++, end, LOG_RESET, LOG_CATEGORY_NONE});
+    }
+}
+
+// Lay events out in pages the way EventLog does, batch records per frame;
+// used is the bytes written, up to the end of the last frame
+static std::vector<uint8_t> encode(const std::vector<LogRecord> &events, size_t batch,
+                                   size_t &used) {
+    std::vector<uint8_t> image;
+    size_t offset = LOG_PAGE_SIZE;   // Forces a page header first
+    uint32_t prevTime = 0, pageSeq = 0;
+    uint8_t frame[LOG_FRAME_MAX_BYTES + 3];
+    
+    for (size_t i = 0; i < events.size();) {
+        LogFrameEncoder encoder;
+        encoder.begin(frame, prevTime, LOG_PAGE_SIZE - offset);
+        size_t n = 0;
+        while (n < batch && i + n < events.size() && encoder.add(events[i + n])) {
+            n++;
+        }
+        size_t size = encoder.finish();
+        if (size == 0) {
+            image.resize(image.size() + LOG_PAGE_SIZE, 0xFF);
+            LogPageHeader header;
+            prevTime = events[i].time;
+            logPageHeaderInit(header, ++pageSeq, events[i].seq, prevTime);
+            memcpy(&image[image.size() - LOG_PAGE_SIZE], &header, sizeof(header));
+            offset = sizeof(header);
+            continue;
+        }
+        memcpy(&image[image.size() - LOG_PAGE_SIZE + offset], frame, size);
+        offset += size;
+        prevTime = encoder.prevTime();
+        i += n;
+    }
+    used = image.size() - LOG_PAGE_SIZE + offset;
+    return image;
+}
+
+static int bench(uint32_t days) {
+    std::vector<LogRecord> events;
+    synthesize(events, days);
+    double perDay = (double)events.size() / days;
+    size_t logBytes = (DEFAULT_LOG_PAGES - 1) * LOG_PAGE_SIZE;  // One page is kept erased
+    printf("%u days, %zu events (%.1f a day)\n\n", days, events.size(), perDay);
+    printf("%-22s %10s %12s %14s\n", "records per frame", "bytes", "bytes/event", "retention");
+    printf("%-22s %10zu %12.2f %11.0f days\n", "fixed 12-byte records",
+           events.size() * FIXED_RECORD_BYTES, (double)FIXED_RECORD_BYTES,
+           logBytes / (FIXED_RECORD_BYTES * perDay));
+    
+    std::vector<uint8_t> image;
+    for (size_t batch : {1, 4, 8, 16}) {
+        size_t used;
+        image = encode(events, batch, used);
+        
+        // Slack at the ends of full pages counts, it is flash not holding records
+        double perEvent = (double)used / events.size();
+        printf("%-22zu %10zu %12.2f %11.0f days\n", batch, used, perEvent,
+               logBytes / (perEvent * perDay));
+    }
+    
+    // Decode the 16-per-frame image repeatedly and check it against the input
+    auto start = std::chrono::steady_clock::now();
+    size_t decoded = 0;
+    uint32_t rounds = 0;
+    do {
+        size_t i = 0;
+        for (size_t page = 0; page < image.size() / LOG_PAGE_SIZE; page++) {
+            LogPageReader reader;
+            LogRecord record;
+            reader.begin(&image[page * LOG_PAGE_SIZE]);
+            while (reader.next(record)) {
+                const LogRecord &want = events[i++];
+                if (record.seq != want.seq || record.time != want.time ||
+                    record.type != want.type || record.category != want.category) {
+                    fprintf(stderr, "mismatch at seq %u\n", want.seq);
+                    return 1;
+                }
+            }
+        }
+        if (i != events.size()) {
+            fprintf(stderr, "decoded %zu of %zu events\n", i, events.size());
+            return 1;
+        }
+        decoded += i;
+        rounds++;
+    } while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("\ndecode: %.1f M events/s, %.1f MB/s (%u rounds, output verified)\n",
+           decoded / seconds / 1e6, rounds * image.size() / seconds / 1e6, rounds);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+        int days = argc >= 3 ? atoi(argv[2]) : 30;
+        return bench(days > 0 ? days : 30);
+    }
+    if (argc != 2 || argv[1][0] == '-') {
+        fprintf(stderr, "usage: %s eventlog.bin\n       %s --bench [days]\n", argv[0], argv[0]);
+        return 2;
+    }
+    return dump(argv[1]);
+}
@@ -0,0 +1,212 @@
+/**
+ * @file mirror_decode.cpp
+ * @brief Host decoder for the display mirror stream, with a codec benchmark
+ *
+ * Build on the host from the repository root:
+ *
+ *     g++ -std=c++11 -O2 -Iinclude tools/mirror_decode.cpp -o mirror_decode
+ *
+ * Capture the USB port of a watch built with DISPLAY_MIRROR and decode
+ * the capture into one PBM image per frame:
+ *
+ *     stty -F /dev/ttyACM0 raw && cat /dev/ttyACM0 > mirror.bin
+ *     ./mirror_decode mirror.bin frames/f
+ *
+ * writes frames/f00000.pbm, frames/f00001.pbm, ... ("-" reads stdin).
+ * Debug text on the same port is skipped. Stream statistics go to
+ * stderr.
+ *
+ *     ./mirror_decode --bench [seconds]
+ *
+ * draws a synthetic watch face (clock and two stopwatches in segment
+ * digits) once a second for an hour by default, passes the rows that
+ * changed through the firmware's encoder and this decoder, checks every
+ * frame comes back exactly, and compares the bytes against sending raw
+ * frames or raw dirty rows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "mirror_codec.h"
+
+#define DEFAULT_KEY_FRAMES  60      // MIRROR_KEY_FRAMES in config.h
+
+// Framebuffer bit set = white, bit 0 = leftmost; PBM is 1 = black, MSB first
+static bool writePbm(const char *path, const MirrorFrame &frame) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    fprintf(f, "P4\n%d %d\n", DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    for (uint8_t y = 0; y < MIRROR_ROWS; y++) {
+        uint8_t row[MIRROR_ROW_BYTES];
+        for (uint8_t x = 0; x < MIRROR_ROW_BYTES; x++) {
+            uint8_t b = ~frame[y][x];
+            uint8_t r = 0;
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                if (b & (1 << bit)) r |= 0x80 >> bit;
+            }
+            row[x] = r;
+        }
+        fwrite(row, 1, sizeof(row), f);
+    }
+    return fclose(f) == 0;
+}
+
+static int decode(const char *input, const char *prefix) {
+    FILE *in = strcmp(input, "-") == 0 ? stdin : fopen(input, "rb");
+    if (!in) {
+        perror(input);
+        return 1;
+    }
+    
+    MirrorDecoder decoder;
+    uint32_t frames = 0, skipped = 0, bad = 0;
+    uint64_t bytes = 0;
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        bytes++;
+        switch (decoder.push((uint8_t)c)) {
+            case MirrorDecoder::MIRROR_FRAME: {
+                char path[512];
+                snprintf(path, sizeof(path), "%s%05u.pbm", prefix, frames);
+                if (!writePbm(path, decoder.frame())) {
+                    perror(path);
+                    return 1;
+                }
+                frames++;
+                break;
+            }
+            case MirrorDecoder::MIRROR_SKIPPED:
+                skipped++;
+                break;
+            case MirrorDecoder::MIRROR_BAD:
+                bad++;
+                break;
+            default:
+                break;
+        }
+    }
+    if (in != stdin) fclose(in);
+    
+    fprintf(stderr, "%llu bytes, %u frames written, %u packets skipped waiting for a keyframe, "
+            "%u lost, %u bad\n", (unsigned long long)bytes, frames, skipped, decoder.lost(), bad);
+    return 0;
+}
+
+// Black rectangle on the white face
+static void fillRect(MirrorFrame &frame, int x, int y, int w, int h) {
+    for (int row = y; row < y + h; row++) {
+        for (int col = x; col < x + w; col++) {
+            frame[row][col >> 3] &= ~(1 << (col & 7));
+        }
+    }
+}
+
+// Seven-segment digit, 2px strokes, 10x16 cell at (x, y)
+static void drawDigit(MirrorFrame &frame, int x, int y, int digit) {
+    static const uint8_t segments[10] = {
+        0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F
+    };
+    uint8_t s = segments[digit];
+    if (s & 0x01) fillRect(frame, x, y, 10, 2);             // a
+    if (s & 0x02) fillRect(frame, x + 8, y, 2, 8);          // b
+    if (s & 0x04) fillRect(frame, x + 8, y + 8, 2, 8);      // c
+    if (s & 0x08) fillRect(frame, x, y + 14, 10, 2);        // d
+    if (s & 0x10) fillRect(frame, x, y + 8, 2, 8);          // e
+    if (s & 0x20) fillRect(frame, x, y, 2, 8);              // f
+    if (s & 0x40) fillRect(frame, x, y + 7, 10, 2);         // g
+}
+
+static void drawTime(MirrorFrame &frame, int x, int y, uint32_t seconds) {
+    uint32_t fields[3] = { seconds / 3600 % 100, seconds / 60 % 60, seconds % 60 };
+    for (int f = 0; f < 3; f++) {
+        drawDigit(frame, x + f * 30, y, fields[f] / 10);
+        drawDigit(frame, x + f * 30 + 12, y, fields[f] % 10);
+        if (f < 2) {
+            fillRect(frame, x + f * 30 + 25, y + 4, 2, 2);
+            fillRect(frame, x + f * 30 + 25, y + 10, 2, 2);
+        }
+    }
+}
+
+// Clock on top, stopwatch 1 running, stopwatch 2 paused
+static void drawFace(MirrorFrame &frame, uint32_t t) {
+    memset(frame, 0xFF, sizeof(MirrorFrame));
+    drawTime(frame, 36, 2, 11 * 3600 + 37 * 60 + t);
+    fillRect(frame, 0, 21, DISPLAY_WIDTH, 1);
+    drawTime(frame, 36, 26, 2 * 3600 + 15 * 60 + t);
+    fillRect(frame, 20, 30, 4, 8);                          // Active marker
+    drawTime(frame, 36, 48, 40 * 60 + 12);
+}
+
+static int bench(uint32_t seconds) {
+    MirrorEncoder encoder;
+    MirrorDecoder decoder;
+    encoder.begin(DEFAULT_KEY_FRAMES);
+    
+    MirrorFrame frame, shadow;
+    memset(shadow, 0, sizeof(shadow));
+    std::vector<uint8_t> packet(MIRROR_PACKET_MAX);
+    uint64_t bytes = 0, keyBytes = 0, rowBytes = 0;
+    uint32_t packets = 0, keys = 0, rows = 0;
+    
+    for (uint32_t t = 0; t < seconds; t++) {
+        drawFace(frame, t);
+        
+        // What buildFrame() would send: rows that differ from the panel
+        uint32_t sent[(MIRROR_ROWS + 31) / 32] = {};
+        for (uint8_t y = 0; y < MIRROR_ROWS; y++) {
+            if (t && memcmp(frame[y], shadow[y], MIRROR_ROW_BYTES) == 0) continue;
+            memcpy(shadow[y], frame[y], MIRROR_ROW_BYTES);
+            sent[y >> 5] |= 1UL << (y & 31);
+            rows++;
+        }
+        encoder.markRows(sent);
+        
+        size_t len = encoder.encode(frame, packet.data());
+        if (!len) continue;
+        bool key = packet[2] == MIRROR_KEY;
+        packets++;
+        bytes += len;
+        if (key) {
+            keys++;
+            keyBytes += len;
+        }
+        
+        MirrorDecoder::Result result = MirrorDecoder::MIRROR_MORE;
+        for (size_t i = 0; i < len; i++) {
+            result = decoder.push(packet[i]);
+        }
+        if (result != MirrorDecoder::MIRROR_FRAME ||
+            memcmp(decoder.frame(), frame, sizeof(MirrorFrame)) != 0) {
+            fprintf(stderr, "frame %u does not decode back\n", t);
+            return 1;
+        }
+    }
+    rowBytes = (uint64_t)rows * (1 + MIRROR_ROW_BYTES);
+    
+    printf("%u frames, %u packets (%u keyframes, every %d)\n", seconds, packets, keys,
+           DEFAULT_KEY_FRAMES);
+    printf("raw frames          %8.1f bytes/frame\n", (double)MIRROR_FRAME_BYTES);
+    printf("raw dirty rows      %8.1f bytes/frame (%.1f rows)\n", (double)rowBytes / seconds,
+           (double)rows / seconds);
+    printf("xor + rle           %8.1f bytes/frame (keyframes %.0f, deltas %.1f)\n",
+           (double)bytes / seconds, keys ? (double)keyBytes / keys : 0.0,
+           packets > keys ? (double)(bytes - keyBytes) / (packets - keys) : 0.0);
+    printf("all frames decoded back exactly\n");
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+        int seconds = argc >= 3 ? atoi(argv[2]) : 3600;
+        return bench(seconds > 0 ? seconds : 3600);
+    }
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s capture.bin|- [prefix]\n       %s --bench [seconds]\n",
+                argv[0], argv[0]);
+        return 2;
+    }
+    return decode(argv[1], argc >= 3 ? argv[2] : "frame");
+}
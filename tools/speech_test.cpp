@@ -0,0 +1,249 @@
+/**
+ * @file speech_test.cpp
+ * @brief Host test of spoken durations: elapsed time to word clips
+ *
+ * Build on the host from the repository root:
+ *
+ *     g++ -std=gnu++11 -O2 -Itools/host -Iinclude tools/speech_test.cpp src/speech.cpp \
+ *         src/adpcm.cpp src/synth.cpp -o speech_test
+ *     ./speech_test
+ *
+ * Checks the word sequences SpeechPhrase builds for the elapsed times
+ * announceElapsed() speaks: zero, ones, teens, tens, the minute and
+ * hour boundaries, hundreds of hours and the clamp, with singular and
+ * plural units. Every number 0-999 is read back from its words, and
+ * the longest phrase must fit. SpeechPlayer's producer is then pulled
+ * through a dictionary of constant-level clips to check that words
+ * follow each other with no gap, in order, across buffer boundaries.
+ *
+ * The audio driver is not built: this file defines the few
+ * GeekWatchAudio and AudioMixer members speech.cpp calls. Exits
+ * non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "speech.h"
+#include "host/check.h"
+
+// Same order as enum SpeechWord
+static const char *const wordNames[SPEECH_WORD_COUNT] = {
+    "zero", "one", "two", "three", "four",
+    "five", "six", "seven", "eight", "nine",
+    "ten", "eleven", "twelve", "thirteen", "fourteen",
+    "fifteen", "sixteen", "seventeen", "eighteen", "nineteen",
+    "twenty", "thirty", "forty", "fifty",
+    "sixty", "seventy", "eighty", "ninety",
+    "hundred",
+    "hour", "hours",
+    "minute", "minutes",
+    "second", "seconds",
+    "geeking for",
+    "living for",
+};
+
+// ========== Stand-ins for the audio driver ==========
+
+static struct {
+    AudioProducer producer;
+    void *context;
+    bool active;
+} stream;
+
+AudioMixer::AudioMixer() {
+}
+
+void AudioMixer::stopVoice(VoiceHandle) {
+    stream.active = false;
+}
+
+bool AudioMixer::isActive(VoiceHandle) const {
+    return stream.active;
+}
+
+GeekWatchAudio::GeekWatchAudio(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t) {
+}
+
+VoiceHandle GeekWatchAudio::playStream(AudioProducer producer, void *context, AudioPriority) {
+    stream.producer = producer;
+    stream.context = context;
+    stream.active = true;
+    return 0x0101;
+}
+
+// ========== Phrases ==========
+
+static std::string spoken(const SpeechPhrase &phrase) {
+    std::string s;
+    for (uint8_t i = 0; i < phrase.count(); i++) {
+        if (i) s += ' ';
+        s += wordNames[phrase.word(i)];
+    }
+    return s;
+}
+
+static void checkElapsed(uint32_t seconds, const char *want) {
+    SpeechPhrase phrase;
+    phrase.add(PHRASE_GEEKING_FOR);
+    bool ok = phrase.addElapsed(seconds);
+    std::string got = spoken(phrase);
+    std::string expected = std::string("geeking for ") + want;
+    CHECK(ok && got == expected, "%lu s: \"%s\", expected \"%s\"", (unsigned long)seconds,
+          got.c_str(), expected.c_str());
+}
+
+static void testElapsed() {
+    checkElapsed(0, "zero seconds");
+    checkElapsed(1, "one second");
+    checkElapsed(2, "two seconds");
+    checkElapsed(10, "ten seconds");
+    checkElapsed(11, "eleven seconds");
+    checkElapsed(13, "thirteen seconds");
+    checkElapsed(19, "nineteen seconds");
+    checkElapsed(20, "twenty seconds");
+    checkElapsed(21, "twenty one seconds");
+    checkElapsed(59, "fifty nine seconds");
+    
+    // Seconds are dropped once there are minutes
+    checkElapsed(60, "one minute");
+    checkElapsed(61, "one minute");
+    checkElapsed(119, "one minute");
+    checkElapsed(120, "two minutes");
+    checkElapsed(14 * 60 + 30, "fourteen minutes");
+    checkElapsed(3599, "fifty nine minutes");
+    
+    // Hour boundary, and zero minutes left out
+    checkElapsed(3600, "one hour");
+    checkElapsed(3601, "one hour");
+    checkElapsed(3660, "one hour one minute");
+    checkElapsed(3720, "one hour two minutes");
+    checkElapsed(7200, "two hours");
+    checkElapsed(7260, "two hours one minute");
+    checkElapsed(2 * 3600 + 15 * 60 + 40, "two hours fifteen minutes");
+    checkElapsed(17 * 3600 + 17 * 60, "seventeen hours seventeen minutes");
+    checkElapsed(86399, "twenty three hours fifty nine minutes");
+    checkElapsed(86400, "twenty four hours");
+    
+    // Hundreds of hours, then the clamp
+    checkElapsed(100 * 3600, "one hundred hours");
+    checkElapsed(101 * 3600 + 60, "one hundred one hours one minute");
+    checkElapsed(115 * 3600, "one hundred fifteen hours");
+    checkElapsed(240 * 3600 + 59 * 60, "two hundred forty hours fifty nine minutes");
+    checkElapsed(999 * 3600 + 59 * 60 + 59,
+                 "nine hundred ninety nine hours fifty nine minutes");
+    checkElapsed(5000UL * 3600 + 60, "nine hundred ninety nine hours one minute");
+    checkElapsed(0xFFFFFFFFUL, "nine hundred ninety nine hours twenty eight minutes");
+}
+
+static int wordValue(SpeechWord w) {
+    if (w <= WORD_NINETEEN) return w - WORD_ZERO;
+    if (w <= WORD_NINETY) return (w - WORD_TWENTY + 2) * 10;
+    return -1;
+}
+
+// Read each number back from its words, the way a listener would
+static void testNumbers() {
+    uint32_t bad = 0;
+    for (uint16_t n = 0; n <= SPEECH_MAX_NUMBER; n++) {
+        SpeechPhrase phrase;
+        if (!phrase.addNumber(n)) {
+            bad++;
+            continue;
+        }
+        int value = 0;
+        bool valid = phrase.count() > 0 && phrase.count() <= 4;
+        for (uint8_t i = 0; valid && i < phrase.count(); i++) {
+            SpeechWord w = phrase.word(i);
+            if (w == WORD_HUNDRED) {
+                valid = i == 1 && value >= 1 && value <= 9;
+                value *= 100;
+            } else if (wordValue(w) < 0) {
+                valid = false;
+            } else {
+                // Nothing spoken after a ones word, and "zero" only on its own
+                int v = wordValue(w);
+                valid = (value % 10 == 0) && !(v == 0 && phrase.count() > 1) &&
+                        !(value % 100 != 0 && v >= 10);
+                value += v;
+            }
+        }
+        if (!valid || value != n) {
+            if (bad < 5) printf("  %u spoken as \"%s\"\n", n, spoken(phrase).c_str());
+            bad++;
+        }
+    }
+    CHECK(bad == 0, "numbers: %u of 0-%u misspoken", bad, SPEECH_MAX_NUMBER);
+    
+    // The longest phrase announceElapsed() builds fits
+    SpeechPhrase longest;
+    bool ok = longest.add(PHRASE_LIVING_FOR) && longest.addElapsed(777 * 3600 + 57 * 60);
+    CHECK(ok && longest.count() < SPEECH_MAX_WORDS, "longest phrase: %u words, %s",
+          longest.count(), ok ? "fits" : "truncated");
+}
+
+// ========== Gapless playback ==========
+
+// One block whose nibbles are all 0: step index 0 keeps the level constant
+static std::vector<uint8_t> constantClip(int16_t level, uint32_t samples) {
+    std::vector<uint8_t> data(ADPCM_HEADER_BYTES + samples / 2, 0);
+    data[0] = (uint8_t)(level & 0xFF);
+    data[1] = (uint8_t)((level >> 8) & 0xFF);
+    return data;
+}
+
+static void testPlayer() {
+    std::vector<uint8_t> data[SPEECH_WORD_COUNT];
+    AdpcmClip clips[SPEECH_WORD_COUNT];
+    const AdpcmClip *dictionary[SPEECH_WORD_COUNT];
+    for (uint8_t w = 0; w < SPEECH_WORD_COUNT; w++) {
+        uint32_t samples = 100 + 37 * w;
+        data[w] = constantClip((int16_t)(1000 + w), samples);
+        clips[w] = { data[w].data(), samples, (uint16_t)data[w].size() };
+        dictionary[w] = &clips[w];
+    }
+    dictionary[WORD_HOURS] = nullptr;  // Missing clips are skipped
+    
+    GeekWatchAudio audio(I2S_SCK_PIN, I2S_LRCK_PIN, I2S_DIN_PIN);
+    SpeechPlayer player;
+    player.begin(audio, dictionary);
+    
+    SpeechPhrase phrase;
+    phrase.add(PHRASE_GEEKING_FOR);
+    phrase.addElapsed(2 * 3600 + 15 * 60);  // "two hours fifteen minutes", hours silent
+    CHECK(player.say(phrase) && player.speaking(), "say() refused");
+    
+    std::vector<int16_t> expected;
+    for (uint8_t i = 0; i < phrase.count(); i++) {
+        if (!dictionary[phrase.word(i)]) continue;
+        expected.insert(expected.end(), clips[phrase.word(i)].numSamples,
+                        (int16_t)(1000 + phrase.word(i)));
+    }
+    
+    // Odd buffer sizes so word ends land all over the buffers
+    for (size_t size : { (size_t)1, (size_t)37, (size_t)MIXER_CHUNK_SAMPLES,
+                         (size_t)AUDIO_BUFFER_SIZE }) {
+        player.say(phrase);
+        std::vector<int16_t> out, buffer(size);
+        size_t got;
+        while ((got = stream.producer(buffer.data(), size, stream.context)) > 0) {
+            out.insert(out.end(), buffer.begin(), buffer.begin() + got);
+            if (got < size) break;
+        }
+        CHECK(out == expected, "%zu-sample buffers: %zu samples, expected %zu%s", size,
+              out.size(), expected.size(), out.size() == expected.size() ? ", out of order" : "");
+    }
+    
+    // Nothing with a clip: nothing to say
+    SpeechPhrase silent;
+    silent.add(WORD_HOURS);
+    CHECK(!player.say(silent), "say() accepted a phrase with no clips");
+}
+
+int main() {
+    testElapsed();
+    testNumbers();
+    testPlayer();
+    
+    return checkResult("speech phrases OK");
+}
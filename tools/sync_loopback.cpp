@@ -0,0 +1,209 @@
+/**
+ * @file sync_loopback.cpp
+ * @brief Host loopback of the log sync protocol over a modelled BLE link
+ *
+ * Build on the host from the repository root:
+ *
+ *     g++ -std=c++11 -O2 -Iinclude tools/sync_loopback.cpp src/sync_protocol.cpp -o sync_loopback
+ *     ./sync_loopback [records]
+ *
+ * Runs the watch's SyncSession against the reference SyncClient, one
+ * connection event at a time, without a radio. Each event the watch
+ * fills the notification queue the way ble_sync.cpp does, the link
+ * model decides how much of it fits in the event given the PHY, data
+ * length and event length, and the client's ACK goes back in the next
+ * event. For a few link setups it reports throughput per connection
+ * event, sync time and radio-on time. Every run also drops the link
+ * part way through, resumes from the watch's cursor, and checks that
+ * the client ends up with every record exactly once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "sync_protocol.h"
+
+#define T_IFS_US            150     // Inter-frame space
+#define RAMP_US             40      // Radio ramp-up per event (fast ramp)
+#define L2CAP_HEADER        4
+#define ATT_HEADER          3       // Opcode + handle
+#define LL_OVERHEAD         9       // Access address, LL header, CRC
+#define HVN_QUEUE           8       // Notifications queued per event, as on the watch
+#define WINDOW              12
+
+struct LinkSetup {
+    const char *name;
+    bool phy2M;
+    uint16_t mtu;
+    uint16_t dataLength;    // LL payload, 27 without DLE
+    uint16_t intervalUs;
+    uint16_t eventUs;       // Event length the stack reserves
+};
+
+static const LinkSetup setups[] = {
+    { "1M  MTU 23  LL 27  30ms",   false, 23,  27,  30000, 3750 },
+    { "1M  MTU 247 LL 251 30ms",   false, 247, 251, 30000, 7500 },
+    { "2M  MTU 247 LL 251 15ms",   true,  247, 251, 15000, 7500 },
+    { "2M  MTU 247 LL 251 7.5ms",  true,  247, 251, 7500,  7500 },
+};
+
+// Air time of one LL PDU with payload bytes
+static uint32_t pduUs(const LinkSetup &link, uint16_t payload) {
+    uint32_t bits = (link.phy2M ? 2 : 1) * 8 + (LL_OVERHEAD + payload) * 8;
+    return link.phy2M ? bits / 2 : bits;
+}
+
+// Serves records from memory, with a hole as a torn frame would leave
+class VectorSource : public SyncSource {
+public:
+    explicit VectorSource(const std::vector<LogRecord> &records) : _records(records), _index(0) {}
+    
+    void seek(uint32_t seq) override {
+        _index = std::lower_bound(_records.begin(), _records.end(), seq,
+                                  [](const LogRecord &r, uint32_t s) { return r.seq < s; }) -
+                 _records.begin();
+    }
+    
+    bool next(LogRecord &record) override {
+        if (_index >= _records.size()) return false;
+        record = _records[_index++];
+        return true;
+    }
+
+private:
+    const std::vector<LogRecord> &_records;
+    size_t _index;
+};
+
+static void synthesize(std::vector<LogRecord> &records, uint32_t count) {
+    srand(1);
+    uint32_t time = 1767225600;  // 2026-01-01
+    uint32_t seq = 0;
+    while (records.size() < count) {
+        if (seq == count / 3) seq += 2;  // Torn frame: two records missing
+        LogRecord record;
+        record.seq = seq++;
+        record.time = time;
+        record.type = LOG_SWITCH;
+        record.category = rand() % 6 == 0 ? LOG_CATEGORY_NONE : seq % 2;
+        records.push_back(record);
+        time += 300 + rand() % 5400;
+    }
+}
+
+static void collect(const LogRecord &record, void *context) {
+    ((std::vector<LogRecord> *)context)->push_back(record);
+}
+
+struct RunResult {
+    uint32_t events;
+    uint32_t packets;
+    uint32_t bytes;         // Notification payload, resends included
+    uint64_t radioUs;
+    bool ok;
+};
+
+static RunResult run(const LinkSetup &link, const std::vector<LogRecord> &records) {
+    VectorSource source(records);
+    SyncSession session;
+    SyncClient client;
+    std::vector<LogRecord> received;
+    session.begin(source);
+    session.setPayload(link.mtu - ATT_HEADER);
+    client.begin(collect, &received);
+    
+    uint8_t command[SYNC_COMMAND_MAX];
+    uint8_t packet[SYNC_PAYLOAD_MAX];
+    size_t commandLen = client.start(command, 0, WINDOW);
+    std::deque<std::vector<uint8_t>> queue;  // Notifications handed to the stack
+    RunResult result = {0, 0, 0, 0, true};
+    bool dropped = false;
+    
+    while (result.events < 1000000) {
+        // Central's packet carries the last ACK or START, if any
+        if (commandLen) session.command(command, commandLen);
+        commandLen = 0;
+        
+        // Drop the link a third of the way in: queued notifications are lost
+        if (!dropped && received.size() > records.size() / 3) {
+            dropped = true;
+            queue.clear();
+            session.stop();
+            commandLen = client.start(command, SYNC_RESUME, WINDOW);
+            continue;
+        }
+        
+        // Watch tops up the notification queue, as ble_sync.cpp does
+        while (queue.size() < HVN_QUEUE) {
+            size_t len = session.nextPacket(packet);
+            if (!len) break;
+            queue.push_back(std::vector<uint8_t>(packet, packet + len));
+        }
+        
+        // Exchange PDUs until the queue is empty or the event is used up
+        uint32_t used = RAMP_US;
+        uint16_t centralPdu = L2CAP_HEADER + ATT_HEADER + SYNC_COMMAND_MAX;
+        bool first = true;
+        for (;;) {
+            if (queue.empty()) {
+                used += pduUs(link, first ? centralPdu : 0) + T_IFS_US + pduUs(link, 0);
+                break;
+            }
+            size_t sdu = L2CAP_HEADER + ATT_HEADER + queue.front().size();
+            uint32_t exchange = 0;
+            for (size_t left = sdu; left > 0;) {
+                size_t fragment = std::min<size_t>(left, link.dataLength);
+                exchange += pduUs(link, first ? centralPdu : 0) + T_IFS_US +
+                            pduUs(link, fragment) + T_IFS_US;
+                first = false;
+                left -= fragment;
+            }
+            if (used + exchange > link.eventUs && result.packets) break;
+            used += exchange;
+            client.receive(queue.front().data(), queue.front().size());
+            queue.pop_front();
+            result.packets++;
+        }
+        result.radioUs += used;
+        result.events++;
+        
+        if (client.caughtUp() && session.caughtUp()) break;
+        commandLen = client.ack(command);
+    }
+    
+    // Everything held, once, in order, across the dropped link
+    size_t expected = records.size();
+    result.ok = received.size() == expected && client.gaps() == 2;
+    for (size_t i = 0; result.ok && i < expected; i++) {
+        result.ok = received[i].seq == records[i].seq && received[i].time == records[i].time &&
+                    received[i].type == records[i].type &&
+                    received[i].category == records[i].category;
+    }
+    result.bytes = session.stats().bytes;
+    return result;
+}
+
+int main(int argc, char **argv) {
+    uint32_t count = argc >= 2 ? atoi(argv[1]) : 10000;
+    if (count < 10) count = 10;
+    std::vector<LogRecord> records;
+    synthesize(records, count);
+    
+    printf("%u records, window %u, %u notifications queued per event\n\n", count, WINDOW,
+           HVN_QUEUE);
+    printf("%-26s %8s %9s %10s %9s %10s %6s\n", "link", "events", "rec/event", "bytes/event",
+           "sync ms", "radio ms", "check");
+    
+    bool allOk = true;
+    for (const LinkSetup &link : setups) {
+        RunResult r = run(link, records);
+        printf("%-26s %8u %9.1f %10.0f %9.0f %10.1f %6s\n", link.name, r.events,
+               (double)count / r.events, (double)r.bytes / r.events,
+               r.events * (link.intervalUs / 1000.0), r.radioUs / 1000.0, r.ok ? "ok" : "FAIL");
+        allOk = allOk && r.ok;
+    }
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,455 @@
+/**
+ * @file timer_wheel_test.cpp
+ * @brief Host test of the timer wheel against a brute-force reference over simulated days
+ *
+ * Build on the host from the repository root:
+ *
+ *     g++ -std=gnu++11 -O2 -Itools/host -Iinclude tools/timer_wheel_test.cpp \
+ *         src/timer_wheel.cpp -o timer_wheel_test
+ *     ./timer_wheel_test [days] [seed]
+ *
+ * Runs TimerWheel side by side with a reference that keeps every timer
+ * in an array and scans it for the due ones, through a week of RTC
+ * ticks by default: repeating timers from under a granule to a week,
+ * one-shot reminders from a second to beyond the wheel's horizon, and
+ * the firmware's own (log flush, nag, midnight roll, sync, reset dialog).
+ * Each timer expires only on ticks of its own residue mod 64, so no two
+ * are ever due on the same tick and the order is fully defined.
+ * The loop wakes at nextDeadline() as the firmware does, or early for a
+ * button, or late when busy. Callbacks and the loop start and cancel
+ * timers, their own and each other's, some already overdue.
+ *
+ * After every advance() the timers called back, their order, the tick
+ * and each timer's next expiry must match the reference, and so must
+ * nextDeadline() and count(). The week runs once from boot and once at
+ * three years of uptime, and timers are then walked across the end of
+ * the top wheel's span, where it wraps to the next lap. A sparse run
+ * then covers two years of reminders, past the horizon. Exits non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "scheduler.h"
+#include "timer_wheel.h"
+#include "host/check.h"
+
+#define SECOND          ((uint64_t)RTC_TICK_HZ)
+#define MINUTE          (60 * SECOND)
+#define HOUR            (60 * MINUTE)
+#define DAY             (24 * HOUR)
+
+// Each timer only ever expires on ticks congruent to its id mod 64, so no
+// two are due on the same tick and the order they fire in is fully defined
+#define TIMERS          48
+#define TICK_STEP       64
+#define STEADY          5       // Ids below this repeat all run, nothing else touches them
+
+static_assert(TIMERS <= TICK_STEP, "One tick residue per timer");
+
+static uint64_t ownTick(int id, uint64_t tick) {
+    return (tick & ~(uint64_t)(TICK_STEP - 1)) | (uint64_t)id;
+}
+
+static uint64_t ownPeriod(uint64_t period) {
+    period &= ~(uint64_t)(TICK_STEP - 1);
+    return period ? period : TICK_STEP;
+}
+
+// A callback as recorded by either side
+struct Fired {
+    int id;
+    uint64_t now;
+    uint64_t expires;   // After the callback was due: the next one if repeating
+    bool active;
+    
+    bool operator==(const Fired& other) const {
+        return id == other.id && now == other.now && expires == other.expires &&
+               active == other.active;
+    }
+};
+
+// What the simulation drives, the wheel or the reference
+class Timers {
+public:
+    virtual ~Timers() {}
+    virtual void start(int id, uint64_t expires, uint64_t period) = 0;
+    virtual void cancel(int id) = 0;
+    virtual uint16_t advance(uint64_t now) = 0;
+    virtual uint64_t nextDeadline() const = 0;
+    virtual uint16_t count() const = 0;
+    
+    std::vector<Fired> fired;
+    uint32_t calls[TIMERS] = {};
+    uint32_t seed = 0;
+    bool longOnly = false;
+};
+
+// ========== Delays ==========
+
+// From a second to past the horizon, weighted towards the short end
+static uint64_t randomDelay(std::mt19937_64& rng, bool longOnly) {
+    static const uint64_t scales[] = { SECOND, 10 * SECOND, MINUTE, 15 * MINUTE, HOUR, DAY,
+                                       7 * DAY, 30 * DAY, 400 * DAY, 800 * DAY };
+    size_t first = longOnly ? 5 : 0;
+    size_t n = sizeof(scales) / sizeof(scales[0]);
+    size_t scale = first + rng() % (n - first);
+    if (!longOnly && scale >= 6 && rng() % 4) scale = rng() % 6;
+    return 1 + rng() % scales[scale];
+}
+
+static uint64_t randomPeriod(std::mt19937_64& rng) {
+    static const uint64_t periods[] = { SECOND, 5 * SECOND, MINUTE, 15 * MINUTE, HOUR, DAY,
+                                        7 * DAY };
+    uint64_t period = periods[rng() % (sizeof(periods) / sizeof(periods[0]))];
+    return ownPeriod(period + (rng() % 3 ? 0 : rng() % SECOND));
+}
+
+/**
+ * @brief What a callback does, the same on both sides
+ *
+ * Decided by the timer and how many times it has fired, not by anything
+ * the side under test keeps, so both make the same calls as long as they
+ * agree so far.
+ */
+static void callback(Timers& timers, int id, uint64_t now, bool repeating) {
+    std::mt19937_64 rng(((uint64_t)timers.seed << 40) ^ ((uint64_t)id << 32) ^ timers.calls[id]++);
+    int other = STEADY + (int)(rng() % (TIMERS - STEADY));
+    uint32_t action = rng() % 50;
+    
+    // A repeating timer keeps going until something else stops it
+    if (repeating && (action <= 2 || action == 10 || action == 12)) return;
+    switch (action) {
+        case 0: case 1: case 2:
+            // Snooze: restart itself as a one-shot
+            timers.start(id, ownTick(id, now + randomDelay(rng, timers.longOnly)), 0);
+            break;
+        case 3: case 4: case 5:
+            timers.start(other, ownTick(other, now + randomDelay(rng, timers.longOnly)), 0);
+            break;
+        case 6: case 7:
+            timers.start(other, ownTick(other, now + randomDelay(rng, timers.longOnly)), randomPeriod(rng));
+            break;
+        case 8: case 9:
+            // May be later in this same batch
+            timers.cancel(other);
+            break;
+        case 10:
+            // Already due: waits for the next advance()
+            timers.start(id, ownTick(id, now > 2 * SECOND ? now - rng() % (2 * SECOND) : 0), 0);
+            break;
+        case 11:
+            timers.start(other, ownTick(other, now), 0);
+            break;
+        case 12:
+            timers.cancel(id);
+            break;
+        default:
+            break;
+    }
+}
+
+// ========== The wheel ==========
+
+class WheelSide : public Timers {
+public:
+    WheelSide(uint64_t now) : _now(now) {
+        for (int id = 0; id < TIMERS; id++) {
+            nodes[id].callback = fire;
+            nodes[id].context = this;
+        }
+        wheel.begin(now);
+    }
+    
+    void start(int id, uint64_t expires, uint64_t period) override {
+        wheel.start(nodes[id], expires, period);
+    }
+    void cancel(int id) override { wheel.cancel(nodes[id]); }
+    uint16_t advance(uint64_t now) override {
+        _now = now;
+        return wheel.advance(now);
+    }
+    uint64_t nextDeadline() const override { return wheel.nextDeadline(); }
+    uint16_t count() const override { return wheel.count(); }
+
+private:
+    TimerWheel wheel;
+    WheelTimer nodes[TIMERS];
+    uint64_t _now;
+    
+    static void fire(WheelTimer& timer) {
+        WheelSide& side = *(WheelSide*)timer.context;
+        int id = (int)(&timer - side.nodes);
+        side.fired.push_back({ id, side._now, timer.expires(), timer.active() });
+        callback(side, id, side._now, timer.active());
+    }
+};
+
+// ========== The reference ==========
+
+class ReferenceSide : public Timers {
+public:
+    void start(int id, uint64_t expires, uint64_t period) override {
+        timers[id] = { true, false, expires, period };
+    }
+    void cancel(int id) override {
+        timers[id].active = false;
+        timers[id].batch = false;
+    }
+    
+    uint16_t advance(uint64_t now) override {
+        // Everything due, in the order it was due; anything started from
+        // here on waits for the next call
+        std::vector<int> due;
+        for (int id = 0; id < TIMERS; id++) {
+            if (timers[id].active && timers[id].expires <= now) {
+                timers[id].batch = true;
+                due.push_back(id);
+            }
+        }
+        std::sort(due.begin(), due.end(), [this](int a, int b) {
+            return timers[a].expires < timers[b].expires;
+        });
+        
+        uint16_t count = 0;
+        for (int id : due) {
+            Timer& t = timers[id];
+            if (!t.batch) continue;
+            t.batch = false;
+            t.active = false;
+            if (t.period) {
+                uint64_t next = t.expires + t.period;
+                if (next <= now) next += ((now - next) / t.period + 1) * t.period;
+                start(id, next, t.period);
+            }
+            count++;
+            fired.push_back({ id, now, t.expires, t.active });
+            callback(*this, id, now, t.active);
+        }
+        return count;
+    }
+    
+    uint64_t nextDeadline() const override {
+        uint64_t deadline = UINT64_MAX;
+        for (const Timer& t : timers) {
+            if (t.active && t.expires < deadline) deadline = t.expires;
+        }
+        return deadline;
+    }
+    uint16_t count() const override {
+        uint16_t n = 0;
+        for (const Timer& t : timers) n += t.active;
+        return n;
+    }
+
+private:
+    struct Timer {
+        bool active;
+        bool batch;         // Due in the advance() under way
+        uint64_t expires;
+        uint64_t period;
+    };
+    Timer timers[TIMERS] = {};
+};
+
+// ========== Simulation ==========
+
+// A start or cancel from the loop, made on both sides
+struct Op {
+    int id;
+    uint64_t expires;
+    uint64_t period;
+    bool cancel;
+};
+
+static void apply(Timers& wheel, Timers& ref, const Op& op) {
+    for (Timers* timers : { &wheel, &ref }) {
+        if (op.cancel) {
+            timers->cancel(op.id);
+        } else {
+            timers->start(op.id, op.expires, op.period);
+        }
+    }
+}
+
+static void printFired(const char* side, const std::vector<Fired>& fired) {
+    printf("  %s:", side);
+    for (const Fired& f : fired) {
+        printf(" #%d(next %llu%s)", f.id, (unsigned long long)f.expires, f.active ? "" : ", idle");
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Run both sides from start for span ticks
+ * @param longOnly Only reminders of a day or more, and waking only for them
+ * @return Callbacks run
+ */
+static uint64_t simulate(const char* name, uint32_t seed, uint64_t start, uint64_t span,
+                         bool longOnly) {
+    std::mt19937_64 rng(seed);
+    WheelSide wheel(start);
+    ReferenceSide ref;
+    wheel.seed = ref.seed = seed;
+    wheel.longOnly = ref.longOnly = longOnly;
+    
+    // The firmware's nag, sync and midnight roll, and two about as fast
+    // as a granule, then its log flush and reset dialog
+    Op firmware[] = {
+        { 0, ownTick(0, start + 90 * MINUTE), ownPeriod(15 * MINUTE), false },
+        { 1, ownTick(1, start + 30 * SECOND), ownPeriod(HOUR), false },
+        { 2, ownTick(2, start + 11 * HOUR + 17 * MINUTE), ownPeriod(DAY), false },
+        { 3, ownTick(3, start + SECOND), ownPeriod(SECOND / 4 + 100), false },
+        { 4, ownTick(4, start + 2 * SECOND), ownPeriod(1000), false },
+        { 5, ownTick(5, start + 5 * SECOND), 0, false },
+        { 6, ownTick(6, start + 10 * SECOND), 0, false },
+    };
+    static_assert(STEADY == 5, "First five above repeat");
+    for (const Op& op : firmware) {
+        if (!longOnly || !op.period) apply(wheel, ref, op);
+    }
+    for (int id = 7; id < TIMERS; id++) {
+        uint32_t kind = rng() % 5;
+        if (kind == 0) continue;
+        Op op = { id, ownTick(id, start + randomDelay(rng, longOnly)),
+                  kind == 1 && !longOnly ? randomPeriod(rng) : 0, false };
+        apply(wheel, ref, op);
+    }
+    
+    uint64_t now = start, end = start + span, callbacks = 0, steps = 0;
+    while (now < end) {
+        uint64_t deadline = wheel.nextDeadline();
+        if (deadline != ref.nextDeadline() || wheel.count() != ref.count()) {
+            CHECK(false, "%s: at tick %llu, deadline %llu with %u timers, expected %llu with %u",
+                  name, (unsigned long long)now, (unsigned long long)deadline, wheel.count(),
+                  (unsigned long long)ref.nextDeadline(), ref.count());
+            return callbacks;
+        }
+        
+        // On the deadline, early for a button, or late when busy
+        uint64_t next = deadline;
+        uint32_t r = rng() % 1000;
+        if (deadline == UINT64_MAX) {
+            next = now + rng() % DAY;
+        } else if (!longOnly && r < 150 && deadline > now) {
+            next = now + rng() % (deadline - now);
+        } else if (!longOnly && r < 300) {
+            next = deadline + rng() % (3 * SECOND);
+        } else if (r < 305) {
+            next = deadline + rng() % (longOnly ? 30 * DAY : 10 * MINUTE);
+        }
+        if (next < now) next = now;
+        now = next;
+        
+        wheel.fired.clear();
+        ref.fired.clear();
+        uint16_t fromWheel = wheel.advance(now);
+        uint16_t fromRef = ref.advance(now);
+        if (wheel.fired != ref.fired || fromWheel != fromRef) {
+            CHECK(false, "%s: advance(%llu) step %llu: %u callbacks, expected %u", name,
+                  (unsigned long long)now, (unsigned long long)steps, fromWheel, fromRef);
+            printFired("wheel", wheel.fired);
+            printFired("expected", ref.fired);
+            return callbacks;
+        }
+        callbacks += fromRef;
+        steps++;
+        
+        // The loop itself starts or stops something now and then
+        if (longOnly || rng() % 4 == 0) {
+            int id = STEADY + (int)(rng() % (TIMERS - STEADY));
+            Op op = { id, ownTick(id, now + randomDelay(rng, longOnly)),
+                      rng() % 2 || longOnly ? 0 : randomPeriod(rng), rng() % 8 == 0 };
+            apply(wheel, ref, op);
+        }
+    }
+    printf("%s: %llu wakeups, %llu callbacks\n", name, (unsigned long long)steps,
+           (unsigned long long)callbacks);
+    return callbacks;
+}
+
+/**
+ * @brief Timers either side of the end of the top wheel's span
+ *
+ * The top wheel covers 2^30 granules (about 388 days); a timer due just
+ * past the end is started while the cursor is still short of it. Woken
+ * exactly at each deadline, both sides must call back the same timers
+ * at the same ticks through the crossing.
+ * @return Callbacks run
+ */
+static uint64_t crossLap(const char* name, uint32_t seed, uint64_t lapEnd) {
+    uint64_t start = lapEnd - 20 * SECOND;
+    WheelSide wheel(start);
+    ReferenceSide ref;
+    wheel.seed = ref.seed = seed;
+    
+    // Last granule of the lap, the first ones of the next, a repeat that
+    // runs across, then one further up each level
+    Op ops[] = {
+        { 7, ownTick(7, lapEnd - 1000), 0, false },
+        { 8, ownTick(8, lapEnd), 0, false },
+        { 9, ownTick(9, lapEnd + 5 * 1024), 0, false },
+        { 10, ownTick(10, start + SECOND), ownPeriod(3 * SECOND), false },
+        { 11, ownTick(11, lapEnd + 100 * 1024), 0, false },
+        { 12, ownTick(12, lapEnd + 5000 * 1024), 0, false },
+        { 13, ownTick(13, lapEnd + DAY), 0, false },
+        { 14, ownTick(14, lapEnd + 40 * DAY), 0, false },
+    };
+    for (const Op& op : ops) apply(wheel, ref, op);
+    
+    uint64_t now = start, end = lapEnd + 50 * DAY, callbacks = 0;
+    while (now < end) {
+        uint64_t deadline = wheel.nextDeadline();
+        if (deadline != ref.nextDeadline()) {
+            CHECK(false, "%s: at tick %llu, deadline %llu, expected %llu", name,
+                  (unsigned long long)now, (unsigned long long)deadline,
+                  (unsigned long long)ref.nextDeadline());
+            return callbacks;
+        }
+        // Callbacks may start timers already overdue
+        if (deadline == UINT64_MAX) deadline = end;
+        if (deadline > now) now = deadline;
+        
+        wheel.fired.clear();
+        ref.fired.clear();
+        uint16_t fromWheel = wheel.advance(now);
+        uint16_t fromRef = ref.advance(now);
+        if (wheel.fired != ref.fired || fromWheel != fromRef) {
+            CHECK(false, "%s: advance(%llu): %u callbacks, expected %u", name,
+                  (unsigned long long)now, fromWheel, fromRef);
+            printFired("wheel", wheel.fired);
+            printFired("expected", ref.fired);
+            return callbacks;
+        }
+        callbacks += fromRef;
+        
+        // The repeat has done its job once it is well into the next lap
+        if (now > lapEnd + MINUTE) apply(wheel, ref, { 10, 0, 0, true });
+    }
+    printf("%s: %llu callbacks\n", name, (unsigned long long)callbacks);
+    return callbacks;
+}
+
+int main(int argc, char** argv) {
+    uint32_t days = argc >= 2 ? (uint32_t)atoi(argv[1]) : 7;
+    uint32_t seed = argc >= 3 ? (uint32_t)atoi(argv[2]) : 19;
+    if (days == 0) days = 7;
+    
+    uint64_t fromBoot = simulate("from boot", seed, 0, days * DAY, false);
+    uint64_t uptime = simulate("3 years up", seed + 1, 3 * 365 * DAY + 12345, days * DAY, false);
+    CHECK(fromBoot > 1000 && uptime > 1000, "too few callbacks to mean anything: %llu, %llu",
+          (unsigned long long)fromBoot, (unsigned long long)uptime);
+    
+    uint64_t lap = 1ULL << (TIMER_WHEEL_SHIFT + 6 * TIMER_WHEEL_LEVELS);  // 64 slots a level
+    uint64_t crossed = crossLap("first lap end", seed + 3, lap) +
+                       crossLap("third lap end", seed + 4, 3 * lap);
+    CHECK(crossed > 2 * 14, "lap ends: only %llu callbacks", (unsigned long long)crossed);
+    
+    // Few long reminders, woken for on time or often days late
+    uint64_t sparse = simulate("2 years sparse", seed + 2, 5 * DAY + 999, 2 * 365 * DAY, true);
+    CHECK(sparse > 50, "sparse run: only %llu callbacks", (unsigned long long)sparse);
+    
+    return checkResult("timer wheel matches the reference");
+}
@@ -0,0 +1,300 @@
+/**
+ * @file totals_test.cpp
+ * @brief Host test of the hourly and daily totals, live and replayed from the log
+ *
+ * Build on the host from the repository root:
+ *
+ *     g++ -std=gnu++11 -O2 -Iinclude tools/totals_test.cpp src/session_totals.cpp -o totals_test
+ *     ./totals_test [days] [seed]
+ *
+ * Generates weeks of stopwatch records (switches, pauses, resets and
+ * boots) and checks SessionTotals against a reference that walks every
+ * run second by second. Checked: the totals kept live with an hourly
+ * roll() as the firmware does; the same records replayed at boot, bucket
+ * for bucket against the live ones; a log whose oldest pages have been
+ * erased, exact from from() on; and a log from firmware that restarted
+ * the clock at the same time every boot, where only the records after
+ * the last restart may count. Every hour the hourly ring still holds
+ * and every day of the daily ring is compared, including the run in
+ * progress. Exits non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <random>
+#include <vector>
+#include "session_totals.h"
+#include "wallclock.h"
+#include "host/check.h"
+
+#define HOUR            3600UL
+#define START_TIME      (11 * HOUR + 37 * 60)  // The clock's first-boot setting
+
+static LogRecord makeRecord(LogEventType type, uint8_t category, uint32_t time) {
+    LogRecord record = { 0, time, (uint8_t)type, category };
+    return record;
+}
+
+/**
+ * @brief A few weeks of use from start: sessions of minutes to hours,
+ *        breaks up to a night, now and then a reset or a reboot
+ */
+static std::vector<LogRecord> generate(uint32_t start, uint32_t days, uint32_t seed,
+                                       bool boots) {
+    std::mt19937 rng(seed);
+    std::vector<LogRecord> records;
+    records.push_back(makeRecord(LOG_BOOT, LOG_CATEGORY_NONE, start));
+    uint32_t time = start, end = start + days * SECONDS_PER_DAY;
+    while (time < end) {
+        uint32_t r = rng() % 100;
+        if (r < 60) {
+            records.push_back(makeRecord(LOG_SWITCH, rng() % TOTALS_CATEGORIES, time));
+            time += 60 + rng() % (r < 10 ? 5 * HOUR : 45 * 60);
+        } else if (r < 90) {
+            records.push_back(makeRecord(LOG_SWITCH, LOG_CATEGORY_NONE, time));
+            time += rng() % (r < 65 ? 14 * HOUR : HOUR);
+        } else if (r < 93) {
+            records.push_back(makeRecord(LOG_RESET, LOG_CATEGORY_NONE, time));
+            time += rng() % HOUR;
+        } else if (boots && r < 96) {
+            // Power lost somewhere after the last record; the clock resumes from it
+            records.push_back(makeRecord(LOG_BOOT, LOG_CATEGORY_NONE, time));
+            time += rng() % 600;
+        } else {
+            time += rng() % 600;
+        }
+    }
+    return records;
+}
+
+// ========== Reference ==========
+
+// Seconds per category, walked one run at a time and split at every hour
+struct Reference {
+    std::map<uint32_t, std::vector<uint32_t> > hours, days;
+    uint32_t latest = 0;
+
+    void credit(uint8_t category, uint32_t from, uint32_t to) {
+        for (uint32_t t = from; t < to;) {
+            uint32_t end = (t / HOUR + 1) * HOUR;
+            if (end > to) end = to;
+            bucket(hours, t / HOUR)[category] += end - t;
+            bucket(days, t / SECONDS_PER_DAY)[category] += end - t;
+            t = end;
+        }
+    }
+
+    uint32_t hour(uint32_t hour, uint8_t category) const { return get(hours, hour, category); }
+    uint32_t day(uint32_t day, uint8_t category) const { return get(days, day, category); }
+
+private:
+    static std::vector<uint32_t>& bucket(std::map<uint32_t, std::vector<uint32_t> >& m,
+                                         uint32_t key) {
+        std::vector<uint32_t>& b = m[key];
+        b.resize(TOTALS_CATEGORIES);
+        return b;
+    }
+
+    static uint32_t get(const std::map<uint32_t, std::vector<uint32_t> >& m, uint32_t key,
+                        uint8_t category) {
+        auto it = m.find(key);
+        return it == m.end() ? 0 : it->second[category];
+    }
+};
+
+/**
+ * @brief Totals the records should give up to now
+ *
+ * A run counts from its switch to the next record, unless that record is
+ * a boot: power went at some unknown point in between, and the run is
+ * dropped as the stopwatches drop it. The last run counts up to now.
+ */
+static Reference reference(const std::vector<LogRecord>& records, uint32_t now) {
+    Reference ref;
+    uint8_t active = STOPWATCH_NONE;
+    uint32_t since = 0;
+    for (const LogRecord& record : records) {
+        if (active != STOPWATCH_NONE && record.type != LOG_BOOT) {
+            ref.credit(active, since, record.time);
+        }
+        active = record.type == LOG_SWITCH && record.category < TOTALS_CATEGORIES
+                 ? record.category : STOPWATCH_NONE;
+        since = record.time;
+        ref.latest = record.time;
+    }
+    if (active != STOPWATCH_NONE) ref.credit(active, since, now);
+    return ref;
+}
+
+// First of the count buckets ending with last
+static uint32_t firstOf(uint32_t last, uint32_t count) {
+    return last + 1 >= count ? last + 1 - count : 0;
+}
+
+/**
+ * @brief Every hour and day the rings hold at now, exact from the hour and day after firstExact
+ */
+static void compare(const char* name, const SessionTotals& totals, const Reference& ref,
+                    uint32_t now, uint32_t firstExact) {
+    uint32_t bad = 0;
+    uint32_t nowHour = now / HOUR, nowDay = now / SECONDS_PER_DAY;
+    for (uint32_t h = firstOf(nowHour, TOTALS_HOURS); h <= nowHour; h++) {
+        if (h * HOUR < firstExact) continue;
+        for (uint8_t c = 0; c < TOTALS_CATEGORIES; c++) {
+            uint32_t got = totals.hourSeconds(h, c, now), want = ref.hour(h, c);
+            if (got != want) {
+                if (bad++ < 3) printf("  %s: hour %u category %u: %u s, expected %u\n", name, h, c,
+                                      got, want);
+            }
+        }
+    }
+    for (uint32_t d = firstOf(nowDay, TOTALS_DAYS); d <= nowDay; d++) {
+        if (d * SECONDS_PER_DAY < firstExact) continue;
+        for (uint8_t c = 0; c < TOTALS_CATEGORIES; c++) {
+            uint32_t got = totals.daySeconds(d, c, now), want = ref.day(d, c);
+            if (got != want) {
+                if (bad++ < 3) printf("  %s: day %u category %u: %u s, expected %u\n", name, d, c,
+                                      got, want);
+            }
+        }
+    }
+    
+    // This week, the way the watch asks
+    uint32_t week = totals.daysSeconds(nowDay, 7, 0, now), want = 0;
+    for (uint32_t d = firstOf(nowDay, 7); d <= nowDay; d++) want += ref.day(d, 0);
+    if (firstOf(nowDay, 7) * SECONDS_PER_DAY >= firstExact && week != want) {
+        printf("  %s: this week %u s, expected %u\n", name, week, want);
+        bad++;
+    }
+    CHECK(bad == 0, "%s: %u buckets differ", name, bad);
+}
+
+// ========== Tests ==========
+
+// Live, with roll() at every hour boundary as the firmware's rollTimer does
+static SessionTotals live(const std::vector<LogRecord>& records, uint32_t now) {
+    SessionTotals totals;
+    for (size_t i = 0; i < records.size(); i++) {
+        totals.apply(records[i]);
+        uint32_t until = i + 1 < records.size() ? records[i + 1].time : now;
+        for (uint32_t roll = totals.nextRoll(); roll != TOTALS_EMPTY && roll <= until;
+             roll = totals.nextRoll()) {
+            totals.roll(roll);
+        }
+    }
+    return totals;
+}
+
+static SessionTotals replay(const std::vector<LogRecord>& records) {
+    SessionTotals totals;
+    for (const LogRecord& record : records) totals.apply(record);
+    return totals;
+}
+
+static bool sameBuckets(const SessionTotals& a, const SessionTotals& b, uint32_t now) {
+    for (uint32_t h = firstOf(now / HOUR, TOTALS_HOURS); h <= now / HOUR; h++) {
+        const HourTotals* x = a.hourBucket(h);
+        const HourTotals* y = b.hourBucket(h);
+        if (!x != !y || (x && memcmp(x, y, sizeof(*x)) != 0)) return false;
+    }
+    for (uint32_t d = firstOf(now / SECONDS_PER_DAY, TOTALS_DAYS); d <= now / SECONDS_PER_DAY;
+         d++) {
+        const DayTotals* x = a.dayBucket(d);
+        const DayTotals* y = b.dayBucket(d);
+        if (!x != !y || (x && memcmp(x, y, sizeof(*x)) != 0)) return false;
+    }
+    return true;
+}
+
+static void testLive(uint32_t days, uint32_t seed) {
+    std::vector<LogRecord> records = generate(START_TIME, days, seed, false);
+    uint32_t end = records.back().time;
+    
+    // Between records, on an hour boundary, and with a run open across one
+    uint32_t ends[] = { end, end + 1234, (uint32_t)((end / HOUR + 1) * HOUR),
+                        (uint32_t)(end + 3 * HOUR + 1) };
+    for (uint32_t now : ends) {
+        SessionTotals totals = live(records, now);
+        compare("live", totals, reference(records, now), now, 0);
+        CHECK(totals.from() == START_TIME && totals.latest() == end, "live: from %u, latest %u",
+              totals.from(), totals.latest());
+    }
+    
+    // The replay at the next boot rebuilds the same buckets
+    std::vector<LogRecord> closed = records;
+    closed.push_back(makeRecord(LOG_SWITCH, LOG_CATEGORY_NONE, end + 60));
+    SessionTotals before = live(closed, end + 120);
+    SessionTotals after = replay(closed);
+    CHECK(sameBuckets(before, after, end + 120), "replay: buckets differ from the live ones");
+}
+
+static void testReboots(uint32_t days, uint32_t seed) {
+    std::vector<LogRecord> records = generate(START_TIME, days, seed, true);
+    uint32_t now = records.back().time + 600;
+    SessionTotals totals = replay(records);
+    compare("reboots", totals, reference(records, now), now, 0);
+    
+    // The boot after: the clock carries on from latest(), nothing is dropped
+    CHECK(totals.latest() == records.back().time, "reboots: latest %u, expected %u",
+          totals.latest(), records.back().time);
+    records.push_back(makeRecord(LOG_BOOT, LOG_CATEGORY_NONE, totals.latest()));
+    records.push_back(makeRecord(LOG_SWITCH, 1, totals.latest() + 5));
+    now = totals.latest() + 2 * HOUR;
+    compare("reboots, next boot", replay(records), reference(records, now), now, 0);
+}
+
+// The oldest pages were erased to make room: exact from the first record left
+static void testExpired(uint32_t days, uint32_t seed) {
+    std::vector<LogRecord> records = generate(START_TIME, days, seed, true);
+    uint32_t now = records.back().time + 600;
+    Reference ref = reference(records, now);
+    for (size_t cut : { records.size() / 3, records.size() / 2, records.size() - 40 }) {
+        std::vector<LogRecord> left(records.begin() + cut, records.end());
+        SessionTotals totals = replay(left);
+        CHECK(totals.from() == left.front().time, "expired: from %u, expected %u", totals.from(),
+              left.front().time);
+        compare("expired", totals, ref, now, left.front().time);
+        
+        // Before that, never more than there was
+        uint32_t over = 0;
+        for (uint32_t d = 0; d <= now / SECONDS_PER_DAY; d++) {
+            for (uint8_t c = 0; c < TOTALS_CATEGORIES; c++) {
+                if (totals.daySeconds(d, c, now) > ref.day(d, c)) over++;
+            }
+        }
+        CHECK(over == 0, "expired: %u days over the reference", over);
+    }
+}
+
+// Firmware that set the clock to 11:37 on day 0 at every boot left one
+// time line per boot in the log; only the last can be placed
+static void testRestartedClock(uint32_t seed) {
+    std::vector<LogRecord> records;
+    std::vector<LogRecord> last;
+    for (uint32_t boot = 0; boot < 4; boot++) {
+        last = generate(START_TIME, 3 + boot % 2 * 5, seed + boot, false);
+        records.insert(records.end(), last.begin(), last.end());
+    }
+    uint32_t now = last.back().time + 900;
+    SessionTotals totals = replay(records);
+    compare("restarted clock", totals, reference(last, now), now, 0);
+    CHECK(totals.from() == START_TIME && totals.latest() == last.back().time,
+          "restarted clock: from %u, latest %u", totals.from(), totals.latest());
+}
+
+int main(int argc, char** argv) {
+    uint32_t days = argc >= 2 ? (uint32_t)atoi(argv[1]) : 60;
+    uint32_t seed = argc >= 3 ? (uint32_t)atoi(argv[2]) : 22;
+    if (days == 0) days = 60;
+    
+    for (uint32_t run = 0; run < 20; run++) {
+        testLive(days, seed + run);
+        testReboots(days, seed + run);
+        testExpired(days, seed + run);
+        testRestartedClock(seed + run);
+    }
+    
+    return checkResult("totals match the reference");
+}
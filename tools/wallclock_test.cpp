@@ -0,0 +1,195 @@
+/**
+ * @file wallclock_test.cpp
+ * @brief Host test of the RTC-derived wall clock over simulated days
+ *
+ * Build on the host from the repository root:
+ *
+ *     g++ -std=c++11 -O2 -Iinclude tools/wallclock_test.cpp src/wallclock.cpp -o wallclock_test
+ *     ./wallclock_test [days]
+ *
+ * Drives WallClock with RTC ticks the way the firmware does: a 24-bit
+ * counter that wraps every 512 seconds, extended in software with an
+ * overflow count as TicklessScheduler::now() does, read at irregular
+ * intervals. Every reading is checked against an exact reference, for a
+ * range of crystal trims, and the test covers midnight and noon
+ * rollovers, trim changes mid-run, nextSecond() and uptimes of years.
+ * Exits non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include "wallclock.h"
+#include "host/check.h"
+
+#define COUNTER_BITS    24
+#define COUNTER_MASK    ((1UL << COUNTER_BITS) - 1)
+
+// The hardware counter plus the scheduler's overflow extension
+class SimRtc {
+public:
+    SimRtc() : _ticks(0), _overflows(0), _lastCounter(0) {}
+    
+    void advance(uint64_t ticks) { _ticks += ticks; }
+    
+    // What TicklessScheduler::now() returns, from the 24-bit counter alone
+    uint64_t now() {
+        uint32_t counter = (uint32_t)(_ticks & COUNTER_MASK);
+        if (counter < _lastCounter) _overflows++;  // The OVRFLW interrupt
+        _lastCounter = counter;
+        return ((uint64_t)_overflows << COUNTER_BITS) | counter;
+    }
+
+private:
+    uint64_t _ticks;
+    uint32_t _overflows;
+    uint32_t _lastCounter;
+};
+
+/**
+ * @brief Exact corrected time in ticks since the epoch, as a double
+ */
+static double exactTicks(uint32_t epoch, uint64_t elapsed, int32_t ppm) {
+    return (double)epoch * WALLCLOCK_TICK_HZ + (double)elapsed * (1.0 + ppm / 1e6);
+}
+
+// A day of readings 0.1-20s apart; the reading may be off by the rounding
+// of one tick, never more, and never goes backwards
+static void testDays(uint32_t days) {
+    static const int32_t trims[] = { 0, 1, -1, 20, -20, 150, -150, 500, -500 };
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<uint32_t> step(WALLCLOCK_TICK_HZ / 10, 20 * WALLCLOCK_TICK_HZ);
+    
+    for (int32_t ppm : trims) {
+        SimRtc rtc;
+        rtc.advance(rng() & COUNTER_MASK);  // Anywhere in the counter period
+        WallClock clock;
+        uint64_t start = rtc.now();
+        uint32_t epoch = 1767225600UL + 11 * 3600 + 37 * 60;  // 2026-01-01 11:37
+        clock.setTime(epoch, start);
+        clock.setTrimPpm(ppm, start);
+        
+        uint32_t last = clock.epochSeconds(start);
+        uint64_t end = start + (uint64_t)days * SECONDS_PER_DAY * WALLCLOCK_TICK_HZ;
+        uint32_t bad = 0;
+        for (uint64_t now = start; now < end; now = rtc.now()) {
+            uint32_t seconds = clock.epochSeconds(now);
+            double exact = exactTicks(epoch, now - start, ppm);
+            double second = (double)seconds * WALLCLOCK_TICK_HZ;
+            if (exact < second - 1.0 || exact >= second + WALLCLOCK_TICK_HZ + 1.0 ||
+                seconds < last) {
+                bad++;
+            }
+            last = seconds;
+            rtc.advance(step(rng));
+        }
+        CHECK(bad == 0, "%d ppm: %u of the readings over %u days off", ppm, bad, days);
+        
+        // Total drift correction over the run, to the tick
+        double expected = (double)days * SECONDS_PER_DAY * (ppm / 1e6);
+        double got = (double)clock.epochSeconds(end) - epoch - (double)days * SECONDS_PER_DAY;
+        CHECK(got > expected - 1.0 && got < expected + 1.0,
+              "%d ppm: %.1fs corrected over %u days, expected %.1fs", ppm, got, days, expected);
+    }
+}
+
+// 11:59:59 PM -> 12:00:00 AM on the next day, 11:59:59 AM -> 12:00:00 PM
+static void testRollovers() {
+    WallClock clock;
+    uint64_t now = 12345;
+    clock.setTime(3 * SECONDS_PER_DAY, now);
+    clock.setTimeOfDay(23, 59, 59, now);
+    
+    WallTime t = clock.timeOfDay(now);
+    CHECK(t.hours == 11 && t.minutes == 59 && t.seconds == 59 && t.isPM, "before midnight: "
+          "%u:%02u:%02u %s", t.hours, t.minutes, t.seconds, t.isPM ? "PM" : "AM");
+    
+    now = clock.nextSecond(now);
+    t = clock.timeOfDay(now);
+    CHECK(t.hours == 12 && t.minutes == 0 && t.seconds == 0 && !t.isPM, "midnight: "
+          "%u:%02u:%02u %s", t.hours, t.minutes, t.seconds, t.isPM ? "PM" : "AM");
+    CHECK(clock.epochSeconds(now) / SECONDS_PER_DAY == 4, "midnight: day %lu",
+          (unsigned long)(clock.epochSeconds(now) / SECONDS_PER_DAY));
+    
+    // setTimeOfDay() keeps the date
+    clock.setTimeOfDay(11, 59, 59, now);
+    CHECK(clock.epochSeconds(now) / SECONDS_PER_DAY == 4, "setTimeOfDay changed the date");
+    now = clock.nextSecond(now);
+    t = clock.timeOfDay(now);
+    CHECK(t.hours == 12 && t.minutes == 0 && t.isPM, "noon: %u:%02u %s", t.hours, t.minutes,
+          t.isPM ? "PM" : "AM");
+    t = clock.timeOfDay(now - 1);
+    CHECK(t.hours == 11 && t.seconds == 59 && !t.isPM, "before noon: %u:%02u:%02u %s", t.hours,
+          t.minutes, t.seconds, t.isPM ? "PM" : "AM");
+}
+
+// nextSecond() is the first tick of the next second, for any trim
+static void testNextSecond() {
+    std::mt19937 rng(11);
+    static const int32_t trims[] = { 0, 37, -37, 500, -500 };
+    for (int32_t ppm : trims) {
+        WallClock clock;
+        clock.setTime(1000000, 0);
+        clock.setTrimPpm(ppm, 5000);
+        uint32_t bad = 0;
+        for (int i = 0; i < 100000; i++) {
+            uint64_t now = 5000 + (rng() % (40ULL * SECONDS_PER_DAY * WALLCLOCK_TICK_HZ));
+            uint64_t next = clock.nextSecond(now);
+            uint32_t seconds = clock.epochSeconds(now);
+            if (next <= now || clock.epochSeconds(next) != seconds + 1 ||
+                clock.epochSeconds(next - 1) != seconds) {
+                bad++;
+            }
+        }
+        CHECK(bad == 0, "%d ppm: nextSecond wrong %u times", ppm, bad);
+    }
+}
+
+// A trim change applies from the moment it is made, not retroactively
+static void testTrimChange() {
+    WallClock clock;
+    uint64_t day = (uint64_t)SECONDS_PER_DAY * WALLCLOCK_TICK_HZ;
+    clock.setTime(0, 0);
+    clock.setTrimPpm(100, 0);
+    uint64_t now = 10 * day;
+    uint64_t before = clock.epochSeconds(now);
+    clock.setTrimPpm(-100, now);
+    CHECK(clock.epochSeconds(now) == before, "trim change moved the time %lu -> %lu",
+          (unsigned long)before, (unsigned long)clock.epochSeconds(now));
+    
+    // +100ppm for 10 days then -100ppm for 10 days nets out
+    uint32_t seconds = clock.epochSeconds(20 * day);
+    CHECK(seconds >= 20 * SECONDS_PER_DAY - 1 && seconds <= 20 * SECONDS_PER_DAY + 1,
+          "after +100/-100ppm: %lu s, expected %lu", (unsigned long)seconds,
+          (unsigned long)(20 * SECONDS_PER_DAY));
+}
+
+// Years of uptime: tick counts well past 32 bits, trim arithmetic intact
+static void testLongUptime() {
+    static const uint32_t years[] = { 1, 5, 10, 30 };
+    for (uint32_t y : years) {
+        uint64_t ticks = (uint64_t)y * 365 * SECONDS_PER_DAY * WALLCLOCK_TICK_HZ;
+        WallClock clock;
+        clock.setTime(0, 7);
+        clock.setTrimPpm(-500, 7);
+        double exact = exactTicks(0, ticks, -500) / WALLCLOCK_TICK_HZ;
+        uint32_t seconds = clock.epochSeconds(ticks + 7);
+        CHECK(seconds >= exact - 1 && seconds <= exact + 1, "%u years: %lu s, expected %.0f", y,
+              (unsigned long)seconds, exact);
+        uint64_t next = clock.nextSecond(ticks + 7);
+        CHECK(clock.epochSeconds(next) == seconds + 1, "%u years: nextSecond wrong", y);
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t days = argc >= 2 ? (uint32_t)atoi(argv[1]) : 30;
+    if (days == 0) days = 30;
+    
+    testDays(days);
+    testRollovers();
+    testNextSecond();
+    testTrimChange();
+    testLongUptime();
+    
+    return checkResult("wall clock OK over %u simulated days", days);
+}
@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+"""
+Convert WAV files into an IMA-ADPCM clip table compiled into flash.
+
+Each input becomes one AdpcmClip (see include/adpcm.h), named after the
+file: "seven.wav" -> clip_seven / CLIP_SEVEN. Input is mixed down to mono
+and resampled to the firmware's sample rate, then encoded as 4-bit
+IMA-ADPCM in WAV-style blocks, a quarter of the size of 16-bit PCM.
+
+    python3 wav2adpcm.py voice/*.wav
+    python3 wav2adpcm.py --rate 16000 --block 256 -o voice_clips voice/*.wav
+
+writes include/voice_clips.h and src/voice_clips.cpp by default.
+
+With --speech the table also gets speechDictionary[], the clips in
+SpeechWord order (include/speech.h) for SpeechPlayer. Name the files
+after the words: zero.wav ... ninety.wav, hundred.wav, hours.wav,
+geeking_for.wav and so on, see SPEECH_WORDS below.
+"""
+import argparse
+import os
+import re
+import struct
+import sys
+import wave
+
+STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+]
+
+INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8]
+
+HEADER_BYTES = 4
+
+# Keep in the order of enum SpeechWord in include/speech.h
+SPEECH_WORDS = [
+    'zero', 'one', 'two', 'three', 'four',
+    'five', 'six', 'seven', 'eight', 'nine',
+    'ten', 'eleven', 'twelve', 'thirteen', 'fourteen',
+    'fifteen', 'sixteen', 'seventeen', 'eighteen', 'nineteen',
+    'twenty', 'thirty', 'forty', 'fifty',
+    'sixty', 'seventy', 'eighty', 'ninety',
+    'hundred',
+    'hour', 'hours',
+    'minute', 'minutes',
+    'second', 'seconds',
+    'geeking_for',
+    'living_for',
+]
+
+
+def clamp(value, low, high):
+    return max(low, min(high, value))
+
+
+def read_wav(path):
+    """Return (samples as mono ints, sample rate)."""
+    with wave.open(path, 'rb') as w:
+        channels = w.getnchannels()
+        width = w.getsampwidth()
+        rate = w.getframerate()
+        frames = w.readframes(w.getnframes())
+
+    if width == 1:
+        raw = [(b - 128) << 8 for b in frames]
+    elif width == 2:
+        raw = list(struct.unpack('<%dh' % (len(frames) // 2), frames))
+    else:
+        raise ValueError('%s: only 8 and 16-bit PCM are supported' % path)
+
+    mono = []
+    for i in range(0, len(raw) - channels + 1, channels):
+        mono.append(sum(raw[i:i + channels]) // channels)
+    return mono, rate
+
+
+def resample(samples, src_rate, dst_rate):
+    """Linear interpolation, good enough for speech prompts."""
+    if src_rate == dst_rate or not samples:
+        return samples
+    count = len(samples) * dst_rate // src_rate
+    out = []
+    for i in range(count):
+        pos = i * src_rate / dst_rate
+        j = int(pos)
+        frac = pos - j
+        a = samples[j]
+        b = samples[j + 1] if j + 1 < len(samples) else a
+        out.append(int(round(a + (b - a) * frac)))
+    return out
+
+
+def decode_nibble(nibble, predictor, index):
+    """Mirror of AdpcmDecoder::read(), so encoder and firmware agree."""
+    step = STEP_TABLE[index]
+    diff = step >> 3
+    if nibble & 4:
+        diff += step
+    if nibble & 2:
+        diff += step >> 1
+    if nibble & 1:
+        diff += step >> 2
+    predictor += -diff if nibble & 8 else diff
+    predictor = clamp(predictor, -32768, 32767)
+    index = clamp(index + INDEX_TABLE[nibble], 0, 88)
+    return predictor, index
+
+
+def encode_nibble(sample, predictor, index):
+    step = STEP_TABLE[index]
+    diff = sample - predictor
+    nibble = 0
+    if diff < 0:
+        nibble = 8
+        diff = -diff
+    if diff >= step:
+        nibble |= 4
+        diff -= step
+    if diff >= step >> 1:
+        nibble |= 2
+        diff -= step >> 1
+    if diff >= step >> 2:
+        nibble |= 1
+    return nibble
+
+
+def encode(samples, block_bytes):
+    """Encode to WAV-style IMA-ADPCM blocks, last block may be short."""
+    block_samples = (block_bytes - HEADER_BYTES) * 2 + 1
+    out = bytearray()
+    index = 0
+    for start in range(0, len(samples), block_samples):
+        block = samples[start:start + block_samples]
+        predictor = block[0]
+        out += struct.pack('<hBB', predictor, index, 0)
+
+        packed = 0
+        for n, sample in enumerate(block[1:]):
+            nibble = encode_nibble(sample, predictor, index)
+            predictor, index = decode_nibble(nibble, predictor, index)
+            if n & 1:
+                out.append(packed | (nibble << 4))
+            else:
+                packed = nibble
+        if len(block) > 1 and (len(block) - 1) & 1:
+            out.append(packed)
+    return bytes(out)
+
+
+def clip_name(path):
+    stem = os.path.splitext(os.path.basename(path))[0]
+    name = re.sub(r'[^0-9a-zA-Z]+', '_', stem).strip('_').lower()
+    if not name or name[0].isdigit():
+        name = 'n' + name
+    return name
+
+
+def write_header(path, base, clips, speech):
+    guard = base.upper() + '_H'
+    with open(path, 'w') as f:
+        f.write('/**\n')
+        f.write(' * @file %s.h\n' % base)
+        f.write(' * @brief Voice clip table, generated by wav2adpcm.py - do not edit\n')
+        f.write(' */\n\n')
+        f.write('#ifndef %s\n#define %s\n\n' % (guard, guard))
+        f.write('#include "adpcm.h"\n')
+        if speech:
+            f.write('#include "speech.h"\n')
+        f.write('\n')
+        f.write('enum VoiceClipId : uint8_t {\n')
+        for name, _, _ in clips:
+            f.write('    CLIP_%s,\n' % name.upper())
+        f.write('    VOICE_CLIP_COUNT\n};\n\n')
+        for name, _, _ in clips:
+            f.write('extern const AdpcmClip clip_%s;\n' % name)
+        f.write('\n// Indexed by VoiceClipId\n')
+        f.write('extern const AdpcmClip *const voiceClips[VOICE_CLIP_COUNT];\n')
+        if speech:
+            f.write('\n// Indexed by SpeechWord, for SpeechPlayer::begin()\n')
+            f.write('extern const AdpcmClip *const speechDictionary[SPEECH_WORD_COUNT];\n')
+        f.write('\n#endif // %s\n' % guard)
+
+
+def write_source(path, base, clips, block_bytes, rate, speech):
+    with open(path, 'w') as f:
+        f.write('/**\n')
+        f.write(' * @file %s.cpp\n' % base)
+        f.write(' * @brief Voice clips, %d Hz IMA-ADPCM, generated by wav2adpcm.py - do not edit\n'
+                % rate)
+        f.write(' */\n\n')
+        f.write('#include "%s.h"\n' % base)
+        for name, data, count in clips:
+            f.write('\n// %d samples, %.2fs, %d bytes\n' % (count, count / rate, len(data)))
+            f.write('static const uint8_t clip_%s_data[] = {\n' % name)
+            for i in range(0, len(data), 16):
+                row = ', '.join('0x%02x' % b for b in data[i:i + 16])
+                f.write('    %s,\n' % row)
+            f.write('};\n')
+            f.write('const AdpcmClip clip_%s = { clip_%s_data, %d, %d };\n'
+                    % (name, name, count, block_bytes))
+        f.write('\nconst AdpcmClip *const voiceClips[VOICE_CLIP_COUNT] = {\n')
+        for name, _, _ in clips:
+            f.write('    &clip_%s,\n' % name)
+        f.write('};\n')
+        if speech:
+            names = set(name for name, _, _ in clips)
+            f.write('\nconst AdpcmClip *const speechDictionary[SPEECH_WORD_COUNT] = {\n')
+            for word in SPEECH_WORDS:
+                if word in names:
+                    f.write('    &clip_%s,\n' % word)
+                else:
+                    f.write('    nullptr,  // %s\n' % word)
+            f.write('};\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert WAV files to an IMA-ADPCM clip table.')
+    parser.add_argument('wavs', metavar='WAV', nargs='+', help='input WAV files')
+    parser.add_argument('-r', '--rate', type=int, default=16000,
+                        help='firmware sample rate (AUDIO_SAMPLE_RATE), default 16000')
+    parser.add_argument('-b', '--block', type=int, default=256,
+                        help='bytes per ADPCM block including header, default 256')
+    parser.add_argument('-o', '--output', default='voice_clips',
+                        help='base name of the generated files, default voice_clips')
+    parser.add_argument('--include-dir', default='include', help='where the header goes')
+    parser.add_argument('--src-dir', default='src', help='where the source goes')
+    parser.add_argument('--speech', action='store_true',
+                        help='also emit speechDictionary[] in SpeechWord order')
+    args = parser.parse_args()
+
+    if args.block <= HEADER_BYTES or args.block > 0xFFFF:
+        parser.error('block size must be between %d and 65535' % (HEADER_BYTES + 1))
+
+    clips = []
+    names = set()
+    pcm_bytes = 0
+    for path in args.wavs:
+        name = clip_name(path)
+        if name in names:
+            parser.error('two inputs map to clip_%s' % name)
+        names.add(name)
+
+        samples, rate = read_wav(path)
+        samples = resample(samples, rate, args.rate)
+        if not samples:
+            parser.error('%s is empty' % path)
+        data = encode(samples, args.block)
+        clips.append((name, data, len(samples)))
+        pcm_bytes += len(samples) * 2
+        print('clip_%-16s %6d samples  %6d bytes' % (name, len(samples), len(data)))
+
+    if args.speech:
+        missing = [word for word in SPEECH_WORDS if word not in names]
+        if missing:
+            print('Warning: no clip for %s, SpeechPlayer will skip them' % ', '.join(missing))
+
+    header = os.path.join(args.include_dir, args.output + '.h')
+    source = os.path.join(args.src_dir, args.output + '.cpp')
+    write_header(header, args.output, clips, args.speech)
+    write_source(source, args.output, clips, args.block, args.rate, args.speech)
+
+    total = sum(len(data) for _, data, _ in clips)
+    print('%d clips, %d bytes (%d as 16-bit PCM)' % (len(clips), total, pcm_bytes))
+    print('Wrote %s and %s' % (header, source))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())